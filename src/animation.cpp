@@ -0,0 +1,77 @@
+#include "animation.h"
+#include <string.h>
+
+uint8_t textToCells(const char* text, uint8_t* cells, uint8_t capacity) {
+  uint8_t count = 0;
+  for (const char* p = text; *p != '\0'; p++) {
+    if (*p == '.' && count > 0 && !(cells[count - 1] & SEG_DP)) {
+      cells[count - 1] |= SEG_DP;
+    } else if (count < capacity) {
+      cells[count++] = glyph(*p);
+    } else {
+      break;
+    }
+  }
+  return count;
+}
+
+Animator::Animator()
+    : cellCount(0), passesLeft(0), frameInPass(0), framesPerPass(0), brightnessLevel(15), fadeTarget(15) {
+  memset(&current, 0, sizeof(current));
+}
+
+void Animator::showText(const char* text, uint8_t passes) {
+  cellCount = textToCells(text, cells, MAX_CELLS);
+  passesLeft = cellCount > 0 ? passes : 0;
+  frameInPass = 0;
+  // Long text enters at the right and scrolls until its last character
+  // reaches the left digit
+  framesPerPass = cellCount > Frame::DIGITS ? (cellCount + Frame::DIGITS - 1) * SCROLL_FRAMES : HOLD_FRAMES;
+}
+
+void Animator::fade(uint8_t from, uint8_t to) {
+  brightnessLevel = from;
+  fadeTarget = to;
+}
+
+void Animator::stopText() {
+  passesLeft = 0;
+}
+
+void Animator::render(int16_t offset) {
+  memset(&current, 0, sizeof(current));
+  for (uint8_t i = 0; i < Frame::DIGITS; i++) {
+    int16_t cell = i - offset;
+    if (cell >= 0 && cell < cellCount) {
+      current.digits[i] = cells[cell];
+    }
+  }
+}
+
+uint8_t Animator::step() {
+  uint8_t changes = 0;
+  if (fading()) {
+    brightnessLevel += brightnessLevel < fadeTarget ? 1 : -1;
+    changes |= CHANGED_BRIGHTNESS;
+  }
+
+  // The last frame of a pass stays up for a full frame period before the
+  // next pass starts or the text is done
+  if (passesLeft > 0 && frameInPass == framesPerPass) {
+    frameInPass = 0;
+    passesLeft--;
+  }
+  if (passesLeft > 0) {
+    Frame before = current;
+    if (cellCount > Frame::DIGITS) {
+      render(Frame::DIGITS - 1 - frameInPass / SCROLL_FRAMES);
+    } else {
+      render((Frame::DIGITS - cellCount) / 2);
+    }
+    frameInPass++;
+    if (memcmp(&before, &current, sizeof(current)) != 0) {
+      changes |= CHANGED_FRAME;
+    }
+  }
+  return changes;
+}
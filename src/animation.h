@@ -0,0 +1,111 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <stdint.h>
+
+// Text and animations for the 4-digit 7-segment display.
+//
+// Animator renders into a Frame, a plain copy of the four digits' segment
+// bits and the colon, one frame per step(). It doesn't know about timers
+// or the display: the caller steps it at FRAME_MS and copies the frame
+// out, so a sequence can be replayed frame by frame anywhere.
+//
+// Two tracks run independently: text (shown still if it fits, otherwise
+// scrolled through from the right) and a brightness fade.
+
+// Segment bits as the backpack wires them
+enum Segment : uint8_t {
+  SEG_A = 0x01,   // Top
+  SEG_B = 0x02,   // Top right
+  SEG_C = 0x04,   // Bottom right
+  SEG_D = 0x08,   // Bottom
+  SEG_E = 0x10,   // Bottom left
+  SEG_F = 0x20,   // Top left
+  SEG_G = 0x40,   // Middle
+  SEG_DP = 0x80   // Decimal point
+};
+
+// Segments for printable ASCII, ' ' to '~'. Letters without a sensible
+// shape (K, M, V, W, X) get the usual approximations.
+static constexpr uint8_t GLYPHS[95] = {
+  0x00, 0x86, 0x22, 0x00, 0x00, 0x00, 0x00, 0x20,  //  !"#$%&'
+  0x39, 0x0F, 0x00, 0x00, 0x80, 0x40, 0x80, 0x52,  // ()*+,-./
+  0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07,  // 01234567
+  0x7F, 0x6F, 0x00, 0x00, 0x00, 0x48, 0x00, 0x53,  // 89:;<=>?
+  0x00, 0x77, 0x7C, 0x39, 0x5E, 0x79, 0x71, 0x3D,  // @ABCDEFG
+  0x76, 0x30, 0x1E, 0x75, 0x38, 0x55, 0x37, 0x3F,  // HIJKLMNO
+  0x73, 0x67, 0x50, 0x6D, 0x78, 0x3E, 0x3E, 0x2A,  // PQRSTUVW
+  0x76, 0x6E, 0x5B, 0x39, 0x64, 0x0F, 0x00, 0x08,  // XYZ[\]^_
+  0x00, 0x5F, 0x7C, 0x58, 0x5E, 0x7B, 0x71, 0x6F,  // `abcdefg
+  0x74, 0x10, 0x0E, 0x75, 0x30, 0x55, 0x54, 0x5C,  // hijklmno
+  0x73, 0x67, 0x50, 0x6D, 0x78, 0x1C, 0x1C, 0x2A,  // pqrstuvw
+  0x76, 0x6E, 0x5B, 0x39, 0x30, 0x0F, 0x40         // xyz{|}~
+};
+
+constexpr uint8_t glyph(char c) {
+  return c >= ' ' && c <= '~' ? GLYPHS[c - ' '] : 0;
+}
+
+static_assert(glyph('8') == 0x7F, "glyph table out of step with ASCII");
+static_assert(glyph('~') == SEG_G, "glyph table out of step with ASCII");
+
+struct Frame {
+  static const uint8_t DIGITS = 4;
+
+  uint8_t digits[DIGITS];  // Segment bits, left to right
+  bool colon;
+};
+
+// Turn text into one cell per character, a '.' folding into the cell
+// before it as its decimal point. Returns the number of cells.
+uint8_t textToCells(const char* text, uint8_t* cells, uint8_t capacity);
+
+class Animator {
+public:
+  static const uint16_t FRAME_MS = 50;      // 20 frames a second
+  static const uint8_t SCROLL_FRAMES = 5;   // 250 ms per character
+  static const uint8_t HOLD_FRAMES = 40;    // Text that fits stays up 2 seconds
+  static const uint8_t MAX_CELLS = 24;
+
+  // What a step() changed
+  enum Change : uint8_t {
+    CHANGED_FRAME = 0x01,
+    CHANGED_BRIGHTNESS = 0x02
+  };
+
+  Animator();
+
+  // Show text, passes times over, replacing any text already showing
+  void showText(const char* text, uint8_t passes = 1);
+
+  // Step brightness from one level to the other, one level per frame
+  void fade(uint8_t from, uint8_t to);
+
+  // Drop the text; a fade carries on
+  void stopText();
+
+  // Advance one frame. Returns the Change flags.
+  uint8_t step();
+
+  bool active() const { return showingText() || fading(); }
+  bool showingText() const { return passesLeft > 0; }
+  bool fading() const { return brightnessLevel != fadeTarget; }
+  const Frame& frame() const { return current; }
+  uint8_t brightness() const { return brightnessLevel; }
+
+private:
+  // Lay the cells out with the first at position offset (negative is off
+  // to the left)
+  void render(int16_t offset);
+
+  uint8_t cells[MAX_CELLS];
+  uint8_t cellCount;
+  uint8_t passesLeft;
+  uint16_t frameInPass;
+  uint16_t framesPerPass;
+  uint8_t brightnessLevel;
+  uint8_t fadeTarget;
+  Frame current;
+};
+
+#endif
@@ -0,0 +1,80 @@
+#include "battery.h"
+
+static float ema(float average, float value, float alpha) {
+  return average + alpha * (value - average);
+}
+
+float BatteryMonitor::Median3::add(float value) {
+  values[next] = value;
+  next = (next + 1) % 3;
+  if (filled < 3) {
+    filled++;
+  }
+  if (filled < 3) {
+    return value;  // Not enough history yet, pass through
+  }
+
+  float a = values[0], b = values[1], c = values[2];
+  if (a > b) { float t = a; a = b; b = t; }
+  if (b > c) { b = c; }
+  return a > b ? a : b;
+}
+
+BatteryMonitor::BatteryMonitor()
+    : voltageEma(0), percentEma(0), rateEma(0), current(BATTERY_UNKNOWN), count(0) {}
+
+void BatteryMonitor::add(const FuelGaugeReading& reading) {
+  float v = voltageMedian.add(reading.voltage);
+  float pct = percentMedian.add(reading.percent);
+  float rate = rateMedian.add(reading.chargeRate);
+
+  if (count == 0) {
+    voltageEma = v;
+    percentEma = pct;
+    rateEma = rate;
+  } else {
+    voltageEma = ema(voltageEma, v, EMA_ALPHA);
+    percentEma = ema(percentEma, pct, EMA_ALPHA);
+    rateEma = ema(rateEma, rate, EMA_ALPHA);
+  }
+  count++;
+  current = classify();
+}
+
+BatteryState BatteryMonitor::classify() const {
+  // Whichever direction we're already in only needs the exit threshold
+  // to stay there
+  float chargeThreshold = current == BATTERY_CHARGING || current == BATTERY_CHARGED ? RATE_EXIT : RATE_ENTER;
+  float dischargeThreshold = current == BATTERY_DISCHARGING ? RATE_EXIT : RATE_ENTER;
+  bool charged = current == BATTERY_CHARGED;
+
+  if (rateEma > chargeThreshold) {
+    return percentEma >= (charged ? 98.0f : 99.0f) ? BATTERY_CHARGED : BATTERY_CHARGING;
+  }
+  if (rateEma < -dischargeThreshold) {
+    return BATTERY_DISCHARGING;
+  }
+  // Near-zero charge rate
+  if (percentEma >= (charged ? 93.0f : 95.0f) && voltageEma >= (charged ? 4.05f : 4.1f)) {
+    return BATTERY_CHARGED;
+  }
+  return BATTERY_ON_BATTERY;
+}
+
+bool BatteryMonitor::critical(float minVoltage, float minPercent) const {
+  if (!valid() || (current != BATTERY_DISCHARGING && current != BATTERY_ON_BATTERY)) {
+    return false;
+  }
+  return voltageEma <= minVoltage || percentEma <= minPercent;
+}
+
+unsigned long BatteryMonitor::nextIntervalMs() const {
+  float rate = rateEma < 0 ? -rateEma : rateEma;
+  if (rate < 0.001f) {
+    return MAX_INTERVAL_MS;
+  }
+  float ms = PERCENT_PER_SAMPLE / rate * 3600000.0f;
+  if (ms < MIN_INTERVAL_MS) return MIN_INTERVAL_MS;
+  if (ms > MAX_INTERVAL_MS) return MAX_INTERVAL_MS;
+  return (unsigned long)ms;
+}
@@ -0,0 +1,65 @@
+#ifndef BATTERY_H
+#define BATTERY_H
+
+#include <stdint.h>
+#include "hal.h"
+#include "status.h"
+
+// Filtered battery state from raw fuel gauge readings.
+//
+// Each channel goes through a median of the last three readings, which
+// throws out a single bad sample, and then an exponential moving average.
+// The charging/discharging/charged decision uses separate enter and exit
+// thresholds so a rate hovering near zero doesn't flap between states.
+//
+// The sample interval follows the charge rate: fast while the charge is
+// moving, slow when it is flat, so the gauge is read about once per half
+// percent of change within the MIN/MAX bounds.
+
+class BatteryMonitor {
+public:
+  static constexpr float EMA_ALPHA = 0.3f;
+  static constexpr float RATE_ENTER = 0.5f;       // %/hr to start counting as (dis)charging
+  static constexpr float RATE_EXIT = 0.1f;        // %/hr to stop
+  static constexpr float PERCENT_PER_SAMPLE = 0.5f;
+  static const unsigned long MIN_INTERVAL_MS = 10000;
+  static const unsigned long MAX_INTERVAL_MS = 300000;
+
+  BatteryMonitor();
+
+  void add(const FuelGaugeReading& reading);
+
+  bool valid() const { return count > 0; }
+  uint32_t samples() const { return count; }
+  float voltage() const { return voltageEma; }
+  float percent() const { return percentEma; }
+  float chargeRate() const { return rateEma; }
+  BatteryState state() const { return current; }
+
+  // True when the filtered readings say the battery is empty and nothing
+  // is charging it
+  bool critical(float minVoltage, float minPercent) const;
+
+  // How long until the next reading is worthwhile
+  unsigned long nextIntervalMs() const;
+
+private:
+  // Median of the last three values of one channel
+  struct Median3 {
+    float values[3];
+    uint8_t filled = 0;
+    uint8_t next = 0;
+    float add(float value);
+  };
+
+  BatteryState classify() const;
+
+  Median3 voltageMedian, percentMedian, rateMedian;
+  float voltageEma;
+  float percentEma;
+  float rateEma;
+  BatteryState current;
+  uint32_t count;
+};
+
+#endif
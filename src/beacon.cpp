@@ -0,0 +1,63 @@
+#include "beacon.h"
+#include <string.h>
+
+static const uint16_t BEACON_MAGIC = 0x4342;  // "BC"
+static const int8_t RSSI_STEP = 5;            // dBm swing worth reporting
+
+static void put16(uint8_t* p, uint16_t value) {
+  p[0] = value;
+  p[1] = value >> 8;
+}
+
+static void put32(uint8_t* p, uint32_t value) {
+  put16(p, value);
+  put16(p + 2, value >> 16);
+}
+
+static uint16_t get16(const uint8_t* p) {
+  return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* p) {
+  return get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+size_t encodeBeacon(const Beacon& beacon, uint8_t* buffer, size_t size) {
+  if (size < BEACON_BYTES) {
+    return 0;
+  }
+  put16(buffer, BEACON_MAGIC);
+  buffer[2] = BEACON_VERSION;
+  buffer[3] = beacon.flags;
+  memcpy(buffer + 4, beacon.mac, sizeof(beacon.mac));
+  put16(buffer + 10, beacon.sequence);
+  put16(buffer + 12, beacon.days);
+  put16(buffer + 14, beacon.batteryMillivolts);
+  buffer[16] = beacon.batteryPercent;
+  buffer[17] = beacon.rssi;
+  put32(buffer + 18, beacon.freeHeap);
+  put32(buffer + 22, beacon.uptime);
+  return BEACON_BYTES;
+}
+
+bool decodeBeacon(const uint8_t* packet, size_t length, Beacon& beacon) {
+  if (length < BEACON_BYTES || get16(packet) != BEACON_MAGIC || packet[2] < 1) {
+    return false;
+  }
+  beacon.flags = packet[3];
+  memcpy(beacon.mac, packet + 4, sizeof(beacon.mac));
+  beacon.sequence = get16(packet + 10);
+  beacon.days = get16(packet + 12);
+  beacon.batteryMillivolts = get16(packet + 14);
+  beacon.batteryPercent = packet[16];
+  beacon.rssi = packet[17];
+  beacon.freeHeap = get32(packet + 18);
+  beacon.uptime = get32(packet + 22);
+  return true;
+}
+
+bool beaconChanged(const Beacon& cur, const Beacon& sent) {
+  int rssiSwing = cur.rssi - sent.rssi;
+  return cur.days != sent.days || cur.flags != sent.flags || cur.batteryPercent != sent.batteryPercent ||
+         rssiSwing >= RSSI_STEP || rssiSwing <= -RSSI_STEP;
+}
@@ -0,0 +1,64 @@
+#ifndef BEACON_H
+#define BEACON_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Compact UDP status beacon for keeping an eye on many units at once.
+//
+// Each unit sends one small datagram when its status changes (and every
+// few minutes regardless, so a collector can tell a quiet unit from a dead
+// one). tools/beacon_collector.py listens for them. Packet layout, all
+// little-endian:
+//
+//   0  u16  magic 0x4342 ("BC")
+//   2  u8   version (1)
+//   3  u8   flags, BeaconFlag
+//   4  u8[6] MAC address, identifies the unit
+//  10  u16  sequence number
+//  12  i16  days until the event on the display, -1 if none
+//  14  u16  battery mV
+//  16  u8   battery %
+//  17  i8   RSSI, dBm
+//  18  u32  free heap, bytes
+//  22  u32  uptime, seconds
+//
+// The fields above never move: newer versions only append, so a reader
+// takes the part it knows and ignores the rest.
+
+static const uint8_t BEACON_VERSION = 1;
+static const size_t BEACON_BYTES = 26;
+
+enum BeaconFlag : uint8_t {
+  BEACON_TIME_VALID = 0x01,
+  BEACON_CHARGING = 0x02,     // Charging or charged
+  BEACON_LOW_BATTERY = 0x04,  // Fuel gauge alert latched, cutoff coming
+  BEACON_LOW_POWER = 0x08,    // Low-power mode, expect beacons only at syncs
+  BEACON_NO_GAUGE = 0x10      // Battery fields are meaningless
+};
+
+struct Beacon {
+  uint8_t flags;
+  uint8_t mac[6];
+  uint16_t sequence;
+  int16_t days;
+  uint16_t batteryMillivolts;
+  uint8_t batteryPercent;
+  int8_t rssi;
+  uint32_t freeHeap;
+  uint32_t uptime;
+};
+
+// Serialize into buffer. Returns the length, 0 if it doesn't fit.
+size_t encodeBeacon(const Beacon& beacon, uint8_t* buffer, size_t size);
+
+// Parse a packet. Longer packets from newer versions decode their common
+// prefix.
+bool decodeBeacon(const uint8_t* packet, size_t length, Beacon& beacon);
+
+// Whether cur differs enough from what was last sent to be worth a packet:
+// days, flags or battery percent changed, or RSSI moved by several dBm.
+// Heap and uptime alone never count.
+bool beaconChanged(const Beacon& cur, const Beacon& sent);
+
+#endif
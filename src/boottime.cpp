@@ -0,0 +1,30 @@
+#include "boottime.h"
+
+BootTimeline::BootTimeline() {
+  for (uint8_t i = 0; i < BOOT_PHASE_COUNT; i++) {
+    at[i] = NOT_REACHED;
+  }
+}
+
+void BootTimeline::mark(BootPhase phase, int64_t nowUs) {
+  if (phase < BOOT_PHASE_COUNT && at[phase] == NOT_REACHED && nowUs >= 0 && nowUs < NOT_REACHED) {
+    at[phase] = nowUs;
+  }
+}
+
+void BootTimeline::writeJson(JsonWriter& json) const {
+  json.beginObject("boot");
+  for (uint8_t i = 0; i < BOOT_PHASE_COUNT; i++) {
+    uint32_t us = at[i];
+    if (us != NOT_REACHED) {
+      json.addFloat(phaseName((BootPhase)i), us / 1000.0f, 1);
+    }
+  }
+  json.endObject();
+}
+
+const char* BootTimeline::phaseName(BootPhase phase) {
+  static const char* const names[BOOT_PHASE_COUNT] = {"log", "settings", "cached", "fuelGauge", "restore",
+                                                      "setup", "count", "wifi", "time", "web"};
+  return phase < BOOT_PHASE_COUNT ? names[phase] : "";
+}
@@ -0,0 +1,47 @@
+#ifndef BOOTTIME_H
+#define BOOTTIME_H
+
+#include <stdint.h>
+#include "jsonwriter.h"
+
+// When each step of startup was reached, for /api/status.
+//
+// Times are microseconds since the app started (esp_timer), so ROM and
+// bootloader time isn't included. Each phase records the first time it's
+// reached only. Stored as 32 bits so the web server's task can read them
+// while the loop task writes; a phase reached after about 71 minutes
+// (WiFi that took that long to appear, say) isn't recorded.
+
+enum BootPhase : uint8_t {
+  BOOT_LOG,          // Logging up
+  BOOT_SETTINGS,     // Settings read from NVS
+  BOOT_CACHED,       // Cached count on the display
+  BOOT_FUEL_GAUGE,   // Fuel gauge checked
+  BOOT_RESTORE,      // Flash mounted, history and targets loaded
+  BOOT_SETUP,        // setup() done, network started in the background
+  BOOT_COUNT,        // First count from a valid clock on the display
+  BOOT_WIFI,         // First WiFi connection
+  BOOT_TIME,         // Clock valid, from the RTC or NTP
+  BOOT_WEB,          // Web server listening
+  BOOT_PHASE_COUNT
+};
+
+class BootTimeline {
+public:
+  BootTimeline();
+
+  void mark(BootPhase phase, int64_t nowUs);
+  bool reached(BootPhase phase) const { return at[phase] != NOT_REACHED; }
+
+  // Adds a "boot" object: milliseconds per reached phase
+  void writeJson(JsonWriter& json) const;
+
+  static const char* phaseName(BootPhase phase);
+
+private:
+  static const uint32_t NOT_REACHED = UINT32_MAX;
+
+  volatile uint32_t at[BOOT_PHASE_COUNT];
+};
+
+#endif
@@ -0,0 +1,111 @@
+#include "brightness.h"
+#include <math.h>
+
+bool inQuietHours(uint16_t start, uint16_t end, uint16_t minute) {
+  if (start == end) {
+    return false;
+  }
+  if (start < end) {
+    return minute >= start && minute < end;
+  }
+  return minute >= start || minute < end;  // Overnight
+}
+
+BrightnessScheduler::BrightnessScheduler()
+    : current(15), why(BRIGHTNESS_CONFIGURED), ambientLevel(-1), batteryDimmed(false) {
+}
+
+bool BrightnessScheduler::update(const BrightnessPolicy& policy, const BrightnessInputs& inputs) {
+  int8_t level = policy.level;
+  BrightnessReason reason = BRIGHTNESS_CONFIGURED;
+
+  // Ambient light scales the configured level down, with some slack so a
+  // reading on the edge of two levels doesn't flicker between them
+  if (inputs.ambient >= 0) {
+    float exact = policy.level * (inputs.ambient > 1000 ? 1000 : inputs.ambient) / 1000.0f;
+    if (ambientLevel < 0 || fabsf(exact - ambientLevel) > AMBIENT_HYSTERESIS) {
+      ambientLevel = (int8_t)(exact + 0.5f);
+    }
+    if (ambientLevel > policy.level) {
+      ambientLevel = policy.level;
+    }
+    if (ambientLevel < level) {
+      level = ambientLevel;
+      reason = BRIGHTNESS_AMBIENT;
+    }
+  } else {
+    ambientLevel = -1;
+  }
+
+  if (inputs.timeValid && inQuietHours(policy.quietStart, policy.quietEnd, inputs.minuteOfDay) &&
+      policy.quietLevel < level) {
+    level = policy.quietLevel;
+    reason = BRIGHTNESS_QUIET_HOURS;
+  }
+
+  // Dim below the threshold and stay dim until the charge is clearly
+  // back above it, or charging starts
+  if (!inputs.onBattery || policy.dimBatteryPercent == 0) {
+    batteryDimmed = false;
+  } else if (inputs.batteryPercent <= policy.dimBatteryPercent) {
+    batteryDimmed = true;
+  } else if (inputs.batteryPercent > policy.dimBatteryPercent + BATTERY_HYSTERESIS) {
+    batteryDimmed = false;
+  }
+  if (batteryDimmed && (int8_t)policy.dimBatteryLevel < level) {
+    level = policy.dimBatteryLevel;
+    reason = BRIGHTNESS_BATTERY;
+  }
+
+  // Still readable, so the count doesn't look like it stopped
+  if (inputs.lowBattery && level > 0) {
+    level = 0;
+    reason = BRIGHTNESS_LOW_BATTERY;
+  }
+
+  why = reason;
+  if (level == current) {
+    return false;
+  }
+  current = level;
+  return true;
+}
+
+const char* BrightnessScheduler::reasonName(BrightnessReason reason) {
+  switch (reason) {
+    case BRIGHTNESS_CONFIGURED: return "configured";
+    case BRIGHTNESS_AMBIENT: return "ambient";
+    case BRIGHTNESS_QUIET_HOURS: return "quiet";
+    case BRIGHTNESS_BATTERY: return "battery";
+    case BRIGHTNESS_LOW_BATTERY: return "lowBattery";
+  }
+  return "unknown";
+}
+
+float LedPowerMeter::currentMa(uint8_t litSegments, int8_t level) {
+  if (level == BRIGHTNESS_OFF) {
+    return 0.0f;
+  }
+  return CHIP_MA + litSegments * SEGMENT_MA * (level + 1) / 16.0f;
+}
+
+void LedPowerMeter::update(uint32_t nowMs, uint8_t litSegments, int8_t level) {
+  if (started) {
+    uint32_t elapsed = nowMs - lastMs;
+    totalMs += elapsed;
+    chargeMaMs += (double)currentMa(segments, brightness) * elapsed;
+    fullChargeMaMs += (double)currentMa(segments, 15) * elapsed;
+  }
+  started = true;
+  lastMs = nowMs;
+  segments = litSegments;
+  brightness = level;
+}
+
+float LedPowerMeter::averageMa() const {
+  return totalMs > 0 ? chargeMaMs / totalMs : currentMa();
+}
+
+float LedPowerMeter::fullBrightnessAverageMa() const {
+  return totalMs > 0 ? fullChargeMaMs / totalMs : currentMa(segments, 15);
+}
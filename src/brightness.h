@@ -0,0 +1,104 @@
+#ifndef BRIGHTNESS_H
+#define BRIGHTNESS_H
+
+#include <stdint.h>
+
+// Display brightness schedule and LED power estimate.
+//
+// The level starts at the configured brightness and each rule can only
+// lower it: an ambient light sensor scales it down in the dark, quiet
+// hours cap it (or blank the display) overnight, and a battery running
+// down caps it further. The scheduler only takes plain inputs, so the
+// loop task feeds it local time and battery state and does the fading
+// itself.
+
+static const int8_t BRIGHTNESS_OFF = -1;  // Display blanked
+
+// Which rule set the level
+enum BrightnessReason : uint8_t {
+  BRIGHTNESS_CONFIGURED,  // The configured brightness, nothing lowered it
+  BRIGHTNESS_AMBIENT,
+  BRIGHTNESS_QUIET_HOURS,
+  BRIGHTNESS_BATTERY,
+  BRIGHTNESS_LOW_BATTERY  // Fuel gauge alert, cutoff coming
+};
+
+struct BrightnessPolicy {
+  uint8_t level;              // 0-15, the daytime brightness
+  uint16_t quietStart;        // Minutes after local midnight; equal to quietEnd
+  uint16_t quietEnd;          // means no quiet hours. May wrap past midnight.
+  int8_t quietLevel;          // 0-15 or BRIGHTNESS_OFF
+  uint8_t dimBatteryPercent;  // On battery at or below this charge... (0 never)
+  uint8_t dimBatteryLevel;    // ...cap the level here
+};
+
+struct BrightnessInputs {
+  bool timeValid;         // minuteOfDay means something
+  uint16_t minuteOfDay;   // Local time
+  bool onBattery;         // Not charging and not on external power
+  uint8_t batteryPercent;
+  bool lowBattery;        // Fuel gauge alert latched
+  int16_t ambient;        // 0 dark to 1000 bright, -1 if there's no sensor
+};
+
+// Whether minute falls in [start, end), wrapping past midnight
+bool inQuietHours(uint16_t start, uint16_t end, uint16_t minute);
+
+class BrightnessScheduler {
+public:
+  static const uint8_t BATTERY_HYSTERESIS = 2;  // Percent above the threshold to undim
+  static constexpr float AMBIENT_HYSTERESIS = 0.75f;  // Levels the light must move by
+
+  BrightnessScheduler();
+
+  // Work out the level for the inputs. Returns true if it changed.
+  bool update(const BrightnessPolicy& policy, const BrightnessInputs& inputs);
+
+  int8_t level() const { return current; }
+  BrightnessReason reason() const { return why; }
+
+  static const char* reasonName(BrightnessReason reason);
+
+private:
+  int8_t current;
+  BrightnessReason why;
+  int8_t ambientLevel;  // Last level the sensor gave, -1 before the first reading
+  bool batteryDimmed;
+};
+
+// Estimated HT16K33 LED current from the segments lit and the brightness.
+//
+// The chip drives each segment for (level + 1) / 16 of its multiplex slot,
+// so the average current is close to linear in lit segments and level.
+// The figures are typical for the 0.56" backpack, good for comparing
+// settings rather than measuring. Alongside the real estimate it keeps
+// what the same frames would have cost at full brightness, which is what
+// the schedule saves.
+class LedPowerMeter {
+public:
+  static constexpr float SEGMENT_MA = 2.5f;  // Per lit segment at level 15
+  static constexpr float CHIP_MA = 0.6f;     // Oscillator and drivers on
+
+  // The display shows litSegments at level (BRIGHTNESS_OFF when blanked)
+  // from nowMs on
+  void update(uint32_t nowMs, uint8_t litSegments, int8_t level);
+
+  static float currentMa(uint8_t litSegments, int8_t level);
+
+  float currentMa() const { return currentMa(segments, brightness); }
+  float averageMa() const;
+  float fullBrightnessAverageMa() const;  // The same frames, never dimmed or blanked
+  float mAhPerDay() const { return averageMa() * 24.0f; }
+  float fullBrightnessMAhPerDay() const { return fullBrightnessAverageMa() * 24.0f; }
+
+private:
+  uint32_t lastMs = 0;
+  bool started = false;
+  uint8_t segments = 0;
+  int8_t brightness = BRIGHTNESS_OFF;
+  uint64_t totalMs = 0;
+  double chargeMaMs = 0;      // mA x ms at the real levels
+  double fullChargeMaMs = 0;  // mA x ms at level 15
+};
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef COUNTDOWN_H
+#define COUNTDOWN_H
+
+#include <stdint.h>
+
+// Integer civil-date math for the countdown.
+//
+// Counting calendar days between two dates needs no time zone, DST or
+// floating point: convert both to a day number and subtract. Everything
+// here is constexpr, so fixed dates fold to constants at compile time.
+
+constexpr bool isLeapYear(int year) {
+  return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+constexpr int daysInMonth(int year, int month) {
+  return month == 2 ? (isLeapYear(year) ? 29 : 28)
+                    : (month == 4 || month == 6 || month == 9 || month == 11) ? 30 : 31;
+}
+
+// Days since 1970-01-01 in the proleptic Gregorian calendar (Howard
+// Hinnant's days_from_civil). Month is 1-12.
+constexpr int32_t daysFromCivil(int year, int month, int day) {
+  int y = month <= 2 ? year - 1 : year;
+  int era = (y >= 0 ? y : y - 399) / 400;
+  int yoe = y - era * 400;                                          // [0, 399]
+  int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;  // [0, 365]
+  int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;                  // [0, 146096]
+  return era * 146097 + doe - 719468;
+}
+
+struct CivilDate {
+  int year;
+  int month;  // 1-12
+  int day;
+};
+
+// Inverse of daysFromCivil (Hinnant's civil_from_days)
+constexpr CivilDate civilFromDays(int32_t days) {
+  int32_t z = days + 719468;
+  int32_t era = (z >= 0 ? z : z - 146096) / 146097;
+  int doe = z - era * 146097;                                   // [0, 146096]
+  int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;  // [0, 399]
+  int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);            // [0, 365]
+  int mp = (5 * doy + 2) / 153;                                 // [0, 11]
+  int month = mp < 10 ? mp + 3 : mp - 9;
+  return CivilDate{(int)(yoe + era * 400) + (month <= 2 ? 1 : 0), month, doy - (153 * mp + 2) / 5 + 1};
+}
+
+// 1-based ordinal day within the year
+constexpr int dayOfYear(int year, int month, int day) {
+  return daysFromCivil(year, month, day) - daysFromCivil(year, 1, 1) + 1;
+}
+
+// 0 = Sunday ... 6 = Saturday
+constexpr int dayOfWeek(int32_t days) {
+  return days >= -4 ? (days + 4) % 7 : (days + 5) % 7 + 6;
+}
+
+struct Countdown {
+  int days;        // Whole calendar days until the target, 0 on the day itself
+  int targetYear;  // Year of the occurrence being counted down to
+};
+
+// Days from the given date until the next month/day anniversary, counting
+// the anniversary itself as 0
+constexpr Countdown countdownToAnnual(int year, int month, int day, int targetMonth, int targetDay) {
+  int targetYear = (month > targetMonth || (month == targetMonth && day > targetDay)) ? year + 1 : year;
+  return Countdown{daysFromCivil(targetYear, targetMonth, targetDay) - daysFromCivil(year, month, day),
+                   targetYear};
+}
+
+static_assert(daysFromCivil(1970, 1, 1) == 0, "epoch");
+static_assert(daysFromCivil(2000, 3, 1) == 11017, "leap century");
+static_assert(dayOfYear(2024, 12, 31) == 366, "leap year length");
+static_assert(civilFromDays(daysFromCivil(2024, 2, 29)).day == 29, "round trip");
+static_assert(civilFromDays(-1).year == 1969, "before the epoch");
+static_assert(dayOfWeek(daysFromCivil(2025, 12, 25)) == 4, "Christmas 2025 is a Thursday");
+static_assert(countdownToAnnual(2025, 12, 24, 12, 25).days == 1, "Christmas Eve");
+static_assert(countdownToAnnual(2025, 12, 25, 12, 25).days == 0, "Christmas Day");
+static_assert(countdownToAnnual(2023, 12, 26, 12, 25).days == 365, "across a leap year");
+static_assert(countdownToAnnual(2024, 12, 26, 12, 25).targetYear == 2025, "rolls over");
+
+#endif
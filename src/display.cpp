@@ -0,0 +1,17 @@
+#include "display.h"
+
+bool ShadowedDisplay::begin(uint8_t address, TwoWire* wire) {
+  shadow.invalidate();
+  return Adafruit_7segment::begin(address, wire);
+}
+
+void ShadowedDisplay::writeDisplay() {
+  if (i2c_dev == nullptr) {
+    return;
+  }
+  shadow.send(displaybuffer);
+}
+
+bool ShadowedDisplay::writeRam(const uint8_t* data, size_t length) {
+  return i2c_dev->write(data, length);
+}
@@ -0,0 +1,34 @@
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include "Adafruit_LEDBackpack.h"
+#include "displayshadow.h"
+
+// HT16K33 7-segment driver that only sends what changed.
+//
+// Drop-in replacement for Adafruit_7segment: writeDisplay() hands the
+// framebuffer to a DisplayShadow, which does the diffing and writes to the
+// chip through this driver's I2C device.
+
+class ShadowedDisplay : public Adafruit_7segment, private DisplayBus {
+public:
+  ShadowedDisplay() : shadow(*this) {}
+
+  bool begin(uint8_t address = 0x70, TwoWire* wire = &Wire);
+
+  // Send changed digit RAM to the chip
+  void writeDisplay();
+
+  // Resend the whole buffer on the next write (e.g. after a chip reset)
+  void invalidate() { shadow.invalidate(); }
+
+  // Lit segments and bus statistics
+  const DisplayShadow& bus() const { return shadow; }
+
+private:
+  bool writeRam(const uint8_t* data, size_t length) override;
+
+  DisplayShadow shadow;
+};
+
+#endif
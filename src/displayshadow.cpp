@@ -0,0 +1,51 @@
+#include "displayshadow.h"
+#include <string.h>
+
+void DisplayShadow::send(const uint16_t* rows) {
+  fullFrames++;
+
+  // Display RAM layout: two bytes per row, low byte first
+  uint8_t frame[RAM_BYTES];
+  for (uint8_t i = 0; i < 8; i++) {
+    frame[2 * i] = rows[i] & 0xFF;
+    frame[2 * i + 1] = rows[i] >> 8;
+  }
+
+  // Find the span of bytes that differ from what the chip already shows
+  uint8_t first = 0;
+  uint8_t last = RAM_BYTES - 1;
+  if (shadowValid) {
+    while (first < RAM_BYTES && frame[first] == shadow[first]) first++;
+    if (first == RAM_BYTES) {
+      skipped++;
+      return;
+    }
+    while (frame[last] == shadow[last]) last--;
+  }
+
+  // One transaction: start address followed by the changed bytes
+  uint8_t buffer[RAM_BYTES + 1];
+  uint8_t length = last - first + 1;
+  buffer[0] = first;
+  memcpy(buffer + 1, frame + first, length);
+  sentBytes += length + 1;
+  sentTransactions++;
+  if (!bus.writeRam(buffer, length + 1)) {
+    shadowValid = false;  // Unknown chip state, resend everything next time
+    return;
+  }
+
+  memcpy(shadow + first, frame + first, length);
+  shadowValid = true;
+}
+
+uint8_t DisplayShadow::litSegments() const {
+  if (!shadowValid) {
+    return 0;
+  }
+  uint8_t lit = 0;
+  for (uint8_t i = 0; i < RAM_BYTES; i++) {
+    lit += __builtin_popcount(shadow[i]);
+  }
+  return lit;
+}
@@ -0,0 +1,55 @@
+#ifndef DISPLAYSHADOW_H
+#define DISPLAYSHADOW_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Frame diffing for the HT16K33 display RAM.
+//
+// Keeps a shadow copy of the RAM last written to the chip. send() compares
+// a frame against it and writes only the span of changed bytes in a single
+// transaction (the HT16K33 auto-increments its RAM pointer), or nothing at
+// all when the frame is unchanged. After a failed write the chip state is
+// unknown, so the next send() writes the whole frame.
+
+// Where the transactions go: the I2C device on the board (display.h), a
+// recording in the tests
+class DisplayBus {
+public:
+  virtual ~DisplayBus() {}
+  virtual bool writeRam(const uint8_t* data, size_t length) = 0;  // Start address, then bytes
+};
+
+class DisplayShadow {
+public:
+  static const uint8_t RAM_BYTES = 16;
+
+  explicit DisplayShadow(DisplayBus& bus) : bus(bus) {}
+
+  // Bring the chip up to date with rows, the driver's 8 row buffer
+  void send(const uint16_t* rows);
+
+  // Segments (and colon dots) on in the frame last sent
+  uint8_t litSegments() const;
+
+  // Resend the whole buffer on the next write (e.g. after a chip reset)
+  void invalidate() { shadowValid = false; }
+
+  // Bus statistics. A failed write still counts as sent: its bytes were
+  // clocked out all the same.
+  uint32_t bytesSent() const { return sentBytes; }
+  uint32_t transactions() const { return sentTransactions; }
+  uint32_t skippedWrites() const { return skipped; }
+  uint32_t fullFrameBytes() const { return fullFrames * (RAM_BYTES + 1); }  // Cost without dirty tracking
+
+private:
+  DisplayBus& bus;
+  uint8_t shadow[RAM_BYTES];
+  bool shadowValid = false;
+  uint32_t sentBytes = 0;
+  uint32_t sentTransactions = 0;
+  uint32_t skipped = 0;
+  uint32_t fullFrames = 0;
+};
+
+#endif
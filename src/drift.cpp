@@ -0,0 +1,49 @@
+#include "drift.h"
+
+void DriftEstimator::addSync(int64_t wallUs, int64_t monotonicUs) {
+  if (haveBaseline) {
+    int64_t wallDelta = wallUs - lastWallUs;
+    int64_t monotonicDelta = monotonicUs - lastMonotonicUs;
+
+    if (wallDelta < (int64_t)MIN_BASELINE_SEC * 1000000 || monotonicDelta <= 0) {
+      // Too short to measure (or the clock went backwards), keep the
+      // older baseline and wait for a longer one
+      return;
+    }
+
+    float measured = (float)(monotonicDelta - wallDelta) * 1e6f / (float)wallDelta;
+
+    // Weight new measurements less once we have a few
+    if (samples == 0) {
+      estimate = measured;
+    } else {
+      float weight = samples < 4 ? 0.5f : 0.25f;
+      estimate += (measured - estimate) * weight;
+    }
+    if (samples < 0xFFFF) samples++;
+  }
+
+  lastWallUs = wallUs;
+  lastMonotonicUs = monotonicUs;
+  haveBaseline = true;
+}
+
+void DriftEstimator::seed(float ppm) {
+  if (ppm == ppm && ppm > -1000.0f && ppm < 1000.0f) {  // Reject NaN and nonsense
+    estimate = ppm;
+    samples = 1;
+  }
+}
+
+float DriftEstimator::predictedError(uint32_t elapsedSec) const {
+  float rate = hasEstimate() ? (estimate < 0 ? -estimate : estimate) + MEASURED_MARGIN_PPM : UNKNOWN_DRIFT_PPM;
+  return elapsedSec * rate * 1e-6f;
+}
+
+uint32_t DriftEstimator::nextSyncDelay(float thresholdSec, uint32_t minSec, uint32_t maxSec) const {
+  float rate = predictedError(1000000) / 1000000.0f;  // Seconds of error per second
+  float delay = rate > 0 ? thresholdSec / rate : (float)maxSec;
+  if (delay < minSec) return minSec;
+  if (delay > maxSec) return maxSec;
+  return (uint32_t)delay;
+}
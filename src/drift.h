@@ -0,0 +1,49 @@
+#ifndef DRIFT_H
+#define DRIFT_H
+
+#include <stdint.h>
+
+// RTC drift estimator for adaptive NTP resync.
+//
+// At each NTP sync we note the true wall time alongside the free-running
+// monotonic clock. Between two syncs the monotonic clock ran for some
+// interval while true time advanced by another; the difference is the
+// oscillator's drift. A running average of that drift predicts how far
+// the clock will wander before the next sync, so the sync can be put off
+// until the predicted error approaches a threshold.
+
+class DriftEstimator {
+public:
+  // Uncertainty assumed on top of the measured drift (ppm)
+  static constexpr float UNKNOWN_DRIFT_PPM = 50.0f;  // No estimate yet
+  static constexpr float MEASURED_MARGIN_PPM = 5.0f;
+
+  // Syncs closer together than this give too noisy a measurement
+  static const uint32_t MIN_BASELINE_SEC = 1800;
+
+  // Record a sync: wall time just set from NTP, and the monotonic clock at
+  // the same instant (both in microseconds)
+  void addSync(int64_t wallUs, int64_t monotonicUs);
+
+  // Start from a previously saved estimate (e.g. restored after sleep)
+  void seed(float ppm);
+
+  bool hasEstimate() const { return samples > 0; }
+  float ppm() const { return estimate; }  // Positive = local clock runs fast
+  uint16_t sampleCount() const { return samples; }
+
+  // Worst-case clock error in seconds after running unsynced for a while
+  float predictedError(uint32_t elapsedSec) const;
+
+  // Seconds until the predicted error reaches thresholdSec, clamped
+  uint32_t nextSyncDelay(float thresholdSec, uint32_t minSec, uint32_t maxSec) const;
+
+private:
+  int64_t lastWallUs = 0;
+  int64_t lastMonotonicUs = 0;
+  bool haveBaseline = false;
+  float estimate = 0.0f;
+  uint16_t samples = 0;
+};
+
+#endif
@@ -0,0 +1,102 @@
+#include "esp32_hal.h"
+#include <Arduino.h>
+#include <esp_timer.h>
+
+// MAX17048 registers, all 16-bit big-endian
+static const uint8_t REG_VCELL = 0x02;   // 78.125 uV/LSB
+static const uint8_t REG_SOC = 0x04;     // 1/256 %/LSB
+static const uint8_t REG_CONFIG = 0x0C;  // RCOMP, then SLEEP | ALSC | ALRT | ATHD[4:0]
+static const uint8_t REG_CRATE = 0x16;   // Signed, 0.208 %/hr/LSB
+static const uint8_t REG_STATUS = 0x1A;  // Alert flags in the high byte
+static const uint8_t BURST_FIRST = REG_VCELL;
+static const uint8_t BURST_BYTES = REG_STATUS + 2 - BURST_FIRST;
+
+static const uint16_t CONFIG_ALRT = 0x0020;
+static const uint16_t CONFIG_ATHD = 0x001F;
+
+bool Max17048FuelGauge::begin() {
+  return gauge.begin() && i2c.begin();
+}
+
+bool Max17048FuelGauge::read(FuelGaugeReading& reading) {
+  // VCELL through STATUS in one transaction; the chip auto-increments
+  uint8_t reg = BURST_FIRST;
+  uint8_t data[BURST_BYTES];
+  if (!i2c.write_then_read(&reg, 1, data, sizeof(data))) {
+    return false;
+  }
+
+  const uint8_t* vcell = data + (REG_VCELL - BURST_FIRST);
+  const uint8_t* soc = data + (REG_SOC - BURST_FIRST);
+  const uint8_t* crate = data + (REG_CRATE - BURST_FIRST);
+  const uint8_t* status = data + (REG_STATUS - BURST_FIRST);
+  reading.voltage = ((vcell[0] << 8) | vcell[1]) * 78.125e-6f;
+  reading.percent = soc[0] + soc[1] / 256.0f;
+  reading.chargeRate = (int16_t)((crate[0] << 8) | crate[1]) * 0.208f;
+  reading.alerts = status[0] & (FUEL_ALERT_VOLTAGE_HIGH | FUEL_ALERT_VOLTAGE_LOW | FUEL_ALERT_VOLTAGE_RESET |
+                                FUEL_ALERT_SOC_LOW | FUEL_ALERT_SOC_CHANGE);
+  return true;
+}
+
+void Max17048FuelGauge::setAlerts(float minVoltage, uint8_t emptyPercent) {
+  gauge.setAlertVoltages(minVoltage, 5.1f);  // No high-voltage alert
+
+  // Empty alert at 32 - ATHD percent
+  if (emptyPercent < 1) emptyPercent = 1;
+  if (emptyPercent > 32) emptyPercent = 32;
+  uint16_t config;
+  if (readRegister(REG_CONFIG, config)) {
+    config = (config & ~(CONFIG_ATHD | CONFIG_ALRT)) | (32 - emptyPercent);
+    writeRegister(REG_CONFIG, config);
+  }
+  clearAlerts();
+}
+
+void Max17048FuelGauge::clearAlerts() {
+  writeRegister(REG_STATUS, 0);
+  uint16_t config;
+  if (readRegister(REG_CONFIG, config) && (config & CONFIG_ALRT)) {
+    writeRegister(REG_CONFIG, config & ~CONFIG_ALRT);
+  }
+}
+
+bool Max17048FuelGauge::readRegister(uint8_t reg, uint16_t& value) {
+  uint8_t data[2];
+  if (!i2c.write_then_read(&reg, 1, data, sizeof(data))) {
+    return false;
+  }
+  value = (data[0] << 8) | data[1];
+  return true;
+}
+
+bool Max17048FuelGauge::writeRegister(uint8_t reg, uint16_t value) {
+  uint8_t data[3] = {reg, (uint8_t)(value >> 8), (uint8_t)value};
+  return i2c.write(data, sizeof(data));
+}
+
+unsigned long Esp32Clock::millis() {
+  return ::millis();
+}
+
+int64_t Esp32Clock::monotonicUs() {
+  return esp_timer_get_time();
+}
+
+uint32_t Esp32Clock::cycleCount() {
+  return ESP.getCycleCount();
+}
+
+time_t Esp32Clock::epoch() {
+  return time(nullptr);
+}
+
+// Never waits for the clock, unlike getLocalTime()
+bool Esp32Clock::localTime(struct tm& timeinfo) {
+  // Same test as getLocalTime(): before 2016 the clock hasn't been set
+  time_t now = time(nullptr);
+  if (now < 1451606400) {
+    return false;
+  }
+  zone.toLocal(now, timeinfo);
+  return true;
+}
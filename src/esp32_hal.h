@@ -0,0 +1,68 @@
+#ifndef ESP32_HAL_H
+#define ESP32_HAL_H
+
+#include "hal.h"
+#include "display.h"
+#include <Adafruit_MAX1704X.h>
+#include <Adafruit_I2CDevice.h>
+
+// DisplayBackend on an HT16K33 backpack, through the shadowed driver
+class Ht16k33Display : public DisplayBackend {
+public:
+  bool begin(uint8_t address) override { return driver.begin(address); }
+  void setBrightness(uint8_t level) override { driver.setBrightness(level); }
+  void setPower(bool on) override { driver.setDisplayState(on); }
+  void clear() override { driver.clear(); }
+  void showNumber(long value, int base = 10) override { driver.print(value, base); }
+  void showDigit(uint8_t position, uint8_t digit) override { driver.writeDigitNum(position, digit); }
+  void showSegments(uint8_t position, uint8_t segments) override { driver.writeDigitRaw(position, segments); }
+  void showColon(bool on) override { driver.drawColon(on); }
+  void showDashes() override { driver.printError(); }
+  void refresh() override { driver.writeDisplay(); }
+  uint8_t litSegments() override { return driver.bus().litSegments(); }
+
+  // Bus statistics live on the driver
+  const DisplayShadow& stats() const { return driver.bus(); }
+
+private:
+  ShadowedDisplay driver;
+};
+
+// FuelGaugeBackend on a MAX17048. Readings come from one burst read of
+// the register file rather than a transaction per value.
+class Max17048FuelGauge : public FuelGaugeBackend {
+public:
+  static const uint8_t ADDRESS = 0x36;
+
+  Max17048FuelGauge() : i2c(ADDRESS, &Wire) {}
+
+  bool begin() override;
+  bool read(FuelGaugeReading& reading) override;
+  void setAlerts(float minVoltage, uint8_t emptyPercent) override;
+  void clearAlerts() override;
+
+private:
+  bool readRegister(uint8_t reg, uint16_t& value);
+  bool writeRegister(uint8_t reg, uint16_t value);
+
+  Adafruit_MAX17048 gauge;  // Chip detection and reset
+  Adafruit_I2CDevice i2c;
+};
+
+// ClockBackend on the Arduino core and the ESP32 system time. The system
+// clock is kept in UTC; local time comes from the TimeZone table rather
+// than libc, so localTime() is only safe from one task.
+class Esp32Clock : public ClockBackend {
+public:
+  unsigned long millis() override;
+  int64_t monotonicUs() override;
+  uint32_t cycleCount() override;
+  time_t epoch() override;
+  void setTimeZone(const TzRule& rule) override { zone.setRule(rule); }
+  bool localTime(struct tm& timeinfo) override;
+
+private:
+  TimeZone zone;
+};
+
+#endif
@@ -0,0 +1,38 @@
+#include "etag.h"
+#include <string.h>
+
+// The quoted part of a tag, without any W/ prefix
+static const char* opaqueTag(const char* tag) {
+  return tag[0] == 'W' && tag[1] == '/' ? tag + 2 : tag;
+}
+
+bool etagMatches(const char* ifNoneMatch, const char* etag) {
+  const char* want = opaqueTag(etag);
+  size_t wantLength = strlen(want);
+  const char* p = ifNoneMatch;
+  while (*p != '\0') {
+    while (*p == ' ' || *p == '\t' || *p == ',') {
+      p++;
+    }
+    if (*p == '*') {
+      return true;
+    }
+    p = opaqueTag(p);
+    if (*p == '"') {
+      const char* end = strchr(p + 1, '"');
+      if (end == nullptr) {
+        return false;
+      }
+      size_t length = end + 1 - p;
+      if (length == wantLength && strncmp(p, want, length) == 0) {
+        return true;
+      }
+      p = end + 1;
+    }
+    // Skip anything malformed up to the next tag
+    while (*p != '\0' && *p != ',') {
+      p++;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,9 @@
+#ifndef ETAG_H
+#define ETAG_H
+
+// Whether an If-None-Match header value matches an entity tag, by the weak
+// comparison RFC 7232 asks for: a list of tags, W/ prefixes ignored, "*"
+// matching anything. The tag is passed with its quotes, as sent in ETag.
+bool etagMatches(const char* ifNoneMatch, const char* etag);
+
+#endif
@@ -0,0 +1,44 @@
+#include "firmware_slot.h"
+#include <Update.h>
+#include <esp_ota_ops.h>
+
+// The Arduino core marks a new image valid as soon as it boots unless
+// this says otherwise. Leave it pending so the health check decides.
+extern "C" bool verifyRollbackLater() {
+  return true;
+}
+
+bool EspFirmwareSlot::begin() {
+  // The size isn't known up front with a multipart upload; Update checks
+  // the image fits the partition as it's written
+  return Update.begin(UPDATE_SIZE_UNKNOWN, U_FLASH);
+}
+
+bool EspFirmwareSlot::write(const uint8_t* data, size_t length) {
+  // Update buffers up to a flash sector and erases/writes it when full
+  return Update.write(const_cast<uint8_t*>(data), length) == length;
+}
+
+bool EspFirmwareSlot::end() {
+  // Checks the image header and switches the boot partition
+  return Update.end(true);
+}
+
+void EspFirmwareSlot::abort() {
+  Update.abort();
+}
+
+bool EspFirmwareSlot::pendingVerify() {
+  esp_ota_img_states_t state;
+  const esp_partition_t* running = esp_ota_get_running_partition();
+  return running != nullptr && esp_ota_get_state_partition(running, &state) == ESP_OK &&
+         state == ESP_OTA_IMG_PENDING_VERIFY;
+}
+
+void EspFirmwareSlot::markValid() {
+  esp_ota_mark_app_valid_cancel_rollback();
+}
+
+void EspFirmwareSlot::rollback() {
+  esp_ota_mark_app_invalid_rollback_and_reboot();
+}
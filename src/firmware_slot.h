@@ -0,0 +1,19 @@
+#ifndef FIRMWARE_SLOT_H
+#define FIRMWARE_SLOT_H
+
+#include "ota.h"
+
+// The inactive OTA app partition, written through the Arduino core's
+// Update, and the bootloader's rollback state
+class EspFirmwareSlot : public FirmwareSlot {
+public:
+  bool begin() override;
+  bool write(const uint8_t* data, size_t length) override;
+  bool end() override;
+  void abort() override;
+  bool pendingVerify() override;
+  void markValid() override;
+  void rollback() override;
+};
+
+#endif
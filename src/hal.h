@@ -0,0 +1,74 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdint.h>
+#include <time.h>
+#include "timezone.h"
+
+// Hardware seams for the display, fuel gauge and clock.
+//
+// Together with NetworkBackend (netconn.h) these are everything the
+// countdown logic touches, so it can be pointed at other hardware or at a
+// simulated device. esp32_hal.h has the implementations for the Feather.
+
+// 4-digit 7-segment display. Drawing calls only change the frame;
+// refresh() sends it to the hardware.
+class DisplayBackend {
+public:
+  virtual ~DisplayBackend() {}
+  virtual bool begin(uint8_t address) = 0;
+  virtual void setBrightness(uint8_t level) = 0;  // 0-15
+  virtual void setPower(bool on) = 0;  // Off blanks the display, keeping the frame
+  virtual void clear() = 0;
+  virtual void showNumber(long value, int base = 10) = 0;
+  virtual void showDigit(uint8_t position, uint8_t digit) = 0;  // Position 0-4, 2 is the colon
+  virtual void showSegments(uint8_t position, uint8_t segments) = 0;  // Raw bits, see animation.h
+  virtual void showColon(bool on) = 0;
+  virtual void showDashes() = 0;  // "----", nothing to count
+  virtual void refresh() = 0;
+  virtual uint8_t litSegments() = 0;  // Segments lit in the last frame sent, for power estimates
+};
+
+// Alert flags reported by the fuel gauge
+enum FuelGaugeAlert : uint8_t {
+  FUEL_ALERT_VOLTAGE_HIGH = 0x02,
+  FUEL_ALERT_VOLTAGE_LOW = 0x04,
+  FUEL_ALERT_VOLTAGE_RESET = 0x08,
+  FUEL_ALERT_SOC_LOW = 0x10,
+  FUEL_ALERT_SOC_CHANGE = 0x20
+};
+
+// Everything the fuel gauge reports, read in one go
+struct FuelGaugeReading {
+  float voltage;     // V
+  float percent;     // State of charge, %
+  float chargeRate;  // %/hr, negative while discharging
+  uint8_t alerts;    // FuelGaugeAlert flags currently raised
+};
+
+// Battery fuel gauge
+class FuelGaugeBackend {
+public:
+  virtual ~FuelGaugeBackend() {}
+  virtual bool begin() = 0;
+  virtual bool read(FuelGaugeReading& reading) = 0;
+
+  // Raise FUEL_ALERT_VOLTAGE_LOW below minVoltage and FUEL_ALERT_SOC_LOW
+  // below emptyPercent (1-32)
+  virtual void setAlerts(float minVoltage, uint8_t emptyPercent) = 0;
+  virtual void clearAlerts() = 0;
+};
+
+// Monotonic and wall clocks
+class ClockBackend {
+public:
+  virtual ~ClockBackend() {}
+  virtual unsigned long millis() = 0;
+  virtual int64_t monotonicUs() = 0;
+  virtual uint32_t cycleCount() = 0;  // CPU cycles, wraps every few seconds
+  virtual time_t epoch() = 0;
+  virtual void setTimeZone(const TzRule& rule) = 0;
+  virtual bool localTime(struct tm& timeinfo) = 0;  // False until the clock has been set
+};
+
+#endif
@@ -0,0 +1,210 @@
+#include "history.h"
+#include <stdio.h>
+#include <string.h>
+
+BatteryHistory::BatteryHistory() : sampleCallback(nullptr), restoring(false) {
+  BatterySample* storage[HISTORY_RESOLUTIONS] = {minuteSamples, hourSamples, daySamples};
+  const uint16_t capacities[HISTORY_RESOLUTIONS] = {MINUTE_SAMPLES, HOUR_SAMPLES, DAY_SAMPLES};
+  const uint16_t units[HISTORY_RESOLUTIONS] = {1, 60, 3600};
+
+  for (int i = 0; i < HISTORY_RESOLUTIONS; i++) {
+    rings[i].samples = storage[i];
+    rings[i].capacity = capacities[i];
+    rings[i].count = 0;
+    rings[i].head = 0;
+    rings[i].timeUnit = units[i];
+    rings[i].total = 0;
+    rings[i].oldestTime = 0;
+    rings[i].newestTime = 0;
+  }
+
+  hourBucket = Bucket{0, 3600, 0, 0, 0, 0};
+  dayBucket = Bucket{0, 86400, 0, 0, 0, 0};
+}
+
+void BatteryHistory::record(uint32_t time, float voltage, float percent, float chargeRate) {
+  // Quantize
+  float mv = voltage * 1000.0f + 0.5f;
+  uint16_t millivolts = mv <= 0 ? 0 : (mv >= 65535 ? 65535 : (uint16_t)mv);
+  uint8_t pct = percent <= 0 ? 0 : (percent >= 100 ? 100 : (uint8_t)(percent + 0.5f));
+  float steps = chargeRate * 2.0f;
+  int8_t rate = steps <= -127 ? -127 : (steps >= 127 ? 127 : (int8_t)(steps < 0 ? steps - 0.5f : steps + 0.5f));
+
+  push(rings[HISTORY_MINUTE], time, millivolts, pct, rate);
+  accumulate(hourBucket, HISTORY_HOUR, time, millivolts, pct, rate, 1);
+  accumulate(dayBucket, HISTORY_DAY, time, millivolts, pct, rate, 1);
+}
+
+void BatteryHistory::restoreHour(uint32_t time, uint16_t millivolts, uint8_t percent, int8_t rate,
+                                 uint16_t readings) {
+  restoring = true;
+  push(rings[HISTORY_HOUR], time, millivolts, percent, rate);
+  accumulate(dayBucket, HISTORY_DAY, time, millivolts, percent, rate, readings > 0 ? readings : READINGS_PER_HOUR);
+  restoring = false;
+}
+
+uint16_t BatteryHistory::count(HistoryResolution res) const {
+  lock();
+  uint16_t n = rings[res].count;
+  unlock();
+  return n;
+}
+
+void BatteryHistory::accumulate(Bucket& bucket, HistoryResolution res, uint32_t time, uint16_t millivolts,
+                                uint8_t percent, int8_t rate, uint16_t weight) {
+  uint32_t index = time / bucket.period;
+
+  // A new bucket started, so the previous one is complete
+  if (bucket.n > 0 && index != bucket.index) {
+    Ring& ring = rings[res];
+    uint32_t bucketTime = bucket.index * bucket.period;
+    push(ring, bucketTime,
+         bucket.millivolts / bucket.n,
+         bucket.percent / bucket.n,
+         bucket.rate / bucket.n);
+    if (sampleCallback != nullptr && !restoring) {
+      sampleCallback(res, ring.samples[(ring.head + ring.capacity - 1) % ring.capacity], bucketTime, bucket.n);
+    }
+    bucket.millivolts = 0;
+    bucket.percent = 0;
+    bucket.rate = 0;
+    bucket.n = 0;
+  }
+
+  bucket.index = index;
+  bucket.millivolts += (uint32_t)millivolts * weight;
+  bucket.percent += (uint32_t)percent * weight;
+  bucket.rate += (int32_t)rate * weight;
+  bucket.n += weight;
+}
+
+void BatteryHistory::push(Ring& ring, uint32_t time, uint16_t millivolts, uint8_t percent, int8_t rate) {
+  // Long gaps (e.g. deep sleep) saturate the delta
+  uint32_t steps = 0;
+  if (ring.count > 0 && time > ring.newestTime) {
+    steps = (time - ring.newestTime + ring.timeUnit / 2) / ring.timeUnit;
+    if (steps > 65535) steps = 65535;
+  }
+
+  lock();
+  if (ring.count == ring.capacity) {
+    // Overwriting the oldest sample; the next one becomes the oldest
+    uint16_t nextOldest = (ring.head + 1) % ring.capacity;
+    ring.oldestTime += (uint32_t)ring.samples[nextOldest].dt * ring.timeUnit;
+  } else {
+    ring.count++;
+  }
+  if (ring.count == 1) {
+    ring.oldestTime = time;
+  }
+
+  BatterySample& sample = ring.samples[ring.head];
+  sample.dt = (uint16_t)steps;
+  sample.millivolts = millivolts;
+  sample.percent = percent;
+  sample.rate = rate;
+
+  ring.head = (ring.head + 1) % ring.capacity;
+  ring.total++;
+  ring.newestTime = time;
+  unlock();
+}
+
+HistoryCursor BatteryHistory::begin(HistoryResolution res) const {
+  const Ring& ring = rings[res];
+  lock();
+  HistoryCursor cursor{ring.total - ring.count, ring.oldestTime};
+  unlock();
+  return cursor;
+}
+
+bool BatteryHistory::next(HistoryResolution res, HistoryCursor& cursor, HistoryPoint& point) const {
+  const Ring& ring = rings[res];
+  lock();
+  uint32_t oldest = ring.total - ring.count;
+  if (cursor.seq >= ring.total || cursor.seq < oldest) {
+    unlock();
+    return false;  // At the end, or the writer lapped us
+  }
+  bool first = cursor.seq == oldest;
+  BatterySample sample = ring.samples[cursor.seq % ring.capacity];
+  unlock();
+
+  if (!first) {
+    cursor.time += (uint32_t)sample.dt * ring.timeUnit;
+  }
+  point.time = cursor.time;
+  point.voltage = sample.millivolts / 1000.0f;
+  point.percent = sample.percent;
+  point.chargeRate = sample.rate / 2.0f;
+  cursor.seq++;
+  return true;
+}
+
+// Held only for a few loads and stores, never across a callback
+void BatteryHistory::lock() const {
+#ifdef ESP_PLATFORM
+  portENTER_CRITICAL(&mux);
+#else
+  mux.lock();
+#endif
+}
+
+void BatteryHistory::unlock() const {
+#ifdef ESP_PLATFORM
+  portEXIT_CRITICAL(&mux);
+#else
+  mux.unlock();
+#endif
+}
+
+const char* BatteryHistory::resolutionName(HistoryResolution res) {
+  switch (res) {
+    case HISTORY_MINUTE: return "minute";
+    case HISTORY_HOUR: return "hour";
+    case HISTORY_DAY: return "day";
+    default: return "";
+  }
+}
+
+HistoryCsvWriter::HistoryCsvWriter(const BatteryHistory& history, HistoryResolution res)
+    : history(history), res(res), cursor(history.begin(res)), rowLen(0), rowPos(0), headerDone(false) {}
+
+size_t HistoryCsvWriter::fill(uint8_t* buffer, size_t maxLen) {
+  size_t written = 0;
+  while (written < maxLen) {
+    if (rowPos == rowLen && !loadRow()) {
+      break;
+    }
+    size_t n = rowLen - rowPos;
+    if (n > maxLen - written) n = maxLen - written;
+    memcpy(buffer + written, row + rowPos, n);
+    rowPos += n;
+    written += n;
+  }
+  return written;
+}
+
+bool HistoryCsvWriter::loadRow() {
+  rowPos = 0;
+  if (!headerDone) {
+    headerDone = true;
+    rowLen = snprintf(row, sizeof(row), "time,voltage,percent,rate\n");
+    return true;
+  }
+
+  HistoryPoint point;
+  if (!history.next(res, cursor, point)) {
+    rowLen = 0;
+    return false;
+  }
+
+  // Integer formatting only, float printf can allocate
+  unsigned mv = (unsigned)(point.voltage * 1000.0f + 0.5f);
+  int halfSteps = (int)(point.chargeRate * 2.0f);
+  unsigned absSteps = halfSteps < 0 ? -halfSteps : halfSteps;
+  rowLen = snprintf(row, sizeof(row), "%lu,%u.%03u,%u,%s%u.%u\n",
+                    (unsigned long)point.time, mv / 1000, mv % 1000, point.percent,
+                    halfSteps < 0 ? "-" : "", absSteps / 2, (absSteps % 2) * 5);
+  return true;
+}
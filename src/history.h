@@ -0,0 +1,152 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
+#else
+#include <mutex>
+#endif
+
+// Battery telemetry history at several resolutions.
+//
+// Each resolution is a fixed ring of packed 6-byte samples. Samples store
+// the time since the previous sample rather than a timestamp; absolute
+// times are rebuilt while reading from the time of the oldest sample.
+// Minute samples are recorded directly and also averaged into hour and
+// day buckets.
+//
+// Readers address samples by sequence number (count of samples ever
+// written to the ring), so a reader streaming the history while new samples
+// arrive can tell when the ring has overwritten the sample it is about to
+// read and stop instead of returning garbage. The loop task records while
+// the web server's task streams, so each write and each read of a sample
+// with its ring position happens under a short critical section.
+
+struct BatterySample {
+  uint16_t dt;          // Time since previous sample, in the ring's time unit
+  uint16_t millivolts;
+  uint8_t percent;
+  int8_t rate;          // Charge rate in 0.5 %/hr steps
+};
+
+struct HistoryPoint {
+  uint32_t time;        // Epoch seconds
+  float voltage;
+  uint8_t percent;
+  float chargeRate;     // %/hr
+};
+
+enum HistoryResolution { HISTORY_MINUTE, HISTORY_HOUR, HISTORY_DAY, HISTORY_RESOLUTIONS };
+
+// Called with every completed hourly or daily average and the number of
+// readings that went into it
+typedef void (*HistorySampleCallback)(HistoryResolution res, const BatterySample& sample, uint32_t time,
+                                      uint16_t readings);
+
+// Position of a reader inside one ring
+struct HistoryCursor {
+  uint32_t seq;
+  uint32_t time;
+};
+
+class BatteryHistory {
+public:
+  static const uint16_t MINUTE_SAMPLES = 240;  // 4 hours
+  static const uint16_t HOUR_SAMPLES = 168;    // 1 week
+  static const uint16_t DAY_SAMPLES = 90;      // About 3 months
+  static const uint16_t READINGS_PER_HOUR = 60;  // At the expected once a minute
+
+  BatteryHistory();
+
+  // Record one reading, expected about once a minute
+  void record(uint32_t time, float voltage, float percent, float chargeRate);
+
+  // Reload a completed hourly average (e.g. from flash after a reboot) made
+  // of readings readings, 0 if unknown (taken as a full hour). Daily
+  // averages are rebuilt from the restored hours, each weighted by its
+  // readings so a partial hour doesn't count as much as a full one.
+  void restoreHour(uint32_t time, uint16_t millivolts, uint8_t percent, int8_t rate, uint16_t readings);
+
+  void onSample(HistorySampleCallback callback) { sampleCallback = callback; }
+
+  uint16_t count(HistoryResolution res) const;
+
+  // Cursor at the oldest sample still held
+  HistoryCursor begin(HistoryResolution res) const;
+
+  // Read the sample at the cursor and advance. Returns false at the end,
+  // or if the sample was overwritten since the cursor was created.
+  bool next(HistoryResolution res, HistoryCursor& cursor, HistoryPoint& point) const;
+
+  static const char* resolutionName(HistoryResolution res);
+
+private:
+  struct Ring {
+    BatterySample* samples;
+    uint16_t capacity;
+    uint16_t count;
+    uint16_t head;         // Slot the next sample goes into
+    uint16_t timeUnit;     // Seconds per dt step
+    uint32_t total;        // Samples ever written
+    uint32_t oldestTime;   // Epoch seconds of the oldest sample held
+    uint32_t newestTime;
+  };
+
+  // Running average feeding a coarser ring
+  struct Bucket {
+    uint32_t index;        // time / period of the bucket being filled
+    uint32_t period;
+    uint32_t millivolts;
+    uint32_t percent;
+    int32_t rate;
+    uint16_t n;            // Readings so far
+  };
+
+  void push(Ring& ring, uint32_t time, uint16_t millivolts, uint8_t percent, int8_t rate);
+  void accumulate(Bucket& bucket, HistoryResolution res, uint32_t time, uint16_t millivolts, uint8_t percent,
+                  int8_t rate, uint16_t weight);
+  void lock() const;
+  void unlock() const;
+
+  BatterySample minuteSamples[MINUTE_SAMPLES];
+  BatterySample hourSamples[HOUR_SAMPLES];
+  BatterySample daySamples[DAY_SAMPLES];
+  Ring rings[HISTORY_RESOLUTIONS];
+  Bucket hourBucket;
+  Bucket dayBucket;
+  HistorySampleCallback sampleCallback;
+  bool restoring;
+#ifdef ESP_PLATFORM
+  mutable portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+#else
+  mutable std::mutex mux;
+#endif
+};
+
+// Streams one ring as CSV ("time,voltage,percent,rate") in whatever
+// chunk sizes the web server asks for, one row at a time, without copying
+// the history
+class HistoryCsvWriter {
+public:
+  HistoryCsvWriter(const BatteryHistory& history, HistoryResolution res);
+
+  // Fill up to maxLen bytes. Returns 0 once everything has been written.
+  size_t fill(uint8_t* buffer, size_t maxLen);
+
+private:
+  static const uint8_t MAX_ROW = 40;
+
+  bool loadRow();
+
+  const BatteryHistory& history;
+  HistoryResolution res;
+  HistoryCursor cursor;
+  char row[MAX_ROW];
+  uint8_t rowLen;
+  uint8_t rowPos;
+  bool headerDone;
+};
+
+#endif
@@ -0,0 +1,105 @@
+#include "historylog.h"
+#include "crc.h"
+
+bool HistoryLog::begin() {
+  mounted = store.begin();
+  if (!mounted) {
+    return false;
+  }
+
+  // Cut each segment back to its intact records. Only the last append
+  // before power loss can be torn, but anything behind a bad record is
+  // unreachable by replay anyway.
+  size_t sizes[2];
+  uint32_t last[2] = {0, 0};
+  for (uint8_t i = 0; i < 2; i++) {
+    size_t size = store.size(i);
+    sizes[i] = scan(i, nullptr, &last[i]);
+    if (sizes[i] < size && store.truncate(i, sizes[i])) {
+      repaired += size - sizes[i];
+    }
+  }
+
+  // Keep appending to the segment with the newest record. Size can't tell:
+  // both segments are full between the other one filling and the next
+  // append switching over. Switching truncates the new segment, so an
+  // empty one is never newer.
+  if (sizes[0] == 0 || sizes[1] == 0) {
+    active = sizes[1] > 0 ? 1 : 0;
+  } else if (last[0] != last[1]) {
+    active = last[1] > last[0] ? 1 : 0;
+  } else {
+    active = sizes[1] > sizes[0] ? 1 : 0;
+  }
+  return true;
+}
+
+bool HistoryLog::append(const Record& record) {
+  if (!mounted) {
+    return false;
+  }
+
+  if (store.size(active) + sizeof(Stored) > SEGMENT_BYTES) {
+    // Segment full: switch over and start the other one fresh, dropping
+    // the oldest history
+    active ^= 1;
+    if (!store.truncate(active, 0)) {
+      return false;
+    }
+  }
+
+  Stored stored;
+  stored.magic = RECORD_MAGIC;
+  stored.readings = record.readings;
+  stored.time = record.time;
+  stored.millivolts = record.millivolts;
+  stored.percent = record.percent;
+  stored.rate = record.rate;
+  stored.crc = recordCrc(stored);
+  return store.append(active, (const uint8_t*)&stored, sizeof(stored));
+}
+
+// Over the reading, then the reading count if there is one, so records
+// written before the count was kept still check out
+uint16_t HistoryLog::recordCrc(const Stored& stored) {
+  uint32_t crc = crc32(&stored.time, sizeof(Stored) - offsetof(Stored, time));
+  if (stored.readings != 0) {
+    crc = crc32(&stored.readings, 1, crc);
+  }
+  return crc & 0xFFFF;
+}
+
+size_t HistoryLog::scan(uint8_t segment, ReplayCallback callback, uint32_t* lastTime) {
+  Stored chunk[SCAN_RECORDS];
+  size_t offset = 0;
+  while (true) {
+    size_t n = store.read(segment, offset, (uint8_t*)chunk, sizeof(chunk)) / sizeof(Stored);
+    for (size_t i = 0; i < n; i++) {
+      if (chunk[i].magic != RECORD_MAGIC || chunk[i].crc != recordCrc(chunk[i])) {
+        return offset;  // Torn or corrupt, nothing after it can be trusted
+      }
+      if (callback != nullptr) {
+        Record record = {chunk[i].time, chunk[i].millivolts, chunk[i].percent, chunk[i].rate,
+                         chunk[i].readings};
+        callback(record);
+      }
+      if (lastTime != nullptr) {
+        *lastTime = chunk[i].time;
+      }
+      offset += sizeof(Stored);
+    }
+    if (n < SCAN_RECORDS) {
+      return offset;
+    }
+  }
+}
+
+uint32_t HistoryLog::replay(ReplayCallback callback) {
+  if (!mounted) {
+    return 0;
+  }
+  // The inactive segment holds the older records
+  size_t bytes = scan(active ^ 1, callback);
+  bytes += scan(active, callback);
+  return bytes / sizeof(Stored);
+}
@@ -0,0 +1,83 @@
+#ifndef HISTORYLOG_H
+#define HISTORYLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Append-only battery history log.
+//
+// Records go to two segment files used alternately so the log never grows
+// without bound. Every record carries its own CRC. Power lost mid-append
+// can leave a torn record at the end of the active segment; begin() cuts
+// each segment back to its last intact record, so the next append lands on
+// a record boundary instead of behind garbage that would end every later
+// replay.
+
+// Where the segments live: LittleFS on the device (persist.h), memory in
+// the tests
+class LogStore {
+public:
+  virtual ~LogStore() {}
+  virtual bool begin() = 0;  // Mount, formatting if needed
+  virtual size_t size(uint8_t segment) = 0;  // 0 if it doesn't exist
+  virtual size_t read(uint8_t segment, size_t offset, uint8_t* out, size_t length) = 0;
+  virtual bool append(uint8_t segment, const uint8_t* data, size_t length) = 0;
+  virtual bool truncate(uint8_t segment, size_t length) = 0;  // 0 starts it fresh
+};
+
+class HistoryLog {
+public:
+  struct Record {
+    uint32_t time;
+    uint16_t millivolts;
+    uint8_t percent;
+    int8_t rate;
+    uint8_t readings;  // Averaged into the hour, 0 if unknown
+  };
+
+  typedef void (*ReplayCallback)(const Record& record);
+
+  static const size_t SEGMENT_BYTES = 8192;  // About 28 days of hourly records per segment
+
+  explicit HistoryLog(LogStore& store) : store(store) {}
+
+  // Mounts the store, cuts off any torn tail and finds the active segment
+  bool begin();
+
+  bool append(const Record& record);
+
+  // Feed every intact record, oldest first. Returns the number replayed.
+  uint32_t replay(ReplayCallback callback);
+
+  // Bytes cut off torn segment tails by begin()
+  size_t repairedBytes() const { return repaired; }
+
+private:
+  static const uint8_t RECORD_MAGIC = 0xB7;
+
+  struct Stored {
+    uint8_t magic;
+    uint8_t readings;  // 0 in records written before it was kept
+    uint16_t crc;      // Low 16 bits of CRC32, see recordCrc()
+    uint32_t time;
+    uint16_t millivolts;
+    uint8_t percent;
+    int8_t rate;
+  };
+
+  static const size_t SCAN_RECORDS = 32;  // Records per store read while scanning
+
+  static uint16_t recordCrc(const Stored& stored);
+
+  // Walk the run of intact records at the start of a segment, passing each
+  // to callback if there is one. Returns the run's length in bytes; if
+  // lastTime is given it gets the last intact record's time.
+  size_t scan(uint8_t segment, ReplayCallback callback, uint32_t* lastTime = nullptr);
+
+  LogStore& store;
+  bool mounted = false;
+  uint8_t active = 0;
+  size_t repaired = 0;
+};
+
+#endif
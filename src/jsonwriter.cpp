@@ -0,0 +1,141 @@
+#include "jsonwriter.h"
+
+JsonWriter::JsonWriter(char* buffer, size_t capacity)
+    : buf(buffer), cap(capacity), len(0), overflow(capacity == 0), depth(0) {
+  needComma[0] = false;
+  if (cap > 0) {
+    buf[0] = '\0';
+  }
+}
+
+void JsonWriter::beginObject(const char* key) {
+  separator(key);
+  put('{');
+  if (depth + 1 < MAX_DEPTH) {
+    needComma[++depth] = false;
+  }
+}
+
+void JsonWriter::endObject() {
+  put('}');
+  if (depth > 0) depth--;
+}
+
+void JsonWriter::beginArray(const char* key) {
+  separator(key);
+  put('[');
+  if (depth + 1 < MAX_DEPTH) {
+    needComma[++depth] = false;
+  }
+}
+
+void JsonWriter::endArray() {
+  put(']');
+  if (depth > 0) depth--;
+}
+
+void JsonWriter::addInt(const char* key, long value) {
+  separator(key);
+  if (value < 0) {
+    put('-');
+    putUInt(0UL - (unsigned long)value);
+  } else {
+    putUInt((unsigned long)value);
+  }
+}
+
+void JsonWriter::addUInt(const char* key, unsigned long value) {
+  separator(key);
+  putUInt(value);
+}
+
+void JsonWriter::addFloat(const char* key, float value, uint8_t decimals) {
+  separator(key);
+  if (value != value) {  // NaN is not valid JSON
+    put("null");
+    return;
+  }
+
+  unsigned long scale = 1;
+  for (uint8_t i = 0; i < decimals; i++) scale *= 10;
+
+  if (value < 0) {
+    put('-');
+    value = -value;
+  }
+  unsigned long scaled = (unsigned long)(value * scale + 0.5f);
+  putUInt(scaled / scale);
+  if (decimals > 0) {
+    put('.');
+    unsigned long frac = scaled % scale;
+    // Leading zeros of the fractional part
+    for (unsigned long div = scale / 10; div > 1 && frac < div; div /= 10) {
+      put('0');
+    }
+    putUInt(frac);
+  }
+}
+
+void JsonWriter::addBool(const char* key, bool value) {
+  separator(key);
+  put(value ? "true" : "false");
+}
+
+void JsonWriter::addString(const char* key, const char* value) {
+  separator(key);
+  put('"');
+  putEscaped(value != nullptr ? value : "");
+  put('"');
+}
+
+void JsonWriter::separator(const char* key) {
+  if (needComma[depth]) {
+    put(',');
+  }
+  needComma[depth] = true;
+  if (key != nullptr) {
+    put('"');
+    putEscaped(key);
+    put("\":");
+  }
+}
+
+void JsonWriter::put(char c) {
+  if (len + 1 < cap) {
+    buf[len++] = c;
+    buf[len] = '\0';
+  } else {
+    overflow = true;
+  }
+}
+
+void JsonWriter::put(const char* s) {
+  while (*s) put(*s++);
+}
+
+void JsonWriter::putEscaped(const char* s) {
+  static const char hex[] = "0123456789abcdef";
+  for (; *s; s++) {
+    char c = *s;
+    if (c == '"' || c == '\\') {
+      put('\\');
+      put(c);
+    } else if ((uint8_t)c < 0x20) {
+      put("\\u00");
+      put(hex[(c >> 4) & 0xF]);
+      put(hex[c & 0xF]);
+    } else {
+      put(c);
+    }
+  }
+}
+
+void JsonWriter::putUInt(unsigned long value) {
+  char digits[20];
+  uint8_t n = 0;
+  do {
+    digits[n++] = '0' + (value % 10);
+    value /= 10;
+  } while (value > 0);
+  while (n > 0) put(digits[--n]);
+}
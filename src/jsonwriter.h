@@ -0,0 +1,50 @@
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Minimal JSON writer that formats into a caller-supplied buffer.
+//
+// Never allocates: numbers are formatted by hand (newlib's float printf
+// can allocate) and output that does not fit is truncated and flagged via
+// overflowed(). The buffer is always NUL terminated.
+
+class JsonWriter {
+public:
+  JsonWriter(char* buffer, size_t capacity);
+
+  void beginObject(const char* key = nullptr);
+  void endObject();
+  void beginArray(const char* key = nullptr);
+  void endArray();
+
+  // Pass key = nullptr for array elements
+  void addInt(const char* key, long value);
+  void addUInt(const char* key, unsigned long value);
+  void addFloat(const char* key, float value, uint8_t decimals);
+  void addBool(const char* key, bool value);
+  void addString(const char* key, const char* value);
+
+  const char* c_str() const { return buf; }
+  size_t length() const { return len; }
+  bool overflowed() const { return overflow; }
+
+private:
+  static const uint8_t MAX_DEPTH = 8;
+
+  void separator(const char* key);
+  void put(char c);
+  void put(const char* s);
+  void putEscaped(const char* s);
+  void putUInt(unsigned long value);
+
+  char* buf;
+  size_t cap;
+  size_t len;
+  bool overflow;
+  uint8_t depth;
+  bool needComma[MAX_DEPTH];
+};
+
+#endif
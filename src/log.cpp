@@ -0,0 +1,115 @@
+#include "log.h"
+#include <Arduino.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+
+static const size_t TAIL_BYTES = 2048;  // Recent output kept for /api/log
+
+static LogRing ring;
+static TaskHandle_t drainTaskHandle = nullptr;
+static std::atomic<bool> draining(false);
+
+// Recent output, written by the drain task and read by /api/log
+static char tail[TAIL_BYTES];
+static size_t tailWritten = 0;  // Total bytes ever written
+static SemaphoreHandle_t tailMutex = nullptr;
+
+static void appendTail(const char* text, size_t length) {
+  xSemaphoreTake(tailMutex, portMAX_DELAY);
+  for (size_t i = 0; i < length; i++) {
+    tail[(tailWritten + i) % TAIL_BYTES] = text[i];
+  }
+  tailWritten += length;
+  xSemaphoreGive(tailMutex);
+}
+
+static void output(const char* text, size_t length) {
+  Serial.write((const uint8_t*)text, length);
+  // Telemetry frames start with a zero byte, text never does
+  if (length > 0 && text[0] != '\0') {
+    appendTail(text, length);
+  }
+}
+
+static void drainTask(void* param) {
+  char line[LogRing::LINE_BYTES];
+  for (;;) {
+    draining.store(true);
+    uint32_t lost = ring.takeDropped();
+    if (lost > 0) {
+      int length = snprintf(line, sizeof(line), "(%lu log lines dropped)\n", (unsigned long)lost);
+      output(line, length);
+    }
+    size_t length;
+    while ((length = ring.pop(line, sizeof(line))) > 0) {
+      output(line, length);
+    }
+    draining.store(false);
+
+    // Producers notify after publishing, so nothing is missed in between
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  }
+}
+
+void logBegin() {
+  if (drainTaskHandle != nullptr) {
+    return;
+  }
+  tailMutex = xSemaphoreCreateMutex();
+  // Just above idle, so logging only uses time nothing else wants
+  xTaskCreate(drainTask, "log", 3072, nullptr, tskIDLE_PRIORITY + 1, &drainTaskHandle);
+}
+
+void logWrite(uint8_t level, const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  ring.push(level, millis(), format, args);
+  va_end(args);
+
+  if (drainTaskHandle != nullptr) {
+    xTaskNotifyGive(drainTaskHandle);
+  }
+}
+
+void logWriteFrame(const uint8_t* frame, size_t length) {
+  ring.pushRaw(frame, length);
+  if (drainTaskHandle != nullptr) {
+    xTaskNotifyGive(drainTaskHandle);
+  }
+}
+
+void logFlush() {
+  if (drainTaskHandle == nullptr) {
+    return;
+  }
+  // Bounded, in case a producer stalled mid-line
+  for (int i = 0; i < 100 && (!ring.empty() || draining.load()); i++) {
+    vTaskDelay(pdMS_TO_TICKS(5));
+  }
+  Serial.flush();
+}
+
+size_t logTail(char* buffer, size_t size) {
+  if (tailMutex == nullptr || size == 0) {
+    return 0;
+  }
+
+  xSemaphoreTake(tailMutex, portMAX_DELAY);
+  size_t available = tailWritten < TAIL_BYTES ? tailWritten : TAIL_BYTES;
+  size_t length = available < size ? available : size;
+  size_t start = tailWritten - length;
+  for (size_t i = 0; i < length; i++) {
+    buffer[i] = tail[(start + i) % TAIL_BYTES];
+  }
+  xSemaphoreGive(tailMutex);
+
+  // Drop the partial line at the front
+  size_t skip = 0;
+  if (start > 0) {
+    while (skip < length && buffer[skip++] != '\n') {}
+  }
+  memmove(buffer, buffer + skip, length - skip);
+  return length - skip;
+}
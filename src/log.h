@@ -0,0 +1,126 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// Buffered, level-filtered logging.
+//
+// LOG_ERROR/LOG_WARN/LOG_INFO/LOG_DEBUG format a line into a slot of a
+// lock-free ring and return; a low-priority task writes the slots to the
+// serial port, so a full UART FIFO stalls that task instead of the caller.
+// Levels above LOG_LEVEL compile to nothing, arguments included. Set it
+// with e.g. -DLOG_LEVEL=LOG_LEVEL_DEBUG in build_flags.
+//
+// Formatting is done here rather than by printf, which can allocate for
+// floats. Supported: %d %i %u %x %c %s %% with l/ll, width and 0 padding,
+// and %f with a precision.
+//
+// When the ring is full new lines are dropped and counted; the drain task
+// reports how many were lost.
+//
+// The formatting and the ring are in logring.cpp and build for the host;
+// log.cpp has the drain task and the serial port.
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) logWrite(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) logWrite(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) logWrite(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) logWrite(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while (0)
+#endif
+
+// Format printf-style into buffer, always terminated. Returns the length
+// written.
+size_t logFormat(char* buffer, size_t size, const char* format, va_list args);
+
+// Multi-producer, single-consumer ring of fixed-size line slots. Each slot
+// carries a sequence number that tells producers and the consumer whose
+// turn it is, so neither side ever takes a lock.
+class LogRing {
+public:
+  static const uint8_t SLOTS = 32;          // Power of two
+  static const uint8_t LINE_BYTES = 120;    // Including the newline
+
+  LogRing();
+
+  // Claim a slot, format the line into it and publish it. Returns false
+  // (and counts a drop) if the ring is full.
+  bool push(uint8_t level, uint32_t timeMs, const char* format, va_list args);
+
+  // Queue bytes as they are, e.g. a binary frame. False if the ring is
+  // full or they don't fit in a slot.
+  bool pushRaw(const uint8_t* data, size_t length);
+
+  // Copy out the oldest line. Returns its length, 0 if the ring is empty.
+  size_t pop(char* line, size_t size);
+
+  // Nothing claimed that hasn't been drained
+  bool empty() const { return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire); }
+
+  // Lines dropped since the last call
+  uint32_t takeDropped() { return dropped.exchange(0, std::memory_order_relaxed); }
+
+private:
+  struct Slot {
+    std::atomic<uint32_t> sequence;
+    uint8_t length;
+    char text[LINE_BYTES];
+  };
+
+  Slot slots[SLOTS];
+  std::atomic<uint32_t> head;   // Next position to claim
+  std::atomic<uint32_t> tail;   // Next position to drain, written by the consumer only
+  std::atomic<uint32_t> dropped;
+
+  // Claim the slot for the next position, nullptr if the ring is full
+  Slot* claim(uint32_t& pos);
+};
+
+// Start the drain task. Lines logged before this are kept until it runs.
+void logBegin();
+
+// Queue a line. Safe from any task, not from interrupts.
+void logWrite(uint8_t level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+// Queue a binary telemetry frame (telemetry.h) in line with the text, so
+// the two never interleave mid-line. Frames go to the UART only, not to
+// logTail().
+void logWriteFrame(const uint8_t* frame, size_t length);
+
+// Wait until everything queued has gone out of the UART (before sleeping)
+void logFlush();
+
+// Copy the most recent output, starting at a line boundary. Returns the
+// length copied.
+size_t logTail(char* buffer, size_t size);
+
+#endif
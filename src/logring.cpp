@@ -0,0 +1,218 @@
+#include "log.h"
+#include <stdio.h>
+#include <string.h>
+
+// Output cursor that silently stops at the end of the buffer
+struct LogOutput {
+  char* pos;
+  char* end;
+
+  void put(char c) {
+    if (pos < end) *pos++ = c;
+  }
+  void puts(const char* s, int precision) {
+    while (*s && precision-- != 0) put(*s++);
+  }
+};
+
+static void formatUnsigned(LogOutput& out, unsigned long long value, unsigned base,
+                           bool negative, int width, bool zeroPad) {
+  char digits[24];
+  int n = 0;
+  do {
+    unsigned d = value % base;
+    digits[n++] = d < 10 ? '0' + d : 'a' + d - 10;
+    value /= base;
+  } while (value > 0);
+
+  int length = n + (negative ? 1 : 0);
+  if (!zeroPad) {
+    for (; length < width; length++) out.put(' ');
+  }
+  if (negative) out.put('-');
+  if (zeroPad) {
+    for (; length < width; length++) out.put('0');
+  }
+  while (n > 0) out.put(digits[--n]);
+}
+
+static void formatFloat(LogOutput& out, double value, int precision, int width, bool zeroPad) {
+  if (value != value) {
+    out.puts("nan", -1);
+    return;
+  }
+  bool negative = value < 0;
+  if (negative) value = -value;
+  if (value > 1e18) {
+    out.puts(negative ? "-inf" : "inf", -1);
+    return;
+  }
+  if (precision > 9) precision = 9;
+
+  unsigned long long scale = 1;
+  for (int i = 0; i < precision; i++) scale *= 10;
+  unsigned long long fixed = (unsigned long long)(value * scale + 0.5);
+  unsigned long long whole = fixed / scale;
+  unsigned long long fraction = fixed % scale;
+
+  // Width covers the whole field, so pad the integer part for it
+  int intWidth = width - (precision > 0 ? precision + 1 : 0);
+  formatUnsigned(out, whole, 10, negative && fixed > 0, intWidth, zeroPad);
+  if (precision > 0) {
+    out.put('.');
+    formatUnsigned(out, fraction, 10, false, precision, true);
+  }
+}
+
+size_t logFormat(char* buffer, size_t size, const char* format, va_list args) {
+  if (size == 0) {
+    return 0;
+  }
+  LogOutput out = {buffer, buffer + size - 1};
+
+  for (const char* p = format; *p; p++) {
+    if (*p != '%') {
+      out.put(*p);
+      continue;
+    }
+    p++;
+
+    bool zeroPad = false;
+    if (*p == '0') {
+      zeroPad = true;
+      p++;
+    }
+    int width = 0;
+    while (*p >= '0' && *p <= '9') {
+      width = width * 10 + (*p++ - '0');
+    }
+    int precision = -1;
+    if (*p == '.') {
+      precision = 0;
+      p++;
+      while (*p >= '0' && *p <= '9') {
+        precision = precision * 10 + (*p++ - '0');
+      }
+    }
+    int longs = 0;
+    while (*p == 'l') {
+      longs++;
+      p++;
+    }
+
+    switch (*p) {
+      case 'd':
+      case 'i': {
+        long long value = longs >= 2 ? va_arg(args, long long) : longs == 1 ? va_arg(args, long) : va_arg(args, int);
+        unsigned long long magnitude = value < 0 ? 0ULL - (unsigned long long)value : value;
+        formatUnsigned(out, magnitude, 10, value < 0, width, zeroPad);
+        break;
+      }
+      case 'u':
+      case 'x': {
+        unsigned long long value = longs >= 2 ? va_arg(args, unsigned long long)
+                                   : longs == 1 ? va_arg(args, unsigned long) : va_arg(args, unsigned);
+        formatUnsigned(out, value, *p == 'x' ? 16 : 10, false, width, zeroPad);
+        break;
+      }
+      case 'f':
+        formatFloat(out, va_arg(args, double), precision < 0 ? 6 : precision, width, zeroPad);
+        break;
+      case 'c':
+        out.put((char)va_arg(args, int));
+        break;
+      case 's': {
+        const char* s = va_arg(args, const char*);
+        out.puts(s != nullptr ? s : "(null)", precision);
+        break;
+      }
+      case '%':
+        out.put('%');
+        break;
+      case '\0':
+        p--;  // Stray % at the end
+        break;
+      default:
+        out.put('%');
+        out.put(*p);
+        break;
+    }
+  }
+
+  *out.pos = '\0';
+  return out.pos - buffer;
+}
+
+LogRing::LogRing() : head(0), tail(0), dropped(0) {
+  for (uint8_t i = 0; i < SLOTS; i++) {
+    slots[i].sequence.store(i, std::memory_order_relaxed);
+    slots[i].length = 0;
+  }
+}
+
+LogRing::Slot* LogRing::claim(uint32_t& pos) {
+  // A slot is free for position pos when its sequence equals pos, and
+  // holds a line for the consumer when it equals pos + 1
+  pos = head.load(std::memory_order_relaxed);
+  for (;;) {
+    Slot* slot = &slots[pos & (SLOTS - 1)];
+    int32_t diff = (int32_t)(slot->sequence.load(std::memory_order_acquire) - pos);
+    if (diff == 0) {
+      if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        return slot;
+      }
+    } else if (diff < 0) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    } else {
+      pos = head.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+bool LogRing::push(uint8_t level, uint32_t timeMs, const char* format, va_list args) {
+  uint32_t pos;
+  Slot* slot = claim(pos);
+  if (slot == nullptr) {
+    return false;
+  }
+
+  static const char LEVEL_TAGS[] = "-EWID";
+  int prefix = snprintf(slot->text, LINE_BYTES, "%lu.%03lu %c ", (unsigned long)(timeMs / 1000),
+                        (unsigned long)(timeMs % 1000), LEVEL_TAGS[level <= LOG_LEVEL_DEBUG ? level : 0]);
+  size_t length = prefix + logFormat(slot->text + prefix, LINE_BYTES - prefix - 1, format, args);
+  slot->text[length++] = '\n';
+  slot->length = length;
+
+  slot->sequence.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
+bool LogRing::pushRaw(const uint8_t* data, size_t length) {
+  if (length > LINE_BYTES) {
+    return false;
+  }
+  uint32_t pos;
+  Slot* slot = claim(pos);
+  if (slot == nullptr) {
+    return false;
+  }
+  memcpy(slot->text, data, length);
+  slot->length = length;
+  slot->sequence.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
+size_t LogRing::pop(char* line, size_t size) {
+  uint32_t pos = tail.load(std::memory_order_relaxed);
+  Slot& slot = slots[pos & (SLOTS - 1)];
+  if (slot.sequence.load(std::memory_order_acquire) != pos + 1) {
+    return 0;  // Empty, or the next line is still being written
+  }
+
+  size_t length = slot.length < size ? slot.length : size;
+  memcpy(line, slot.text, length);
+  slot.sequence.store(pos + SLOTS, std::memory_order_release);
+  tail.store(pos + 1, std::memory_order_release);
+  return length;
+}
@@ -1,146 +1,330 @@
 #include <Arduino.h>
 #include <WiFi.h>
+#include <WiFiUdp.h>
+#include <ESPmDNS.h>
 #include <time.h>
+#include <driver/gpio.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 #include <Adafruit_GFX.h>
 #include "Adafruit_LEDBackpack.h"
 #include "config.h"
 #include <ESPAsyncWebServer.h>
 #include "webpage.h"
-#include <Adafruit_MAX1704X.h>
-
-// Create display object
-Adafruit_7segment display = Adafruit_7segment();
-
-// Create MAX17048 fuel gauge object
-Adafruit_MAX17048 fuelGauge;
+#include "etag.h"
+#include "scheduler.h"
+#include "netconn.h"
+#include "wifi_backend.h"
+#include "jsonwriter.h"
+#include "countdown.h"
+#include "esp32_hal.h"
+#include "power.h"
+#include "history.h"
+#include "persist.h"
+#include "drift.h"
+#include "status.h"
+#include "seqlock.h"
+#include "metrics.h"
+#include "log.h"
+#include "battery.h"
+#include "targets.h"
+#include "settings.h"
+#include "ota.h"
+#include "firmware_slot.h"
+#include "animation.h"
+#include "beacon.h"
+#include "boottime.h"
+#include "telemetry.h"
+#include "brightness.h"
+#include "responsebuf.h"
+
+// Hardware, reached through the HAL interfaces in hal.h. The display
+// driver only sends changed digits over I2C.
+Ht16k33Display ht16k33;
+Max17048FuelGauge max17048;
+Esp32Clock esp32Clock;
+DisplayBackend& display = ht16k33;
+FuelGaugeBackend& fuelGauge = max17048;
+ClockBackend& sysClock = esp32Clock;
+bool hasFuelGauge = false;
+
+// Battery history at minute/hour/day resolution for /api/history,
+// with hourly averages persisted to flash
+BatteryHistory batteryHistory;
+LittleFsLogStore historyStore;
+HistoryLog historyLog(historyStore);
 
 // Create web server
 AsyncWebServer server(80);
-
-// Track last time we printed network info
-unsigned long lastNetworkInfoTime = 0;
-const unsigned long networkInfoInterval = 300000;  // 5 minutes in milliseconds
+bool webServerStarted = false;
+const size_t statusJsonSize = 1536;  // Room for /api/status with plenty of headroom
+const size_t logTailSize = 2048;     // Bytes of recent output served by /api/log
+const size_t settingsJsonSize = 1024;  // /api/config with every network slot in use
+
+// Bodies of the formatted-in-one-go endpoints, held until each response
+// has been sent
+ResponseBufferPool responseBuffers;
+static_assert(statusJsonSize <= ResponseBuffer::SIZE && logTailSize <= ResponseBuffer::SIZE &&
+              settingsJsonSize <= ResponseBuffer::SIZE, "Response buffers too small");
+
+// Push channel for the web page: the full status on connect, then only
+// the fields that changed
+AsyncEventSource events("/events");
+const size_t maxEventClients = 4;        // Each client holds a socket and a send queue
+const size_t maxEventBacklog = 4;        // Queued messages per client before we hold off
+const size_t statusEventSize = 384;      // The status fields alone, no diagnostics
+StatusSnapshot lastSentStatus;           // What the connected clients have been told
+uint32_t lastEventId = 0;
+
+// Loop phase and web request timings for /api/metrics
+Metrics metrics;
+uint32_t wifiDisconnects = 0;
+
+// Fleet discovery: mDNS once WiFi is up, and a status beacon over UDP
+// on every change when beaconHost is set
+WiFiUDP beaconSocket;
+Beacon lastBeacon = {};            // What the collector was last sent
+bool beaconSent = false;
+uint16_t beaconSequence = 0;
+unsigned long lastBeaconTime = 0;
+const unsigned long beaconCheckInterval = 1000;       // Look for changes worth a packet
+const unsigned long beaconHeartbeatInterval = 300000; // Send at least every 5 minutes
+
+// Runtime settings (networks, time zone, brightness schedule, battery cutoff),
+// loaded from NVS once at boot. The loop task owns this copy; /api/config
+// reads the published one and submits changes through the other.
+Settings settings;
+Seqlock<Settings> submittedSettings;  // Written by the web server only
+Seqlock<Settings> publishedSettings;  // Written by the loop task only
+
+// Non-blocking WiFi/NTP connection manager
+WiFiNetworkBackend wifiBackend;
+NetworkManager network(wifiBackend);
+NetworkCredentials networkList[Settings::MAX_NETWORKS];
+
+// Hot state kept in RTC memory across deep sleep (last sync, last good
+// network, last battery reading)
+RtcState rtcState;
+
+// Task scheduler - every periodic job runs at its own cadence
+Scheduler scheduler;
+int displayTaskId = -1;
+int batteryTaskId = -1;
+int networkTaskId = -1;
+int ntpTaskId = -1;
+int statusReportTaskId = -1;
+int networkReportTaskId = -1;
+int historyTaskId = -1;
+int eventsTaskId = -1;
+int beaconTaskId = -1;
+
+const unsigned long displayTickInterval = 500;      // Fast enough to blink the colon on Christmas
+const unsigned long lowPowerDisplayTickInterval = 1000;
+const unsigned long batteryPollInterval = 30000;    // 30 seconds at first, then follows the charge rate
+const unsigned long statusReportInterval = 60000;   // 1 minute
+const unsigned long historyInterval = 60000;        // 1 minute, finest history resolution
+const unsigned long networkInfoInterval = 300000;   // 5 minutes in milliseconds
+const unsigned long eventsInterval = 1000;          // Check for status changes to push
+const unsigned long timeRetryInterval = 60000;      // Retry sync after 1 minute while time is invalid
+
+// Power accounting for duty cycle and battery life estimates
+PowerModel powerModel;
+unsigned long lastPowerAccountTime = 0;
+const unsigned long minLightSleepMs = 20;  // Shorter waits aren't worth sleeping for
+const float nominalLowPowerAwakeDuty = 0.01f;  // Projection for low-power mode when not running it
+const unsigned long nominalRadioOnPerSyncMs = 10000;
 
 // Track last NTP sync time
 unsigned long lastNtpSyncTime = 0;
-const unsigned long ntpSyncInterval = 3600000;  // 1 hour in milliseconds
+const unsigned long ntpSyncInterval = 3600000;       // Minimum: 1 hour in milliseconds
+const unsigned long maxNtpSyncInterval = 86400000;   // Maximum: 1 day in milliseconds
+const float maxClockError = 1.0f;                    // Seconds of predicted drift before resyncing
+
+// RTC drift estimate, used to space NTP syncs as far apart as the clock allows
+DriftEstimator drift;
 
 // Track if we have valid time
 bool hasValidTime = false;
 
-// Global variables for countdown info
-int g_daysUntilChristmas = 0;
-int g_currentYear = 0;
-int g_currentMonth = 0;
-int g_currentDay = 0;
-int g_currentHour = 0;
-int g_currentMin = 0;
-int g_currentSec = 0;
-int g_christmasYear = 0;
-float g_batteryVoltage = 0.0;
-int g_batteryPercent = 0;
-String g_batteryStatus = "Unknown";
-float g_batteryChargeRate = 0.0;
-
-// Low battery protection
-#define LOW_BATTERY_VOLTAGE 3.0  // Voltage threshold for low battery
-#define LOW_BATTERY_PERCENT 5    // Percentage threshold for low battery
-
-// Function to try connecting to WiFi and syncing time
-void tryWifiAndNtpSync() {
-  // Check if we're already connected
-  if (WiFi.status() == WL_CONNECTED) {
-    // Already connected, just sync time
-    Serial.println("Re-syncing time from NTP...");
-    configTime(gmtOffset_sec, daylightOffset_sec, ntpServer);
-    delay(2000);  // Give it a moment to sync
-
-    struct tm timeinfo;
-    if (getLocalTime(&timeinfo)) {
-      Serial.println("Time re-synchronized!");
-      Serial.println(&timeinfo, "%A, %B %d %Y %H:%M:%S");
-      hasValidTime = true;
-      lastNtpSyncTime = millis();
-    } else {
-      Serial.println("NTP sync failed, will retry later");
-    }
-    return;
-  }
-
-  // Not connected, try to connect
-  Serial.println("\nAttempting to connect to WiFi...");
-
-  for (int i = 0; i < numNetworks; i++) {
-    Serial.print("Trying network: ");
-    Serial.println(wifiNetworks[i].ssid);
-
-    WiFi.begin(wifiNetworks[i].ssid, wifiNetworks[i].password);
+// Countdown, time and battery info. The loop task updates g_status and
+// publishes it whole; web handlers only ever read the published copy.
+StatusSnapshot g_status = {};
+Seqlock<StatusSnapshot> publishedStatus;
+
+// Countdown targets. The loop task owns the table of upcoming events;
+// /api/targets hands it new lists through one Seqlock and reads the current
+// list back from another.
+TargetTable targetTable;
+Seqlock<TargetList> submittedTargets;   // Written by the web server only
+Seqlock<TargetList> configuredTargets;  // Written by the loop task only
+const size_t targetsTextSize = 1024;               // Largest /api/targets body, 32 targets fit
+static_assert(targetsTextSize <= ResponseBuffer::SIZE, "Response buffers too small");
+const unsigned long targetRotateInterval = 8000;   // Time each event stays on the display, name and count
+
+// Startup timings for /api/status, and the count a boot puts straight
+// back on the display
+BootTimeline bootTimeline;
+CountCache countCache = {};
+bool showingCachedCount = false;  // Until the clock gives us the real one
+
+// Filtered fuel gauge readings
+BatteryMonitor batteryMonitor;
+
+// Firmware updates through /update. The web server's task owns the
+// upload; only one runs at a time, and the loop task restarts into the
+// new firmware once it's in place.
+EspFirmwareSlot firmwareSlot;
+OtaUpdate otaUpdate(firmwareSlot);
+AsyncWebServerRequest* otaOwner = nullptr;  // The request whose upload is being written
+volatile bool restartPending = false;       // Set by /update after a good image
+const uint8_t otaMinBatteryPercent = 30;    // Flash writes on a sagging battery risk a brownout
+
+// A freshly installed firmware stays on probation until it has run for a
+// while and reached the network; otherwise the bootloader goes back to
+// the previous one
+FirmwareHealth firmwareHealth(firmwareSlot);
+
+// Text and fades on the display. A hardware timer marks each frame due
+// and wakes the loop task, which draws it, so frames keep their pace
+// whatever else the loop is doing and the timer only runs while something
+// is animating.
+Animator animator;
+esp_timer_handle_t frameTimer = nullptr;
+TaskHandle_t loopTaskHandle = nullptr;
+volatile bool framePending = false;  // Set by the frame timer
+bool frameTimerRunning = false;
+
+// Brightness schedule (brightness.h): quiet hours, battery dimming and
+// the light sensor pick a level and the display fades to it. The meter
+// estimates what the LEDs draw, for /api/status.
+BrightnessScheduler brightnessScheduler;
+LedPowerMeter ledPower;
+int8_t displayLevel = 15;        // What the display is set to, BRIGHTNESS_OFF when blanked
+bool blankAfterFade = false;     // Turn the display off once it has faded to 0
+int16_t ambientLight = -1;       // Filtered light sensor reading, 0-1000
+const int16_t ambientSmoothing = 8;  // Readings averaged over, roughly
+
+// Low battery protection. The fuel gauge raises an alert at the
+// thresholds in settings; the device cuts off once the filtered readings
+// confirm it.
+volatile bool batteryAlertPending = false;  // Set from the ALRT pin interrupt
+bool lowBatteryAlert = false;               // Latched until the battery recovers
+
+void markBoot(BootPhase phase) {
+  bootTimeline.mark(phase, sysClock.monotonicUs());
+}
 
-    int attempts = 0;
-    int maxAttempts = 10;  // 5 seconds per network
+// Send the frame to the display, timing the I2C write
+void refreshDisplay() {
+  uint32_t start = sysClock.cycleCount();
+  display.refresh();
+  metrics.recordPhase(PHASE_DISPLAY, sysClock.cycleCount() - start);
+  ledPower.update(sysClock.millis(), display.litSegments(), displayLevel);
+}
 
-    while (WiFi.status() != WL_CONNECTED && attempts < maxAttempts) {
-      delay(500);
-      Serial.print(".");
-      attempts++;
+// Set the display to level, or blank it for BRIGHTNESS_OFF
+void setDisplayLevel(int8_t level) {
+  if (level == BRIGHTNESS_OFF) {
+    display.setPower(false);
+  } else {
+    if (displayLevel == BRIGHTNESS_OFF) {
+      display.setPower(true);
     }
+    display.setBrightness(level);
+  }
+  displayLevel = level;
+  ledPower.update(sysClock.millis(), display.litSegments(), level);
+}
 
-    if (WiFi.status() == WL_CONNECTED) {
-      Serial.println("\nWiFi reconnected!");
-      Serial.print("Connected to: ");
-      Serial.println(wifiNetworks[i].ssid);
-      Serial.print("IP address: ");
-      Serial.println(WiFi.localIP());
-
-      // Now sync time
-      Serial.println("Getting time from NTP server...");
-      configTime(gmtOffset_sec, daylightOffset_sec, ntpServer);
+void onFrameTimer(void* arg) {
+  framePending = true;
+  xTaskNotifyGive(loopTaskHandle);
+}
 
-      struct tm timeinfo;
-      int retries = 0;
-      while (!getLocalTime(&timeinfo) && retries < 20) {
-        delay(500);
-        retries++;
-      }
+// Copy an animation frame to the display, around the colon
+void showFrame(const Frame& frame) {
+  static const uint8_t positions[Frame::DIGITS] = {0, 1, 3, 4};
+  for (uint8_t i = 0; i < Frame::DIGITS; i++) {
+    display.showSegments(positions[i], frame.digits[i]);
+  }
+  display.showColon(frame.colon);
+}
 
-      if (retries < 20) {
-        Serial.println("Time synchronized!");
-        Serial.println(&timeinfo, "%A, %B %d %Y %H:%M:%S");
-        hasValidTime = true;
-        lastNtpSyncTime = millis();
-      }
+void startAnimation() {
+  if (frameTimer == nullptr) {
+    animator.stopText();  // No timer to step it, don't hide the count forever
+    return;
+  }
+  if (!frameTimerRunning) {
+    esp_timer_start_periodic(frameTimer, Animator::FRAME_MS * 1000ULL);
+    frameTimerRunning = true;
+  }
+}
 
-      return;
-    } else {
-      Serial.println("\nFailed to connect");
-      WiFi.disconnect();
-    }
+// Draw the next frame if the timer says it's due
+void animationFrame() {
+  if (!framePending) {
+    return;
+  }
+  framePending = false;
+  bool wasShowingText = animator.showingText();
+  uint8_t changes = animator.step();
+  if (changes & Animator::CHANGED_BRIGHTNESS) {
+    setDisplayLevel(animator.brightness());
+  }
+  if (blankAfterFade && !animator.fading()) {
+    blankAfterFade = false;
+    setDisplayLevel(BRIGHTNESS_OFF);
+  }
+  if (changes & Animator::CHANGED_FRAME) {
+    showFrame(animator.frame());
+    refreshDisplay();
+  }
+  if (wasShowingText && !animator.showingText()) {
+    scheduler.runAfter(displayTaskId, sysClock.millis(), 0);  // Back to the count
   }
+  if (!animator.active()) {
+    esp_timer_stop(frameTimer);
+    frameTimerRunning = false;
+  }
+}
 
-  Serial.println("Could not connect to any WiFi network, will retry later");
+// Run the current animation to its end before carrying on
+void playAnimation() {
+  startAnimation();
+  while (frameTimerRunning) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    animationFrame();
+  }
 }
 
 // Function to enter deep sleep mode
 void enterDeepSleep() {
-  Serial.println("\n!!! LOW BATTERY WARNING !!!");
-  Serial.println("Battery critically low - entering deep sleep to protect battery");
-  Serial.print("Voltage: ");
-  Serial.print(g_batteryVoltage, 2);
-  Serial.println("V");
-  Serial.print("Percent: ");
-  Serial.print(g_batteryPercent);
-  Serial.println("%");
-
-  // Show error on display
-  display.clear();
-  display.print(0xDEAD);  // Show "dead" pattern
-  display.writeDisplay();
-  delay(2000);
+  LOG_ERROR("!!! LOW BATTERY WARNING !!!");
+  LOG_ERROR("Battery critically low - entering deep sleep to protect battery");
+  LOG_ERROR("Voltage: %.2fV, percent: %u%%", g_status.batteryVoltage, g_status.batteryPercent);
+
+  // Say why on the display, then fade it out. Quiet hours or not, this
+  // is worth lighting the display for.
+  blankAfterFade = false;
+  if (displayLevel == BRIGHTNESS_OFF) {
+    setDisplayLevel(0);
+  }
+  animator.showText("LO bAt", 2);
+  playAnimation();
+  animator.fade(displayLevel, 0);
+  playAnimation();
   display.clear();
-  display.writeDisplay();
+  display.refresh();
+
+  LOG_INFO("Device will wake when USB power is connected or after deep sleep timer");
+  logFlush();
 
-  Serial.println("Device will wake when USB power is connected or after deep sleep timer");
-  Serial.flush();
+  // Keep what we know for the next wake
+  rtcState.batteryMillivolts = g_status.batteryVoltage * 1000;
+  rtcState.batteryPercent = g_status.batteryPercent;
+  saveRtcState(rtcState);
 
   // Configure wake on USB power detection (if supported) or timer
   // Wake up every hour to check if power has been restored
@@ -150,332 +334,1506 @@ void enterDeepSleep() {
   esp_deep_sleep_start();
 }
 
-// Function to read battery status from MAX17048
-void updateBatteryStatus() {
-  // Read voltage from fuel gauge
-  g_batteryVoltage = fuelGauge.cellVoltage();
+void IRAM_ATTR onBatteryAlert() {
+  batteryAlertPending = true;
+}
 
-  // Read state of charge percentage (more accurate than voltage-based calculation)
-  g_batteryPercent = (int)fuelGauge.cellPercent();
+// Binary telemetry on the serial port, next to the text log (see
+// telemetry.h). Only built when serialTelemetry is on.
+void sendTelemetry(TelemetryFrame& frame) {
+  uint8_t out[TELEMETRY_MAX_FRAME];
+  size_t length = frame.finish(out, sizeof(out));
+  if (length > 0) {
+    logWriteFrame(out, length);
+  }
+}
 
-  // Read charge rate (positive = charging, negative = discharging)
-  g_batteryChargeRate = fuelGauge.chargeRate();
+void sendTickTelemetry(unsigned long now) {
+  bool online = WiFi.status() == WL_CONNECTED;
+  TelemetryFrame frame(TELEMETRY_TICK, now);
+  frame.u32(hasValidTime ? sysClock.epoch() : 0);
+  frame.i16(g_status.days);
+  frame.u16(g_status.batteryVoltage * 1000.0f + 0.5f);
+  frame.u8(g_status.batteryPercent);
+  frame.u8(g_status.batteryStatus);
+  frame.i8(online ? WiFi.RSSI() : 0);
+  frame.u8((hasValidTime ? TICK_TIME_VALID : 0) | (online ? TICK_WIFI : 0) | (lowPowerMode ? TICK_LOW_POWER : 0) |
+           (lowBatteryAlert ? TICK_LOW_BATTERY : 0));
+  sendTelemetry(frame);
+}
 
-  // Determine charging status based on charge rate and voltage
-  if (g_batteryChargeRate > 0.1) {
-    // Positive charge rate = charging
-    if (g_batteryPercent >= 99) {
-      g_batteryStatus = "Charged";
-    } else {
-      g_batteryStatus = "Charging";
-    }
-  } else if (g_batteryChargeRate < -0.1) {
-    // Negative charge rate = discharging
-    g_batteryStatus = "Discharging";
-  } else {
-    // Near-zero charge rate
-    if (g_batteryPercent >= 95 && g_batteryVoltage >= 4.1) {
-      g_batteryStatus = "Charged";
-    } else {
-      g_batteryStatus = "On Battery";
+void sendBatteryTelemetry(const FuelGaugeReading& reading) {
+  TelemetryFrame frame(TELEMETRY_BATTERY, sysClock.millis());
+  frame.u16(reading.voltage * 1000.0f + 0.5f);
+  frame.u16(reading.percent * 100.0f + 0.5f);
+  frame.i16(reading.chargeRate * 100.0f);
+  frame.u8(batteryMonitor.state());
+  frame.u8(reading.alerts);
+  sendTelemetry(frame);
+}
+
+void sendNetworkTelemetry(NetworkEvent event, int index) {
+  TelemetryFrame frame(TELEMETRY_NETWORK, sysClock.millis());
+  frame.u8(event);
+  frame.i8(index);
+  frame.i8(WiFi.status() == WL_CONNECTED ? WiFi.RSSI() : 0);
+  sendTelemetry(frame);
+}
+
+void sendNetworkStatusTelemetry(unsigned long now) {
+  bool online = WiFi.status() == WL_CONNECTED;
+  TelemetryFrame frame(TELEMETRY_NETSTATUS, now);
+  frame.u8(online);
+  frame.i8(online ? WiFi.RSSI() : 0);
+  frame.u32(hasValidTime ? (now - lastNtpSyncTime) / 1000 : UINT32_MAX);
+  frame.i16(drift.hasEstimate() ? drift.ppm() * 10.0f : 0);
+  frame.u16(scheduler.taskInterval(ntpTaskId) / 60000);
+  frame.u16(powerModel.awakeDuty() * 10000.0f + 0.5f);
+  frame.u16(powerModel.radioDuty() * 10000.0f + 0.5f);
+  frame.u16(powerModel.measuredMAhPerDay() * 10.0f + 0.5f);
+  sendTelemetry(frame);
+}
+
+// Read the fuel gauge (one burst) and update the filtered battery state
+void updateBatteryStatus() {
+  FuelGaugeReading reading;
+  if (!fuelGauge.read(reading)) {
+    LOG_WARN("Fuel gauge read failed");
+    return;
+  }
+  batteryMonitor.add(reading);
+  if (serialTelemetry) {
+    sendBatteryTelemetry(reading);
+  }
+  g_status.batteryVoltage = batteryMonitor.voltage();
+  g_status.batteryPercent = (uint8_t)(batteryMonitor.percent() + 0.5f);
+  g_status.batteryStatus = batteryMonitor.state();
+
+  if (reading.alerts & (FUEL_ALERT_VOLTAGE_LOW | FUEL_ALERT_SOC_LOW)) {
+    if (!lowBatteryAlert) {
+      LOG_WARN("Fuel gauge low battery alert (0x%x)", reading.alerts);
     }
+    lowBatteryAlert = true;
+    fuelGauge.clearAlerts();
   }
 
-  // Check for critically low battery (only when discharging)
-  if (g_batteryStatus == "Discharging" || g_batteryStatus == "On Battery") {
-    if (g_batteryVoltage <= LOW_BATTERY_VOLTAGE || g_batteryPercent <= LOW_BATTERY_PERCENT) {
+  // Only cut off once the filtered readings agree with the alert, so one
+  // bad sample can't put the device to sleep
+  if (lowBatteryAlert) {
+    if (batteryMonitor.critical(settings.lowBatteryVoltage, settings.lowBatteryPercent)) {
       enterDeepSleep();
+    } else if (batteryMonitor.voltage() > settings.lowBatteryVoltage + 0.1f &&
+               batteryMonitor.percent() > settings.lowBatteryPercent + 2) {
+      lowBatteryAlert = false;
     }
   }
 }
 
-void setup() {
-  Serial.begin(115200);
-  delay(1000);
-  Serial.println("\n\nChristmas Countdown Timer");
+// Light sensor reading scaled to 0-1000 between the dark and bright
+// calibration points, smoothed so a passing shadow doesn't dim the display
+void readAmbientLight() {
+  if (ambientLightPin < 0) {
+    return;
+  }
+  long raw = analogRead(ambientLightPin);
+  long span = ambientLightBright > ambientLightDark ? ambientLightBright - ambientLightDark : 1;
+  long scaled = (raw - (long)ambientLightDark) * 1000 / span;
+  scaled = scaled < 0 ? 0 : scaled > 1000 ? 1000 : scaled;
+  ambientLight = ambientLight < 0 ? scaled : ambientLight + (scaled - ambientLight) / ambientSmoothing;
+}
 
-  // Check wake-up reason
-  esp_sleep_wakeup_cause_t wakeup_reason = esp_sleep_get_wakeup_cause();
-  if (wakeup_reason == ESP_SLEEP_WAKEUP_TIMER) {
-    Serial.println("Woke from deep sleep (battery check)");
+// Take the display to the level the schedule calls for now, fading to it
+// if ramp is set, otherwise straight away
+void scheduleBrightness(bool ramp) {
+  BrightnessPolicy policy = {settings.displayBrightness, settings.quietStart, settings.quietEnd,
+                             settings.quietBrightness, settings.dimBatteryPercent, settings.dimBatteryBrightness};
+  BrightnessInputs inputs = {};
+  struct tm timeinfo;
+  inputs.timeValid = sysClock.localTime(timeinfo);
+  if (inputs.timeValid) {
+    inputs.minuteOfDay = timeinfo.tm_hour * 60 + timeinfo.tm_min;
+  }
+  inputs.onBattery = hasFuelGauge && (g_status.batteryStatus == BATTERY_ON_BATTERY ||
+                                      g_status.batteryStatus == BATTERY_DISCHARGING);
+  inputs.batteryPercent = g_status.batteryPercent;
+  inputs.lowBattery = lowBatteryAlert;
+  inputs.ambient = ambientLight;
+
+  int8_t previous = brightnessScheduler.level();
+  if (!brightnessScheduler.update(policy, inputs) && ramp) {
+    return;
+  }
+  int8_t level = brightnessScheduler.level();
+  if (ramp) {
+    LOG_INFO("Brightness %d -> %d (%s)", previous, level,
+             BrightnessScheduler::reasonName(brightnessScheduler.reason()));
+  }
+  if (!ramp || frameTimer == nullptr) {
+    setDisplayLevel(level);
+    return;
+  }
+  // Blanking fades to the dimmest level first; coming back starts there
+  if (displayLevel == BRIGHTNESS_OFF) {
+    setDisplayLevel(0);
   }
+  blankAfterFade = level == BRIGHTNESS_OFF;
+  animator.fade(displayLevel, level == BRIGHTNESS_OFF ? 0 : level);
+  startAnimation();
+}
 
-  // Initialize MAX17048 fuel gauge
-  if (!fuelGauge.begin()) {
-    Serial.println("Couldn't find MAX17048 fuel gauge!");
-    Serial.println("Battery monitoring will be unavailable");
-  } else {
-    Serial.println("MAX17048 fuel gauge initialized");
-    float voltage = fuelGauge.cellVoltage();
-    float percent = fuelGauge.cellPercent();
+// Time until the next NTP sync: as long as the drift estimate says the
+// clock stays within maxClockError, between 1 hour and 1 day
+unsigned long adaptiveSyncInterval() {
+  return drift.nextSyncDelay(maxClockError, ntpSyncInterval / 1000, maxNtpSyncInterval / 1000) * 1000UL;
+}
+
+// Projected drain in low-power mode: measured if we're running it,
+// otherwise a nominal profile with the radio up only for NTP syncs
+float lowPowerMahPerDay() {
+  if (lowPowerMode) {
+    return powerModel.measuredMAhPerDay();
+  }
+  float radio = (float)nominalRadioOnPerSyncMs / adaptiveSyncInterval();
+  return powerModel.mAhPerDay(nominalLowPowerAwakeDuty + radio, radio);
+}
 
-    Serial.print("Battery Voltage: ");
-    Serial.print(voltage, 2);
-    Serial.println("V");
-    Serial.print("Battery Percent: ");
-    Serial.print(percent, 1);
-    Serial.println("%");
+// Fill in the network fields and publish the status for the web server
+void publishStatus() {
+  int networkIndex = network.connectedNetwork();
+  bool online = networkIndex >= 0 && WiFi.status() == WL_CONNECTED;
 
-    // If we woke from sleep, check if battery is still too low
-    if (wakeup_reason == ESP_SLEEP_WAKEUP_TIMER) {
-      if (voltage <= LOW_BATTERY_VOLTAGE && percent <= LOW_BATTERY_PERCENT) {
-        Serial.println("Battery still too low, going back to sleep");
-        esp_sleep_enable_timer_wakeup(3600ULL * 1000000ULL);  // Sleep another hour
-        esp_deep_sleep_start();
-      } else {
-        Serial.println("Battery recovered! Continuing normal operation");
-      }
+  strlcpy(g_status.ssid, online ? settings.networks[networkIndex].ssid : "", sizeof(g_status.ssid));
+  g_status.ip[0] = '\0';
+  if (online) {
+    IPAddress addr = WiFi.localIP();
+    snprintf(g_status.ip, sizeof(g_status.ip), "%u.%u.%u.%u", addr[0], addr[1], addr[2], addr[3]);
+  }
+  g_status.rssi = online ? WiFi.RSSI() : 0;
+  publishedStatus.write(g_status);
+}
+
+// Format the /api/status document without touching the heap
+size_t formatStatusJson(char* buffer, size_t size) {
+  StatusSnapshot status;
+  publishedStatus.read(status);
+
+  JsonWriter json(buffer, size);
+  json.beginObject();
+  writeStatusFields(json, status);
+  const DisplayShadow& bus = ht16k33.stats();
+  json.addUInt("displayBytesSent", bus.bytesSent());
+  json.addUInt("displayWrites", bus.transactions());
+  json.addUInt("displayWritesSkipped", bus.skippedWrites());
+  json.addUInt("displayBytesSaved", bus.fullFrameBytes() - bus.bytesSent());
+  json.addFloat("driftPpm", drift.ppm(), 1);
+  json.addUInt("ntpIntervalSec", scheduler.taskInterval(ntpTaskId) / 1000);
+  json.addBool("lowPowerMode", lowPowerMode);
+  json.addFloat("awakeDuty", powerModel.awakeDuty(), 4);
+  json.addFloat("radioDuty", powerModel.radioDuty(), 4);
+  json.addFloat("powerCalibration", powerModel.calibration(), 2);
+  json.addFloat("estimatedMahPerDay", powerModel.measuredMAhPerDay(), 1);
+  json.addFloat("alwaysOnMahPerDay", powerModel.mAhPerDay(1.0f, 1.0f), 1);
+  json.addFloat("lowPowerMahPerDay", lowPowerMahPerDay(), 1);
+  json.addInt("displayLevel", displayLevel);
+  json.addString("brightnessReason", BrightnessScheduler::reasonName(brightnessScheduler.reason()));
+  if (ambientLightPin >= 0) {
+    json.addInt("ambientLight", ambientLight);
+  }
+  json.addFloat("displayMa", ledPower.currentMa(), 1);
+  json.addFloat("displayMahPerDay", ledPower.mAhPerDay(), 1);
+  json.addFloat("displayMahSavedPerDay", ledPower.fullBrightnessMAhPerDay() - ledPower.mAhPerDay(), 1);
+  bootTimeline.writeJson(json);
+  json.endObject();
+
+  if (json.overflowed()) {
+    LOG_WARN("Status JSON truncated");
+  }
+  return json.length();
+}
+
+// Format the /api/config document. Passwords are never sent back, only
+// whether one is set.
+size_t formatSettingsJson(char* buffer, size_t size) {
+  Settings current;
+  publishedSettings.read(current);
+
+  JsonWriter json(buffer, size);
+  json.beginObject();
+  json.addUInt("version", SETTINGS_VERSION);
+  json.beginArray("networks");
+  for (uint8_t i = 0; i < current.networkCount; i++) {
+    json.beginObject();
+    json.addString("ssid", current.networks[i].ssid);
+    json.addBool("hasPassword", current.networks[i].password[0] != '\0');
+    json.endObject();
+  }
+  json.endArray();
+  json.addString("ntpServer", current.ntpServer);
+  json.addString("tzRule", current.tzRule);
+  json.addUInt("brightness", current.displayBrightness);
+  char clock[6];
+  snprintf(clock, sizeof(clock), "%02u:%02u", current.quietStart / 60, current.quietStart % 60);
+  json.addString("quietStart", clock);
+  snprintf(clock, sizeof(clock), "%02u:%02u", current.quietEnd / 60, current.quietEnd % 60);
+  json.addString("quietEnd", clock);
+  json.addInt("quietBrightness", current.quietBrightness);
+  json.addUInt("dimBatteryPercent", current.dimBatteryPercent);
+  json.addUInt("dimBatteryBrightness", current.dimBatteryBrightness);
+  json.addFloat("lowBatteryVoltage", current.lowBatteryVoltage, 2);
+  json.addUInt("lowBatteryPercent", current.lowBatteryPercent);
+  json.endObject();
+
+  if (json.overflowed()) {
+    LOG_WARN("Config JSON truncated");
+  }
+  return json.length();
+}
+
+// Form parameter as a number. False if it's present but not a number.
+bool numberParam(AsyncWebServerRequest *request, const char* name, long& value) {
+  if (!request->hasParam(name, true)) {
+    return true;
+  }
+  const char* text = request->getParam(name, true)->value().c_str();
+  char* end;
+  long parsed = strtol(text, &end, 10);
+  if (end == text || *end != '\0') {
+    return false;
+  }
+  value = parsed;
+  return true;
+}
+
+bool numberParam(AsyncWebServerRequest *request, const char* name, float& value) {
+  if (!request->hasParam(name, true)) {
+    return true;
+  }
+  const char* text = request->getParam(name, true)->value().c_str();
+  char* end;
+  float parsed = strtof(text, &end);
+  if (end == text || *end != '\0') {
+    return false;
+  }
+  value = parsed;
+  return true;
+}
+
+// Time of day form parameter, HH:MM, as minutes after midnight. False if
+// it's present but not a time.
+bool clockParam(AsyncWebServerRequest *request, const char* name, uint16_t& minutes) {
+  if (!request->hasParam(name, true)) {
+    return true;
+  }
+  const char* text = request->getParam(name, true)->value().c_str();
+  unsigned hours, mins;
+  char end;
+  if (sscanf(text, "%2u:%2u%c", &hours, &mins, &end) != 2 || hours > 23 || mins > 59) {
+    return false;
+  }
+  minutes = hours * 60 + mins;
+  return true;
+}
+
+// String form parameter into a fixed buffer. False if it doesn't fit.
+bool stringParam(AsyncWebServerRequest *request, const char* name, char* value, size_t size) {
+  if (!request->hasParam(name, true)) {
+    return true;
+  }
+  const String& text = request->getParam(name, true)->value();
+  if (text.length() >= size) {
+    return false;
+  }
+  strlcpy(value, text.c_str(), size);
+  return true;
+}
+
+// Apply the form parameters of a PUT /api/config on top of the current
+// settings. Returns the name of the first bad field, nullptr if all good.
+const char* settingsFromRequest(AsyncWebServerRequest *request, Settings& next) {
+  // ssidN/passwordN edit slot N; an empty ssid removes it
+  char name[12];
+  for (uint8_t i = 0; i < Settings::MAX_NETWORKS; i++) {
+    if (i >= next.networkCount) {
+      memset(&next.networks[i], 0, sizeof(next.networks[i]));
+    }
+    snprintf(name, sizeof(name), "ssid%u", i);
+    if (!stringParam(request, name, next.networks[i].ssid, sizeof(next.networks[i].ssid))) {
+      return "ssid";
+    }
+    snprintf(name, sizeof(name), "password%u", i);
+    if (!stringParam(request, name, next.networks[i].password, sizeof(next.networks[i].password))) {
+      return "password";
     }
   }
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < Settings::MAX_NETWORKS; i++) {
+    if (next.networks[i].ssid[0] != '\0') {
+      next.networks[count++] = next.networks[i];
+    }
+  }
+  next.networkCount = count;
+  for (uint8_t i = count; i < Settings::MAX_NETWORKS; i++) {
+    memset(&next.networks[i], 0, sizeof(next.networks[i]));
+  }
 
-  // Initialize the display
-  if (!display.begin(displayAddress)) {
-    Serial.println("Couldn't find display!");
-    while (1);
+  long brightness = next.displayBrightness;
+  long quietBrightness = next.quietBrightness;
+  long dimBatteryPercent = next.dimBatteryPercent;
+  long dimBatteryBrightness = next.dimBatteryBrightness;
+  long lowBatteryPercent = next.lowBatteryPercent;
+  if (!stringParam(request, "ntpServer", next.ntpServer, sizeof(next.ntpServer))) {
+    return "ntpServer";
+  }
+  if (!stringParam(request, "tzRule", next.tzRule, sizeof(next.tzRule))) {
+    return "tzRule";
+  }
+  // Range-check the narrow fields before they're truncated to fit
+  if (!numberParam(request, "brightness", brightness) || brightness < 0 || brightness > 15) {
+    return "brightness";
+  }
+  if (!clockParam(request, "quietStart", next.quietStart)) {
+    return "quietStart";
+  }
+  if (!clockParam(request, "quietEnd", next.quietEnd)) {
+    return "quietEnd";
+  }
+  if (!numberParam(request, "quietBrightness", quietBrightness) || quietBrightness < -1 || quietBrightness > 15) {
+    return "quietBrightness";
+  }
+  if (!numberParam(request, "dimBatteryPercent", dimBatteryPercent) || dimBatteryPercent < 0 ||
+      dimBatteryPercent > 100) {
+    return "dimBatteryPercent";
+  }
+  if (!numberParam(request, "dimBatteryBrightness", dimBatteryBrightness) || dimBatteryBrightness < 0 ||
+      dimBatteryBrightness > 15) {
+    return "dimBatteryBrightness";
+  }
+  if (!numberParam(request, "lowBatteryVoltage", next.lowBatteryVoltage)) {
+    return "lowBatteryVoltage";
   }
-  Serial.println("Display initialized");
-  display.setBrightness(displayBrightness);
-  display.print(8888);  // Test pattern
-  display.writeDisplay();
-  delay(1000);
+  if (!numberParam(request, "lowBatteryPercent", lowBatteryPercent) || lowBatteryPercent < 0 ||
+      lowBatteryPercent > 100) {
+    return "lowBatteryPercent";
+  }
+  next.displayBrightness = brightness;
+  next.quietBrightness = quietBrightness;
+  next.dimBatteryPercent = dimBatteryPercent;
+  next.dimBatteryBrightness = dimBatteryBrightness;
+  next.lowBatteryPercent = lowBatteryPercent;
+
+  const char* error = nullptr;
+  return validateSettings(next, error) ? nullptr : error;
+}
 
-  // Set hostname before connecting to WiFi
-  WiFi.setHostname(hostname);
-  Serial.print("Hostname set to: ");
-  Serial.println(hostname);
+// Time spent in a web handler, started at startUs
+void recordRequest(MetricsRoute route, int64_t startUs) {
+  metrics.recordRequest(route, (uint32_t)(sysClock.monotonicUs() - startUs));
+}
 
-  // Try to connect to WiFi networks with fallback
-  bool connected = false;
-  display.clear();
-  display.writeDisplay();
-
-  for (int i = 0; i < numNetworks && !connected; i++) {
-    Serial.print("Trying network: ");
-    Serial.println(wifiNetworks[i].ssid);
-
-    WiFi.begin(wifiNetworks[i].ssid, wifiNetworks[i].password);
-
-    int dotState = 0;
-    int attempts = 0;
-    int maxAttempts = 20;  // 10 seconds per network
-
-    while (WiFi.status() != WL_CONNECTED && attempts < maxAttempts) {
-      delay(500);
-      Serial.print(".");
-      // Animate dots while connecting
-      display.writeDigitNum(0, dotState % 10);
-      display.writeDisplay();
-      dotState++;
-      attempts++;
-    }
-
-    if (WiFi.status() == WL_CONNECTED) {
-      connected = true;
-      Serial.println("\nWiFi connected!");
-      Serial.print("Connected to: ");
-      Serial.println(wifiNetworks[i].ssid);
-      Serial.print("IP address: ");
-      Serial.println(WiFi.localIP());
+// Gather the point-in-time values for a /api/metrics scrape
+void captureGauges(MetricsGauges& gauges) {
+  gauges.uptimeSeconds = sysClock.monotonicUs() / 1000000;
+  gauges.heapFree = ESP.getFreeHeap();
+  gauges.heapMinFree = ESP.getMinFreeHeap();
+  gauges.heapLargestBlock = ESP.getMaxAllocHeap();
+  gauges.wifiConnectAttempts = network.connectAttempts();
+  gauges.wifiConnections = network.connections();
+  gauges.wifiDisconnects = wifiDisconnects;
+  gauges.ntpSyncs = network.timeSyncs();
+  gauges.schedulerWakeups = scheduler.wakeups();
+  gauges.responseBuffersExhausted = responseBuffers.exhausted();
+}
+
+// Send a body formatted into a pooled buffer. The filler reads slices of
+// it as the connection takes them, and the buffer goes back to the pool
+// when the request is torn down, sent or not.
+void sendBuffer(AsyncWebServerRequest *request, const char* contentType, ResponseBuffer* body) {
+  request->onDisconnect([body](){
+    responseBuffers.release(body);
+  });
+  request->send(request->beginResponse(contentType, body->length(),
+    [body](uint8_t *buffer, size_t maxLen, size_t index) {
+      return body->read(buffer, maxLen, index);
+    }));
+}
+
+// Claim a response buffer, or answer 503 if slow clients hold them all
+ResponseBuffer* claimResponseBuffer(AsyncWebServerRequest *request) {
+  ResponseBuffer* body = responseBuffers.claim();
+  if (body == nullptr) {
+    AsyncWebServerResponse *response = request->beginResponse(503, "text/plain", "Busy\n");
+    response->addHeader("Retry-After", "1");
+    request->send(response);
+  }
+  return body;
+}
+
+// Start the web server the first time WiFi comes up
+void startWebServer() {
+  if (webServerStarted) {
+    return;
+  }
+  webServerStarted = true;
+
+  server.on("/", HTTP_GET, [](AsyncWebServerRequest *request){
+    int64_t start = sysClock.monotonicUs();
+    // The page only changes with the firmware, so a matching ETag means
+    // the browser's copy is current
+    if (request->hasHeader("If-None-Match") &&
+        etagMatches(request->getHeader("If-None-Match")->value().c_str(), index_html_etag)) {
+      AsyncWebServerResponse *response = request->beginResponse(304);
+      response->addHeader("ETag", index_html_etag);
+      response->addHeader("Cache-Control", "no-cache");
+      request->send(response);
+      recordRequest(ROUTE_PAGE, start);
+      return;
+    }
+
+    AsyncWebServerResponse *response =
+        request->beginResponse_P(200, "text/html", index_html_gz, index_html_gz_len);
+    response->addHeader("Content-Encoding", "gzip");
+    response->addHeader("ETag", index_html_etag);
+    response->addHeader("Cache-Control", "no-cache");
+    request->send(response);
+    recordRequest(ROUTE_PAGE, start);
+  });
+
+  server.on("/api/status", HTTP_GET, [](AsyncWebServerRequest *request){
+    int64_t start = sysClock.monotonicUs();
+    ResponseBuffer* body = claimResponseBuffer(request);
+    if (body != nullptr) {
+      body->setLength(formatStatusJson(body->data(), statusJsonSize));
+      sendBuffer(request, "application/json", body);
+    }
+    recordRequest(ROUTE_STATUS, start);
+  });
+
+  server.on("/api/history", HTTP_GET, [](AsyncWebServerRequest *request){
+    // ?res=minute|hour|day, hourly by default
+    int64_t start = sysClock.monotonicUs();
+    HistoryResolution res = HISTORY_HOUR;
+    if (request->hasParam("res")) {
+      const String& name = request->getParam("res")->value();
+      for (int i = 0; i < HISTORY_RESOLUTIONS; i++) {
+        if (name == BatteryHistory::resolutionName((HistoryResolution)i)) {
+          res = (HistoryResolution)i;
+        }
+      }
+    }
+
+    // Stream rows straight out of the ring buffer
+    HistoryCsvWriter writer(batteryHistory, res);
+    request->send(request->beginChunkedResponse("text/csv",
+      [writer](uint8_t *buffer, size_t maxLen, size_t index) mutable {
+        return writer.fill(buffer, maxLen);
+      }));
+    recordRequest(ROUTE_HISTORY, start);
+  });
+
+  server.on("/api/metrics", HTTP_GET, [](AsyncWebServerRequest *request){
+    // Prometheus text format, streamed a line at a time
+    int64_t start = sysClock.monotonicUs();
+    MetricsGauges gauges;
+    captureGauges(gauges);
+    MetricsWriter writer(metrics, gauges);
+    request->send(request->beginChunkedResponse("text/plain; version=0.0.4",
+      [writer](uint8_t *buffer, size_t maxLen, size_t index) mutable {
+        return writer.fill(buffer, maxLen);
+      }));
+    recordRequest(ROUTE_METRICS, start);
+  });
+
+  server.on("/api/targets", HTTP_GET, [](AsyncWebServerRequest *request){
+    // The configured targets, in the format they're submitted in
+    int64_t start = sysClock.monotonicUs();
+    ResponseBuffer* body = claimResponseBuffer(request);
+    if (body != nullptr) {
+      TargetList list;
+      configuredTargets.read(list);
+      body->setLength(formatTargets(list, body->data(), targetsTextSize));
+      sendBuffer(request, "text/plain", body);
+    }
+    recordRequest(ROUTE_TARGETS, start);
+  });
+
+  server.on("/api/targets", HTTP_POST, [](AsyncWebServerRequest *request){
+    // Replace the whole list, sent as a form field or as the raw body
+    int64_t start = sysClock.monotonicUs();
+    const char* text = nullptr;
+    size_t len = 0;
+    if (request->hasParam("targets", true)) {
+      const String& value = request->getParam("targets", true)->value();
+      text = value.c_str();
+      len = value.length();
+    } else if (request->_tempObject != nullptr) {
+      text = (const char*)request->_tempObject;
+      len = request->contentLength();
+    }
+
+    TargetList list;
+    int errorLine;
+    if (len > targetsTextSize || (text == nullptr && request->contentLength() > targetsTextSize)) {
+      request->send(413, "text/plain", "Too many targets\n");
+    } else if (text == nullptr) {
+      request->send(400, "text/plain", "No targets\n");
+    } else if (!parseTargets(text, len, list, errorLine)) {
+      char message[48];
+      snprintf(message, sizeof(message), "Invalid target on line %d\n", errorLine);
+      request->send(400, "text/plain", message);
     } else {
-      Serial.println("\nFailed to connect");
-      WiFi.disconnect();
+      // The loop task saves it and switches over on its next tick
+      submittedTargets.write(list);
+      ResponseBuffer* body = claimResponseBuffer(request);
+      if (body != nullptr) {
+        body->setLength(formatTargets(list, body->data(), targetsTextSize));
+        sendBuffer(request, "text/plain", body);
+      }
     }
-  }
+    recordRequest(ROUTE_TARGETS, start);
+  }, nullptr, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total){
+    // Collect a raw body (form posts arrive as params instead). The
+    // request frees _tempObject when it's done.
+    if (total > targetsTextSize) {
+      return;
+    }
+    if (index == 0) {
+      request->_tempObject = malloc(total);
+    }
+    if (request->_tempObject != nullptr) {
+      memcpy((uint8_t*)request->_tempObject + index, data, len);
+    }
+  });
+
+  server.on("/api/config", HTTP_GET, [](AsyncWebServerRequest *request){
+    int64_t start = sysClock.monotonicUs();
+    ResponseBuffer* body = claimResponseBuffer(request);
+    if (body != nullptr) {
+      body->setLength(formatSettingsJson(body->data(), settingsJsonSize));
+      sendBuffer(request, "application/json", body);
+    }
+    recordRequest(ROUTE_CONFIG, start);
+  });
+
+  server.on("/api/config", HTTP_PUT, [](AsyncWebServerRequest *request){
+    // Change any subset of the settings with form parameters; the loop
+    // task saves and applies them on its next pass
+    int64_t start = sysClock.monotonicUs();
+    Settings next;
+    publishedSettings.read(next);
+    const char* error = settingsFromRequest(request, next);
+    if (error != nullptr) {
+      char message[48];
+      snprintf(message, sizeof(message), "Invalid %s\n", error);
+      request->send(400, "text/plain", message);
+    } else {
+      submittedSettings.write(next);
+      request->send(202, "text/plain", "Applying\n");
+    }
+    recordRequest(ROUTE_CONFIG, start);
+  });
+
+  server.on("/api/log", HTTP_GET, [](AsyncWebServerRequest *request){
+    // Recent console output, oldest line first
+    int64_t start = sysClock.monotonicUs();
+    ResponseBuffer* body = claimResponseBuffer(request);
+    if (body != nullptr) {
+      body->setLength(logTail(body->data(), logTailSize));
+      sendBuffer(request, "text/plain", body);
+    }
+    recordRequest(ROUTE_LOG, start);
+  });
+
+  server.on("/update", HTTP_POST, [](AsyncWebServerRequest *request){
+    // The upload handler below has already written the image by now
+    int64_t start = sysClock.monotonicUs();
+    if (otaOwner != request) {
+      if (otaOwner == nullptr) {
+        request->send(400, "text/plain", "No firmware image\n");
+      } else {
+        request->send(409, "text/plain", "Update already in progress\n");
+      }
+    } else {
+      otaUpdate.abort();  // Only does anything if the upload was cut short
+      if (otaUpdate.succeeded()) {
+        request->send(200, "text/plain", "Update complete, restarting\n");
+        restartPending = true;
+      } else {
+        char message[64];
+        snprintf(message, sizeof(message), "Update failed: %s\n", otaUpdate.error());
+        request->send(400, "text/plain", message);
+      }
+      otaOwner = nullptr;
+    }
+    recordRequest(ROUTE_UPDATE, start);
+  }, [](AsyncWebServerRequest *request, const String& filename, size_t index, uint8_t *data, size_t len, bool final){
+    // Multipart upload: each chunk goes straight to flash
+    if (index == 0) {
+      if (otaOwner != nullptr) {
+        return;
+      }
+      otaOwner = request;
+      request->onDisconnect([request](){
+        if (otaOwner == request) {
+          otaUpdate.abort();
+          otaOwner = nullptr;
+        }
+      });
+
+      StatusSnapshot status;
+      publishedStatus.read(status);
+      bool charging = status.batteryStatus == BATTERY_CHARGING || status.batteryStatus == BATTERY_CHARGED;
+      const AsyncWebParameter* sha256 = request->hasParam("sha256") ? request->getParam("sha256")
+                                      : request->getParam("sha256", true);
+      if (hasFuelGauge && !charging && status.batteryPercent < otaMinBatteryPercent) {
+        otaUpdate.refuse("battery too low, charge it first");
+      } else if (otaUpdate.begin(sha256 != nullptr ? sha256->value().c_str() : nullptr)) {
+        LOG_INFO("Firmware update started: %s", filename.c_str());
+      }
+    }
+    if (otaOwner != request) {
+      return;
+    }
+    if (len > 0) {
+      otaUpdate.write(data, len);
+    }
+    if (final) {
+      if (otaUpdate.finish()) {
+        LOG_INFO("Firmware update written: %u bytes", (unsigned)otaUpdate.written());
+      } else {
+        LOG_WARN("Firmware update failed: %s", otaUpdate.error());
+      }
+    }
+  });
 
-  if (!connected) {
-    Serial.println("Could not connect to any WiFi network!");
-    Serial.println("Continuing without WiFi - using internal RTC only");
-    Serial.println("Warning: Time may not be accurate until WiFi connection is established");
+  events.onConnect([](AsyncEventSourceClient *client){
+    // Every client costs a socket and a send queue, so turn extras away;
+    // their page falls back to polling /api/status
+    if (events.count() > maxEventClients) {
+      client->close();
+      return;
+    }
+    // Start the new client off with everything
+    int64_t start = sysClock.monotonicUs();
+    StatusSnapshot status;
+    publishedStatus.read(status);
+    char buffer[statusEventSize];
+    JsonWriter json(buffer, sizeof(buffer));
+    json.beginObject();
+    writeStatusFields(json, status);
+    json.endObject();
+    client->send(json.c_str(), "status", lastEventId);
+    recordRequest(ROUTE_EVENTS, start);
+  });
+  server.addHandler(&events);
+
+  server.begin();
+  markBoot(BOOT_WEB);
+  IPAddress addr = WiFi.localIP();
+  LOG_INFO("Web server started! Visit: http://%u.%u.%u.%u", addr[0], addr[1], addr[2], addr[3]);
+
+  // Browsers find the page as <hostname>.local; fleet tools browse for
+  // _countdown._tcp, whose TXT record says where the status and beacons are
+  if (MDNS.begin(hostname)) {
+    MDNS.addService("http", "tcp", 80);
+    MDNS.addService("countdown", "tcp", 80);
+    MDNS.addServiceTxt("countdown", "tcp", "api", "/api/status");
+    if (beaconHost[0] != '\0') {
+      MDNS.addServiceTxt("countdown", "tcp", "beacon", String(beaconPort));
+    }
+    LOG_INFO("Advertising http://%s.local", hostname);
   } else {
-    // Initialize time from NTP
-    Serial.println("Getting time from NTP server...");
-    configTime(gmtOffset_sec, daylightOffset_sec, ntpServer);
-
-    // Wait for time to be set
-    struct tm timeinfo;
-    int retries = 0;
-    while (!getLocalTime(&timeinfo) && retries < 20) {
-      delay(500);
-      Serial.print(".");
-      retries++;
-    }
-
-    if (retries >= 20) {
-      Serial.println("\nFailed to obtain time from NTP");
-      hasValidTime = false;
-    } else {
-      Serial.println("\nTime synchronized!");
-      Serial.println(&timeinfo, "%A, %B %d %Y %H:%M:%S");
+    LOG_WARN("mDNS failed to start");
+  }
+}
+
+// Fold the sync that just happened into the drift estimate and schedule
+// the next one
+void updateDriftEstimate() {
+  int64_t wallUs, monotonicUs;
+  if (wifiBackend.lastSyncReference(wallUs, monotonicUs)) {
+    drift.addSync(wallUs, monotonicUs);
+  }
+  if (drift.hasEstimate()) {
+    rtcState.driftPpm = drift.ppm();
+    LOG_INFO("RTC drift estimate: %.1f ppm", drift.ppm());
+  }
+
+  unsigned long interval = adaptiveSyncInterval();
+  scheduler.setInterval(ntpTaskId, interval);
+  scheduler.runAfter(ntpTaskId, sysClock.millis(), interval);
+  LOG_INFO("Next NTP sync in %lu minutes", interval / 60000);
+}
+
+// Task: send a status beacon when something a collector cares about
+// changed, or when it hasn't heard from us for a while
+void beaconTask(unsigned long now) {
+  if (WiFi.status() != WL_CONNECTED) {
+    return;
+  }
+
+  bool charging = g_status.batteryStatus == BATTERY_CHARGING || g_status.batteryStatus == BATTERY_CHARGED;
+  Beacon beacon = {};
+  beacon.flags = (hasValidTime ? BEACON_TIME_VALID : 0) | (charging ? BEACON_CHARGING : 0) |
+                 (lowBatteryAlert ? BEACON_LOW_BATTERY : 0) | (lowPowerMode ? BEACON_LOW_POWER : 0) |
+                 (hasFuelGauge ? 0 : BEACON_NO_GAUGE);
+  WiFi.macAddress(beacon.mac);
+  beacon.days = g_status.days;
+  beacon.batteryMillivolts = g_status.batteryVoltage * 1000.0f + 0.5f;
+  beacon.batteryPercent = g_status.batteryPercent;
+  beacon.rssi = WiFi.RSSI();
+  beacon.freeHeap = ESP.getFreeHeap();
+  beacon.uptime = now / 1000;
+
+  if (beaconSent && !beaconChanged(beacon, lastBeacon) && now - lastBeaconTime < beaconHeartbeatInterval) {
+    return;
+  }
+  beacon.sequence = ++beaconSequence;
+  uint8_t packet[BEACON_BYTES];
+  size_t len = encodeBeacon(beacon, packet, sizeof(packet));
+  if (!beaconSocket.beginPacket(beaconHost, beaconPort)) {
+    return;
+  }
+  beaconSocket.write(packet, len);
+  if (beaconSocket.endPacket()) {
+    beaconSent = true;
+    lastBeacon = beacon;
+    lastBeaconTime = now;
+  }
+}
+
+// Log connection progress and react to state changes
+void onNetworkEvent(NetworkEvent event, int index) {
+  if (serialTelemetry) {
+    sendNetworkTelemetry(event, index);
+  }
+  switch (event) {
+    case NET_ATTEMPT:
+      LOG_INFO("Trying network: %s", settings.networks[index].ssid);
+      break;
+    case NET_CONNECTED: {
+      IPAddress addr = WiFi.localIP();
+      LOG_INFO("WiFi connected to %s, IP address %u.%u.%u.%u", settings.networks[index].ssid,
+               addr[0], addr[1], addr[2], addr[3]);
+      LOG_INFO("Getting time from NTP server...");
+      rtcState.lastGoodNetwork = index;
+      saveRtcState(rtcState);
+      markBoot(BOOT_WIFI);
+      startWebServer();
+      break;
+    }
+    case NET_CONNECT_FAILED:
+      LOG_WARN("Failed to connect");
+      break;
+    case NET_ALL_FAILED:
+      LOG_WARN("Could not connect to any WiFi network, will retry later");
+      scheduler.runAfter(ntpTaskId, sysClock.millis(), ntpSyncInterval);
+      if (!hasValidTime) {
+        LOG_WARN("Time may not be accurate until WiFi connection is established");
+      }
+      break;
+    case NET_TIME_SYNCED: {
+      struct tm timeinfo;
+      if (sysClock.localTime(timeinfo)) {
+        char date[48];
+        strftime(date, sizeof(date), "%A, %B %d %Y %H:%M:%S", &timeinfo);
+        LOG_INFO("Time synchronized! %s", date);
+      }
       hasValidTime = true;
-      lastNtpSyncTime = millis();
-    }
-  }
-
-  // Setup web server (only if WiFi is connected)
-  if (connected) {
-    server.on("/", HTTP_GET, [](AsyncWebServerRequest *request){
-      request->send_P(200, "text/html", index_html);
-    });
-
-    server.on("/api/status", HTTP_GET, [](AsyncWebServerRequest *request){
-      String json = "{";
-      json += "\"days\":" + String(g_daysUntilChristmas) + ",";
-      json += "\"christmasYear\":" + String(g_christmasYear) + ",";
-      json += "\"year\":" + String(g_currentYear) + ",";
-      json += "\"month\":" + String(g_currentMonth) + ",";
-      json += "\"day\":" + String(g_currentDay) + ",";
-      json += "\"hour\":" + String(g_currentHour) + ",";
-      json += "\"min\":" + String(g_currentMin) + ",";
-      json += "\"sec\":" + String(g_currentSec) + ",";
-      json += "\"ssid\":\"" + String(WiFi.SSID()) + "\",";
-      json += "\"ip\":\"" + WiFi.localIP().toString() + "\",";
-      json += "\"rssi\":" + String(WiFi.RSSI()) + ",";
-      json += "\"batteryVoltage\":" + String(g_batteryVoltage, 2) + ",";
-      json += "\"batteryPercent\":" + String(g_batteryPercent) + ",";
-      json += "\"batteryStatus\":\"" + g_batteryStatus + "\"";
-      json += "}";
-      request->send(200, "application/json", json);
-    });
-
-    server.begin();
-    Serial.println("\nWeb server started!");
-    Serial.print("Visit: http://");
-    Serial.println(WiFi.localIP());
-  } else {
-    Serial.println("\nWeb server not started (no WiFi connection)");
+      markBoot(BOOT_TIME);
+      lastNtpSyncTime = sysClock.millis();
+      rtcState.lastSyncEpoch = sysClock.epoch();
+      rtcState.timeValid = true;
+      updateDriftEstimate();
+      saveRtcState(rtcState);
+      if (lowPowerMode && beaconHost[0] != '\0') {
+        beaconTask(sysClock.millis());  // WiFi is only up around syncs
+      }
+      break;
+    }
+    case NET_SYNC_FAILED:
+      LOG_WARN("NTP sync failed, will retry later");
+      scheduler.runAfter(ntpTaskId, sysClock.millis(), ntpSyncInterval);
+      break;
+    case NET_LOST:
+      LOG_WARN("WiFi connection lost, running on internal RTC");
+      wifiDisconnects++;
+      break;
   }
 }
 
-void loop() {
-  // Check if it's time to re-sync NTP (every hour)
-  unsigned long currentTime = millis();
-  if (currentTime - lastNtpSyncTime >= ntpSyncInterval) {
-    tryWifiAndNtpSync();
+// Take up a target list submitted through /api/targets: save it and make
+// it the current one
+void applySubmittedTargets() {
+  static uint32_t appliedVersion = 0;
+  if (submittedTargets.version() == appliedVersion) {
+    return;
   }
+  TargetList list;
+  appliedVersion = submittedTargets.read(list);
+  char text[targetsTextSize];
+  size_t len = formatTargets(list, text, sizeof(text));
+  if (!saveTargetsText(text, len)) {
+    LOG_ERROR("Failed to save countdown targets to flash");
+  }
+  configuredTargets.write(list);
+  LOG_INFO("Countdown targets updated, %u configured", list.count);
+}
 
-  struct tm timeinfo;
+// Local time follows the TZ rule in settings
+void applyTimeZone() {
+  TzRule rule;
+  if (!parseTzRule(settings.tzRule, rule)) {
+    LOG_ERROR("Invalid time zone rule \"%s\", using UTC", settings.tzRule);
+    parseTzRule("UTC0", rule);
+  }
+  sysClock.setTimeZone(rule);
+}
+
+// Point the connection manager at the networks in settings
+void updateNetworkList() {
+  for (uint8_t i = 0; i < settings.networkCount; i++) {
+    networkList[i].ssid = settings.networks[i].ssid;
+    networkList[i].password = settings.networks[i].password;
+  }
+  network.setNetworks(networkList, settings.networkCount);
+}
+
+bool sameNetworks(const Settings& a, const Settings& b) {
+  if (a.networkCount != b.networkCount) {
+    return false;
+  }
+  for (uint8_t i = 0; i < a.networkCount; i++) {
+    if (strcmp(a.networks[i].ssid, b.networks[i].ssid) != 0 ||
+        strcmp(a.networks[i].password, b.networks[i].password) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Take up settings submitted through /api/config: save them and apply
+// whatever changed without a reboot
+void applySubmittedSettings(unsigned long now) {
+  static uint32_t appliedVersion = 0;
+  if (submittedSettings.version() == appliedVersion) {
+    return;
+  }
+  Settings previous = settings;
+  appliedVersion = submittedSettings.read(settings);
+  if (!saveSettings(settings)) {
+    LOG_ERROR("Failed to save settings to flash");
+  }
+  publishedSettings.write(settings);
+  LOG_INFO("Settings updated");
+
+  // Brightness or its schedule may have changed
+  scheduleBrightness(true);
+  if (hasFuelGauge && (settings.lowBatteryVoltage != previous.lowBatteryVoltage ||
+                       settings.lowBatteryPercent != previous.lowBatteryPercent)) {
+    fuelGauge.setAlerts(settings.lowBatteryVoltage, settings.lowBatteryPercent);
+  }
+  if (strcmp(settings.tzRule, previous.tzRule) != 0) {
+    // Takes effect on the next display tick
+    applyTimeZone();
+  }
+  if (!sameNetworks(settings, previous)) {
+    updateNetworkList();
+    // Low-power mode only brings WiFi up for the next sync anyway
+    if (!lowPowerMode) {
+      LOG_INFO("Network list changed, reconnecting");
+      network.reconnect(now);
+      scheduler.runAfter(networkTaskId, now, 0);
+    }
+  }
+}
+
+// Rebuild the table of upcoming events when the configured list changes,
+// otherwise move it on to today. Returns true if anything was recomputed.
+bool updateTargetTable(int32_t today) {
+  static uint32_t loadedVersion = 0;
+  static int32_t tableDate = INT32_MIN;
+  // A time zone change can move the date backwards, which advance() can't
+  if (configuredTargets.version() != loadedVersion || today < tableDate) {
+    TargetList list;
+    loadedVersion = configuredTargets.read(list);
+    targetTable.load(list, today);
+  } else if (today != tableDate) {
+    targetTable.advance(today);
+  } else {
+    return false;
+  }
+  tableDate = today;
+  return true;
+}
 
-  if (!getLocalTime(&timeinfo)) {
-    Serial.println("Failed to obtain time");
+// Task: recalculate the countdown and refresh the display
+void displayTask(unsigned long now) {
+  struct tm timeinfo;
+  uint32_t start = sysClock.cycleCount();
+  applySubmittedTargets();
+  readAmbientLight();
+  scheduleBrightness(true);
+
+  // Don't wait for the clock here, the sync task takes care of that
+  if (!sysClock.localTime(timeinfo)) {
+    metrics.recordPhase(PHASE_TIME, sysClock.cycleCount() - start);
     if (!hasValidTime) {
-      Serial.println("No valid time available - trying to sync...");
-      tryWifiAndNtpSync();
+      scheduler.runWithin(ntpTaskId, now, timeRetryInterval);
     }
-    display.print(0);
-    display.writeDisplay();
-    delay(1000);
+    static bool connecting = false;
+    bool wasConnecting = connecting;
+    connecting = network.isBusy();
+    if (animator.showingText() || showingCachedCount) {
+      // Leave the display to the animation, or the count from before
+      // the reset
+    } else if (connecting) {
+      // Animate a digit while connecting
+      static uint8_t spinner = 0;
+      display.clear();
+      display.showDigit(0, spinner++ % 10);
+    } else if (!lowPowerMode || wasConnecting) {
+      // Over and over, or in low-power mode once per failed attempt so
+      // the frame timer doesn't keep the CPU awake
+      animator.showText("no WiFi");
+      startAnimation();
+    } else {
+      display.showNumber(0);
+    }
+    refreshDisplay();
+    publishStatus();
     return;
   }
 
-  // Calculate days until Christmas
   int currentYear = timeinfo.tm_year + 1900;
   int currentMonth = timeinfo.tm_mon + 1;  // tm_mon is 0-11
   int currentDay = timeinfo.tm_mday;
 
-  // Determine which Christmas to count down to
-  int christmasYear = currentYear;
-  if (currentMonth == 12 && currentDay > 25) {
-    christmasYear = currentYear + 1;
+  // Occurrences only change at local midnight, so the table is only
+  // touched when the date does
+  int32_t today = daysFromCivil(currentYear, currentMonth, currentDay);
+  if (updateTargetTable(today) && targetTable.count() > 0) {
+    LOG_DEBUG("Next event: %s in %ld days", targetTable.target(0).name, (long)(targetTable.day(0) - today));
   }
 
-  // Create time structure for Christmas
-  struct tm christmas = {0};
-  christmas.tm_year = christmasYear - 1900;
-  christmas.tm_mon = 11;  // December (0-indexed)
-  christmas.tm_mday = 25;
-  christmas.tm_hour = 0;
-  christmas.tm_min = 0;
-  christmas.tm_sec = 0;
-
-  // Convert to time_t
-  time_t now = mktime(&timeinfo);
-  time_t christmasTime = mktime(&christmas);
+  // Take turns showing the next few events
+  uint8_t shown = targetTable.count() < displayedTargets ? targetTable.count() : displayedTargets;
+  if (shown == 0) {
+    g_status.days = -1;
+    g_status.event[0] = '\0';
+    g_status.eventYear = 0;
+  } else {
+    uint8_t index = (now / targetRotateInterval) % shown;
+    int32_t days = targetTable.day(index) - today;
+    g_status.days = days < 9999 ? days : 9999;  // Four digits
+    strlcpy(g_status.event, targetTable.target(index).name, sizeof(g_status.event));
+    g_status.eventYear = civilFromDays(targetTable.day(index)).year;
+  }
+  int daysUntilEvent = g_status.days;
+
+  // Keep the next event's count for the next boot
+  if (targetTable.count() > 0) {
+    int32_t nextDays = targetTable.day(0) - today;
+    CountCache next = {targetTable.day(0), (int16_t)(nextDays < 9999 ? nextDays : 9999)};
+    if (next.eventDay != countCache.eventDay || next.days != countCache.days) {
+      countCache = next;
+      if (!saveCountCache(countCache)) {
+        LOG_WARN("Failed to save the count to flash");
+      }
+    }
+  }
 
-  // Calculate difference in seconds and convert to days
-  double secondsUntilChristmas = difftime(christmasTime, now);
-  int daysUntilChristmas = (int)(secondsUntilChristmas / 86400);
+  // Scroll an event's name past before its count. Low-power mode skips
+  // it: the frame timer would keep the CPU out of light sleep. So does a
+  // blanked display, where nobody would see it.
+  static char namedEvent[sizeof(g_status.event)] = "";
+  if (strcmp(namedEvent, g_status.event) != 0) {
+    strlcpy(namedEvent, g_status.event, sizeof(namedEvent));
+    if (!lowPowerMode && namedEvent[0] != '\0' && displayLevel != BRIGHTNESS_OFF) {
+      animator.showText(namedEvent);
+      startAnimation();
+    }
+  }
 
   // Update global variables for web server
-  g_daysUntilChristmas = daysUntilChristmas;
-  g_currentYear = currentYear;
-  g_currentMonth = currentMonth;
-  g_currentDay = currentDay;
-  g_currentHour = timeinfo.tm_hour;
-  g_currentMin = timeinfo.tm_min;
-  g_currentSec = timeinfo.tm_sec;
-  g_christmasYear = christmasYear;
-
-  // Update battery status
+  g_status.year = currentYear;
+  g_status.month = currentMonth;
+  g_status.day = currentDay;
+  g_status.hour = timeinfo.tm_hour;
+  g_status.min = timeinfo.tm_min;
+  g_status.sec = timeinfo.tm_sec;
+  metrics.recordPhase(PHASE_TIME, sysClock.cycleCount() - start);
+
+  // Handle the day itself specially
+  static bool colonOn = false;
+  if (animator.showingText()) {
+    // The count comes back once the animation is done
+  } else if (daysUntilEvent < 0) {
+    // Nothing left to count down to
+    display.showDashes();
+    display.showColon(false);
+  } else if (daysUntilEvent == 0) {
+    // It's here! Show 0 and blink the colon every tick
+    colonOn = !colonOn;
+    display.showNumber(0);
+    display.showColon(colonOn);
+  } else {
+    // Display the countdown
+    display.showNumber(daysUntilEvent);
+    display.showColon(false);
+  }
+  if (!animator.showingText()) {
+    showingCachedCount = false;
+    markBoot(BOOT_COUNT);
+  }
+
+  refreshDisplay();
+  publishStatus();
+}
+
+// Task: poll the fuel gauge
+void batteryTask(unsigned long now) {
+  if (!hasFuelGauge) {
+    return;
+  }
+  uint32_t start = sysClock.cycleCount();
   updateBatteryStatus();
+  metrics.recordPhase(PHASE_BATTERY, sysClock.cycleCount() - start);
+  rtcState.batteryMillivolts = g_status.batteryVoltage * 1000;
+  rtcState.batteryPercent = g_status.batteryPercent;
+  saveRtcState(rtcState);
+  powerModel.calibrate(batteryMonitor.chargeRate(), batteryCapacity_mAh);
+
+  // Sample as often as the charge is moving, and quickly while confirming
+  // a low battery alert
+  scheduler.setInterval(batteryTaskId, lowBatteryAlert ? BatteryMonitor::MIN_INTERVAL_MS : batteryMonitor.nextIntervalMs());
+  publishStatus();
+}
+
+// Task: record a battery history sample (needs real time for timestamps)
+void historyTask(unsigned long now) {
+  if (hasFuelGauge && hasValidTime) {
+    batteryHistory.record(sysClock.epoch(), g_status.batteryVoltage, g_status.batteryPercent, batteryMonitor.chargeRate());
+  }
+}
+
+// Task: advance the WiFi/NTP state machine, waking only as often as it asks
+void networkTask(unsigned long now) {
+  scheduler.runAfter(networkTaskId, now, network.poll(now));
+}
+
+// Task: periodic NTP re-sync (and WiFi reconnect)
+void ntpTask(unsigned long now) {
+  if (!network.isBusy()) {
+    LOG_INFO("Syncing time from NTP...");
+    uint32_t start = sysClock.cycleCount();
+    network.sync(now);
+    metrics.recordPhase(PHASE_NTP, sysClock.cycleCount() - start);
+    scheduler.runAfter(networkTaskId, now, 0);
+  }
+}
+
+// Task: push changed status fields to the web page
+void eventsTask(unsigned long now) {
+  if (!webServerStarted || events.count() == 0) {
+    return;
+  }
+
+  // A slow client would otherwise pile up queued messages; skip this
+  // round and send the accumulated changes once it has drained
+  if (events.avgPacketsWaiting() >= maxEventBacklog) {
+    return;
+  }
+
+  // Nothing new since the last look
+  static uint32_t checkedVersion = 0;
+  if (publishedStatus.version() == checkedVersion) {
+    return;
+  }
+
+  StatusSnapshot status;
+  uint32_t version = publishedStatus.read(status);
+  StatusSnapshot sent = lastSentStatus;
+  char buffer[statusEventSize];
+  JsonWriter json(buffer, sizeof(buffer));
+  json.beginObject();
+  uint8_t changed = writeStatusDelta(json, status, sent);
+  json.endObject();
+  checkedVersion = version;
+  if (changed == 0 || json.overflowed()) {
+    return;
+  }
+
+  events.send(json.c_str(), "status", ++lastEventId);
+  lastSentStatus = sent;
+}
+
+// Keep a new firmware once it has run for a minute and, unless WiFi is
+// only brought up for syncs, got the web server going (so it can be
+// updated again). Go back to the previous one if that hasn't happened by
+// the deadline.
+void checkFirmwareHealth(unsigned long now) {
+  switch (firmwareHealth.check(now, lowPowerMode || webServerStarted)) {
+    case FirmwareHealth::CONFIRMED:
+      LOG_INFO("New firmware confirmed");
+      break;
+    case FirmwareHealth::FAILED:
+      LOG_ERROR("New firmware failed its health check, rolling back");
+      logFlush();
+      firmwareHealth.rollback();
+      break;
+    default:
+      break;
+  }
+}
+
+// Task: one-line status report on the serial console
+void statusReportTask(unsigned long now) {
+  checkFirmwareHealth(now);
+  if (serialTelemetry) {
+    sendTickTelemetry(now);
+  }
+  if (!hasValidTime && g_status.year == 0) {
+    LOG_WARN("Failed to obtain time - waiting for NTP sync");
+    return;
+  }
+
+  LOG_INFO("Today: %d/%d/%d %d:%02d:%02d - Days until %s %d: %d - Battery: %.2fV (%u%%) - %s",
+           g_status.month, g_status.day, g_status.year, g_status.hour, g_status.min, g_status.sec,
+           g_status.event, g_status.eventYear, g_status.days, g_status.batteryVoltage, g_status.batteryPercent,
+           batteryStateName(g_status.batteryStatus));
+}
 
-  // Handle Christmas day specially
-  if (daysUntilChristmas == 0 && currentMonth == 12 && currentDay == 25) {
-    // It's Christmas! Show 0 and blink
-    display.print(0);
-    display.drawColon(millis() % 1000 < 500);
+// Task: detailed network report every 5 minutes
+void networkReportTask(unsigned long now) {
+  if (serialTelemetry) {
+    sendNetworkStatusTelemetry(now);
+  }
+  LOG_INFO("--- Network Status ---");
+  if (WiFi.status() == WL_CONNECTED) {
+    IPAddress addr = WiFi.localIP();
+    LOG_INFO("Connected to: %s, IP address %u.%u.%u.%u, signal strength %d dBm", WiFi.SSID().c_str(),
+             addr[0], addr[1], addr[2], addr[3], WiFi.RSSI());
+    LOG_INFO("Last NTP sync: %lu seconds ago", (now - lastNtpSyncTime) / 1000);
   } else {
-    // Display the countdown
-    display.print(daysUntilChristmas);
-    display.drawColon(false);
-  }
-
-  display.writeDisplay();
-
-  // Debug output
-  Serial.print("Today: ");
-  Serial.print(currentMonth);
-  Serial.print("/");
-  Serial.print(currentDay);
-  Serial.print("/");
-  Serial.print(currentYear);
-  Serial.print(" ");
-  Serial.print(timeinfo.tm_hour);
-  Serial.print(":");
-  if (timeinfo.tm_min < 10) Serial.print("0");
-  Serial.print(timeinfo.tm_min);
-  Serial.print(":");
-  if (timeinfo.tm_sec < 10) Serial.print("0");
-  Serial.print(timeinfo.tm_sec);
-  Serial.print(" - Days until Christmas ");
-  Serial.print(christmasYear);
-  Serial.print(": ");
-  Serial.print(daysUntilChristmas);
-  Serial.print(" - Battery: ");
-  Serial.print(g_batteryVoltage, 2);
-  Serial.print("V (");
-  Serial.print(g_batteryPercent);
-  Serial.print("%) - ");
-  Serial.println(g_batteryStatus);
-
-  // Print network info every 5 minutes
-  if (currentTime - lastNetworkInfoTime >= networkInfoInterval) {
-    Serial.println("\n--- Network Status ---");
-    if (WiFi.status() == WL_CONNECTED) {
-      Serial.print("Connected to: ");
-      Serial.println(WiFi.SSID());
-      Serial.print("IP Address: ");
-      Serial.println(WiFi.localIP());
-      Serial.print("Signal Strength: ");
-      Serial.print(WiFi.RSSI());
-      Serial.println(" dBm");
-      Serial.print("Last NTP sync: ");
-      Serial.print((currentTime - lastNtpSyncTime) / 1000);
-      Serial.println(" seconds ago");
+    LOG_INFO("WiFi: Not Connected, running on internal RTC");
+    if (hasValidTime) {
+      LOG_INFO("Last NTP sync: %lu seconds ago", (now - lastNtpSyncTime) / 1000);
     } else {
-      Serial.println("WiFi: Not Connected");
-      Serial.println("Running on internal RTC");
-      if (hasValidTime) {
-        Serial.print("Last NTP sync: ");
-        Serial.print((currentTime - lastNtpSyncTime) / 1000);
-        Serial.println(" seconds ago");
+      LOG_WARN("Time may not be accurate");
+    }
+  }
+  if (drift.hasEstimate()) {
+    LOG_INFO("RTC drift: %.1f ppm, NTP sync every %lu minutes", drift.ppm(), scheduler.taskInterval(ntpTaskId) / 60000);
+  } else {
+    LOG_INFO("RTC drift: unknown, NTP sync every %lu minutes", scheduler.taskInterval(ntpTaskId) / 60000);
+  }
+  LOG_INFO("Power: awake %.1f%%, radio %.1f%%, ~%.0f mAh/day", powerModel.awakeDuty() * 100.0f,
+           powerModel.radioDuty() * 100.0f, powerModel.measuredMAhPerDay());
+}
+
+// Persist every completed hourly battery average
+void onHistorySample(HistoryResolution res, const BatterySample& sample, uint32_t time, uint16_t readings) {
+  if (res != HISTORY_HOUR) {
+    return;
+  }
+  HistoryLog::Record record = {time, sample.millivolts, sample.percent, sample.rate,
+                               (uint8_t)(readings < 255 ? readings : 255)};
+  if (!historyLog.append(record)) {
+    LOG_ERROR("Failed to write battery history to flash");
+  }
+}
+
+void onHistoryReplay(const HistoryLog::Record& record) {
+  batteryHistory.restoreHour(record.time, record.millivolts, record.percent, record.rate, record.readings);
+}
+
+// Targets saved through /api/targets, or the defaults from config.h
+void loadTargets() {
+  TargetList list;
+  char text[targetsTextSize];
+  int errorLine;
+  size_t len = loadTargetsText(text, sizeof(text));
+  if (len > 0 && parseTargets(text, len, list, errorLine)) {
+    LOG_INFO("Loaded %u countdown targets", list.count);
+  } else {
+    if (len > 0) {
+      LOG_WARN("Saved countdown targets are invalid (line %d), using the defaults", errorLine);
+    }
+    if (!parseTargets(defaultTargets, strlen(defaultTargets), list, errorLine)) {
+      LOG_ERROR("defaultTargets in config.h is invalid (line %d)", errorLine);
+      list.count = 0;
+    }
+  }
+  configuredTargets.write(list);
+}
+
+// Settings from NVS, or the defaults in config.h until something is
+// changed through /api/config
+void loadRuntimeSettings() {
+  memset(&settings, 0, sizeof(settings));
+  settings.networkCount = numNetworks < Settings::MAX_NETWORKS ? numNetworks : Settings::MAX_NETWORKS;
+  for (uint8_t i = 0; i < settings.networkCount; i++) {
+    strlcpy(settings.networks[i].ssid, wifiNetworks[i].ssid, sizeof(settings.networks[i].ssid));
+    strlcpy(settings.networks[i].password, wifiNetworks[i].password, sizeof(settings.networks[i].password));
+  }
+  strlcpy(settings.ntpServer, ntpServer, sizeof(settings.ntpServer));
+  strlcpy(settings.tzRule, tzRule, sizeof(settings.tzRule));
+  settings.displayBrightness = displayBrightness;
+  settings.quietStart = quietStart;
+  settings.quietEnd = quietEnd;
+  settings.quietBrightness = quietBrightness;
+  settings.dimBatteryPercent = dimBatteryPercent;
+  settings.dimBatteryBrightness = dimBatteryBrightness;
+  settings.lowBatteryVoltage = lowBatteryVoltage;
+  settings.lowBatteryPercent = lowBatteryPercent;
+
+  if (loadSettings(settings)) {
+    LOG_INFO("Loaded settings from flash");
+  } else if (numNetworks > Settings::MAX_NETWORKS) {
+    LOG_WARN("Only the first %u networks in config.h are used", Settings::MAX_NETWORKS);
+  }
+  publishedSettings.write(settings);
+  applyTimeZone();
+}
+
+// Put the count from before the reset back on the display. If the clock
+// survived (deep sleep, software reset) it's brought up to date; after
+// power loss it's shown as it was, with the last decimal point lit to say
+// it may be stale, until the clock is set.
+void showCachedCount() {
+  if (!loadCountCache(countCache)) {
+    return;
+  }
+  int32_t days = countCache.days;
+  struct tm timeinfo;
+  bool current = sysClock.localTime(timeinfo);
+  if (current) {
+    days = countCache.eventDay - daysFromCivil(timeinfo.tm_year + 1900, timeinfo.tm_mon + 1, timeinfo.tm_mday);
+  }
+  if (days < 0) {
+    return;  // Passed since; the display task works out what's next
+  }
+
+  char text[8];
+  snprintf(text, sizeof(text), "%4ld", (long)(days < 9999 ? days : 9999));
+  Frame frame = {};
+  textToCells(text, frame.digits, Frame::DIGITS);
+  if (!current) {
+    frame.digits[Frame::DIGITS - 1] |= SEG_DP;
+  }
+  showFrame(frame);
+  showingCachedCount = true;
+  markBoot(BOOT_CACHED);
+  LOG_INFO("Showing cached count: %ld days%s", (long)days, current ? "" : " (clock not set)");
+}
+
+// Bring back state from before the last deep sleep or reboot
+void restorePersistedState() {
+  if (historyLog.begin()) {
+    if (historyLog.repairedBytes() > 0) {
+      LOG_WARN("Cut %u bytes of torn battery history", (unsigned)historyLog.repairedBytes());
+    }
+    uint32_t restored = historyLog.replay(onHistoryReplay);
+    LOG_INFO("Restored %lu hours of battery history", (unsigned long)restored);
+  } else {
+    LOG_ERROR("Couldn't mount flash filesystem, history will not persist");
+  }
+  batteryHistory.onSample(onHistorySample);
+  loadTargets();
+
+  if (!loadRtcState(rtcState)) {
+    return;  // Power-on reset, nothing to restore
+  }
+
+  // The system clock keeps running through deep sleep and software
+  // resets, so if it was set before it still is
+  time_t nowEpoch = sysClock.epoch();
+  if (rtcState.timeValid && nowEpoch >= (time_t)rtcState.lastSyncEpoch) {
+    // Arm SNTP for when WiFi comes up (the clock itself stays in UTC)
+    configTime(0, 0, settings.ntpServer);
+    hasValidTime = true;
+    if (rtcState.driftPpm != 0.0f) {
+      drift.seed(rtcState.driftPpm);
+    }
+    unsigned long age = nowEpoch - rtcState.lastSyncEpoch;
+    lastNtpSyncTime = sysClock.millis() - (age < maxNtpSyncInterval / 1000 ? age * 1000 : maxNtpSyncInterval);
+    LOG_INFO("Restored time from RTC, last NTP sync %lu seconds ago", age);
+    markBoot(BOOT_TIME);
+  }
+}
+
+void setup() {
+  // Logging is buffered, so nothing needs to wait for the serial port
+  Serial.begin(115200);
+  logBegin();
+  markBoot(BOOT_LOG);
+  LOG_INFO("Christmas Countdown Timer");
+  loadRuntimeSettings();
+  markBoot(BOOT_SETTINGS);
+  firmwareHealth.begin();
+  if (firmwareHealth.pending()) {
+    LOG_INFO("Running new firmware, keeping it after a health check");
+  }
+
+  // Check wake-up reason
+  esp_sleep_wakeup_cause_t wakeup_reason = esp_sleep_get_wakeup_cause();
+  if (wakeup_reason == ESP_SLEEP_WAKEUP_TIMER) {
+    LOG_INFO("Woke from deep sleep (battery check)");
+  }
+
+  metrics.setCpuMhz(getCpuFrequencyMhz());
+
+  // The display comes first so the count is back up within milliseconds;
+  // everything after this can take its time
+  if (!display.begin(displayAddress)) {
+    LOG_ERROR("Couldn't find display!");
+    while (1);
+  }
+  scheduleBrightness(false);  // Quiet hours already, if the clock survived the reset
+  loopTaskHandle = xTaskGetCurrentTaskHandle();
+  esp_timer_create_args_t frameTimerArgs = {};
+  frameTimerArgs.callback = onFrameTimer;
+  frameTimerArgs.name = "frame";
+  esp_timer_create(&frameTimerArgs, &frameTimer);
+  if (bootSelfTest) {
+    display.showNumber(8888);  // Test pattern
+    display.refresh();
+    delay(1000);
+    display.clear();
+  }
+  // A timer wake is the low battery check, which may go straight back
+  // to sleep; leave the display dark for that
+  if (wakeup_reason != ESP_SLEEP_WAKEUP_TIMER) {
+    showCachedCount();
+  }
+  display.refresh();
+  LOG_INFO("Display initialized");
+
+  // Initialize MAX17048 fuel gauge
+  if (!fuelGauge.begin()) {
+    LOG_ERROR("Couldn't find MAX17048 fuel gauge! Battery monitoring will be unavailable");
+  } else {
+    LOG_INFO("MAX17048 fuel gauge initialized");
+    hasFuelGauge = true;
+    FuelGaugeReading reading = {};
+    fuelGauge.read(reading);
+
+    LOG_INFO("Battery Voltage: %.2fV, Percent: %.1f%%", reading.voltage, reading.percent);
+
+    // If we woke from sleep, check if battery is still too low
+    if (wakeup_reason == ESP_SLEEP_WAKEUP_TIMER) {
+      if (reading.voltage <= settings.lowBatteryVoltage && reading.percent <= settings.lowBatteryPercent) {
+        LOG_WARN("Battery still too low, going back to sleep");
+        logFlush();
+        esp_sleep_enable_timer_wakeup(3600ULL * 1000000ULL);  // Sleep another hour
+        esp_deep_sleep_start();
       } else {
-        Serial.println("Warning: Time may not be accurate");
+        LOG_INFO("Battery recovered! Continuing normal operation");
+      }
+    }
+
+    // Low battery cutoff is driven by the gauge's ALRT output
+    fuelGauge.setAlerts(settings.lowBatteryVoltage, settings.lowBatteryPercent);
+    if (batteryAlertPin >= 0) {
+      pinMode(batteryAlertPin, INPUT_PULLUP);
+      attachInterrupt(digitalPinToInterrupt(batteryAlertPin), onBatteryAlert, FALLING);
+      if (lowPowerMode) {
+        gpio_wakeup_enable((gpio_num_t)batteryAlertPin, GPIO_INTR_LOW_LEVEL);
+        esp_sleep_enable_gpio_wakeup();
       }
     }
-    Serial.println("---------------------\n");
-    lastNetworkInfoTime = currentTime;
+  }
+  markBoot(BOOT_FUEL_GAUGE);
+
+  restorePersistedState();
+  markBoot(BOOT_RESTORE);
+
+  // Set hostname before connecting to WiFi
+  WiFi.setHostname(hostname);
+  LOG_INFO("Hostname set to: %s", hostname);
+
+  // Connect and sync in the background, starting with the last network
+  // that worked
+  updateNetworkList();
+  wifiBackend.setTimeServer(settings.ntpServer);
+  network.setPreferredNetwork(rtcState.lastGoodNetwork);
+  network.onEvent(onNetworkEvent);
+  network.setStayConnected(!lowPowerMode);
+
+  // A restored clock needs no network at all in low-power mode; the ntp
+  // task catches up when the regular sync is due
+  if (hasValidTime && lowPowerMode) {
+    LOG_INFO("Skipping WiFi, next NTP sync when due");
+  } else {
+    network.sync(sysClock.millis());
+  }
+
+  if (lowPowerMode) {
+    LOG_INFO("Low-power mode: light sleep between ticks, WiFi only during NTP sync");
+  }
+
+  // Register periodic tasks, earliest first run first
+  unsigned long now = sysClock.millis();
+  lastPowerAccountTime = now;
+  networkTaskId = scheduler.addTask("wifi", NetworkManager::ACTIVE_POLL_MS, networkTask, now);
+  displayTaskId = scheduler.addTask("display", lowPowerMode ? lowPowerDisplayTickInterval : displayTickInterval,
+                                    displayTask, now);
+  batteryTaskId = scheduler.addTask("battery", batteryPollInterval, batteryTask, now);
+  statusReportTaskId = scheduler.addTask("status", statusReportInterval, statusReportTask, now, 1000);
+  networkReportTaskId = scheduler.addTask("network", networkInfoInterval, networkReportTask, now, 1000);
+  unsigned long syncInterval = adaptiveSyncInterval();
+  unsigned long sinceSync = now - lastNtpSyncTime;
+  ntpTaskId = scheduler.addTask("ntp", syncInterval, ntpTask, now,
+                                sinceSync < syncInterval ? syncInterval - sinceSync : 0);
+  historyTaskId = scheduler.addTask("history", historyInterval, historyTask, now, historyInterval);
+  if (!lowPowerMode) {
+    // The web page is only reachable while WiFi stays up
+    eventsTaskId = scheduler.addTask("events", eventsInterval, eventsTask, now, eventsInterval);
+    if (beaconHost[0] != '\0') {
+      beaconTaskId = scheduler.addTask("beacon", beaconCheckInterval, beaconTask, now, beaconCheckInterval);
+    }
+  }
+  markBoot(BOOT_SETUP);
+}
+
+void loop() {
+  // The fuel gauge pulled ALRT low, read it now
+  if (batteryAlertPending) {
+    batteryAlertPending = false;
+    scheduler.runAfter(batteryTaskId, sysClock.millis(), 0);
+  }
+  animationFrame();
+  applySubmittedSettings(sysClock.millis());
+  if (restartPending) {
+    LOG_INFO("Restarting into the new firmware");
+    logFlush();
+    delay(500);  // Let the /update response go out
+    ESP.restart();
+  }
+  scheduler.runDue(sysClock.millis());
+
+  // Sleep until the next task is due. In low-power mode the CPU light
+  // sleeps whenever the radio is off; the HT16K33 keeps showing the count
+  // on its own.
+  unsigned long wait = scheduler.msUntilNext(sysClock.millis());
+  bool radioOn = network.radioActive();
+  unsigned long slept = 0;
+  if (lowPowerMode && !radioOn && !frameTimerRunning && wait >= minLightSleepMs) {
+    logFlush();  // UART output would be cut off by the sleep
+    int64_t sleepStart = sysClock.monotonicUs();
+    esp_sleep_enable_timer_wakeup(wait * 1000ULL);
+    esp_light_sleep_start();
+    slept = (sysClock.monotonicUs() - sleepStart) / 1000;
+    if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_GPIO) {
+      batteryAlertPending = true;  // The edge happened while asleep
+    }
+  } else {
+    // Like delay(), but the frame timer can wake us early
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait));
   }
 
-  // Update every 60 seconds
-  delay(60000);
+  unsigned long now = sysClock.millis();
+  unsigned long elapsed = now - lastPowerAccountTime;
+  powerModel.account(elapsed, slept, radioOn ? elapsed : 0);
+  lastPowerAccountTime = now;
 }
@@ -0,0 +1,175 @@
+#include "metrics.h"
+#include <stdio.h>
+#include <string.h>
+
+const uint32_t LatencyHistogram::BOUNDS_US[BUCKETS] = {
+  10, 50, 100, 500, 1000, 5000, 10000, 50000, 100000, 500000
+};
+
+const char* const LatencyHistogram::BOUNDS_LABEL[BUCKETS] = {
+  "1e-05", "5e-05", "0.0001", "0.0005", "0.001", "0.005", "0.01", "0.05", "0.1", "0.5"
+};
+
+void LatencyHistogram::record(uint32_t us) {
+  uint8_t i = 0;
+  while (i < BUCKETS && us > BOUNDS_US[i]) {
+    i++;
+  }
+  working.buckets[i]++;
+  working.total++;
+  working.sumUs += us;
+  published.write(working);
+}
+
+const char* Metrics::phaseName(int index) {
+  static const char* const names[PHASE_COUNT] = {"time", "battery", "display", "ntp"};
+  return index >= 0 && index < PHASE_COUNT ? names[index] : "";
+}
+
+const char* Metrics::routeName(int index) {
+  static const char* const names[ROUTE_COUNT] = {"/", "/api/status", "/api/history", "/events",
+                                                 "/api/metrics", "/api/log", "/api/targets", "/api/config",
+                                                 "/update"};
+  return index >= 0 && index < ROUTE_COUNT ? names[index] : "";
+}
+
+struct ScalarFamily {
+  const char* name;
+  const char* type;
+  const char* help;
+  size_t offset;  // Into MetricsGauges
+};
+
+static const ScalarFamily SCALARS[] = {
+  {"countdown_uptime_seconds", "gauge", "Seconds since boot", offsetof(MetricsGauges, uptimeSeconds)},
+  {"esp_heap_free_bytes", "gauge", "Free heap", offsetof(MetricsGauges, heapFree)},
+  {"esp_heap_min_free_bytes", "gauge", "Lowest free heap since boot", offsetof(MetricsGauges, heapMinFree)},
+  {"esp_heap_largest_free_block_bytes", "gauge", "Largest block the heap can allocate",
+   offsetof(MetricsGauges, heapLargestBlock)},
+  {"wifi_connect_attempts_total", "counter", "WiFi connection attempts", offsetof(MetricsGauges, wifiConnectAttempts)},
+  {"wifi_connections_total", "counter", "Successful WiFi connections", offsetof(MetricsGauges, wifiConnections)},
+  {"wifi_disconnects_total", "counter", "WiFi connections dropped while online", offsetof(MetricsGauges, wifiDisconnects)},
+  {"ntp_syncs_total", "counter", "Completed NTP syncs", offsetof(MetricsGauges, ntpSyncs)},
+  {"scheduler_wakeups_total", "counter", "Main loop wakeups", offsetof(MetricsGauges, schedulerWakeups)},
+  {"http_response_buffers_exhausted_total", "counter", "Requests refused because every response buffer was in use",
+   offsetof(MetricsGauges, responseBuffersExhausted)},
+};
+static const uint8_t SCALAR_COUNT = sizeof(SCALARS) / sizeof(SCALARS[0]);
+
+struct HistogramFamily {
+  const char* name;
+  const char* help;
+  const char* label;
+  uint8_t count;
+  const char* (*labelValue)(int index);
+  const LatencyHistogram& (Metrics::*histogram)(int index) const;
+};
+
+static const HistogramFamily HISTOGRAMS[] = {
+  {"countdown_phase_duration_seconds", "Time spent in each main loop phase", "phase", PHASE_COUNT,
+   Metrics::phaseName, &Metrics::phase},
+  {"http_request_duration_seconds", "Time spent handling each web request", "route", ROUTE_COUNT,
+   Metrics::routeName, &Metrics::route},
+};
+static const uint8_t HISTOGRAM_COUNT = sizeof(HISTOGRAMS) / sizeof(HISTOGRAMS[0]);
+
+// Lines per labelled histogram: each bucket, +Inf, _sum and _count
+static const uint8_t HISTOGRAM_LINES = LatencyHistogram::BUCKETS + 3;
+
+MetricsWriter::MetricsWriter(const Metrics& metrics, const MetricsGauges& gauges)
+    : metrics(metrics), gauges(gauges), family(0), step(0), counts(), lineLen(0), linePos(0) {}
+
+size_t MetricsWriter::fill(uint8_t* buffer, size_t maxLen) {
+  size_t written = 0;
+  while (written < maxLen) {
+    if (linePos == lineLen && !loadLine()) {
+      break;
+    }
+    size_t n = lineLen - linePos;
+    if (n > maxLen - written) n = maxLen - written;
+    memcpy(buffer + written, line + linePos, n);
+    linePos += n;
+    written += n;
+  }
+  return written;
+}
+
+bool MetricsWriter::loadLine() {
+  linePos = 0;
+  lineLen = 0;
+  while (family < SCALAR_COUNT + HISTOGRAM_COUNT) {
+    bool loaded = family < SCALAR_COUNT ? loadScalarLine(family) : loadHistogramLine(family - SCALAR_COUNT);
+    if (loaded) {
+      step++;
+      return true;
+    }
+    family++;
+    step = 0;
+  }
+  return false;
+}
+
+bool MetricsWriter::loadScalarLine(uint8_t index) {
+  const ScalarFamily& f = SCALARS[index];
+  int len;
+  switch (step) {
+    case 0:
+      len = snprintf(line, sizeof(line), "# HELP %s %s\n", f.name, f.help);
+      break;
+    case 1:
+      len = snprintf(line, sizeof(line), "# TYPE %s %s\n", f.name, f.type);
+      break;
+    case 2: {
+      uint32_t value;
+      memcpy(&value, (const uint8_t*)&gauges + f.offset, sizeof(value));
+      len = snprintf(line, sizeof(line), "%s %lu\n", f.name, (unsigned long)value);
+      break;
+    }
+    default:
+      return false;
+  }
+  lineLen = len < (int)sizeof(line) ? len : sizeof(line) - 1;
+  return true;
+}
+
+bool MetricsWriter::loadHistogramLine(uint8_t index) {
+  const HistogramFamily& f = HISTOGRAMS[index];
+  int len;
+  if (step == 0) {
+    len = snprintf(line, sizeof(line), "# HELP %s %s\n", f.name, f.help);
+  } else if (step == 1) {
+    len = snprintf(line, sizeof(line), "# TYPE %s histogram\n", f.name);
+  } else {
+    uint8_t item = (step - 2) / HISTOGRAM_LINES;
+    uint8_t part = (step - 2) % HISTOGRAM_LINES;
+    if (item >= f.count) {
+      return false;
+    }
+
+    // One copy per histogram, so its lines agree with each other
+    if (part == 0) {
+      (metrics.*f.histogram)(item).read(counts);
+    }
+    const char* labelValue = f.labelValue(item);
+    if (part <= LatencyHistogram::BUCKETS) {
+      // Prometheus buckets are cumulative
+      uint32_t cumulative = 0;
+      for (uint8_t i = 0; i <= part; i++) {
+        cumulative += counts.buckets[i];
+      }
+      const char* le = part < LatencyHistogram::BUCKETS ? LatencyHistogram::BOUNDS_LABEL[part] : "+Inf";
+      len = snprintf(line, sizeof(line), "%s_bucket{%s=\"%s\",le=\"%s\"} %lu\n",
+                     f.name, f.label, labelValue, le, (unsigned long)cumulative);
+    } else if (part == LatencyHistogram::BUCKETS + 1) {
+      // Integer formatting only, float printf can allocate
+      uint64_t sum = counts.sumUs;
+      len = snprintf(line, sizeof(line), "%s_sum{%s=\"%s\"} %lu.%06lu\n", f.name, f.label, labelValue,
+                     (unsigned long)(sum / 1000000), (unsigned long)(sum % 1000000));
+    } else {
+      len = snprintf(line, sizeof(line), "%s_count{%s=\"%s\"} %lu\n", f.name, f.label, labelValue,
+                     (unsigned long)counts.total);
+    }
+  }
+  lineLen = len < (int)sizeof(line) ? len : sizeof(line) - 1;
+  return true;
+}
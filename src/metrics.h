@@ -0,0 +1,122 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "seqlock.h"
+
+// Runtime instrumentation, served in Prometheus text format.
+//
+// Latencies go into fixed-bucket histograms, so recording is a few integer
+// operations and memory use never grows. Each histogram has one writer:
+// loop phases are recorded from the loop task and web requests from the
+// web server's task. The writer publishes the histogram whole through a
+// Seqlock after each update, so a scrape from another task reads buckets,
+// count and a 64-bit sum that all belong to the same update.
+
+class LatencyHistogram {
+public:
+  static const uint8_t BUCKETS = 10;         // Plus an implicit +Inf bucket
+  static const uint32_t BOUNDS_US[BUCKETS];  // Upper bounds in microseconds
+  static const char* const BOUNDS_LABEL[BUCKETS];  // The same bounds in seconds, as "le" labels
+
+  struct Counts {
+    uint32_t buckets[BUCKETS + 1];  // Not cumulative; BUCKETS is +Inf
+    uint32_t total;
+    uint64_t sumUs;
+  };
+
+  // From the histogram's one writer only
+  void record(uint32_t us);
+
+  // A consistent copy, from any task
+  void read(Counts& counts) const { published.read(counts); }
+
+private:
+  Counts working = {};
+  Seqlock<Counts> published;
+};
+
+enum MetricsPhase {
+  PHASE_TIME,      // Reading the clock and working out the countdown
+  PHASE_BATTERY,   // Fuel gauge reads
+  PHASE_DISPLAY,   // Display I2C write
+  PHASE_NTP,       // Starting a WiFi/NTP sync
+  PHASE_COUNT
+};
+
+enum MetricsRoute {
+  ROUTE_PAGE,
+  ROUTE_STATUS,
+  ROUTE_HISTORY,
+  ROUTE_EVENTS,
+  ROUTE_METRICS,
+  ROUTE_LOG,
+  ROUTE_TARGETS,
+  ROUTE_CONFIG,
+  ROUTE_UPDATE,
+  ROUTE_COUNT
+};
+
+// Point-in-time values gathered by the caller for each scrape
+struct MetricsGauges {
+  uint32_t uptimeSeconds;
+  uint32_t heapFree;
+  uint32_t heapMinFree;
+  uint32_t heapLargestBlock;
+  uint32_t wifiConnectAttempts;
+  uint32_t wifiConnections;
+  uint32_t wifiDisconnects;
+  uint32_t ntpSyncs;
+  uint32_t schedulerWakeups;
+  uint32_t responseBuffersExhausted;
+};
+
+class Metrics {
+public:
+  // Cycle counts are converted at this clock rate
+  void setCpuMhz(uint32_t mhz) { cpuMhz = mhz > 0 ? mhz : 1; }
+
+  // Record a loop phase from a cycle counter delta
+  void recordPhase(MetricsPhase phase, uint32_t cycles) { phases[phase].record(cycles / cpuMhz); }
+  void recordRequest(MetricsRoute route, uint32_t us) { routes[route].record(us); }
+
+  const LatencyHistogram& phase(int index) const { return phases[index]; }
+  const LatencyHistogram& route(int index) const { return routes[index]; }
+
+  static const char* phaseName(int index);
+  static const char* routeName(int index);
+
+private:
+  uint32_t cpuMhz = 240;
+  LatencyHistogram phases[PHASE_COUNT];
+  LatencyHistogram routes[ROUTE_COUNT];
+};
+
+// Streams the metrics as Prometheus text, a line at a time, for a chunked
+// response
+class MetricsWriter {
+public:
+  MetricsWriter(const Metrics& metrics, const MetricsGauges& gauges);
+
+  // Fill up to maxLen bytes. Returns 0 once everything has been written.
+  size_t fill(uint8_t* buffer, size_t maxLen);
+
+private:
+  static const uint8_t MAX_LINE = 128;
+
+  bool loadLine();
+  bool loadScalarLine(uint8_t index);
+  bool loadHistogramLine(uint8_t index);
+
+  const Metrics& metrics;
+  MetricsGauges gauges;
+  uint8_t family;     // Metric family being written
+  uint16_t step;      // Line within the family
+  LatencyHistogram::Counts counts;  // Of the histogram being written, copied at its first line
+  char line[MAX_LINE];
+  uint8_t lineLen;
+  uint8_t linePos;
+};
+
+#endif
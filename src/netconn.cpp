@@ -0,0 +1,193 @@
+#include "netconn.h"
+
+NetworkManager::NetworkManager(NetworkBackend& backend)
+    : backend(backend),
+      networks(nullptr),
+      networkCount(0),
+      preferred(-1),
+      currentState(IDLE),
+      stateStart(0),
+      attempt(0),
+      currentNetwork(-1),
+      eventCallback(nullptr),
+      stayConnected(true),
+      retryMs(RETRY_MIN_MS),
+      attempts(0),
+      connectCount(0),
+      syncCount(0),
+      firstRequestAt(0),
+      firstRequestSeen(false),
+      firstSyncMs(0) {}
+
+void NetworkManager::setNetworks(const NetworkCredentials* list, int count) {
+  networks = list;
+  networkCount = count;
+  if (preferred >= networkCount) {
+    preferred = -1;
+  }
+}
+
+void NetworkManager::setPreferredNetwork(int index) {
+  preferred = (index >= 0 && index < networkCount) ? index : -1;
+}
+
+void NetworkManager::sync(unsigned long now) {
+  if (isBusy()) {
+    return;
+  }
+
+  if (!firstRequestSeen) {
+    firstRequestSeen = true;
+    firstRequestAt = now;
+  }
+
+  if (currentState == ONLINE && backend.isConnected()) {
+    // Already connected, just sync time
+    enter(SYNCING, now);
+    return;
+  }
+
+  if (networkCount == 0) {
+    emit(NET_ALL_FAILED, -1);
+    enter(OFFLINE, now);
+    return;
+  }
+
+  attempt = 0;
+  startAttempt(now);
+}
+
+void NetworkManager::reconnect(unsigned long now) {
+  if (isBusy()) {
+    return;
+  }
+  if (currentState == ONLINE) {
+    backend.disconnect();
+  }
+  currentState = IDLE;
+  sync(now);
+}
+
+unsigned long NetworkManager::poll(unsigned long now) {
+  switch (currentState) {
+    case CONNECTING:
+      if (backend.isConnected()) {
+        connectCount++;
+        preferred = currentNetwork;  // Try this one first next time
+        retryMs = RETRY_MIN_MS;
+        emit(NET_CONNECTED, currentNetwork);
+        enter(SYNCING, now);
+      } else if (now - stateStart >= CONNECT_TIMEOUT_MS) {
+        emit(NET_CONNECT_FAILED, currentNetwork);
+        backend.disconnect();
+        attempt++;
+        if (attempt < networkCount) {
+          startAttempt(now);
+        } else {
+          emit(NET_ALL_FAILED, -1);
+          if (!stayConnected) {
+            backend.radioOff();
+          }
+          enter(OFFLINE, now);
+        }
+      }
+      return ACTIVE_POLL_MS;
+
+    case SYNCING:
+      if (backend.timeSynced()) {
+        syncCount++;
+        if (firstSyncMs == 0) {
+          unsigned long elapsed = now - firstRequestAt;
+          firstSyncMs = elapsed > 0 ? elapsed : 1;
+        }
+        emit(NET_TIME_SYNCED, currentNetwork);
+        finishSync(now);
+        return IDLE_POLL_MS;
+      }
+      if (now - stateStart >= SYNC_TIMEOUT_MS) {
+        emit(NET_SYNC_FAILED, currentNetwork);
+        finishSync(now);
+        return IDLE_POLL_MS;
+      }
+      return ACTIVE_POLL_MS;
+
+    case ONLINE:
+      if (!backend.isConnected()) {
+        emit(NET_LOST, currentNetwork);
+        enter(OFFLINE, now);
+      }
+      return IDLE_POLL_MS;
+
+    case OFFLINE: {
+      if (!stayConnected) {
+        return IDLE_POLL_MS;
+      }
+      if (currentNetwork >= 0 && backend.isConnected()) {
+        // Rejoined by itself; the clock ran free meanwhile, so sync again
+        connectCount++;
+        retryMs = RETRY_MIN_MS;
+        emit(NET_CONNECTED, currentNetwork);
+        enter(SYNCING, now);
+        return ACTIVE_POLL_MS;
+      }
+      unsigned long waited = now - stateStart;
+      if (waited >= retryMs && networkCount > 0) {
+        retryMs = retryMs >= RETRY_MAX_MS / 2 ? RETRY_MAX_MS : retryMs * 2;
+        backend.disconnect();
+        attempt = 0;
+        startAttempt(now);
+        return ACTIVE_POLL_MS;
+      }
+      unsigned long left = retryMs - waited;
+      return left < IDLE_POLL_MS ? left : IDLE_POLL_MS;
+    }
+
+    case IDLE:
+    default:
+      return IDLE_POLL_MS;
+  }
+}
+
+void NetworkManager::finishSync(unsigned long now) {
+  backend.stopTimeSync();
+  if (stayConnected) {
+    enter(ONLINE, now);
+  } else {
+    backend.radioOff();
+    enter(IDLE, now);
+  }
+}
+
+void NetworkManager::startAttempt(unsigned long now) {
+  currentNetwork = networkForAttempt(attempt);
+  attempts++;
+  emit(NET_ATTEMPT, currentNetwork);
+  backend.begin(networks[currentNetwork].ssid, networks[currentNetwork].password);
+  enter(CONNECTING, now);
+}
+
+// Fallback order: the preferred network first, then the rest in list order
+int NetworkManager::networkForAttempt(int n) const {
+  if (preferred < 0) {
+    return n;
+  }
+  if (n == 0) {
+    return preferred;
+  }
+  int index = n - 1;
+  return index >= preferred ? index + 1 : index;
+}
+
+void NetworkManager::enter(State next, unsigned long now) {
+  currentState = next;
+  stateStart = now;
+  if (next == SYNCING) {
+    backend.startTimeSync();
+  }
+}
+
+void NetworkManager::emit(NetworkEvent event, int index) {
+  if (eventCallback != nullptr) {
+    eventCallback(event, index);
+  }
+}
@@ -0,0 +1,123 @@
+#ifndef NETCONN_H
+#define NETCONN_H
+
+#include <stdint.h>
+
+// Non-blocking WiFi + NTP connection state machine.
+//
+// Walks the configured networks with fallback, trying the last network that
+// worked first, then starts an NTP sync once connected. Nothing here ever
+// waits: poll() advances the state machine and returns how long until it
+// next needs attention. All hardware access goes through NetworkBackend so
+// the logic can be exercised against a simulated network.
+
+struct NetworkCredentials {
+  const char* ssid;
+  const char* password;
+};
+
+// Hardware seam over WiFi and the SNTP client
+class NetworkBackend {
+public:
+  virtual ~NetworkBackend() {}
+  virtual void begin(const char* ssid, const char* password) = 0;
+  virtual bool isConnected() = 0;
+  virtual void disconnect() = 0;
+  virtual void startTimeSync() = 0;
+  virtual bool timeSynced() = 0;  // True once the sync started above completed
+  virtual void stopTimeSync() = 0;  // Let the clock free-run until the next sync
+  virtual void radioOff() = 0;
+};
+
+enum NetworkEvent {
+  NET_ATTEMPT,         // Started connecting to a network
+  NET_CONNECTED,       // Associated and got an IP
+  NET_CONNECT_FAILED,  // One network timed out
+  NET_ALL_FAILED,      // Every network failed, will retry (see poll())
+  NET_TIME_SYNCED,     // NTP sync completed
+  NET_SYNC_FAILED,     // NTP sync timed out
+  NET_LOST             // Connection dropped while online
+};
+
+typedef void (*NetworkEventCallback)(NetworkEvent event, int networkIndex);
+
+class NetworkManager {
+public:
+  enum State { IDLE, CONNECTING, SYNCING, ONLINE, OFFLINE };
+
+  static const unsigned long CONNECT_TIMEOUT_MS = 10000;  // Per network
+  static const unsigned long SYNC_TIMEOUT_MS = 10000;
+  static const unsigned long ACTIVE_POLL_MS = 100;
+  static const unsigned long IDLE_POLL_MS = 10000;
+  static const unsigned long RETRY_MIN_MS = 30000;  // Reconnect backoff while offline
+  static const unsigned long RETRY_MAX_MS = 1800000;
+
+  explicit NetworkManager(NetworkBackend& backend);
+
+  void setNetworks(const NetworkCredentials* networks, int count);
+  void setPreferredNetwork(int index);
+  void onEvent(NetworkEventCallback callback) { eventCallback = callback; }
+
+  // When false, the radio is switched off as soon as each sync finishes
+  // (successfully or not) and only powered up again by the next sync()
+  void setStayConnected(bool stay) { stayConnected = stay; }
+  bool radioActive() const { return currentState != IDLE && currentState != OFFLINE; }
+
+  // Connect (if needed) and sync time. Does nothing if a connection or
+  // sync is already in progress.
+  void sync(unsigned long now);
+
+  // Drop the current connection (if any) and connect again from the top of
+  // the list, e.g. after the list changed. Does nothing while busy.
+  void reconnect(unsigned long now);
+
+  // Advance the state machine. Returns milliseconds until the next poll.
+  //
+  // Offline with stayConnected, it watches for the link coming back by
+  // itself (the WiFi stack rejoins after a drop) and otherwise starts over
+  // from the top of the list, backing off from RETRY_MIN_MS to
+  // RETRY_MAX_MS between rounds. Without stayConnected the radio stays off
+  // until the next sync().
+  unsigned long poll(unsigned long now);
+
+  State state() const { return currentState; }
+  bool isBusy() const { return currentState == CONNECTING || currentState == SYNCING; }
+  int connectedNetwork() const { return currentState == SYNCING || currentState == ONLINE ? currentNetwork : -1; }
+  int preferredNetwork() const { return preferred; }
+
+  // Statistics
+  uint32_t connectAttempts() const { return attempts; }
+  uint32_t connections() const { return connectCount; }
+  uint32_t timeSyncs() const { return syncCount; }
+  unsigned long firstSyncLatency() const { return firstSyncMs; }  // 0 until the first sync
+  unsigned long retryDelay() const { return retryMs; }  // Current offline backoff
+
+private:
+  void startAttempt(unsigned long now);
+  int networkForAttempt(int attempt) const;
+  void enter(State next, unsigned long now);
+  void finishSync(unsigned long now);
+  void emit(NetworkEvent event, int index);
+
+  NetworkBackend& backend;
+  const NetworkCredentials* networks;
+  int networkCount;
+  int preferred;
+
+  State currentState;
+  unsigned long stateStart;
+  int attempt;          // Position in the fallback order
+  int currentNetwork;   // Index into networks
+  NetworkEventCallback eventCallback;
+  bool stayConnected;
+  unsigned long retryMs;
+
+  uint32_t attempts;
+  uint32_t connectCount;
+  uint32_t syncCount;
+  unsigned long firstRequestAt;
+  bool firstRequestSeen;
+  unsigned long firstSyncMs;
+};
+
+#endif
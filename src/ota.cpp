@@ -0,0 +1,114 @@
+#include "ota.h"
+#include <string.h>
+
+static int hexDigit(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+OtaUpdate::OtaUpdate(FirmwareSlot& slot) : slot(slot), state(IDLE), errorMessage(""), bytesWritten(0) {
+  memset(expected, 0, sizeof(expected));
+}
+
+bool OtaUpdate::begin(const char* sha256Hex) {
+  abort();
+  state = IDLE;
+  errorMessage = "";
+  bytesWritten = 0;
+
+  if (sha256Hex == nullptr || strlen(sha256Hex) != 2 * sizeof(expected)) {
+    fail("sha256 must be 64 hex digits");
+    return false;
+  }
+  for (size_t i = 0; i < sizeof(expected); i++) {
+    int high = hexDigit(sha256Hex[2 * i]), low = hexDigit(sha256Hex[2 * i + 1]);
+    if (high < 0 || low < 0) {
+      fail("sha256 must be 64 hex digits");
+      return false;
+    }
+    expected[i] = high << 4 | low;
+  }
+
+  if (!slot.begin()) {
+    fail("no partition to update");
+    return false;
+  }
+  hash.begin();
+  state = WRITING;
+  return true;
+}
+
+bool OtaUpdate::write(const uint8_t* data, size_t length) {
+  if (state != WRITING) {
+    return false;
+  }
+  hash.update(data, length);
+  if (!slot.write(data, length)) {
+    abort();
+    fail("write failed");
+    return false;
+  }
+  bytesWritten += length;
+  return true;
+}
+
+bool OtaUpdate::finish() {
+  if (state != WRITING) {
+    return false;
+  }
+  uint8_t actual[Sha256::DIGEST_BYTES];
+  hash.finish(actual);
+  if (memcmp(actual, expected, sizeof(actual)) != 0) {
+    slot.abort();
+    fail("sha256 mismatch");
+    return false;
+  }
+  if (!slot.end()) {
+    fail("image rejected");
+    return false;
+  }
+  state = DONE;
+  return true;
+}
+
+void OtaUpdate::abort() {
+  if (state != WRITING) {
+    return;
+  }
+  slot.abort();
+  fail("aborted");
+}
+
+void OtaUpdate::refuse(const char* reason) {
+  abort();
+  fail(reason);
+}
+
+void OtaUpdate::fail(const char* reason) {
+  state = FAILED;
+  errorMessage = reason;
+}
+
+FirmwareHealth::FirmwareHealth(FirmwareSlot& slot) : slot(slot), onProbation(false) {}
+
+void FirmwareHealth::begin() {
+  onProbation = slot.pendingVerify();
+}
+
+FirmwareHealth::Verdict FirmwareHealth::check(unsigned long now, bool reachable) {
+  if (!onProbation) {
+    return SETTLED;
+  }
+  if (now >= HEALTHY_AFTER_MS && reachable) {
+    slot.markValid();
+    onProbation = false;
+    return CONFIRMED;
+  }
+  return now >= DEADLINE_MS ? FAILED : WAITING;
+}
+
+void FirmwareHealth::rollback() {
+  slot.rollback();
+}
@@ -0,0 +1,119 @@
+#ifndef OTA_H
+#define OTA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sha256.h"
+
+// Firmware updates over the web server.
+//
+// The upload is written to the inactive OTA partition as it arrives, a
+// chunk at a time, so the image never has to fit in RAM. A SHA-256 of the
+// bytes is kept as they go past and compared with the one the uploader
+// sent before the new partition is made bootable.
+//
+// A new image boots in the "pending verify" state. FirmwareHealth marks
+// it valid once it has shown it works; if it rolls back instead, or the
+// device resets before deciding, the bootloader goes back to the previous
+// image.
+//
+// The flash and boot partition side is FirmwareSlot; firmware_slot.h has
+// the ESP32 one.
+
+class FirmwareSlot {
+public:
+  virtual ~FirmwareSlot() {}
+
+  // Get the inactive partition ready for an image of unknown size
+  virtual bool begin() = 0;
+  virtual bool write(const uint8_t* data, size_t length) = 0;
+
+  // Check the image written and boot from it next time
+  virtual bool end() = 0;
+
+  // Drop what was written; the boot partition stays as it was
+  virtual void abort() = 0;
+
+  // The running image was just installed and hasn't been confirmed yet
+  virtual bool pendingVerify() = 0;
+
+  // Keep the running image
+  virtual void markValid() = 0;
+
+  // Go back to the previous image. On the device this reboots.
+  virtual void rollback() = 0;
+};
+
+class OtaUpdate {
+public:
+  explicit OtaUpdate(FirmwareSlot& slot);
+
+  // Start an update expecting the given SHA-256 (64 hex digits). Returns
+  // false, with error() set, if the hash is malformed or there is no
+  // partition to write to.
+  bool begin(const char* sha256Hex);
+
+  // Write the next piece of the image. False once anything has failed.
+  bool write(const uint8_t* data, size_t length);
+
+  // Check the hash and image and make the new partition bootable
+  bool finish();
+
+  // Give up on the update, leaving the running firmware in charge
+  void abort();
+
+  // Refuse an update before it starts, e.g. for a low battery
+  void refuse(const char* reason);
+
+  bool active() const { return state == WRITING; }
+  bool succeeded() const { return state == DONE; }
+  const char* error() const { return errorMessage; }
+  size_t written() const { return bytesWritten; }
+
+private:
+  enum State : uint8_t { IDLE, WRITING, DONE, FAILED };
+
+  void fail(const char* reason);
+
+  FirmwareSlot& slot;
+  State state;
+  const char* errorMessage;
+  size_t bytesWritten;
+  uint8_t expected[Sha256::DIGEST_BYTES];
+  Sha256 hash;
+};
+
+// Probation for a freshly installed image: keep it once it has run for
+// HEALTHY_AFTER_MS and is reachable for another update, give up on it if
+// that hasn't happened by DEADLINE_MS after boot.
+class FirmwareHealth {
+public:
+  static const unsigned long HEALTHY_AFTER_MS = 60000;  // 1 minute
+  static const unsigned long DEADLINE_MS = 300000;      // 5 minutes
+
+  enum Verdict : uint8_t {
+    SETTLED,    // Not on probation
+    WAITING,
+    CONFIRMED,  // Marked valid just now
+    FAILED      // Call rollback(), after saying why
+  };
+
+  explicit FirmwareHealth(FirmwareSlot& slot);
+
+  // Read the boot state, once at boot
+  void begin();
+
+  // now is milliseconds since boot; reachable means the web server is up,
+  // or WiFi is only brought up for syncs anyway
+  Verdict check(unsigned long now, bool reachable);
+
+  void rollback();
+
+  bool pending() const { return onProbation; }
+
+private:
+  FirmwareSlot& slot;
+  bool onProbation;
+};
+
+#endif
@@ -0,0 +1,215 @@
+#include "persist.h"
+#include "crc.h"
+#include "settings.h"
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <Preferences.h>
+
+static const uint32_t RTC_STATE_MAGIC = 0x58435331;  // "XCS1"
+
+// Survives deep sleep and software resets, not power loss
+RTC_DATA_ATTR static struct {
+  uint32_t magic;
+  RtcState state;
+  uint32_t crc;
+} rtcStore;
+
+static const char* segmentPath(uint8_t segment) {
+  return segment == 0 ? "/hist0.log" : "/hist1.log";
+}
+
+bool loadRtcState(RtcState& state) {
+  if (rtcStore.magic == RTC_STATE_MAGIC &&
+      rtcStore.crc == crc32(&rtcStore.state, sizeof(rtcStore.state))) {
+    state = rtcStore.state;
+    return true;
+  }
+
+  state.lastSyncEpoch = 0;
+  state.driftPpm = 0.0f;
+  state.lastGoodNetwork = -1;
+  state.timeValid = false;
+  state.batteryMillivolts = 0;
+  state.batteryPercent = 0;
+  return false;
+}
+
+void saveRtcState(const RtcState& state) {
+  rtcStore.magic = RTC_STATE_MAGIC;
+  rtcStore.state = state;
+  rtcStore.crc = crc32(&rtcStore.state, sizeof(rtcStore.state));
+}
+
+static const char* TARGETS_PATH = "/targets.txt";
+static const char* TARGETS_TEMP_PATH = "/targets.tmp";
+
+size_t loadTargetsText(char* buffer, size_t size) {
+  // Power lost between the remove and the rename in saveTargetsText leaves
+  // only the new file, under its temporary name
+  const char* path = LittleFS.exists(TARGETS_PATH) ? TARGETS_PATH : TARGETS_TEMP_PATH;
+  if (!LittleFS.exists(path)) {
+    return 0;
+  }
+  File f = LittleFS.open(path, "r");
+  if (!f) {
+    return 0;
+  }
+  size_t length = f.read((uint8_t*)buffer, size);
+  f.close();
+  return length;
+}
+
+bool saveTargetsText(const char* text, size_t length) {
+  File f = LittleFS.open(TARGETS_TEMP_PATH, "w");
+  if (!f) {
+    return false;
+  }
+  bool written = f.write((const uint8_t*)text, length) == length;
+  f.close();
+  if (!written) {
+    LittleFS.remove(TARGETS_TEMP_PATH);
+    return false;
+  }
+  LittleFS.remove(TARGETS_PATH);
+  return LittleFS.rename(TARGETS_TEMP_PATH, TARGETS_PATH);
+}
+
+// NVS rather than LittleFS: it's readable before the filesystem is mounted
+// and NVS entries are checksummed, so a torn write reads as missing
+static const char* COUNT_NAMESPACE = "countdown";
+static const char* COUNT_KEY = "count";
+
+bool loadCountCache(CountCache& cache) {
+  Preferences prefs;
+  if (!prefs.begin(COUNT_NAMESPACE, true)) {
+    return false;
+  }
+  bool loaded = prefs.getBytes(COUNT_KEY, &cache, sizeof(cache)) == sizeof(cache);
+  prefs.end();
+  return loaded;
+}
+
+bool saveCountCache(const CountCache& cache) {
+  Preferences prefs;
+  if (!prefs.begin(COUNT_NAMESPACE, false)) {
+    return false;
+  }
+  bool saved = prefs.putBytes(COUNT_KEY, &cache, sizeof(cache)) == sizeof(cache);
+  prefs.end();
+  return saved;
+}
+
+static const char* SETTINGS_NAMESPACE = "countdown";
+static const char* SETTINGS_KEY = "settings";
+
+bool loadSettings(Settings& settings) {
+  Preferences prefs;
+  if (!prefs.begin(SETTINGS_NAMESPACE, true)) {
+    return false;  // Namespace doesn't exist yet
+  }
+  uint8_t record[SETTINGS_MAX_BYTES];
+  size_t length = prefs.getBytesLength(SETTINGS_KEY);
+  bool loaded = length > 0 && length <= sizeof(record) && prefs.getBytes(SETTINGS_KEY, record, length) == length;
+  prefs.end();
+  if (!loaded) {
+    return false;
+  }
+
+  // Decode into a copy so a damaged record can't leave half of it behind
+  Settings decoded = settings;
+  const char* error;
+  if (!decodeSettings(record, length, decoded) || !validateSettings(decoded, error)) {
+    return false;
+  }
+  settings = decoded;
+  return true;
+}
+
+bool saveSettings(const Settings& settings) {
+  uint8_t record[SETTINGS_MAX_BYTES];
+  size_t length = encodeSettings(settings, record, sizeof(record));
+  if (length == 0) {
+    return false;
+  }
+  Preferences prefs;
+  if (!prefs.begin(SETTINGS_NAMESPACE, false)) {
+    return false;
+  }
+  bool saved = prefs.putBytes(SETTINGS_KEY, record, length) == length;
+  prefs.end();
+  return saved;
+}
+
+bool LittleFsLogStore::begin() {
+  return LittleFS.begin(true);
+}
+
+size_t LittleFsLogStore::size(uint8_t segment) {
+  if (!LittleFS.exists(segmentPath(segment))) {
+    return 0;
+  }
+  File f = LittleFS.open(segmentPath(segment), "r");
+  if (!f) {
+    return 0;
+  }
+  size_t size = f.size();
+  f.close();
+  return size;
+}
+
+size_t LittleFsLogStore::read(uint8_t segment, size_t offset, uint8_t* out, size_t length) {
+  if (!LittleFS.exists(segmentPath(segment))) {
+    return 0;
+  }
+  File f = LittleFS.open(segmentPath(segment), "r");
+  if (!f) {
+    return 0;
+  }
+  size_t n = f.seek(offset) ? f.read(out, length) : 0;
+  f.close();
+  return n;
+}
+
+bool LittleFsLogStore::append(uint8_t segment, const uint8_t* data, size_t length) {
+  File f = LittleFS.open(segmentPath(segment), "a");
+  if (!f) {
+    return false;
+  }
+  bool ok = f.write(data, length) == length;
+  f.close();
+  return ok;
+}
+
+static const char* SEGMENT_TEMP_PATH = "/hist.tmp";
+
+// The Arduino File has no truncate, so copy what's kept to a temporary
+// file and rename it over the segment. Power lost part way leaves the old
+// segment, which the next begin() cuts again.
+bool LittleFsLogStore::truncate(uint8_t segment, size_t length) {
+  if (length == 0) {
+    File f = LittleFS.open(segmentPath(segment), "w");
+    if (!f) {
+      return false;
+    }
+    f.close();
+    return true;
+  }
+
+  File in = LittleFS.open(segmentPath(segment), "r");
+  File out = LittleFS.open(SEGMENT_TEMP_PATH, "w");
+  bool ok = in && out;
+  uint8_t chunk[128];
+  for (size_t copied = 0; ok && copied < length;) {
+    size_t n = length - copied < sizeof(chunk) ? length - copied : sizeof(chunk);
+    ok = in.read(chunk, n) == n && out.write(chunk, n) == n;
+    copied += n;
+  }
+  if (in) in.close();
+  if (out) out.close();
+  if (!ok) {
+    LittleFS.remove(SEGMENT_TEMP_PATH);
+    return false;
+  }
+  LittleFS.remove(segmentPath(segment));
+  return LittleFS.rename(SEGMENT_TEMP_PATH, segmentPath(segment));
+}
@@ -0,0 +1,65 @@
+#ifndef PERSIST_H
+#define PERSIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "historylog.h"
+#include "settings.h"
+
+// State that survives deep sleep and reboots.
+//
+// Hot state (last sync, drift estimate, last good network, last battery
+// reading) lives in RTC slow memory, which keeps its contents through deep
+// sleep and software resets but not power loss. It is CRC protected so
+// garbage after a power-on reset is detected rather than trusted.
+//
+// Battery history goes to an append-only log (historylog.h) kept on
+// LittleFS by LittleFsLogStore.
+
+struct RtcState {
+  uint32_t lastSyncEpoch;     // Epoch seconds of the last successful NTP sync
+  float driftPpm;             // Estimated RTC drift, positive = running fast
+  int8_t lastGoodNetwork;     // Index into the network list, -1 if none
+  bool timeValid;             // System clock has been set since power-on
+  uint16_t batteryMillivolts; // Last battery reading
+  uint8_t batteryPercent;
+};
+
+// Returns false (and fills in defaults) if RTC memory holds no valid state
+bool loadRtcState(RtcState& state);
+void saveRtcState(const RtcState& state);
+
+// Countdown targets in the text format of targets.h, stored as a file on
+// LittleFS (mounted by LittleFsLogStore::begin). Saving writes a temporary file
+// and renames it over the old one, so power loss leaves one or the other.
+// loadTargetsText returns the length read, 0 if there is no file.
+size_t loadTargetsText(char* buffer, size_t size);
+bool saveTargetsText(const char* text, size_t length);
+
+// The next event's count as last shown, kept in NVS so a boot after power
+// loss can put it straight back on the display. Saved when it changes,
+// about once a day.
+struct CountCache {
+  int32_t eventDay;  // Day number (countdown.h) of the event
+  int16_t days;      // Days to go when it was saved
+};
+
+bool loadCountCache(CountCache& cache);
+bool saveCountCache(const CountCache& cache);
+
+// The settings record (settings.h) in NVS. loadSettings returns false,
+// leaving the defaults the caller filled in, if nothing usable is stored.
+bool loadSettings(Settings& settings);
+bool saveSettings(const Settings& settings);
+
+// History log segments as files on LittleFS
+class LittleFsLogStore : public LogStore {
+public:
+  bool begin() override;
+  size_t size(uint8_t segment) override;
+  size_t read(uint8_t segment, size_t offset, uint8_t* out, size_t length) override;
+  bool append(uint8_t segment, const uint8_t* data, size_t length) override;
+  bool truncate(uint8_t segment, size_t length) override;
+};
+
+#endif
@@ -0,0 +1,43 @@
+#include "power.h"
+
+void PowerModel::account(uint32_t elapsedMs, uint32_t sleptMs, uint32_t radioMs) {
+  totalMs += elapsedMs;
+  sleepMs += sleptMs < elapsedMs ? sleptMs : elapsedMs;
+  radioOnMs += radioMs < elapsedMs ? radioMs : elapsedMs;
+}
+
+void PowerModel::calibrate(float chargeRatePercentPerHour, uint16_t capacity_mAh) {
+  // Only a steady discharge tells us what the board draws
+  if (chargeRatePercentPerHour > -0.1f || capacity_mAh == 0 || totalMs < 60000) {
+    return;
+  }
+
+  float measured = -chargeRatePercentPerHour * capacity_mAh / 100.0f;
+  float modeled = uncalibratedCurrent(awakeDuty(), radioDuty());
+  if (modeled <= 0.0f) {
+    return;
+  }
+
+  // Slow EMA, the gauge's rate estimate is itself noisy
+  float ratio = measured / modeled;
+  if (ratio < 0.25f) ratio = 0.25f;
+  if (ratio > 4.0f) ratio = 4.0f;
+  calibrationFactor += (ratio - calibrationFactor) * 0.1f;
+}
+
+float PowerModel::awakeDuty() const {
+  return totalMs > 0 ? (float)(totalMs - sleepMs) / totalMs : 1.0f;
+}
+
+float PowerModel::radioDuty() const {
+  return totalMs > 0 ? (float)radioOnMs / totalMs : 0.0f;
+}
+
+float PowerModel::averageCurrent(float awake, float radio) const {
+  return uncalibratedCurrent(awake, radio) * calibrationFactor;
+}
+
+float PowerModel::uncalibratedCurrent(float awake, float radio) const {
+  if (radio > awake) radio = awake;  // Radio only runs while awake
+  return LIGHT_SLEEP_MA * (1.0f - awake) + AWAKE_MA * (awake - radio) + RADIO_MA * radio;
+}
@@ -0,0 +1,50 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdint.h>
+
+// Power model for estimating battery drain.
+//
+// Accumulates how long the device spends awake, asleep and with the radio
+// on, and turns that into an average current using typical draw figures
+// for the Feather ESP32-S3. When the fuel gauge reports a discharge rate,
+// the model is calibrated against it so projections for other modes use
+// this unit's real consumption.
+
+class PowerModel {
+public:
+  // Typical board current in each state, in mA
+  static constexpr float RADIO_MA = 160.0f;      // Awake with WiFi on
+  static constexpr float AWAKE_MA = 80.0f;       // Awake with WiFi off
+  static constexpr float LIGHT_SLEEP_MA = 1.5f;  // CPU in light sleep
+
+  // Account for elapsedMs of wall time, sleptMs of which was spent in light
+  // sleep and radioMs of which had the radio on
+  void account(uint32_t elapsedMs, uint32_t sleptMs, uint32_t radioMs);
+
+  // Feed a MAX17048 charge rate (%/hr, negative while discharging)
+  void calibrate(float chargeRatePercentPerHour, uint16_t capacity_mAh);
+
+  float awakeDuty() const;  // Fraction of time the CPU was awake
+  float radioDuty() const;  // Fraction of time the radio was on
+  float calibration() const { return calibrationFactor; }
+
+  // Average current for a given awake/radio duty cycle, calibrated
+  float averageCurrent(float awake, float radio) const;
+
+  // Projected consumption per day for a duty cycle
+  float mAhPerDay(float awake, float radio) const { return averageCurrent(awake, radio) * 24.0f; }
+
+  // Projected consumption per day at the duty cycle measured so far
+  float measuredMAhPerDay() const { return mAhPerDay(awakeDuty(), radioDuty()); }
+
+private:
+  float uncalibratedCurrent(float awake, float radio) const;
+
+  uint64_t totalMs = 0;
+  uint64_t sleepMs = 0;
+  uint64_t radioOnMs = 0;
+  float calibrationFactor = 1.0f;
+};
+
+#endif
@@ -0,0 +1,38 @@
+#include "responsebuf.h"
+#include <string.h>
+
+size_t ResponseBuffer::read(uint8_t* out, size_t maxLen, size_t index) const {
+  if (index >= len) {
+    return 0;
+  }
+  size_t n = len - index;
+  if (n > maxLen) n = maxLen;
+  memcpy(out, text + index, n);
+  return n;
+}
+
+ResponseBuffer* ResponseBufferPool::claim() {
+  for (uint8_t i = 0; i < BUFFERS; i++) {
+    if (!buffers[i].inUse) {
+      buffers[i].inUse = true;
+      buffers[i].len = 0;
+      return &buffers[i];
+    }
+  }
+  refused++;
+  return nullptr;
+}
+
+void ResponseBufferPool::release(ResponseBuffer* buffer) {
+  if (buffer != nullptr) {
+    buffer->inUse = false;
+  }
+}
+
+uint8_t ResponseBufferPool::inUse() const {
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < BUFFERS; i++) {
+    if (buffers[i].inUse) n++;
+  }
+  return n;
+}
@@ -0,0 +1,57 @@
+#ifndef RESPONSEBUF_H
+#define RESPONSEBUF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Static buffers for web responses that are formatted in one go.
+//
+// /api/status, /api/config, /api/targets and /api/log build their whole
+// body up front. Rather than format it on the stack and then have the
+// server copy it into a heap buffer of the same size, a handler claims a
+// buffer from the pool, formats into it, and the response's filler hands
+// out slices of it as the connection takes them. The buffer goes back to
+// the pool when the request is torn down, so a slow client holds one
+// buffer and nothing on the heap.
+//
+// Handlers, fillers and disconnects all run on the web server's task, so
+// the pool needs no locking.
+
+class ResponseBuffer {
+public:
+  static const size_t SIZE = 2048;  // Largest body: /api/log
+
+  char* data() { return text; }
+  size_t capacity() const { return SIZE; }
+  size_t length() const { return len; }
+  void setLength(size_t length) { len = length < SIZE ? length : SIZE; }
+
+  // Copy up to maxLen bytes of the body, starting at index, into out.
+  // Returns the number copied, 0 once index reaches the end.
+  size_t read(uint8_t* out, size_t maxLen, size_t index) const;
+
+private:
+  friend class ResponseBufferPool;
+
+  char text[SIZE];
+  size_t len = 0;
+  bool inUse = false;
+};
+
+class ResponseBufferPool {
+public:
+  static const uint8_t BUFFERS = 4;  // Responses in flight at once
+
+  // A free buffer, or nullptr if every one is held by a response
+  ResponseBuffer* claim();
+  void release(ResponseBuffer* buffer);
+
+  uint8_t inUse() const;
+  uint32_t exhausted() const { return refused; }  // Claims that found no buffer
+
+private:
+  ResponseBuffer buffers[BUFFERS];
+  uint32_t refused = 0;
+};
+
+#endif
@@ -0,0 +1,117 @@
+#include "scheduler.h"
+
+// Wrap-safe "a is before b" for millis() timestamps
+static inline bool before(unsigned long a, unsigned long b) {
+  return (long)(a - b) < 0;
+}
+
+Scheduler::Scheduler() : count(0), wakeupCount(0) {}
+
+int Scheduler::addTask(const char* name, unsigned long intervalMs, TaskCallback callback,
+                       unsigned long now, unsigned long firstDelayMs) {
+  if (count >= MAX_TASKS || callback == nullptr) {
+    return -1;
+  }
+
+  uint8_t id = count;
+  Task& task = tasks[id];
+  task.name = name;
+  task.callback = callback;
+  task.interval = intervalMs > 0 ? intervalMs : 1;
+  task.due = now + firstDelayMs;
+  task.runs = 0;
+  task.maxLateness = 0;
+
+  queue[count++] = id;
+  reorder(id);
+  return id;
+}
+
+void Scheduler::setInterval(int id, unsigned long intervalMs) {
+  if (id < 0 || id >= count) return;
+  tasks[id].interval = intervalMs > 0 ? intervalMs : 1;
+}
+
+void Scheduler::runAfter(int id, unsigned long now, unsigned long delayMs) {
+  if (id < 0 || id >= count) return;
+  tasks[id].due = now + delayMs;
+  reorder(id);
+}
+
+void Scheduler::runWithin(int id, unsigned long now, unsigned long delayMs) {
+  if (id < 0 || id >= count) return;
+  if (before(now + delayMs, tasks[id].due)) {
+    runAfter(id, now, delayMs);
+  }
+}
+
+void Scheduler::runDue(unsigned long now) {
+  wakeupCount++;
+
+  while (count > 0) {
+    uint8_t id = queue[0];
+    Task& task = tasks[id];
+    if (before(now, task.due)) {
+      break;  // Queue is ordered, nothing else is due either
+    }
+
+    unsigned long lateness = now - task.due;
+    if (lateness > task.maxLateness) {
+      task.maxLateness = lateness;
+    }
+    task.runs++;
+
+    // Reschedule before running so the callback can override its own
+    // deadline. Fixed-rate, but never try to catch up on missed runs.
+    task.due += task.interval;
+    if (!before(now, task.due)) {
+      task.due = now + task.interval;
+    }
+    reorder(id);
+
+    task.callback(now);
+  }
+}
+
+unsigned long Scheduler::msUntilNext(unsigned long now) const {
+  if (count == 0) {
+    return 1000;  // Nothing registered, just idle
+  }
+  unsigned long due = tasks[queue[0]].due;
+  return before(now, due) ? due - now : 0;
+}
+
+const char* Scheduler::taskName(int id) const {
+  return (id >= 0 && id < count) ? tasks[id].name : "";
+}
+
+unsigned long Scheduler::taskInterval(int id) const {
+  return (id >= 0 && id < count) ? tasks[id].interval : 0;
+}
+
+uint32_t Scheduler::taskRuns(int id) const {
+  return (id >= 0 && id < count) ? tasks[id].runs : 0;
+}
+
+unsigned long Scheduler::taskMaxLateness(int id) const {
+  return (id >= 0 && id < count) ? tasks[id].maxLateness : 0;
+}
+
+void Scheduler::reorder(uint8_t id) {
+  // Pull the task out of the queue...
+  uint8_t pos = 0;
+  while (pos < count && queue[pos] != id) pos++;
+  for (uint8_t i = pos; i + 1 < count; i++) {
+    queue[i] = queue[i + 1];
+  }
+
+  // ...and insert it back behind every task due no later than it
+  uint8_t insertAt = 0;
+  while (insertAt < count - 1 && !before(tasks[id].due, tasks[queue[insertAt]].due)) {
+    insertAt++;
+  }
+  for (uint8_t i = count - 1; i > insertAt; i--) {
+    queue[i] = queue[i - 1];
+  }
+  queue[insertAt] = id;
+}
@@ -0,0 +1,73 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+
+// Cooperative task scheduler with deadline-ordered timers.
+//
+// Every task runs at its own cadence. runDue() runs whatever is due and
+// msUntilNext() tells the caller how long it may sleep until the next
+// deadline, so loop() wakes exactly when there is work instead of polling
+// on a fixed delay.
+//
+// The scheduler never reads the clock itself - the caller passes "now" in
+// milliseconds - so it can be driven from millis() on the device or from a
+// fake clock on the host. All deadline comparisons are wrap-safe across the
+// 49.7 day millis() rollover.
+
+typedef void (*TaskCallback)(unsigned long now);
+
+class Scheduler {
+public:
+  static const uint8_t MAX_TASKS = 10;
+
+  Scheduler();
+
+  // Register a periodic task. The first run happens firstDelayMs after
+  // "now". Returns the task id, or -1 if the task table is full.
+  int addTask(const char* name, unsigned long intervalMs, TaskCallback callback,
+              unsigned long now, unsigned long firstDelayMs = 0);
+
+  // Change a task's period. Takes effect from its next run.
+  void setInterval(int id, unsigned long intervalMs);
+
+  // Move a task's next deadline to now + delayMs.
+  void runAfter(int id, unsigned long now, unsigned long delayMs);
+
+  // Pull a task's deadline in to now + delayMs if it is currently later.
+  void runWithin(int id, unsigned long now, unsigned long delayMs);
+
+  // Run every task whose deadline has passed, earliest deadline first.
+  void runDue(unsigned long now);
+
+  // Milliseconds until the earliest deadline, 0 if one is already overdue
+  unsigned long msUntilNext(unsigned long now) const;
+
+  // Timing statistics, mainly for tuning task cadences
+  const char* taskName(int id) const;
+  unsigned long taskInterval(int id) const;
+  uint32_t taskRuns(int id) const;
+  unsigned long taskMaxLateness(int id) const;
+  uint8_t taskCount() const { return count; }
+  uint32_t wakeups() const { return wakeupCount; }
+
+private:
+  struct Task {
+    const char* name;
+    TaskCallback callback;
+    unsigned long interval;
+    unsigned long due;
+    uint32_t runs;
+    unsigned long maxLateness;
+  };
+
+  // Move a task to its place in the deadline-ordered queue
+  void reorder(uint8_t id);
+
+  Task tasks[MAX_TASKS];
+  uint8_t queue[MAX_TASKS];  // Task ids, earliest deadline first
+  uint8_t count;
+  uint32_t wakeupCount;
+};
+
+#endif
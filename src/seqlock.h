@@ -0,0 +1,88 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <type_traits>
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#endif
+
+// Single-writer sequence lock for sharing a plain struct between tasks.
+//
+// The writer bumps the sequence to odd, copies the value in, and bumps it
+// back to even. Readers copy the value out and retry if the sequence was
+// odd or moved while they were copying, so they never block the writer and
+// never see half of one update and half of another. The value is held as
+// atomic words so the copies themselves are race-free.
+//
+// Only one task may call write(); any number may call read(). A reader
+// that keeps finding a write in progress has most likely preempted the
+// writer on the same core, so it sleeps a tick to let the writer finish.
+
+template <typename T>
+class Seqlock {
+  static_assert(std::is_trivially_copyable<T>::value, "Seqlock needs a trivially copyable type");
+
+public:
+  Seqlock() : sequence(0) {
+    for (size_t i = 0; i < WORDS; i++) {
+      words[i].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  void write(const T& value) {
+    uint32_t buffer[WORDS] = {};
+    memcpy(buffer, &value, sizeof(T));
+
+    uint32_t seq = sequence.load(std::memory_order_relaxed);
+    sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < WORDS; i++) {
+      words[i].store(buffer[i], std::memory_order_relaxed);
+    }
+    sequence.store(seq + 2, std::memory_order_release);
+  }
+
+  // Returns the version of the copy (bumped by every write, 0 before the
+  // first one)
+  uint32_t read(T& value) const {
+    uint32_t buffer[WORDS];
+    uint32_t before, after;
+    uint8_t spins = 0;
+    do {
+      if (spins++ >= MAX_SPINS) {
+        backoff();
+        spins = 0;
+      }
+      before = sequence.load(std::memory_order_acquire);
+      for (size_t i = 0; i < WORDS; i++) {
+        buffer[i] = words[i].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      after = sequence.load(std::memory_order_relaxed);
+    } while ((before & 1) != 0 || before != after);
+
+    memcpy(&value, buffer, sizeof(T));
+    return before / 2;
+  }
+
+  uint32_t version() const { return sequence.load(std::memory_order_acquire) / 2; }
+
+private:
+  static const uint8_t MAX_SPINS = 64;
+  static const size_t WORDS = (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+  static void backoff() {
+#ifdef ESP_PLATFORM
+    vTaskDelay(1);
+#endif
+  }
+
+  std::atomic<uint32_t> sequence;
+  std::atomic<uint32_t> words[WORDS];
+};
+
+#endif
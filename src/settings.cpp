@@ -0,0 +1,297 @@
+#include "settings.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "crc.h"
+#include "timezone.h"
+
+static const uint16_t SETTINGS_MAGIC = 0x4353;  // "CS"
+static const size_t HEADER_BYTES = 10;
+
+// Little-endian field packing with bounds checks. Once a write or read
+// runs off the end every later one fails too, so callers only check at
+// the end.
+class FieldWriter {
+public:
+  FieldWriter(uint8_t* buffer, size_t size) : buffer(buffer), size(size), pos(0), ok(true) {}
+
+  void u8(uint8_t value) { bytes(&value, 1); }
+  void u16(uint16_t value) {
+    uint8_t b[2] = {(uint8_t)value, (uint8_t)(value >> 8)};
+    bytes(b, 2);
+  }
+  void i32(int32_t value) {
+    uint32_t v = (uint32_t)value;
+    uint8_t b[4] = {(uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24)};
+    bytes(b, 4);
+  }
+  void str(const char* value) {
+    size_t length = strlen(value);
+    u8(length);
+    bytes(value, length);
+  }
+
+  size_t length() const { return ok ? pos : 0; }
+
+private:
+  void bytes(const void* data, size_t length) {
+    if (!ok || length > size - pos) {
+      ok = false;
+      return;
+    }
+    memcpy(buffer + pos, data, length);
+    pos += length;
+  }
+
+  uint8_t* buffer;
+  size_t size;
+  size_t pos;
+  bool ok;
+};
+
+class FieldReader {
+public:
+  FieldReader(const uint8_t* data, size_t size) : data(data), size(size), pos(0), ok(true) {}
+
+  uint8_t u8() {
+    const uint8_t* b = take(1);
+    return b ? b[0] : 0;
+  }
+  uint16_t u16() {
+    const uint8_t* b = take(2);
+    return b ? b[0] | (b[1] << 8) : 0;
+  }
+  int32_t i32() {
+    const uint8_t* b = take(4);
+    return b ? (int32_t)(b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24)) : 0;
+  }
+  void str(char* value, size_t capacity) {
+    uint8_t length = u8();
+    const uint8_t* b = take(length);
+    if (b == nullptr || length >= capacity) {
+      ok = false;
+      return;
+    }
+    memcpy(value, b, length);
+    value[length] = '\0';
+  }
+
+  // Every byte used, nothing left over
+  bool complete() const { return ok && pos == size; }
+
+private:
+  const uint8_t* take(size_t length) {
+    if (!ok || length > size - pos) {
+      ok = false;
+      return nullptr;
+    }
+    const uint8_t* b = data + pos;
+    pos += length;
+    return b;
+  }
+
+  const uint8_t* data;
+  size_t size;
+  size_t pos;
+  bool ok;
+};
+
+size_t encodeSettings(const Settings& settings, uint8_t* buffer, size_t size) {
+  if (size < HEADER_BYTES) {
+    return 0;
+  }
+
+  FieldWriter payload(buffer + HEADER_BYTES, size - HEADER_BYTES);
+  payload.u8(settings.networkCount);
+  for (uint8_t i = 0; i < settings.networkCount && i < Settings::MAX_NETWORKS; i++) {
+    payload.str(settings.networks[i].ssid);
+    payload.str(settings.networks[i].password);
+  }
+  payload.str(settings.ntpServer);
+  payload.str(settings.tzRule);
+  payload.u8(settings.displayBrightness);
+  payload.u16((uint16_t)(settings.lowBatteryVoltage * 1000.0f + 0.5f));
+  payload.u8(settings.lowBatteryPercent);
+  payload.u16(settings.quietStart);
+  payload.u16(settings.quietEnd);
+  payload.u8((uint8_t)settings.quietBrightness);
+  payload.u8(settings.dimBatteryPercent);
+  payload.u8(settings.dimBatteryBrightness);
+  size_t length = payload.length();
+  if (length == 0) {
+    return 0;
+  }
+
+  FieldWriter header(buffer, HEADER_BYTES);
+  header.u16(SETTINGS_MAGIC);
+  header.u8(SETTINGS_VERSION);
+  header.u8(0);
+  header.u16(length);
+  header.i32(crc32(buffer + HEADER_BYTES, length));
+  return HEADER_BYTES + length;
+}
+
+static bool decodeNetworks(FieldReader& in, Settings& settings) {
+  settings.networkCount = in.u8();
+  if (settings.networkCount > Settings::MAX_NETWORKS) {
+    return false;
+  }
+  for (uint8_t i = 0; i < settings.networkCount; i++) {
+    in.str(settings.networks[i].ssid, sizeof(settings.networks[i].ssid));
+    in.str(settings.networks[i].password, sizeof(settings.networks[i].password));
+  }
+  return true;
+}
+
+// The TZ string configTime() used to build from version 1's offsets,
+// which implies the US DST rules whenever there was a daylight offset
+static void tzRuleFromOffsets(int32_t gmtOffset, int32_t daylightOffset, char* rule, size_t size) {
+  int32_t west = -gmtOffset;
+  unsigned long hours = labs(west) / 3600, minutes = labs(west) / 60 % 60;
+  int length = snprintf(rule, size, "UTC%c%lu:%02lu", west < 0 ? '-' : '+', hours, minutes);
+  if (daylightOffset != 0 && length > 0 && (size_t)length < size) {
+    west -= daylightOffset;
+    hours = labs(west) / 3600;
+    minutes = labs(west) / 60 % 60;
+    snprintf(rule + length, size - length, "DST%c%lu:%02lu", west < 0 ? '-' : '+', hours, minutes);
+  }
+}
+
+// Schema version 1: fixed offsets
+static bool decodeV1(FieldReader& in, Settings& settings) {
+  if (!decodeNetworks(in, settings)) {
+    return false;
+  }
+  in.str(settings.ntpServer, sizeof(settings.ntpServer));
+  int32_t gmtOffset = in.i32();
+  int32_t daylightOffset = in.i32();
+  tzRuleFromOffsets(gmtOffset, daylightOffset, settings.tzRule, sizeof(settings.tzRule));
+  settings.displayBrightness = in.u8();
+  settings.lowBatteryVoltage = in.u16() / 1000.0f;
+  settings.lowBatteryPercent = in.u8();
+  return in.complete();
+}
+
+// Fields version 2 added, the ones after the networks
+static void decodeV2Fields(FieldReader& in, Settings& settings) {
+  in.str(settings.ntpServer, sizeof(settings.ntpServer));
+  in.str(settings.tzRule, sizeof(settings.tzRule));
+  settings.displayBrightness = in.u8();
+  settings.lowBatteryVoltage = in.u16() / 1000.0f;
+  settings.lowBatteryPercent = in.u8();
+}
+
+// Schema version 2: TZ rule
+static bool decodeV2(FieldReader& in, Settings& settings) {
+  if (!decodeNetworks(in, settings)) {
+    return false;
+  }
+  decodeV2Fields(in, settings);
+  return in.complete();
+}
+
+// Schema version 3: brightness schedule
+static bool decodeV3(FieldReader& in, Settings& settings) {
+  if (!decodeNetworks(in, settings)) {
+    return false;
+  }
+  decodeV2Fields(in, settings);
+  settings.quietStart = in.u16();
+  settings.quietEnd = in.u16();
+  settings.quietBrightness = (int8_t)in.u8();
+  settings.dimBatteryPercent = in.u8();
+  settings.dimBatteryBrightness = in.u8();
+  return in.complete();
+}
+
+bool decodeSettings(const uint8_t* record, size_t length, Settings& settings) {
+  FieldReader header(record, length < HEADER_BYTES ? length : HEADER_BYTES);
+  uint16_t magic = header.u16();
+  uint8_t version = header.u8();
+  header.u8();
+  uint16_t payloadLength = header.u16();
+  uint32_t crc = header.i32();
+  if (!header.complete() || magic != SETTINGS_MAGIC || payloadLength != length - HEADER_BYTES ||
+      crc != crc32(record + HEADER_BYTES, payloadLength)) {
+    return false;
+  }
+
+  FieldReader payload(record + HEADER_BYTES, payloadLength);
+  switch (version) {
+    case 1:
+      return decodeV1(payload, settings);
+    case 2:
+      return decodeV2(payload, settings);
+    case 3:
+      return decodeV3(payload, settings);
+    default:
+      return false;  // Written by newer firmware
+  }
+}
+
+bool validateSettings(const Settings& settings, const char*& error) {
+  if (settings.networkCount > Settings::MAX_NETWORKS) {
+    error = "too many networks";
+    return false;
+  }
+  for (uint8_t i = 0; i < settings.networkCount; i++) {
+    const WifiCredentials& network = settings.networks[i];
+    size_t ssidLength = strnlen(network.ssid, sizeof(network.ssid));
+    size_t passwordLength = strnlen(network.password, sizeof(network.password));
+    if (ssidLength == 0 || ssidLength >= sizeof(network.ssid)) {
+      error = "ssid";
+      return false;
+    }
+    // Open network, or WPA: 8-63 characters or 64 hex digits
+    if (passwordLength >= sizeof(network.password) || (passwordLength > 0 && passwordLength < 8)) {
+      error = "password";
+      return false;
+    }
+  }
+  size_t serverLength = strnlen(settings.ntpServer, sizeof(settings.ntpServer));
+  if (serverLength == 0 || serverLength >= sizeof(settings.ntpServer)) {
+    error = "ntpServer";
+    return false;
+  }
+  TzRule rule;
+  if (strnlen(settings.tzRule, sizeof(settings.tzRule)) >= sizeof(settings.tzRule) ||
+      !parseTzRule(settings.tzRule, rule)) {
+    error = "tzRule";
+    return false;
+  }
+  if (settings.displayBrightness > 15) {
+    error = "brightness";
+    return false;
+  }
+  if (settings.quietStart >= 24 * 60) {
+    error = "quietStart";
+    return false;
+  }
+  if (settings.quietEnd >= 24 * 60) {
+    error = "quietEnd";
+    return false;
+  }
+  if (settings.quietBrightness < -1 || settings.quietBrightness > 15) {
+    error = "quietBrightness";
+    return false;
+  }
+  if (settings.dimBatteryPercent > 100) {
+    error = "dimBatteryPercent";
+    return false;
+  }
+  if (settings.dimBatteryBrightness > 15) {
+    error = "dimBatteryBrightness";
+    return false;
+  }
+  // The fuel gauge alert threshold, in its 20 mV steps
+  if (!(settings.lowBatteryVoltage >= 2.5f && settings.lowBatteryVoltage <= 3.8f)) {
+    error = "lowBatteryVoltage";
+    return false;
+  }
+  // The fuel gauge can only alert between 1% and 32%
+  if (settings.lowBatteryPercent < 1 || settings.lowBatteryPercent > 32) {
+    error = "lowBatteryPercent";
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,66 @@
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Runtime configuration, kept in NVS and editable through /api/config.
+//
+// config.h only supplies the values for the very first boot. After that
+// the settings live in NVS as one small binary record: a header with a
+// magic number, schema version, payload length and CRC, then the fields
+// packed one after another (strings length-prefixed). Reading an older
+// schema version decodes the fields that version had and leaves the newer
+// ones at the values the caller filled in, so adding a field means bumping
+// SETTINGS_VERSION and teaching decodeSettings the new layout.
+//
+// The firmware reads the record once at boot into a Settings struct; the
+// hot path only ever looks at that copy. The NVS side is loadSettings and
+// saveSettings in persist.h.
+//
+// Version history:
+//   1  first release
+//   2  POSIX TZ rule instead of fixed GMT and daylight offsets
+//   3  quiet hours and battery dimming for the brightness schedule
+
+static const uint8_t SETTINGS_VERSION = 3;
+
+struct WifiCredentials {
+  char ssid[33];
+  char password[65];
+};
+
+struct Settings {
+  static const uint8_t MAX_NETWORKS = 5;
+
+  uint8_t networkCount;
+  WifiCredentials networks[MAX_NETWORKS];  // Tried in order
+  char ntpServer[64];
+  char tzRule[64];             // POSIX TZ string, see timezone.h
+  uint8_t displayBrightness;   // 0-15
+  uint16_t quietStart;         // Minutes after local midnight, see brightness.h
+  uint16_t quietEnd;           // Same as quietStart for no quiet hours
+  int8_t quietBrightness;      // 0-15, or -1 to blank the display
+  uint8_t dimBatteryPercent;   // Dim on battery at or below this charge (0 never)...
+  uint8_t dimBatteryBrightness;  // ...to this level
+  float lowBatteryVoltage;     // Cut off at or below this...
+  uint8_t lowBatteryPercent;   // ...and this state of charge
+};
+
+// Largest encoded record, header included (640 with every field at its
+// longest), plus some room
+static const size_t SETTINGS_MAX_BYTES = 672;
+
+// Serialize into buffer. Returns the length, 0 if it doesn't fit.
+size_t encodeSettings(const Settings& settings, uint8_t* buffer, size_t size);
+
+// Parse a record of any known version. Fields the record's version
+// doesn't have keep the values settings came in with. Returns false, with
+// settings partly overwritten, if the record is damaged or from a newer
+// firmware.
+bool decodeSettings(const uint8_t* record, size_t length, Settings& settings);
+
+// Check every field is in range. On failure error names the first bad one.
+bool validateSettings(const Settings& settings, const char*& error);
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+#ifdef ESP_PLATFORM
+#include <mbedtls/sha256.h>
+#endif
+
+// SHA-256 over data fed in pieces. On the ESP32 this is mbedtls, which
+// uses the SHA accelerator; elsewhere (the host tests) a plain FIPS 180-4
+// implementation.
+class Sha256 {
+public:
+  static const size_t DIGEST_BYTES = 32;
+
+  Sha256();
+  ~Sha256();
+
+  void begin();
+  void update(const uint8_t* data, size_t length);
+  void finish(uint8_t digest[DIGEST_BYTES]);
+
+private:
+#ifdef ESP_PLATFORM
+  mbedtls_sha256_context context;
+#else
+  void block(const uint8_t* data);
+
+  uint32_t state[8];
+  uint8_t pending[64];
+  size_t pendingLength;
+  uint64_t totalLength;
+#endif
+};
+
+#endif
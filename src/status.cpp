@@ -0,0 +1,96 @@
+#include "status.h"
+#include <string.h>
+
+static const int8_t RSSI_DELTA = 3;          // dBm
+static const float VOLTAGE_DELTA = 0.01f;   // V
+
+const char* batteryStateName(BatteryState state) {
+  switch (state) {
+    case BATTERY_ON_BATTERY: return "On Battery";
+    case BATTERY_DISCHARGING: return "Discharging";
+    case BATTERY_CHARGING: return "Charging";
+    case BATTERY_CHARGED: return "Charged";
+    case BATTERY_UNKNOWN:
+    default: return "Unknown";
+  }
+}
+
+void writeStatusFields(JsonWriter& json, const StatusSnapshot& status) {
+  json.addInt("days", status.days);
+  json.addString("event", status.event);
+  json.addInt("eventYear", status.eventYear);
+  json.addInt("year", status.year);
+  json.addInt("month", status.month);
+  json.addInt("day", status.day);
+  json.addInt("hour", status.hour);
+  json.addInt("min", status.min);
+  json.addInt("sec", status.sec);
+  json.addString("ssid", status.ssid);
+  json.addString("ip", status.ip);
+  json.addInt("rssi", status.rssi);
+  json.addFloat("batteryVoltage", status.batteryVoltage, 2);
+  json.addInt("batteryPercent", status.batteryPercent);
+  json.addString("batteryStatus", batteryStateName(status.batteryStatus));
+}
+
+uint8_t writeStatusDelta(JsonWriter& json, const StatusSnapshot& cur, StatusSnapshot& sent) {
+  uint8_t written = 0;
+
+  if (cur.days != sent.days || cur.eventYear != sent.eventYear || strcmp(cur.event, sent.event) != 0) {
+    json.addInt("days", cur.days);
+    json.addString("event", cur.event);
+    json.addInt("eventYear", cur.eventYear);
+    sent.days = cur.days;
+    sent.eventYear = cur.eventYear;
+    memcpy(sent.event, cur.event, sizeof(sent.event));
+    written += 3;
+  }
+
+  if (cur.min != sent.min || cur.hour != sent.hour || cur.day != sent.day ||
+      cur.month != sent.month || cur.year != sent.year) {
+    json.addInt("year", cur.year);
+    json.addInt("month", cur.month);
+    json.addInt("day", cur.day);
+    json.addInt("hour", cur.hour);
+    json.addInt("min", cur.min);
+    json.addInt("sec", cur.sec);
+    sent.year = cur.year;
+    sent.month = cur.month;
+    sent.day = cur.day;
+    sent.hour = cur.hour;
+    sent.min = cur.min;
+    sent.sec = cur.sec;
+    written += 6;
+  }
+
+  if (strcmp(cur.ssid, sent.ssid) != 0 || strcmp(cur.ip, sent.ip) != 0) {
+    json.addString("ssid", cur.ssid);
+    json.addString("ip", cur.ip);
+    memcpy(sent.ssid, cur.ssid, sizeof(sent.ssid));
+    memcpy(sent.ip, cur.ip, sizeof(sent.ip));
+    written += 2;
+  }
+
+  if (cur.rssi - sent.rssi >= RSSI_DELTA || sent.rssi - cur.rssi >= RSSI_DELTA) {
+    json.addInt("rssi", cur.rssi);
+    sent.rssi = cur.rssi;
+    written++;
+  }
+
+  float dv = cur.batteryVoltage - sent.batteryVoltage;
+  if (dv >= VOLTAGE_DELTA || dv <= -VOLTAGE_DELTA) {
+    json.addFloat("batteryVoltage", cur.batteryVoltage, 2);
+    sent.batteryVoltage = cur.batteryVoltage;
+    written++;
+  }
+
+  if (cur.batteryPercent != sent.batteryPercent || cur.batteryStatus != sent.batteryStatus) {
+    json.addInt("batteryPercent", cur.batteryPercent);
+    json.addString("batteryStatus", batteryStateName(cur.batteryStatus));
+    sent.batteryPercent = cur.batteryPercent;
+    sent.batteryStatus = cur.batteryStatus;
+    written += 2;
+  }
+
+  return written;
+}
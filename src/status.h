@@ -0,0 +1,48 @@
+#ifndef STATUS_H
+#define STATUS_H
+
+#include <stdint.h>
+#include "jsonwriter.h"
+
+enum BatteryState : uint8_t {
+  BATTERY_UNKNOWN,
+  BATTERY_ON_BATTERY,
+  BATTERY_DISCHARGING,
+  BATTERY_CHARGING,
+  BATTERY_CHARGED
+};
+
+const char* batteryStateName(BatteryState state);
+
+// The status fields shown on the web page, shared by /api/status and the
+// /events push channel. The loop task owns the working copy and publishes
+// it whole through a Seqlock, so the web server's task always reads one
+// consistent tick.
+struct StatusSnapshot {
+  int16_t days;        // Until the event on the display, -1 if there is none
+  int16_t eventYear;
+  char event[16];
+  int16_t year;
+  int8_t month;
+  int8_t day;
+  int8_t hour;
+  int8_t min;
+  int8_t sec;
+  char ssid[33];
+  char ip[16];
+  int8_t rssi;
+  float batteryVoltage;
+  uint8_t batteryPercent;
+  BatteryState batteryStatus;
+};
+
+// Write all of the snapshot's fields into an open JSON object
+void writeStatusFields(JsonWriter& json, const StatusSnapshot& status);
+
+// Write only the fields that changed meaningfully since what the client
+// was last sent, and record them in sent: time only when the minute rolls
+// over (the page ticks seconds itself), RSSI only on swings of a few dBm,
+// voltage only in 10 mV steps. Returns the number of fields written.
+uint8_t writeStatusDelta(JsonWriter& json, const StatusSnapshot& cur, StatusSnapshot& sent);
+
+#endif
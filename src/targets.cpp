@@ -0,0 +1,255 @@
+#include "targets.h"
+#include <stdio.h>
+#include <string.h>
+#include "countdown.h"
+
+static const char* const WEEKDAYS[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+
+// nth weekday of a month, 0 if that month doesn't have one (a 5th)
+static int nthWeekdayOfMonth(int year, int month, int nth, int weekday) {
+  if (nth < 0) {
+    int last = daysInMonth(year, month);
+    int lastWeekday = dayOfWeek(daysFromCivil(year, month, last));
+    return last - (lastWeekday - weekday + 7) % 7;
+  }
+  int firstWeekday = dayOfWeek(daysFromCivil(year, month, 1));
+  int day = 1 + (weekday - firstWeekday + 7) % 7 + (nth - 1) * 7;
+  return day <= daysInMonth(year, month) ? day : 0;
+}
+
+// The target's date in the given year, NO_OCCURRENCE if it has none
+static int32_t occurrenceInYear(const CountdownTarget& target, int year) {
+  switch (target.rule) {
+    case RULE_ANNUAL: {
+      // February 29 falls on the 28th in common years
+      int maxDay = daysInMonth(year, target.month);
+      return daysFromCivil(year, target.month, target.day <= maxDay ? target.day : maxDay);
+    }
+    case RULE_NTH_WEEKDAY: {
+      int day = nthWeekdayOfMonth(year, target.month, target.nth, target.weekday);
+      return day > 0 ? daysFromCivil(year, target.month, day) : NO_OCCURRENCE;
+    }
+    case RULE_ONCE:
+    default:
+      return year == target.year ? daysFromCivil(target.year, target.month, target.day) : NO_OCCURRENCE;
+  }
+}
+
+int32_t nextOccurrence(const CountdownTarget& target, int32_t today) {
+  if (target.rule == RULE_ONCE) {
+    int32_t day = daysFromCivil(target.year, target.month, target.day);
+    return day >= today ? day : NO_OCCURRENCE;
+  }
+
+  // A 5th weekday can be missing for decades: a 5th Monday in February
+  // needs a leap year starting February on a Monday, 28 years apart or
+  // 40 across a century. The calendar repeats every 400 years, so a rule
+  // with nothing in that span never occurs.
+  int year = civilFromDays(today).year;
+  for (int i = 0; i <= 400; i++) {
+    int32_t day = occurrenceInYear(target, year + i);
+    if (day != NO_OCCURRENCE && day >= today) {
+      return day;
+    }
+  }
+  return NO_OCCURRENCE;
+}
+
+// Parse an unsigned number of at most maxDigits digits
+static bool parseNumber(const char*& p, const char* end, int maxDigits, int& value) {
+  value = 0;
+  int digits = 0;
+  while (p < end && *p >= '0' && *p <= '9' && digits < maxDigits) {
+    value = value * 10 + (*p++ - '0');
+    digits++;
+  }
+  return digits > 0;
+}
+
+static bool parseRule(const char* p, const char* end, CountdownTarget& target) {
+  int a, b, c;
+  if (!parseNumber(p, end, 4, a)) {
+    return false;
+  }
+
+  if (p < end && *p == '/') {
+    // month/nth/weekday
+    p++;
+    if (p < end && (*p == 'L' || *p == 'l')) {
+      b = -1;
+      p++;
+    } else if (!parseNumber(p, end, 1, b) || b < 1 || b > 5) {
+      return false;
+    }
+    if (p >= end || *p++ != '/' || end - p != 3) {
+      return false;
+    }
+    for (c = 0; c < 7; c++) {
+      if (strncasecmp(p, WEEKDAYS[c], 3) == 0) break;
+    }
+    if (a < 1 || a > 12 || c == 7) {
+      return false;
+    }
+    target.rule = RULE_NTH_WEEKDAY;
+    target.month = a;
+    target.nth = b;
+    target.weekday = c;
+    return true;
+  }
+
+  if (p >= end || *p++ != '-' || !parseNumber(p, end, 2, b)) {
+    return false;
+  }
+  if (p == end) {
+    // month-day
+    if (a < 1 || a > 12 || b < 1 || b > daysInMonth(2000, a)) {
+      return false;
+    }
+    target.rule = RULE_ANNUAL;
+    target.month = a;
+    target.day = b;
+    return true;
+  }
+
+  // year-month-day
+  if (*p++ != '-' || !parseNumber(p, end, 2, c) || p != end) {
+    return false;
+  }
+  if (a < 1970 || a > 9999 || b < 1 || b > 12 || c < 1 || c > daysInMonth(a, b)) {
+    return false;
+  }
+  target.rule = RULE_ONCE;
+  target.year = a;
+  target.month = b;
+  target.day = c;
+  return true;
+}
+
+bool parseTargets(const char* text, size_t length, TargetList& list, int& errorLine) {
+  list.count = 0;
+  errorLine = 0;
+  const char* end = text + length;
+  int lineNumber = 0;
+
+  for (const char* line = text; line < end;) {
+    const char* lineEnd = (const char*)memchr(line, '\n', end - line);
+    if (lineEnd == nullptr) lineEnd = end;
+    const char* next = lineEnd < end ? lineEnd + 1 : end;
+    lineNumber++;
+
+    // Trim whitespace (and \r)
+    while (line < lineEnd && (*line == ' ' || *line == '\t')) line++;
+    while (lineEnd > line && (lineEnd[-1] == ' ' || lineEnd[-1] == '\t' || lineEnd[-1] == '\r')) lineEnd--;
+    if (line == lineEnd || *line == '#') {
+      line = next;
+      continue;
+    }
+
+    if (list.count >= TargetList::MAX_TARGETS) {
+      errorLine = lineNumber;
+      return false;
+    }
+    const char* comma = (const char*)memchr(line, ',', lineEnd - line);
+    size_t nameLength = comma != nullptr ? comma - line : 0;
+    CountdownTarget& target = list.targets[list.count];
+    memset(&target, 0, sizeof(target));
+    if (nameLength == 0 || nameLength >= sizeof(target.name) || !parseRule(comma + 1, lineEnd, target)) {
+      errorLine = lineNumber;
+      return false;
+    }
+    memcpy(target.name, line, nameLength);
+    list.count++;
+    line = next;
+  }
+  return true;
+}
+
+size_t formatTargets(const TargetList& list, char* buffer, size_t size) {
+  if (size == 0) {
+    return 0;
+  }
+  size_t length = 0;
+  for (uint8_t i = 0; i < list.count && length < size - 1; i++) {
+    const CountdownTarget& t = list.targets[i];
+    int n;
+    switch (t.rule) {
+      case RULE_ANNUAL:
+        n = snprintf(buffer + length, size - length, "%s,%02d-%02d\n", t.name, t.month, t.day);
+        break;
+      case RULE_NTH_WEEKDAY:
+        if (t.nth < 0) {
+          n = snprintf(buffer + length, size - length, "%s,%d/L/%s\n", t.name, t.month, WEEKDAYS[t.weekday % 7]);
+        } else {
+          n = snprintf(buffer + length, size - length, "%s,%d/%d/%s\n", t.name, t.month, t.nth,
+                       WEEKDAYS[t.weekday % 7]);
+        }
+        break;
+      case RULE_ONCE:
+      default:
+        n = snprintf(buffer + length, size - length, "%s,%04d-%02d-%02d\n", t.name, t.year, t.month, t.day);
+        break;
+    }
+    length += n;
+  }
+  return length < size ? length : size - 1;
+}
+
+TargetTable::TargetTable() : upcomingCount(0) {
+  list.count = 0;
+}
+
+void TargetTable::load(const TargetList& targets, int32_t today) {
+  list = targets;
+  upcomingCount = 0;
+  for (uint8_t i = 0; i < list.count; i++) {
+    int32_t day = nextOccurrence(list.targets[i], today);
+    if (day != NO_OCCURRENCE) {
+      insert(Occurrence{day, i});
+    }
+  }
+}
+
+void TargetTable::advance(int32_t today) {
+  // Everything before today has passed; they're a prefix of the table
+  uint8_t passed = find(today);
+  if (passed == 0) {
+    return;
+  }
+
+  Occurrence stale[TargetList::MAX_TARGETS];
+  memcpy(stale, upcoming, passed * sizeof(Occurrence));
+  upcomingCount -= passed;
+  memmove(upcoming, upcoming + passed, upcomingCount * sizeof(Occurrence));
+
+  for (uint8_t i = 0; i < passed; i++) {
+    int32_t day = nextOccurrence(list.targets[stale[i].target], today);
+    if (day != NO_OCCURRENCE) {
+      insert(Occurrence{day, stale[i].target});
+    }
+  }
+}
+
+uint8_t TargetTable::find(int32_t day) const {
+  uint8_t low = 0, high = upcomingCount;
+  while (low < high) {
+    uint8_t mid = (low + high) / 2;
+    if (upcoming[mid].day < day) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+void TargetTable::insert(const Occurrence& occurrence) {
+  // Ties go in list order, whichever of them was inserted first
+  uint8_t index = find(occurrence.day);
+  while (index < upcomingCount && upcoming[index].day == occurrence.day &&
+         upcoming[index].target < occurrence.target) {
+    index++;
+  }
+  memmove(upcoming + index + 1, upcoming + index, (upcomingCount - index) * sizeof(Occurrence));
+  upcoming[index] = occurrence;
+  upcomingCount++;
+}
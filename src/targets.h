@@ -0,0 +1,96 @@
+#ifndef TARGETS_H
+#define TARGETS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Countdown targets: the events the display counts down to.
+//
+// A target is a fixed date every year, the nth (or last) weekday of a
+// month every year, or a one-off date. TargetTable keeps the next
+// occurrence of each target sorted by date. When the date changes only the
+// targets whose occurrence has passed are recomputed and re-inserted, and
+// lookups are binary searches.
+//
+// Targets are configured as text, one per line:
+//
+//   Christmas,12-25          every December 25
+//   Thanksgiving,11/4/Thu    4th Thursday of November
+//   Memorial Day,5/L/Mon     last Monday of May
+//   Launch,2026-03-14        once
+//
+// Blank lines and lines starting with # are ignored.
+
+enum TargetRule : uint8_t {
+  RULE_ANNUAL,       // month/day every year
+  RULE_NTH_WEEKDAY,  // nth weekday of month every year
+  RULE_ONCE          // year/month/day
+};
+
+struct CountdownTarget {
+  char name[16];
+  TargetRule rule;
+  int8_t nth;        // RULE_NTH_WEEKDAY: 1-5, or -1 for the last
+  uint8_t weekday;   // RULE_NTH_WEEKDAY: 0 = Sunday
+  uint8_t month;     // 1-12
+  uint8_t day;       // RULE_ANNUAL, RULE_ONCE
+  int16_t year;      // RULE_ONCE
+};
+
+// A fixed array rather than anything growable: the web server hands a
+// list to the loop task through a Seqlock, and it is copied whole through
+// the handoff, the table and a few stack frames. At 32 targets that is
+// about 800 bytes a copy, and the text form fits a 1 KB request body. A
+// display rotating through the next few events has no use for thousands;
+// the table's cost per day is in the targets that passed, not the total.
+struct TargetList {
+  static const uint8_t MAX_TARGETS = 32;
+
+  uint8_t count;
+  CountdownTarget targets[MAX_TARGETS];
+};
+
+// Day number (days since 1970-01-01) of the first occurrence on or after
+// today, or NO_OCCURRENCE if there is none (a one-off in the past)
+static const int32_t NO_OCCURRENCE = INT32_MAX;
+int32_t nextOccurrence(const CountdownTarget& target, int32_t today);
+
+// Parse the text format. On failure returns false with the 1-based number
+// of the offending line in errorLine; list is left partly filled.
+bool parseTargets(const char* text, size_t length, TargetList& list, int& errorLine);
+
+// Write the text format. Returns the length, truncated to fit if needed.
+size_t formatTargets(const TargetList& list, char* buffer, size_t size);
+
+class TargetTable {
+public:
+  TargetTable();
+
+  // Compute every occurrence from scratch
+  void load(const TargetList& list, int32_t today);
+
+  // Move on to a new date, recomputing only the occurrences that passed
+  void advance(int32_t today);
+
+  // Upcoming occurrences, soonest first
+  uint8_t count() const { return upcomingCount; }
+  const CountdownTarget& target(uint8_t index) const { return list.targets[upcoming[index].target]; }
+  int32_t day(uint8_t index) const { return upcoming[index].day; }
+
+  // Index of the first occurrence on or after day, or count() if none
+  uint8_t find(int32_t day) const;
+
+private:
+  struct Occurrence {
+    int32_t day;
+    uint8_t target;  // Index into list
+  };
+
+  void insert(const Occurrence& occurrence);
+
+  TargetList list;
+  Occurrence upcoming[TargetList::MAX_TARGETS];
+  uint8_t upcomingCount;
+};
+
+#endif
@@ -0,0 +1,100 @@
+#include "telemetry.h"
+#include <string.h>
+#include "crc.h"
+
+size_t cobsEncode(const uint8_t* data, size_t length, uint8_t* out, size_t size) {
+  // Each block is a code byte (its length + 1) followed by up to 254
+  // non-zero bytes; a code below 0xFF stands for a zero after the block
+  size_t codePos = 0;
+  size_t pos = 1;
+  uint8_t code = 1;
+  if (size == 0) {
+    return 0;
+  }
+  for (size_t i = 0; i < length; i++) {
+    if (data[i] != 0) {
+      if (pos >= size) {
+        return 0;
+      }
+      out[pos++] = data[i];
+      code++;
+    }
+    if (data[i] == 0 || code == 0xFF) {
+      out[codePos] = code;
+      code = 1;
+      codePos = pos;
+      if (pos >= size) {
+        return 0;
+      }
+      pos++;
+    }
+  }
+  out[codePos] = code;
+  return pos;
+}
+
+size_t cobsDecode(const uint8_t* data, size_t length, uint8_t* out, size_t size) {
+  size_t in = 0;
+  size_t pos = 0;
+  while (in < length) {
+    uint8_t code = data[in++];
+    if (code == 0 || in + code - 1 > length) {
+      return 0;
+    }
+    for (uint8_t i = 1; i < code; i++) {
+      if (data[in] == 0 || pos >= size) {
+        return 0;
+      }
+      out[pos++] = data[in++];
+    }
+    // The zero a short block stands for, except after the last block
+    if (code != 0xFF && in < length) {
+      if (pos >= size) {
+        return 0;
+      }
+      out[pos++] = 0;
+    }
+  }
+  return pos;
+}
+
+TelemetryFrame::TelemetryFrame(TelemetryRecord type, uint32_t timeMs) : length(0), ok(true) {
+  u8(type);
+  u32(timeMs);
+}
+
+void TelemetryFrame::u16(uint16_t value) {
+  uint8_t b[2] = {(uint8_t)value, (uint8_t)(value >> 8)};
+  bytes(b, 2);
+}
+
+void TelemetryFrame::u32(uint32_t value) {
+  uint8_t b[4] = {(uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)};
+  bytes(b, 4);
+}
+
+void TelemetryFrame::bytes(const void* data, size_t count) {
+  if (!ok || count > MAX_RECORD - length) {
+    ok = false;
+    return;
+  }
+  memcpy(record + length, data, count);
+  length += count;
+}
+
+size_t TelemetryFrame::finish(uint8_t* out, size_t size) {
+  if (!ok || size < 2) {
+    return 0;
+  }
+  uint16_t crc = crc32(record, length);
+  record[length] = crc;
+  record[length + 1] = crc >> 8;
+
+  size_t encoded = cobsEncode(record, length + 2, out + 1, size - 2);
+  if (encoded == 0) {
+    return 0;
+  }
+  out[0] = 0;
+  out[encoded + 1] = 0;
+  return encoded + 2;
+}
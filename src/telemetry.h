@@ -0,0 +1,84 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary telemetry records on the serial port, alongside the text log.
+//
+// Each record is one frame: a 0x00 byte, the COBS encoding of the record
+// followed by the low 16 bits of its CRC32 (little-endian), and another
+// 0x00. COBS leaves no zero bytes inside the frame and text lines never
+// contain one, so a reader splits the stream on zeros: what lies between
+// a pair is a frame, everything else is log text. tools/telemetry_decode.py
+// does that and writes one CSV per record type.
+//
+// Every record starts with its type (u8) and the uptime in milliseconds
+// (u32); the fields per type follow, little-endian:
+//
+//   1 tick       u32 epoch, i16 days, u16 battery mV, u8 battery %,
+//                u8 battery state (status.h), i8 RSSI, u8 flags
+//   2 battery    u16 mV, u16 percent * 100, i16 rate %/hr * 100,
+//                u8 state, u8 fuel gauge alerts (hal.h)
+//   3 network    u8 event (netconn.h), i8 network index, i8 RSSI
+//   4 netstatus  u8 connected, i8 RSSI, u32 seconds since sync,
+//                i16 drift ppm * 10, u16 sync interval minutes,
+//                u16 awake duty * 10000, u16 radio duty * 10000,
+//                u16 mAh/day * 10
+//
+// New fields go at the end of a record, so a reader takes the fields it
+// knows and ignores any extra bytes.
+//
+// Encoding works in the caller's buffers, nothing is allocated.
+
+enum TelemetryRecord : uint8_t {
+  TELEMETRY_TICK = 1,
+  TELEMETRY_BATTERY = 2,
+  TELEMETRY_NETWORK = 3,
+  TELEMETRY_NETSTATUS = 4
+};
+
+enum TickFlag : uint8_t {
+  TICK_TIME_VALID = 0x01,
+  TICK_WIFI = 0x02,
+  TICK_LOW_POWER = 0x04,
+  TICK_LOW_BATTERY = 0x08
+};
+
+// Largest frame: record, CRC, COBS overhead and both delimiters
+static const size_t TELEMETRY_MAX_FRAME = 48;
+
+// COBS-encode length bytes of data into out. Returns the encoded length,
+// 0 if out is too small. Worst case is length + length / 254 + 1.
+size_t cobsEncode(const uint8_t* data, size_t length, uint8_t* out, size_t size);
+
+// Reverse cobsEncode. Returns the decoded length, 0 if the input is
+// malformed or out is too small.
+size_t cobsDecode(const uint8_t* data, size_t length, uint8_t* out, size_t size);
+
+// Builds one record and frames it
+class TelemetryFrame {
+public:
+  TelemetryFrame(TelemetryRecord type, uint32_t timeMs);
+
+  void u8(uint8_t value) { bytes(&value, 1); }
+  void i8(int8_t value) { u8((uint8_t)value); }
+  void u16(uint16_t value);
+  void i16(int16_t value) { u16((uint16_t)value); }
+  void u32(uint32_t value);
+
+  // Write the framed record into out. Returns its length, 0 if anything
+  // didn't fit.
+  size_t finish(uint8_t* out, size_t size);
+
+private:
+  static const size_t MAX_RECORD = 32;
+
+  void bytes(const void* data, size_t length);
+
+  uint8_t record[MAX_RECORD + 2];  // Room for the CRC
+  size_t length;
+  bool ok;
+};
+
+#endif
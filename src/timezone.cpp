@@ -0,0 +1,258 @@
+#include "timezone.h"
+#include <string.h>
+#include "countdown.h"
+
+static const int32_t SECONDS_PER_DAY = 86400;
+
+static int64_t floorDiv(int64_t a, int64_t b) {
+  int64_t q = a / b;
+  return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+static bool isDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+static bool isAlpha(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+// Unsigned number of at most maxDigits digits, no larger than max
+static bool parseNumber(const char*& p, int maxDigits, int max, int& value) {
+  value = 0;
+  int digits = 0;
+  while (isDigit(*p) && digits < maxDigits) {
+    value = value * 10 + (*p++ - '0');
+    digits++;
+  }
+  return digits > 0 && value <= max;
+}
+
+// Zone abbreviation: at least three letters, or anything in <brackets>
+static bool parseName(const char*& p) {
+  const char* start;
+  if (*p == '<') {
+    start = ++p;
+    while (*p != '\0' && *p != '>') p++;
+    if (*p != '>' || p - start < 3) {
+      return false;
+    }
+    p++;
+    return true;
+  }
+  start = p;
+  while (isAlpha(*p)) p++;
+  return p - start >= 3;
+}
+
+// [+-]hh[:mm[:ss]] in seconds
+static bool parseTime(const char*& p, int maxHours, int32_t& seconds) {
+  int sign = 1;
+  if (*p == '+' || *p == '-') {
+    sign = *p++ == '-' ? -1 : 1;
+  }
+  int hours, minutes = 0, secs = 0;
+  if (!parseNumber(p, 3, maxHours, hours)) {
+    return false;
+  }
+  if (*p == ':') {
+    p++;
+    if (!parseNumber(p, 2, 59, minutes)) {
+      return false;
+    }
+    if (*p == ':') {
+      p++;
+      if (!parseNumber(p, 2, 59, secs)) {
+        return false;
+      }
+    }
+  }
+  seconds = sign * (hours * 3600 + minutes * 60 + secs);
+  return true;
+}
+
+static bool parseTransition(const char*& p, TzTransitionRule& transition) {
+  int value;
+  memset(&transition, 0, sizeof(transition));
+  if (*p == 'M') {
+    p++;
+    transition.kind = TzTransitionRule::MONTH_WEEK;
+    int month, week, weekday;
+    if (!parseNumber(p, 2, 12, month) || month < 1 || *p++ != '.' ||
+        !parseNumber(p, 1, 5, week) || week < 1 || *p++ != '.' ||
+        !parseNumber(p, 1, 6, weekday)) {
+      return false;
+    }
+    transition.month = month;
+    transition.week = week;
+    transition.weekday = weekday;
+  } else if (*p == 'J') {
+    p++;
+    transition.kind = TzTransitionRule::JULIAN;
+    if (!parseNumber(p, 3, 365, value) || value < 1) {
+      return false;
+    }
+    transition.day = value;
+  } else {
+    transition.kind = TzTransitionRule::DAY_OF_YEAR;
+    if (!parseNumber(p, 3, 365, value)) {
+      return false;
+    }
+    transition.day = value;
+  }
+
+  transition.time = 2 * 3600;
+  if (*p == '/') {
+    p++;
+    return parseTime(p, 167, transition.time);
+  }
+  return true;
+}
+
+bool parseTzRule(const char* text, TzRule& rule) {
+  memset(&rule, 0, sizeof(rule));
+  const char* p = text;
+  int32_t offset;
+
+  // POSIX offsets are west of UTC, the opposite of what everything else uses
+  if (!parseName(p) || !parseTime(p, 24, offset)) {
+    return false;
+  }
+  rule.stdOffset = -offset;
+  rule.dstOffset = rule.stdOffset;
+  if (*p == '\0') {
+    return true;
+  }
+
+  if (!parseName(p)) {
+    return false;
+  }
+  rule.hasDst = true;
+  rule.dstOffset = rule.stdOffset + 3600;
+  if (*p != '\0' && *p != ',') {
+    if (!parseTime(p, 24, offset)) {
+      return false;
+    }
+    rule.dstOffset = -offset;
+  }
+
+  if (*p == '\0') {
+    const char* usRules = "M3.2.0,M11.1.0";
+    return parseTransition(usRules, rule.start) && *usRules++ == ',' && parseTransition(usRules, rule.end);
+  }
+  p++;
+  if (!parseTransition(p, rule.start) || *p++ != ',' || !parseTransition(p, rule.end)) {
+    return false;
+  }
+  return *p == '\0';
+}
+
+// Day number of the transition's date in the given year
+static int32_t transitionDay(const TzTransitionRule& transition, int year) {
+  int32_t jan1 = daysFromCivil(year, 1, 1);
+  switch (transition.kind) {
+    case TzTransitionRule::JULIAN:
+      return jan1 + transition.day - 1 + (isLeapYear(year) && transition.day >= 60 ? 1 : 0);
+    case TzTransitionRule::DAY_OF_YEAR:
+      return jan1 + transition.day;
+    case TzTransitionRule::MONTH_WEEK:
+    default: {
+      int32_t first = daysFromCivil(year, transition.month, 1);
+      int day = (transition.weekday - dayOfWeek(first) + 7) % 7 + (transition.week - 1) * 7;
+      while (day >= daysInMonth(year, transition.month)) {
+        day -= 7;  // Week 5 means the last one
+      }
+      return first + day;
+    }
+  }
+}
+
+TimeZone::TimeZone() : count(0), validFrom(INT64_MIN), validUntil(INT64_MAX), lastIndex(0) {
+  memset(&rule, 0, sizeof(rule));
+}
+
+void TimeZone::setRule(const TzRule& newRule) {
+  rule = newRule;
+  count = 0;
+  lastIndex = 0;
+  // Without DST there's nothing to look up; otherwise the first
+  // conversion builds the table
+  validFrom = rule.hasDst ? 0 : INT64_MIN;
+  validUntil = rule.hasDst ? 0 : INT64_MAX;
+}
+
+void TimeZone::buildTable(int64_t utc) {
+  int year = civilFromDays(floorDiv(utc + rule.stdOffset, SECONDS_PER_DAY)).year;
+
+  // The start rule is given in standard time and the end rule in
+  // daylight time
+  count = 0;
+  for (int y = year - 1; y <= year + 1; y++) {
+    table[count++] = {(int64_t)transitionDay(rule.start, y) * SECONDS_PER_DAY + rule.start.time - rule.stdOffset,
+                      rule.dstOffset, true};
+    table[count++] = {(int64_t)transitionDay(rule.end, y) * SECONDS_PER_DAY + rule.end.time - rule.dstOffset,
+                      rule.stdOffset, false};
+  }
+
+  // Southern hemisphere zones end DST earlier in the year than they start it
+  for (uint8_t i = 1; i < count; i++) {
+    Transition t = table[i];
+    uint8_t j = i;
+    for (; j > 0 && table[j - 1].utc > t.utc; j--) {
+      table[j] = table[j - 1];
+    }
+    table[j] = t;
+  }
+
+  validFrom = table[0].utc;
+  validUntil = table[count - 1].utc;
+  lastIndex = 0;
+}
+
+uint8_t TimeZone::lookup(int64_t utc) {
+  if (utc < validFrom || utc >= validUntil) {
+    buildTable(utc);
+  }
+  if (table[lastIndex].utc <= utc && (lastIndex + 1 >= count || utc < table[lastIndex + 1].utc)) {
+    return lastIndex;
+  }
+  uint8_t i = 0;
+  while (i + 1 < count && table[i + 1].utc <= utc) {
+    i++;
+  }
+  lastIndex = i;
+  return i;
+}
+
+int32_t TimeZone::offsetAt(int64_t utc) {
+  if (!rule.hasDst) {
+    return rule.stdOffset;
+  }
+  return table[lookup(utc)].offset;
+}
+
+void TimeZone::toLocal(int64_t utc, struct tm& local) {
+  bool dst = false;
+  int32_t offset = rule.stdOffset;
+  if (rule.hasDst) {
+    const Transition& t = table[lookup(utc)];
+    offset = t.offset;
+    dst = t.dst;
+  }
+
+  int64_t seconds = utc + offset;
+  int32_t days = floorDiv(seconds, SECONDS_PER_DAY);
+  int32_t secondOfDay = seconds - (int64_t)days * SECONDS_PER_DAY;
+  CivilDate date = civilFromDays(days);
+
+  memset(&local, 0, sizeof(local));
+  local.tm_year = date.year - 1900;
+  local.tm_mon = date.month - 1;
+  local.tm_mday = date.day;
+  local.tm_hour = secondOfDay / 3600;
+  local.tm_min = secondOfDay / 60 % 60;
+  local.tm_sec = secondOfDay % 60;
+  local.tm_wday = dayOfWeek(days);
+  local.tm_yday = days - daysFromCivil(date.year, 1, 1);
+  local.tm_isdst = dst ? 1 : 0;
+}
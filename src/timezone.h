@@ -0,0 +1,81 @@
+#ifndef TIMEZONE_H
+#define TIMEZONE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// Local time from POSIX TZ rules, without libc's localtime().
+//
+// A rule such as "EST5EDT,M3.2.0,M11.1.0" is parsed once. TimeZone then
+// works out the DST transitions around the current year into a small
+// table, and converting a UTC time is a lookup in that table plus integer
+// date math. The table is only rebuilt when the time moves outside it,
+// i.e. about once a year.
+//
+// Supported: std offset [dst [offset] [,start[/time],end[/time]]] with
+// names either alphabetic or <quoted>, start/end as Mm.w.d, Jn or n, and
+// transition times from -167 to 167 hours. A zone with DST but no rules
+// uses the US rules (M3.2.0,M11.1.0), like glibc.
+
+struct TzTransitionRule {
+  enum Kind : uint8_t {
+    JULIAN,       // Jn: day 1-365, February 29 never counted
+    DAY_OF_YEAR,  // n: day 0-365, counting February 29
+    MONTH_WEEK    // Mm.w.d: weekday d of week w (5 = last) of month m
+  };
+
+  Kind kind;
+  uint8_t month;
+  uint8_t week;
+  uint8_t weekday;  // 0 = Sunday
+  uint16_t day;
+  int32_t time;     // Seconds after local midnight
+};
+
+struct TzRule {
+  int32_t stdOffset;  // Seconds east of UTC
+  int32_t dstOffset;
+  bool hasDst;
+  TzTransitionRule start;  // Into DST, in standard time
+  TzTransitionRule end;    // Out of DST, in daylight time
+};
+
+// Returns false if the string isn't a TZ rule this understands
+bool parseTzRule(const char* text, TzRule& rule);
+
+class TimeZone {
+public:
+  TimeZone();
+
+  void setRule(const TzRule& rule);
+
+  // Seconds east of UTC in effect at the given UTC time
+  int32_t offsetAt(int64_t utc);
+
+  // Break a UTC time down into local time, tm_isdst included
+  void toLocal(int64_t utc, struct tm& local);
+
+private:
+  struct Transition {
+    int64_t utc;     // When it happens
+    int32_t offset;  // Offset from then on
+    bool dst;
+  };
+
+  // Transitions for the year before through the year after the one utc
+  // falls in
+  void buildTable(int64_t utc);
+  uint8_t lookup(int64_t utc);
+
+  static const uint8_t MAX_TRANSITIONS = 6;
+
+  TzRule rule;
+  Transition table[MAX_TRANSITIONS];
+  uint8_t count;
+  int64_t validFrom;   // The table answers for validFrom <= utc < validUntil
+  int64_t validUntil;
+  uint8_t lastIndex;   // Most lookups hit the same entry as the last one
+};
+
+#endif
@@ -0,0 +1,64 @@
+#include "wifi_backend.h"
+#include <WiFi.h>
+#include <esp_sntp.h>
+#include <esp_timer.h>
+
+// Set from the SNTP task when a sync completes
+static volatile bool sntpSynced = false;
+static volatile int64_t syncWallUs = 0;
+static volatile int64_t syncMonotonicUs = 0;
+
+static void onSntpSync(struct timeval* tv) {
+  syncMonotonicUs = esp_timer_get_time();
+  syncWallUs = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+  sntpSynced = true;
+}
+
+void WiFiNetworkBackend::setTimeServer(const char* server) {
+  ntpServer = server;
+}
+
+void WiFiNetworkBackend::begin(const char* ssid, const char* password) {
+  WiFi.mode(WIFI_STA);
+  WiFi.begin(ssid, password);
+}
+
+bool WiFiNetworkBackend::isConnected() {
+  return WiFi.status() == WL_CONNECTED;
+}
+
+void WiFiNetworkBackend::disconnect() {
+  WiFi.disconnect();
+}
+
+void WiFiNetworkBackend::startTimeSync() {
+  sntpSynced = false;
+  sntp_set_time_sync_notification_cb(onSntpSync);
+  // configTime() restarts the SNTP client, which fires the callback above
+  // once the first response has been applied to the system clock
+  configTime(0, 0, ntpServer);
+}
+
+bool WiFiNetworkBackend::timeSynced() {
+  return sntpSynced;
+}
+
+void WiFiNetworkBackend::stopTimeSync() {
+  // Otherwise SNTP keeps correcting the clock in the background, hiding
+  // the drift we want to measure between our own syncs
+  sntp_stop();
+}
+
+bool WiFiNetworkBackend::lastSyncReference(int64_t& wallUs, int64_t& monotonicUs) {
+  if (syncWallUs == 0) {
+    return false;
+  }
+  wallUs = syncWallUs;
+  monotonicUs = syncMonotonicUs;
+  return true;
+}
+
+void WiFiNetworkBackend::radioOff() {
+  WiFi.disconnect(true);
+  WiFi.mode(WIFI_OFF);
+}
@@ -0,0 +1,28 @@
+#ifndef WIFI_BACKEND_H
+#define WIFI_BACKEND_H
+
+#include "netconn.h"
+
+// NetworkBackend on top of the ESP32 WiFi stack and SNTP client
+class WiFiNetworkBackend : public NetworkBackend {
+public:
+  // The system clock stays in UTC; local time is the clock backend's job
+  void setTimeServer(const char* server);
+
+  void begin(const char* ssid, const char* password) override;
+  bool isConnected() override;
+  void disconnect() override;
+  void startTimeSync() override;
+  bool timeSynced() override;
+  void stopTimeSync() override;
+  void radioOff() override;
+
+  // Wall clock just applied by the last sync and the monotonic clock at
+  // that instant, both in microseconds. False until a sync has happened.
+  bool lastSyncReference(int64_t& wallUs, int64_t& monotonicUs);
+
+private:
+  const char* ntpServer = "pool.ntp.org";
+};
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef SIM_FIRMWARE_H
+#define SIM_FIRMWARE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "ota.h"
+
+// Two OTA app partitions and the bootloader's rollback state, in memory.
+//
+// Writes behave like the Arduino core's Update: they are buffered up to a
+// flash sector and only reach the partition a sector at a time, the first
+// byte must be the image magic, and an image that outgrows the partition
+// fails. end() walks the ESP image format (header, segments, checksum) the
+// way the bootloader's image check does before switching partitions.
+//
+// reboot() is the bootloader with app rollback enabled and the core's
+// verifyRollbackLater() returning true: a new image boots pending verify,
+// and booting again while still pending marks it invalid and goes back.
+class SimFirmwareSlot : public FirmwareSlot {
+public:
+  static const size_t PARTITION_BYTES = 256 * 1024;
+  static const size_t SECTOR_BYTES = 4096;
+  static const uint8_t IMAGE_MAGIC = 0xE9;
+
+  enum ImageState : uint8_t { EMPTY, NEW, PENDING_VERIFY, VALID, INVALID };
+
+  SimFirmwareSlot() {
+    for (auto& p : partitions) {
+      p.assign(PARTITION_BYTES, 0xFF);
+    }
+    states[0] = VALID;
+  }
+
+  bool begin() override {
+    target = 1 - running;
+    writing = true;
+    buffer.clear();
+    written = 0;
+    return true;
+  }
+
+  bool write(const uint8_t* data, size_t length) override {
+    if (!writing) {
+      return false;
+    }
+    if (written + buffer.size() == 0 && length > 0 && data[0] != IMAGE_MAGIC) {
+      writing = false;
+      return false;
+    }
+    if (written + buffer.size() + length > PARTITION_BYTES) {
+      writing = false;
+      return false;
+    }
+    buffer.insert(buffer.end(), data, data + length);
+    while (buffer.size() >= SECTOR_BYTES) {
+      flushSector(SECTOR_BYTES);
+    }
+    return true;
+  }
+
+  bool end() override {
+    if (!writing) {
+      return false;
+    }
+    flushSector(buffer.size());
+    writing = false;
+    if (!imageValid(partitions[target].data(), written)) {
+      return false;
+    }
+    states[target] = NEW;
+    boot = target;
+    return true;
+  }
+
+  void abort() override {
+    writing = false;
+    buffer.clear();
+  }
+
+  bool pendingVerify() override { return states[running] == PENDING_VERIFY; }
+
+  void markValid() override { states[running] = VALID; }
+
+  void rollback() override {
+    states[running] = INVALID;
+    boot = 1 - running;
+    rollbacks++;
+    reboot();
+  }
+
+  // Power cycle or reset: anything still buffered is lost
+  void reboot() {
+    writing = false;
+    buffer.clear();
+    if (states[boot] == PENDING_VERIFY) {
+      states[boot] = INVALID;  // Reset before the new image decided
+      boot = 1 - boot;
+    } else if (states[boot] == NEW) {
+      states[boot] = PENDING_VERIFY;
+    }
+    running = boot;
+    boots++;
+  }
+
+  // Whether data is an image the bootloader would accept: magic, 1-16
+  // segments each within the data, padding to a 16-byte boundary and the
+  // XOR checksum of the segment data in its last byte
+  static bool imageValid(const uint8_t* data, size_t length) {
+    if (length < 24 || data[0] != IMAGE_MAGIC || data[1] == 0 || data[1] > 16) {
+      return false;
+    }
+    size_t pos = 24;
+    uint8_t checksum = 0xEF;
+    for (uint8_t s = 0; s < data[1]; s++) {
+      if (length - pos < 8) {
+        return false;
+      }
+      uint32_t size = data[pos + 4] | data[pos + 5] << 8 | data[pos + 6] << 16 | (uint32_t)data[pos + 7] << 24;
+      pos += 8;
+      if (size > length - pos) {
+        return false;
+      }
+      for (uint32_t i = 0; i < size; i++) {
+        checksum ^= data[pos + i];
+      }
+      pos += size;
+    }
+    size_t end = (pos | 15) + 1;
+    return end <= length && data[end - 1] == checksum;
+  }
+
+  std::vector<uint8_t> partitions[2];
+  ImageState states[2] = {EMPTY, EMPTY};
+  uint8_t running = 0;
+  uint8_t boot = 0;
+  uint32_t boots = 0;
+  uint32_t rollbacks = 0;
+
+private:
+  void flushSector(size_t length) {
+    memcpy(partitions[target].data() + written, buffer.data(), length);
+    buffer.erase(buffer.begin(), buffer.begin() + length);
+    written += length;
+  }
+
+  uint8_t target = 1;
+  bool writing = false;
+  std::vector<uint8_t> buffer;
+  size_t written = 0;
+};
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef SIM_FLASH_H
+#define SIM_FLASH_H
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "historylog.h"
+
+// The history log's segments in memory, with power cuts.
+//
+// cutPowerAfter(n) lets n more bytes reach flash and then drops power:
+// the write in progress stops part way, returns false, and everything
+// fails until begin() (the reboot). With erasedTail the rest of the torn
+// write reads back as erased flash (0xFF) instead of being missing, the
+// way a file whose size was committed before its data can look.
+class SimFlashStore : public LogStore {
+public:
+  bool begin() override {
+    powered = true;
+    mounts++;
+    return true;
+  }
+  size_t size(uint8_t segment) override { return powered ? segments[segment].size() : 0; }
+  size_t read(uint8_t segment, size_t offset, uint8_t* out, size_t length) override {
+    reads++;
+    const std::vector<uint8_t>& data = segments[segment];
+    if (!powered || offset >= data.size()) {
+      return 0;
+    }
+    size_t n = data.size() - offset < length ? data.size() - offset : length;
+    memcpy(out, data.data() + offset, n);
+    return n;
+  }
+  bool append(uint8_t segment, const uint8_t* data, size_t length) override {
+    if (!powered) {
+      return false;
+    }
+    std::vector<uint8_t>& bytes = segments[segment];
+    if (budget >= 0 && (size_t)budget < length) {
+      bytes.insert(bytes.end(), data, data + budget);
+      if (erasedTail) {
+        bytes.insert(bytes.end(), length - budget, 0xFF);
+      }
+      powered = false;
+      budget = -1;
+      return false;
+    }
+    bytes.insert(bytes.end(), data, data + length);
+    if (budget >= 0) {
+      budget -= length;
+    }
+    return true;
+  }
+  // Copy and rename, like LittleFsLogStore: a cut part way leaves the old
+  // segment whole
+  bool truncate(uint8_t segment, size_t length) override {
+    if (!powered) {
+      return false;
+    }
+    if (budget >= 0 && (size_t)budget < length) {
+      powered = false;
+      budget = -1;
+      return false;
+    }
+    if (budget >= 0) {
+      budget -= length;
+    }
+    if (length < segments[segment].size()) {
+      segments[segment].resize(length);
+    }
+    return true;
+  }
+
+  void cutPowerAfter(size_t bytes, bool erased = false) {
+    budget = (long)bytes;
+    erasedTail = erased;
+  }
+
+  std::vector<uint8_t> segments[2];
+  bool powered = false;
+  uint32_t mounts = 0;
+  uint32_t reads = 0;
+
+private:
+  long budget = -1;  // Bytes until the power cut, -1 for none
+  bool erasedTail = false;
+};
+
+#endif
@@ -0,0 +1,360 @@
+#ifndef SIM_HAL_H
+#define SIM_HAL_H
+
+#include <stdint.h>
+#include <string.h>
+#include "hal.h"
+#include "netconn.h"
+#include "animation.h"
+#include "timezone.h"
+
+// Simulated hardware for the native environment.
+//
+// Each class implements one of the seams in hal.h (or NetworkBackend) on
+// plain memory, driven by a SimClock that only moves when the test says
+// so. Nothing sleeps: a test advances the clock straight to the next
+// deadline, so a simulated year takes seconds.
+
+// Monotonic and wall clocks. The wall clock stays unset (localTime() false,
+// like the ESP32 before its first sync) until setEpoch(), and can run fast
+// or slow by driftPpm to stand in for the RTC crystal.
+class SimClock : public ClockBackend {
+public:
+  explicit SimClock(unsigned long millisAtStart = 0) : millisBase(millisAtStart) {}
+
+  void advanceMs(uint64_t ms) { nowUs += ms * 1000; }
+  void advanceUs(uint64_t us) { nowUs += us; }
+
+  // Set the wall clock, as an NTP sync would
+  void setEpoch(int64_t epoch) {
+    wallBaseUs = epoch * 1000000;
+    wallSetAtUs = nowUs;
+    wallSet = true;
+  }
+  void clearEpoch() { wallSet = false; }
+  void setDriftPpm(double ppm) {
+    if (wallSet) {
+      wallBaseUs = wallUs();
+      wallSetAtUs = nowUs;
+    }
+    driftPpm = ppm;
+  }
+
+  int64_t wallUs() const {
+    return wallBaseUs + (int64_t)((nowUs - wallSetAtUs) * (1.0 + driftPpm / 1e6));
+  }
+
+  // Wraps at the width of unsigned long, like millis() does at 32 bits
+  unsigned long millis() override { return millisBase + (unsigned long)(nowUs / 1000); }
+  int64_t monotonicUs() override { return (int64_t)nowUs; }
+  uint32_t cycleCount() override { return (uint32_t)(nowUs * 240); }  // 240 MHz
+  time_t epoch() override { return wallSet ? (time_t)(wallUs() / 1000000) : 0; }
+  void setTimeZone(const TzRule& rule) override { zone.setRule(rule); }
+  bool localTime(struct tm& timeinfo) override {
+    if (!wallSet) {
+      return false;
+    }
+    zone.toLocal(wallUs() / 1000000, timeinfo);
+    return true;
+  }
+
+private:
+  uint64_t nowUs = 0;
+  unsigned long millisBase;
+  bool wallSet = false;
+  int64_t wallBaseUs = 0;
+  uint64_t wallSetAtUs = 0;
+  double driftPpm = 0;
+  TimeZone zone;
+};
+
+// The 4-digit display as segment bits. Drawing changes the frame in
+// memory; refresh() latches it as what the LEDs show, like the HT16K33's
+// RAM, and counts the writes.
+class SimDisplay : public DisplayBackend {
+public:
+  static const uint8_t POSITIONS = 5;  // 2 is the colon
+  static const uint8_t COLON = 0x02;
+
+  bool begin(uint8_t address) override {
+    clear();
+    refresh();
+    return present;
+  }
+  void setBrightness(uint8_t level) override { brightness = level > 15 ? 15 : level; }
+  void setPower(bool on) override { powered = on; }
+  void clear() override { memset(ram, 0, sizeof(ram)); }
+  void showNumber(long value, int base = 10) override {
+    // Right-aligned without leading zeros, dashes when it doesn't fit
+    if (value > 9999 || value < -999 || base != 10) {
+      showDashes();
+      return;
+    }
+    bool negative = value < 0;
+    unsigned long rest = negative ? -value : value;
+    static const uint8_t digits[4] = {4, 3, 1, 0};
+    for (uint8_t i = 0; i < 4; i++) {
+      uint8_t position = digits[i];
+      if (i == 0 || rest > 0) {
+        ram[position] = glyph('0' + rest % 10);
+        rest /= 10;
+      } else if (negative) {
+        ram[position] = glyph('-');
+        negative = false;
+      } else {
+        ram[position] = 0;
+      }
+    }
+    ram[2] = 0;
+  }
+  void showDigit(uint8_t position, uint8_t digit) override {
+    if (position < POSITIONS) {
+      ram[position] = glyph('0' + digit % 10);
+    }
+  }
+  void showSegments(uint8_t position, uint8_t segments) override {
+    if (position < POSITIONS) {
+      ram[position] = segments;
+    }
+  }
+  void showColon(bool on) override { ram[2] = on ? COLON : 0; }
+  void showDashes() override {
+    ram[0] = ram[1] = ram[3] = ram[4] = SEG_G;
+    ram[2] = 0;
+  }
+  void refresh() override {
+    if (memcmp(shown, ram, sizeof(ram)) != 0) {
+      memcpy(shown, ram, sizeof(ram));
+      changes++;
+    }
+    refreshes++;
+  }
+  uint8_t litSegments() override {
+    uint8_t lit = 0;
+    for (uint8_t i = 0; i < POSITIONS; i++) {
+      lit += __builtin_popcount(shown[i]);
+    }
+    return lit;
+  }
+
+  // The digits on the LEDs as a number, or -1 if they don't read as one
+  long number() const {
+    static const uint8_t digits[4] = {0, 1, 3, 4};
+    long value = 0;
+    bool any = false;
+    for (uint8_t i = 0; i < 4; i++) {
+      uint8_t segments = shown[digits[i]] & ~SEG_DP;
+      if (segments == 0 && !any) {
+        continue;
+      }
+      int digit = -1;
+      for (int d = 0; d <= 9; d++) {
+        if (glyph('0' + d) == segments) {
+          digit = d;
+        }
+      }
+      if (digit < 0) {
+        return -1;
+      }
+      value = value * 10 + digit;
+      any = true;
+    }
+    return any ? value : -1;
+  }
+  bool dashes() const {
+    return shown[0] == SEG_G && shown[1] == SEG_G && shown[3] == SEG_G && shown[4] == SEG_G;
+  }
+  bool colon() const { return shown[2] & COLON; }
+  const uint8_t* frame() const { return shown; }
+
+  bool present = true;
+  bool powered = true;
+  uint8_t brightness = 15;
+  uint32_t refreshes = 0;
+  uint32_t changes = 0;  // Refreshes that changed what's shown
+
+private:
+  uint8_t ram[POSITIONS] = {};
+  uint8_t shown[POSITIONS] = {};
+};
+
+// A battery behind a MAX17048. The charge follows a constant load (or a
+// charger), voltage comes from a simple open-circuit curve, and the alert
+// flags latch the way the chip's do. Reads can be made to fail or to
+// return one wild sample.
+class SimFuelGauge : public FuelGaugeBackend {
+public:
+  SimFuelGauge(SimClock& clock, float capacity_mAh, float percent)
+      : clock(clock), capacity(capacity_mAh), charge(percent) {}
+
+  bool begin() override { return present; }
+
+  bool read(FuelGaugeReading& reading) override {
+    update();
+    if (failReads) {
+      return false;
+    }
+    reading.voltage = voltageFor(charge);
+    reading.percent = (float)charge;
+    reading.chargeRate = rate();
+    if (glitchNext) {
+      // One absurd sample, as a bus error or a gauge reset can give
+      glitchNext = false;
+      reading.voltage = 2.5f;
+      reading.percent = 0.0f;
+    }
+    reading.alerts = alerts;
+    return true;
+  }
+
+  void setAlerts(float minVoltage, uint8_t emptyPercent) override {
+    alertVoltage = minVoltage;
+    alertPercent = emptyPercent;
+    clearAlerts();
+  }
+  void clearAlerts() override { alerts = 0; }
+
+  // Open-circuit voltage for a state of charge, roughly a LiPo's curve
+  static float voltageFor(float percent) {
+    if (percent < 10.0f) {
+      return 3.3f + percent * 0.04f;
+    }
+    return 3.7f + (percent - 10.0f) * 0.5f / 90.0f;
+  }
+
+  float rate() const {  // %/hr
+    float mA = chargingMa > 0 ? chargingMa : -loadMa;
+    return mA / capacity * 100.0f;
+  }
+  float percent() const { return (float)charge; }
+
+  bool present = true;
+  bool failReads = false;
+  bool glitchNext = false;
+  float loadMa = 60.0f;
+  float chargingMa = 0.0f;
+
+private:
+  void update() {
+    int64_t now = clock.monotonicUs();
+    double hours = (now - lastUs) / 3.6e9;
+    lastUs = now;
+    charge += rate() * hours;
+    if (charge > 100.0f) charge = 100.0f;
+    if (charge < 0.0f) charge = 0.0f;
+    if (alertVoltage > 0 && voltageFor(charge) < alertVoltage) alerts |= FUEL_ALERT_VOLTAGE_LOW;
+    if (alertPercent > 0 && charge < alertPercent) alerts |= FUEL_ALERT_SOC_LOW;
+  }
+
+  SimClock& clock;
+  float capacity;
+  double charge;  // Double, so a second of sleep current still registers
+  int64_t lastUs = 0;
+  float alertVoltage = 0;
+  uint8_t alertPercent = 0;
+  uint8_t alerts = 0;
+};
+
+// WiFi networks and an NTP server with set delays. Each network in the
+// table either comes up connectDelayMs after begin() or never; the time
+// server answers syncDelayMs after startTimeSync(). drop() takes the
+// connection away; with autoReconnect the stack brings it back by itself
+// after reconnectDelayMs, as the ESP32's does.
+class SimNetwork : public NetworkBackend {
+public:
+  struct Network {
+    const char* ssid;
+    bool available;
+    unsigned long connectDelayMs;
+  };
+
+  static const int MAX_NETWORKS = 8;
+
+  explicit SimNetwork(SimClock& clock) : clock(clock) {}
+
+  void addNetwork(const char* ssid, bool available, unsigned long connectDelayMs) {
+    if (networkCount < MAX_NETWORKS) {
+      networks[networkCount++] = Network{ssid, available, connectDelayMs};
+    }
+  }
+  Network* network(const char* ssid) {
+    for (int i = 0; i < networkCount; i++) {
+      if (strcmp(networks[i].ssid, ssid) == 0) {
+        return &networks[i];
+      }
+    }
+    return nullptr;
+  }
+
+  void begin(const char* ssid, const char* password) override {
+    joining = network(ssid);
+    joinedAt = clock.millis();
+    linked = false;
+    radio = true;
+    begins++;
+    lastSsid = ssid;
+  }
+  bool isConnected() override {
+    if (!linked && joining != nullptr && joining->available && !dropped &&
+        clock.millis() - joinedAt >= joining->connectDelayMs) {
+      linked = true;
+    }
+    if (dropped && autoReconnect && joining != nullptr && joining->available &&
+        clock.millis() - droppedAt >= reconnectDelayMs) {
+      dropped = false;
+      linked = true;
+    }
+    return linked && !dropped;
+  }
+  void disconnect() override {
+    linked = false;
+    joining = nullptr;
+    dropped = false;
+  }
+  void startTimeSync() override {
+    syncStartedAt = clock.millis();
+    syncing = true;
+    syncStarts++;
+  }
+  bool timeSynced() override {
+    return syncing && ntpAvailable && isConnected() && clock.millis() - syncStartedAt >= syncDelayMs;
+  }
+  void stopTimeSync() override { syncing = false; }
+  void radioOff() override {
+    disconnect();
+    radio = false;
+  }
+
+  // Lose the connection, e.g. the access point rebooted
+  void drop() {
+    if (linked) {
+      dropped = true;
+      droppedAt = clock.millis();
+    }
+  }
+
+  bool radioOn() const { return radio; }
+
+  bool ntpAvailable = true;
+  unsigned long syncDelayMs = 300;
+  bool autoReconnect = true;
+  unsigned long reconnectDelayMs = 5000;
+  uint32_t begins = 0;
+  uint32_t syncStarts = 0;
+  const char* lastSsid = nullptr;
+
+private:
+  SimClock& clock;
+  Network networks[MAX_NETWORKS];
+  int networkCount = 0;
+  Network* joining = nullptr;
+  unsigned long joinedAt = 0;
+  bool linked = false;
+  bool dropped = false;
+  unsigned long droppedAt = 0;
+  bool syncing = false;
+  unsigned long syncStartedAt = 0;
+  bool radio = false;
+};
+
+#endif
@@ -0,0 +1,208 @@
+// Animator against golden frame traces: scrolling text, text that fits,
+// repeated passes, fades and a fade under scrolling text. Each trace line
+// is a frame that changed something:
+//
+//   frame  changes (F frame, B brightness)  four digits' segment bits  brightness
+//
+// Segment bits are the backpack's (animation.h), so "39 74 50 10" is
+// "Chri".
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "animation.h"
+
+static std::string trace(Animator& animator, int frames, bool everyFrame = false) {
+  std::string out;
+  for (int f = 0; f < frames; f++) {
+    uint8_t changes = animator.step();
+    if (changes == 0 && !everyFrame) {
+      continue;
+    }
+    const Frame& frame = animator.frame();
+    char line[40];
+    snprintf(line, sizeof(line), "%3d %c%c %02x %02x %02x %02x %2u\n", f,
+             changes & Animator::CHANGED_FRAME ? 'F' : '-', changes & Animator::CHANGED_BRIGHTNESS ? 'B' : '-',
+             frame.digits[0], frame.digits[1], frame.digits[2], frame.digits[3], animator.brightness());
+    out += line;
+  }
+  return out;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// Enters at the right, one character every 250 ms, until the last one
+// has reached the left digit; that frame stays up a full character time
+void test_scroll(void) {
+  Animator animator;
+  animator.showText("Christmas");
+  TEST_ASSERT_EQUAL_STRING("  0 F- 00 00 00 39 15\n"   // ___C
+                           "  5 F- 00 00 39 74 15\n"   // __Ch
+                           " 10 F- 00 39 74 50 15\n"
+                           " 15 F- 39 74 50 10 15\n"   // Chri
+                           " 20 F- 74 50 10 6d 15\n"
+                           " 25 F- 50 10 6d 78 15\n"
+                           " 30 F- 10 6d 78 55 15\n"
+                           " 35 F- 6d 78 55 5f 15\n"
+                           " 40 F- 78 55 5f 6d 15\n"   // tmas
+                           " 45 F- 55 5f 6d 00 15\n"
+                           " 50 F- 5f 6d 00 00 15\n"
+                           " 55 F- 6d 00 00 00 15\n",  // s___
+                           trace(animator, 64).c_str());
+  TEST_ASSERT_FALSE(animator.active());
+  // 12 positions of 5 frames: 3 seconds a pass
+  TEST_ASSERT_EQUAL_UINT32(3000, 12 * Animator::SCROLL_FRAMES * Animator::FRAME_MS);
+}
+
+// Two passes: the second starts from the right again as soon as the
+// first one's last frame has had its time
+void test_scroll_passes(void) {
+  Animator animator;
+  animator.showText("New Year", 2);
+  TEST_ASSERT_EQUAL_STRING("  0 F- 00 00 00 37 15\n"
+                           "  5 F- 00 00 37 7b 15\n"
+                           " 10 F- 00 37 7b 2a 15\n"
+                           " 15 F- 37 7b 2a 00 15\n"   // New_
+                           " 20 F- 7b 2a 00 6e 15\n"
+                           " 25 F- 2a 00 6e 7b 15\n"
+                           " 30 F- 00 6e 7b 5f 15\n"
+                           " 35 F- 6e 7b 5f 50 15\n"   // Year
+                           " 40 F- 7b 5f 50 00 15\n"
+                           " 45 F- 5f 50 00 00 15\n"
+                           " 50 F- 50 00 00 00 15\n"
+                           " 55 F- 00 00 00 37 15\n"   // Second pass
+                           " 60 F- 00 00 37 7b 15\n"
+                           " 65 F- 00 37 7b 2a 15\n"
+                           " 70 F- 37 7b 2a 00 15\n"
+                           " 75 F- 7b 2a 00 6e 15\n"
+                           " 80 F- 2a 00 6e 7b 15\n"
+                           " 85 F- 00 6e 7b 5f 15\n"
+                           " 90 F- 6e 7b 5f 50 15\n"
+                           " 95 F- 7b 5f 50 00 15\n"
+                           "100 F- 5f 50 00 00 15\n"
+                           "105 F- 50 00 00 00 15\n",
+                           trace(animator, 120).c_str());
+  TEST_ASSERT_FALSE(animator.active());
+}
+
+// Text that fits is centred and held for two seconds, drawn once
+void test_text_that_fits(void) {
+  Animator animator;
+  animator.showText("21");
+  TEST_ASSERT_EQUAL_STRING("  0 F- 00 5b 06 00 15\n", trace(animator, Animator::HOLD_FRAMES).c_str());
+  TEST_ASSERT_TRUE(animator.showingText());
+  animator.step();
+  TEST_ASSERT_FALSE(animator.showingText());
+
+  animator.showText("Noel");
+  TEST_ASSERT_EQUAL_STRING("  0 F- 37 5c 7b 30 15\n", trace(animator, 10).c_str());
+}
+
+// One level a frame, every frame, and nothing once it arrives
+void test_fade(void) {
+  Animator animator;
+  animator.fade(0, 15);
+  TEST_ASSERT_EQUAL_STRING("  0 -B 00 00 00 00  1\n"
+                           "  1 -B 00 00 00 00  2\n"
+                           "  2 -B 00 00 00 00  3\n"
+                           "  3 -B 00 00 00 00  4\n"
+                           "  4 -B 00 00 00 00  5\n"
+                           "  5 -B 00 00 00 00  6\n"
+                           "  6 -B 00 00 00 00  7\n"
+                           "  7 -B 00 00 00 00  8\n"
+                           "  8 -B 00 00 00 00  9\n"
+                           "  9 -B 00 00 00 00 10\n"
+                           " 10 -B 00 00 00 00 11\n"
+                           " 11 -B 00 00 00 00 12\n"
+                           " 12 -B 00 00 00 00 13\n"
+                           " 13 -B 00 00 00 00 14\n"
+                           " 14 -B 00 00 00 00 15\n"
+                           " 15 -- 00 00 00 00 15\n",
+                           trace(animator, 16, true).c_str());
+  TEST_ASSERT_FALSE(animator.active());
+
+  animator.fade(9, 9);
+  TEST_ASSERT_FALSE(animator.fading());
+  TEST_ASSERT_EQUAL_UINT8(0, animator.step());
+}
+
+// A fade down under scrolling text: the two tracks keep their own pace,
+// and the decimal point folds into the digit before it
+void test_fade_under_scroll(void) {
+  Animator animator;
+  animator.fade(15, 3);
+  animator.showText("Eid 2.5");
+  TEST_ASSERT_EQUAL_STRING("  0 FB 00 00 00 79 14\n"
+                           "  1 -B 00 00 00 79 13\n"
+                           "  2 -B 00 00 00 79 12\n"
+                           "  3 -B 00 00 00 79 11\n"
+                           "  4 -B 00 00 00 79 10\n"
+                           "  5 FB 00 00 79 10  9\n"
+                           "  6 -B 00 00 79 10  8\n"
+                           "  7 -B 00 00 79 10  7\n"
+                           "  8 -B 00 00 79 10  6\n"
+                           "  9 -B 00 00 79 10  5\n"
+                           " 10 FB 00 79 10 5e  4\n"
+                           " 11 -B 00 79 10 5e  3\n"
+                           " 15 F- 79 10 5e 00  3\n"
+                           " 20 F- 10 5e 00 db  3\n"   // "2." in one digit
+                           " 25 F- 5e 00 db 6d  3\n"
+                           " 30 F- 00 db 6d 00  3\n"
+                           " 35 F- db 6d 00 00  3\n"
+                           " 40 F- 6d 00 00 00  3\n",
+                           trace(animator, 50).c_str());
+}
+
+// New text replaces a scroll part way and starts from the right; stopping
+// the text leaves a fade running
+void test_replace_and_stop(void) {
+  Animator animator;
+  animator.showText("Halloween");
+  trace(animator, 23);
+  animator.showText("Diwali");
+  animator.fade(15, 13);
+  TEST_ASSERT_EQUAL_STRING("  0 FB 00 00 00 5e 14\n"
+                           "  1 -B 00 00 00 5e 13\n",
+                           trace(animator, 5).c_str());
+  animator.stopText();
+  animator.fade(13, 11);
+  TEST_ASSERT_EQUAL_STRING("  0 -B 00 00 00 5e 12\n"
+                           "  1 -B 00 00 00 5e 11\n",
+                           trace(animator, 10).c_str());
+}
+
+void test_text_to_cells(void) {
+  uint8_t cells[Animator::MAX_CELLS];
+  TEST_ASSERT_EQUAL_UINT8(3, textToCells("3.14", cells, sizeof(cells)));
+  TEST_ASSERT_EQUAL_HEX8(0xCF, cells[0]);
+  TEST_ASSERT_EQUAL_HEX8(0x06, cells[1]);
+  TEST_ASSERT_EQUAL_HEX8(0x66, cells[2]);
+
+  // A leading dot or a second one gets a digit of its own
+  TEST_ASSERT_EQUAL_UINT8(2, textToCells(".5.", cells, sizeof(cells)));
+  TEST_ASSERT_EQUAL_HEX8(0x80, cells[0]);
+  TEST_ASSERT_EQUAL_HEX8(0xED, cells[1]);
+  TEST_ASSERT_EQUAL_UINT8(2, textToCells("1..", cells, sizeof(cells)));
+  TEST_ASSERT_EQUAL_HEX8(0x86, cells[0]);
+  TEST_ASSERT_EQUAL_HEX8(0x80, cells[1]);
+
+  // Capped at the capacity; characters without a glyph are blanks
+  TEST_ASSERT_EQUAL_UINT8(Animator::MAX_CELLS,
+                          textToCells("A very long event name for the display", cells, sizeof(cells)));
+  TEST_ASSERT_EQUAL_UINT8(2, textToCells("\t#", cells, sizeof(cells)));
+  TEST_ASSERT_EQUAL_HEX8(0, cells[0] | cells[1]);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_scroll);
+  RUN_TEST(test_scroll_passes);
+  RUN_TEST(test_text_that_fits);
+  RUN_TEST(test_fade);
+  RUN_TEST(test_fade_under_scroll);
+  RUN_TEST(test_replace_and_stop);
+  RUN_TEST(test_text_to_cells);
+  return UNITY_END();
+}
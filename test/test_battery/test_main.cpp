@@ -0,0 +1,211 @@
+// The battery filter and state classifier: the median throws out single
+// bad readings, the average settles at the expected pace, the enter/exit
+// thresholds stop a rate near zero from flapping, and the sample interval
+// follows the charge rate.
+
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "battery.h"
+
+static FuelGaugeReading reading(float voltage, float percent, float rate) {
+  FuelGaugeReading r = {voltage, percent, rate, 0};
+  return r;
+}
+
+static void feed(BatteryMonitor& monitor, int n, float voltage, float percent, float rate) {
+  for (int i = 0; i < n; i++) {
+    monitor.add(reading(voltage, percent, rate));
+  }
+}
+
+// Uniform noise in [-amplitude, amplitude]
+static float noise(float amplitude) { return ((rand() % 2001) - 1000) / 1000.0f * amplitude; }
+
+void setUp(void) { srand(16); }
+void tearDown(void) {}
+
+void test_first_reading_seeds_the_average(void) {
+  BatteryMonitor monitor;
+  TEST_ASSERT_FALSE(monitor.valid());
+  TEST_ASSERT_EQUAL(BATTERY_UNKNOWN, monitor.state());
+  monitor.add(reading(3.85f, 70.0f, -2.0f));
+  TEST_ASSERT_TRUE(monitor.valid());
+  TEST_ASSERT_EQUAL_FLOAT(3.85f, monitor.voltage());
+  TEST_ASSERT_EQUAL_FLOAT(70.0f, monitor.percent());
+  TEST_ASSERT_EQUAL(BATTERY_DISCHARGING, monitor.state());
+}
+
+// One wild reading on every channel (a bus error, a gauge reset) leaves
+// no mark; two in a row get through, as a median of three allows
+void test_median_rejects_a_single_glitch(void) {
+  BatteryMonitor monitor;
+  feed(monitor, 10, 3.9f, 80.0f, -1.0f);
+  monitor.add(reading(2.5f, 0.0f, 500.0f));
+  TEST_ASSERT_EQUAL_FLOAT(3.9f, monitor.voltage());
+  TEST_ASSERT_EQUAL_FLOAT(80.0f, monitor.percent());
+  TEST_ASSERT_EQUAL_FLOAT(-1.0f, monitor.chargeRate());
+  TEST_ASSERT_FALSE(monitor.critical(3.3f, 5.0f));
+  feed(monitor, 3, 3.9f, 80.0f, -1.0f);
+  TEST_ASSERT_EQUAL_FLOAT(3.9f, monitor.voltage());
+
+  monitor.add(reading(2.5f, 0.0f, -1.0f));
+  monitor.add(reading(2.5f, 0.0f, -1.0f));
+  TEST_ASSERT_TRUE(monitor.voltage() < 3.9f);
+}
+
+// A step settles by (1 - alpha) per reading once the median has caught up
+void test_average_settles(void) {
+  BatteryMonitor monitor;
+  feed(monitor, 5, 3.7f, 50.0f, 0.0f);
+  feed(monitor, 2, 3.9f, 50.0f, 0.0f);  // The median passes it on the second
+  float remaining = 0.2f * (1.0f - BatteryMonitor::EMA_ALPHA);
+  TEST_ASSERT_FLOAT_WITHIN(1e-5f, 3.9f - remaining, monitor.voltage());
+  for (int i = 0; i < 10; i++) {
+    monitor.add(reading(3.9f, 50.0f, 0.0f));
+    remaining *= 1.0f - BatteryMonitor::EMA_ALPHA;
+    TEST_ASSERT_FLOAT_WITHIN(1e-5f, 3.9f - remaining, monitor.voltage());
+  }
+}
+
+// A weak charger's rate wandering around the enter threshold: count state
+// changes against a classifier with a single threshold
+void test_hysteresis_stops_flapping(void) {
+  BatteryMonitor monitor;
+  uint32_t changes = 0, singleChanges = 0;
+  BatteryState last = BATTERY_UNKNOWN;
+  bool singleCharging = false;
+  for (int i = 0; i < 2000; i++) {
+    float rate = 0.5f + 0.2f * sinf(i / 40.0f) + noise(0.3f);
+    monitor.add(reading(3.95f, 85.0f, rate));
+    if (monitor.state() != last && last != BATTERY_UNKNOWN) changes++;
+    last = monitor.state();
+    bool charging = monitor.chargeRate() > BatteryMonitor::RATE_ENTER;
+    if (i > 0 && charging != singleCharging) singleChanges++;
+    singleCharging = charging;
+  }
+  char message[96];
+  snprintf(message, sizeof(message), "state changes: %u with hysteresis, %u with one threshold", changes,
+           singleChanges);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_TRUE(changes * 4 < singleChanges);
+}
+
+void test_enter_and_exit_thresholds(void) {
+  BatteryMonitor monitor;
+  feed(monitor, 20, 3.9f, 80.0f, 0.3f);  // Below enter
+  TEST_ASSERT_EQUAL(BATTERY_ON_BATTERY, monitor.state());
+  feed(monitor, 20, 3.9f, 80.0f, 1.0f);
+  TEST_ASSERT_EQUAL(BATTERY_CHARGING, monitor.state());
+  feed(monitor, 20, 3.9f, 80.0f, 0.3f);  // Above exit, stays
+  TEST_ASSERT_EQUAL(BATTERY_CHARGING, monitor.state());
+  feed(monitor, 20, 3.9f, 80.0f, 0.05f);
+  TEST_ASSERT_EQUAL(BATTERY_ON_BATTERY, monitor.state());
+
+  feed(monitor, 20, 3.9f, 80.0f, -0.3f);
+  TEST_ASSERT_EQUAL(BATTERY_ON_BATTERY, monitor.state());
+  feed(monitor, 20, 3.9f, 80.0f, -1.0f);
+  TEST_ASSERT_EQUAL(BATTERY_DISCHARGING, monitor.state());
+  feed(monitor, 20, 3.9f, 80.0f, -0.3f);
+  TEST_ASSERT_EQUAL(BATTERY_DISCHARGING, monitor.state());
+}
+
+// Charged, whether the gauge still reports a trickle or nothing at all,
+// with its own band so a full battery settling doesn't flap either
+void test_charged(void) {
+  BatteryMonitor monitor;
+  feed(monitor, 20, 4.15f, 99.5f, 1.0f);
+  TEST_ASSERT_EQUAL(BATTERY_CHARGED, monitor.state());
+  feed(monitor, 20, 4.15f, 98.5f, 1.0f);
+  TEST_ASSERT_EQUAL(BATTERY_CHARGED, monitor.state());
+  feed(monitor, 20, 4.15f, 97.5f, 1.0f);
+  TEST_ASSERT_EQUAL(BATTERY_CHARGING, monitor.state());
+
+  BatteryMonitor idle;
+  feed(idle, 20, 4.12f, 96.0f, 0.0f);
+  TEST_ASSERT_EQUAL(BATTERY_CHARGED, idle.state());
+  feed(idle, 20, 4.06f, 94.0f, 0.0f);
+  TEST_ASSERT_EQUAL(BATTERY_CHARGED, idle.state());
+  feed(idle, 20, 4.06f, 92.0f, 0.0f);
+  TEST_ASSERT_EQUAL(BATTERY_ON_BATTERY, idle.state());
+}
+
+// Only a battery running itself down is critical
+void test_critical(void) {
+  BatteryMonitor monitor;
+  TEST_ASSERT_FALSE(monitor.critical(3.3f, 5.0f));
+  feed(monitor, 10, 3.5f, 4.0f, -2.0f);
+  TEST_ASSERT_TRUE(monitor.critical(3.3f, 5.0f));
+  feed(monitor, 10, 3.25f, 20.0f, -2.0f);
+  TEST_ASSERT_TRUE(monitor.critical(3.3f, 5.0f));
+  feed(monitor, 20, 3.25f, 4.0f, 5.0f);
+  TEST_ASSERT_EQUAL(BATTERY_CHARGING, monitor.state());
+  TEST_ASSERT_FALSE(monitor.critical(3.3f, 5.0f));
+}
+
+// About one reading per half percent of change, within the bounds
+void test_interval_follows_rate(void) {
+  BatteryMonitor monitor;
+  feed(monitor, 30, 3.9f, 80.0f, 0.0f);
+  TEST_ASSERT_EQUAL_UINT32(BatteryMonitor::MAX_INTERVAL_MS, monitor.nextIntervalMs());
+  feed(monitor, 30, 3.9f, 80.0f, -1.0f);  // Two hours a reading, capped
+  TEST_ASSERT_EQUAL_UINT32(BatteryMonitor::MAX_INTERVAL_MS, monitor.nextIntervalMs());
+  feed(monitor, 60, 3.9f, 80.0f, 60.0f);
+  TEST_ASSERT_UINT32_WITHIN(100, 30000, monitor.nextIntervalMs());
+  feed(monitor, 60, 3.9f, 80.0f, -500.0f);
+  TEST_ASSERT_EQUAL_UINT32(BatteryMonitor::MIN_INTERVAL_MS, monitor.nextIntervalMs());
+}
+
+// A day on battery with noisy readings and the odd glitch (never two close
+// enough together to outvote the median): the state goes
+// straight to discharging and stays there, the filtered percent tracks the
+// charge, and it turns critical only near the end
+void test_noisy_discharge(void) {
+  BatteryMonitor monitor;
+  float charge = 60.0f;
+  uint32_t changes = 0;
+  BatteryState last = BATTERY_UNKNOWN;
+  float worst = 0.0f;
+  int criticalAt = -1;
+  int sinceGlitch = 3;
+  for (int minute = 0; charge > 1.0f; minute += 5) {
+    charge -= 2.5f * 5 / 60.0f;
+    float voltage = charge < 10 ? 3.3f + charge * 0.04f : 3.7f + (charge - 10) * 0.5f / 90;
+    FuelGaugeReading r = reading(voltage + noise(0.01f), charge + noise(0.3f), -2.5f + noise(0.8f));
+    if (rand() % 50 == 0 && sinceGlitch >= 3) {
+      r = reading(2.5f, 0.0f, 0.0f);
+      sinceGlitch = 0;
+    }
+    sinceGlitch++;
+    monitor.add(r);
+    if (monitor.state() != last) changes++;
+    last = monitor.state();
+    if (monitor.samples() > 5) {
+      float error = fabsf(monitor.percent() - charge);
+      if (error > worst) worst = error;
+    }
+    if (criticalAt < 0 && monitor.critical(3.4f, 5.0f)) {
+      criticalAt = minute;
+      TEST_ASSERT_TRUE(charge < 6.0f);
+    }
+  }
+  TEST_ASSERT_EQUAL_UINT32(1, changes);
+  TEST_ASSERT_EQUAL(BATTERY_DISCHARGING, monitor.state());
+  TEST_ASSERT_TRUE(worst < 1.0f);
+  TEST_ASSERT_TRUE(criticalAt > 0);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_first_reading_seeds_the_average);
+  RUN_TEST(test_median_rejects_a_single_glitch);
+  RUN_TEST(test_average_settles);
+  RUN_TEST(test_hysteresis_stops_flapping);
+  RUN_TEST(test_enter_and_exit_thresholds);
+  RUN_TEST(test_charged);
+  RUN_TEST(test_critical);
+  RUN_TEST(test_interval_follows_rate);
+  RUN_TEST(test_noisy_discharge);
+  return UNITY_END();
+}
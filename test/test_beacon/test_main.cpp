@@ -0,0 +1,211 @@
+// Status beacons: the packet layout against bytes tools/beacon_collector.py
+// decodes too (test/tools/test_beacon_collector.py holds the same
+// packets), and the packets through a real UDP socket on the loopback
+// interface, the way a collector receives them.
+//
+// mDNS advertising is ESPmDNS's and only runs on the device.
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "beacon.h"
+
+// The same two packets as the Python test
+static const char* GOLDEN_CHARGING = "42430103246f28aabbcc34125700930f51c3a0cc020080510100";
+static const char* GOLDEN_NO_GAUGE = "42430118246f28aabbcc0700ffff000000a6a086010005000000";
+
+static Beacon chargingBeacon() {
+  Beacon beacon = {};
+  beacon.flags = BEACON_TIME_VALID | BEACON_CHARGING;
+  const uint8_t mac[6] = {0x24, 0x6f, 0x28, 0xaa, 0xbb, 0xcc};
+  memcpy(beacon.mac, mac, sizeof(mac));
+  beacon.sequence = 0x1234;
+  beacon.days = 87;
+  beacon.batteryMillivolts = 3987;
+  beacon.batteryPercent = 81;
+  beacon.rssi = -61;
+  beacon.freeHeap = 183456;
+  beacon.uptime = 86400;
+  return beacon;
+}
+
+static Beacon noGaugeBeacon() {
+  Beacon beacon = chargingBeacon();
+  beacon.flags = BEACON_LOW_POWER | BEACON_NO_GAUGE;
+  beacon.sequence = 7;
+  beacon.days = -1;
+  beacon.batteryMillivolts = 0;
+  beacon.batteryPercent = 0;
+  beacon.rssi = -90;
+  beacon.freeHeap = 100000;
+  beacon.uptime = 5;
+  return beacon;
+}
+
+static void toHex(const uint8_t* data, size_t length, char* hex) {
+  for (size_t i = 0; i < length; i++) {
+    snprintf(hex + 2 * i, 3, "%02x", data[i]);
+  }
+}
+
+static void assertSameBeacon(const Beacon& expected, const Beacon& actual) {
+  TEST_ASSERT_EQUAL_HEX8(expected.flags, actual.flags);
+  TEST_ASSERT_EQUAL_MEMORY(expected.mac, actual.mac, sizeof(expected.mac));
+  TEST_ASSERT_EQUAL_UINT16(expected.sequence, actual.sequence);
+  TEST_ASSERT_EQUAL_INT16(expected.days, actual.days);
+  TEST_ASSERT_EQUAL_UINT16(expected.batteryMillivolts, actual.batteryMillivolts);
+  TEST_ASSERT_EQUAL_UINT8(expected.batteryPercent, actual.batteryPercent);
+  TEST_ASSERT_EQUAL_INT8(expected.rssi, actual.rssi);
+  TEST_ASSERT_EQUAL_UINT32(expected.freeHeap, actual.freeHeap);
+  TEST_ASSERT_EQUAL_UINT32(expected.uptime, actual.uptime);
+}
+
+// A UDP socket bound to an ephemeral loopback port
+static int openReceiver(sockaddr_in& address) {
+  int sock = socket(AF_INET, SOCK_DGRAM, 0);
+  TEST_ASSERT_TRUE(sock >= 0);
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  TEST_ASSERT_EQUAL_INT(0, bind(sock, (sockaddr*)&address, sizeof(address)));
+  socklen_t length = sizeof(address);
+  getsockname(sock, (sockaddr*)&address, &length);
+  int buffer = 1 << 20;  // Room for a burst without the receiver keeping up
+  setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+  timeval timeout = {1, 0};
+  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  return sock;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_layout(void) {
+  uint8_t packet[BEACON_BYTES];
+  char hex[2 * BEACON_BYTES + 1];
+  TEST_ASSERT_EQUAL_UINT32(BEACON_BYTES, encodeBeacon(chargingBeacon(), packet, sizeof(packet)));
+  toHex(packet, sizeof(packet), hex);
+  TEST_ASSERT_EQUAL_STRING(GOLDEN_CHARGING, hex);
+  encodeBeacon(noGaugeBeacon(), packet, sizeof(packet));
+  toHex(packet, sizeof(packet), hex);
+  TEST_ASSERT_EQUAL_STRING(GOLDEN_NO_GAUGE, hex);
+
+  TEST_ASSERT_EQUAL_UINT32(0, encodeBeacon(chargingBeacon(), packet, BEACON_BYTES - 1));
+}
+
+// Datagrams from the beacon encoder to a receiving socket and back
+// through the decoder, a burst of them, with sequence numbers wrapping
+void test_loopback_round_trip(void) {
+  sockaddr_in collector;
+  int receiver = openReceiver(collector);
+  int sender = socket(AF_INET, SOCK_DGRAM, 0);
+  TEST_ASSERT_TRUE(sender >= 0);
+
+  static const int PACKETS = 500;
+  Beacon sent = chargingBeacon();
+  for (int i = 0; i < PACKETS; i++) {
+    sent.sequence = 0xFF00 + i;
+    sent.batteryPercent = 100 - i / 10;
+    sent.uptime = 86400 + i;
+    uint8_t packet[BEACON_BYTES];
+    size_t length = encodeBeacon(sent, packet, sizeof(packet));
+    TEST_ASSERT_EQUAL_INT((int)length, sendto(sender, packet, length, 0, (sockaddr*)&collector, sizeof(collector)));
+  }
+
+  Beacon expected = chargingBeacon();
+  for (int i = 0; i < PACKETS; i++) {
+    uint8_t packet[512];
+    ssize_t length = recv(receiver, packet, sizeof(packet), 0);
+    TEST_ASSERT_EQUAL_INT(BEACON_BYTES, length);
+    Beacon received;
+    TEST_ASSERT_TRUE(decodeBeacon(packet, length, received));
+    expected.sequence = 0xFF00 + i;
+    expected.batteryPercent = 100 - i / 10;
+    expected.uptime = 86400 + i;
+    assertSameBeacon(expected, received);
+  }
+  close(sender);
+  close(receiver);
+}
+
+// What a collector must cope with on the port: packets from a newer
+// version with fields appended decode their common part, anything else is
+// turned away
+void test_loopback_foreign_packets(void) {
+  sockaddr_in collector;
+  int receiver = openReceiver(collector);
+  int sender = socket(AF_INET, SOCK_DGRAM, 0);
+
+  uint8_t newer[BEACON_BYTES + 6];
+  encodeBeacon(noGaugeBeacon(), newer, sizeof(newer));
+  newer[2] = 2;
+  memset(newer + BEACON_BYTES, 0xAB, 6);
+  uint8_t shortPacket[BEACON_BYTES - 1];
+  memcpy(shortPacket, newer, sizeof(shortPacket));
+  const char* text = "GET / HTTP/1.1\r\n\r\n                ";
+  uint8_t versionZero[BEACON_BYTES];
+  encodeBeacon(chargingBeacon(), versionZero, sizeof(versionZero));
+  versionZero[2] = 0;
+
+  sendto(sender, newer, sizeof(newer), 0, (sockaddr*)&collector, sizeof(collector));
+  sendto(sender, shortPacket, sizeof(shortPacket), 0, (sockaddr*)&collector, sizeof(collector));
+  sendto(sender, text, strlen(text), 0, (sockaddr*)&collector, sizeof(collector));
+  sendto(sender, versionZero, sizeof(versionZero), 0, (sockaddr*)&collector, sizeof(collector));
+
+  uint8_t packet[512];
+  Beacon received;
+  ssize_t length = recv(receiver, packet, sizeof(packet), 0);
+  TEST_ASSERT_EQUAL_INT(sizeof(newer), length);
+  TEST_ASSERT_TRUE(decodeBeacon(packet, length, received));
+  assertSameBeacon(noGaugeBeacon(), received);
+  for (int i = 0; i < 3; i++) {
+    length = recv(receiver, packet, sizeof(packet), 0);
+    TEST_ASSERT_TRUE(length > 0);
+    TEST_ASSERT_FALSE(decodeBeacon(packet, length, received));
+  }
+  close(sender);
+  close(receiver);
+}
+
+// Heap and uptime never count as a change; RSSI only in 5 dBm swings
+void test_change_detection(void) {
+  Beacon sent = chargingBeacon();
+  Beacon cur = sent;
+  cur.freeHeap -= 5000;
+  cur.uptime += 600;
+  cur.sequence++;
+  TEST_ASSERT_FALSE(beaconChanged(cur, sent));
+  cur.rssi = sent.rssi - 4;
+  TEST_ASSERT_FALSE(beaconChanged(cur, sent));
+  cur.rssi = sent.rssi + 5;
+  TEST_ASSERT_TRUE(beaconChanged(cur, sent));
+  cur.rssi = sent.rssi - 5;
+  TEST_ASSERT_TRUE(beaconChanged(cur, sent));
+
+  cur = sent;
+  cur.days--;
+  TEST_ASSERT_TRUE(beaconChanged(cur, sent));
+  cur = sent;
+  cur.batteryPercent--;
+  TEST_ASSERT_TRUE(beaconChanged(cur, sent));
+  cur = sent;
+  cur.flags |= BEACON_LOW_BATTERY;
+  TEST_ASSERT_TRUE(beaconChanged(cur, sent));
+  cur = sent;
+  cur.batteryMillivolts -= 30;  // Voltage alone is noise
+  TEST_ASSERT_FALSE(beaconChanged(cur, sent));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_layout);
+  RUN_TEST(test_loopback_round_trip);
+  RUN_TEST(test_loopback_foreign_packets);
+  RUN_TEST(test_change_detection);
+  return UNITY_END();
+}
@@ -0,0 +1,369 @@
+// Boot on simulated hardware: how soon a count is on the display after
+// power-on, deep sleep or a reset, with WiFi and NTP in the background.
+//
+// The steps below follow main.cpp's setup() and display task. Each one
+// moves the simulated clock by roughly what it costs on the device, so the
+// BootTimeline marks come out as /api/status would report them. A change
+// that puts something slow in front of the cached count fails the budget
+// test; the report prints the phases next to the old blocking boot.
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "sim_hal.h"
+#include "scheduler.h"
+#include "netconn.h"
+#include "boottime.h"
+#include "jsonwriter.h"
+#include "countdown.h"
+#include "animation.h"
+#include "persist.h"
+
+static const char* TZ_RULE = "UTC0";
+static const int32_t EVENT_DAY = daysFromCivil(2025, 12, 25);
+static const int64_t START_EPOCH = (int64_t)daysFromCivil(2025, 9, 30) * 86400 + 12 * 3600;  // 86 days to go
+
+// What each step costs on the device, roughly
+static const uint32_t LOG_US = 300;             // Serial.begin(), log ring
+static const uint32_t NVS_READ_US = 2500;       // One Preferences record
+static const uint32_t DISPLAY_BEGIN_US = 1200;  // HT16K33 oscillator, blink and dimming commands
+static const uint32_t FRAME_WRITE_US = 450;     // 17 bytes at 400 kHz
+static const uint32_t FUEL_GAUGE_US = 1500;     // MAX17048 probe, read and alert setup
+static const uint32_t RESTORE_US = 45000;       // LittleFS mount, history replay, targets
+static const uint32_t NETWORK_START_US = 8000;  // WiFi driver up, SNTP armed
+
+// The cached count is up within this of the app starting, whatever the
+// network does
+static const uint32_t CACHED_BUDGET_US = 10000;
+static const uint32_t SETUP_BUDGET_US = 80000;
+
+static const unsigned long DISPLAY_TICK_MS = 500;
+
+struct Device {
+  SimClock clock;
+  SimDisplay display;
+  SimFuelGauge gauge;
+  SimNetwork wifi;
+  NetworkManager network;
+  Scheduler scheduler;
+  BootTimeline timeline;
+  NetworkCredentials credentials[2] = {{"home", "password1"}, {"phone", "password2"}};
+
+  bool cacheStored = true;  // The NVS record
+  CountCache cache = {EVENT_DAY, 87};  // Saved yesterday
+  bool selfTest = false;
+  bool showingCachedCount = false;
+  int networkTask = -1;
+
+  Device() : gauge(clock, 500, 80.0f), wifi(clock), network(wifi) {}
+};
+
+static Device* device;
+
+static void markBoot(BootPhase phase) {
+  device->timeline.mark(phase, device->clock.monotonicUs());
+}
+
+static void spend(uint32_t us) {
+  device->clock.advanceUs(us);
+}
+
+static void refreshDisplay() {
+  device->display.refresh();
+  spend(FRAME_WRITE_US);
+}
+
+// What the clock should say: app start is START_EPOCH
+static int64_t trueEpoch() {
+  return START_EPOCH + device->clock.monotonicUs() / 1000000;
+}
+
+static void onNetworkEvent(NetworkEvent event, int index) {
+  if (event == NET_CONNECTED) {
+    markBoot(BOOT_WIFI);
+    markBoot(BOOT_WEB);
+  } else if (event == NET_TIME_SYNCED) {
+    device->clock.setEpoch(trueEpoch());
+    markBoot(BOOT_TIME);
+  }
+}
+
+static void showCachedCount() {
+  Device& d = *device;
+  spend(NVS_READ_US);
+  if (!d.cacheStored) {
+    return;
+  }
+  int32_t days = d.cache.days;
+  struct tm timeinfo;
+  bool current = d.clock.localTime(timeinfo);
+  if (current) {
+    days = d.cache.eventDay - daysFromCivil(timeinfo.tm_year + 1900, timeinfo.tm_mon + 1, timeinfo.tm_mday);
+  }
+  if (days < 0) {
+    return;
+  }
+  char text[8];
+  snprintf(text, sizeof(text), "%4ld", (long)(days < 9999 ? days : 9999));
+  Frame frame = {};
+  textToCells(text, frame.digits, Frame::DIGITS);
+  if (!current) {
+    frame.digits[Frame::DIGITS - 1] |= SEG_DP;
+  }
+  static const uint8_t positions[Frame::DIGITS] = {0, 1, 3, 4};
+  for (uint8_t i = 0; i < Frame::DIGITS; i++) {
+    d.display.showSegments(positions[i], frame.digits[i]);
+  }
+  d.showingCachedCount = true;
+  markBoot(BOOT_CACHED);
+}
+
+static void displayTask(unsigned long now) {
+  Device& d = *device;
+  struct tm timeinfo;
+  if (!d.clock.localTime(timeinfo)) {
+    if (!d.showingCachedCount && d.network.isBusy()) {
+      d.display.clear();
+      d.display.showDigit(0, 0);  // Spinner
+      refreshDisplay();
+    }
+    return;
+  }
+  int32_t today = daysFromCivil(timeinfo.tm_year + 1900, timeinfo.tm_mon + 1, timeinfo.tm_mday);
+  d.display.showNumber(EVENT_DAY - today);
+  d.display.showColon(false);
+  d.showingCachedCount = false;
+  markBoot(BOOT_COUNT);
+  refreshDisplay();
+}
+
+static void networkTask(unsigned long now) {
+  device->scheduler.runAfter(device->networkTask, now, device->network.poll(now));
+}
+
+static void setup(Device& d) {
+  device = &d;
+  spend(LOG_US);
+  markBoot(BOOT_LOG);
+  TzRule rule;
+  TEST_ASSERT_TRUE(parseTzRule(TZ_RULE, rule));
+  d.clock.setTimeZone(rule);
+  spend(NVS_READ_US);
+  markBoot(BOOT_SETTINGS);
+
+  TEST_ASSERT_TRUE(d.display.begin(0x70));
+  spend(DISPLAY_BEGIN_US);
+  if (d.selfTest) {
+    d.display.showNumber(8888);
+    refreshDisplay();
+    d.clock.advanceMs(1000);
+    d.display.clear();
+  }
+  showCachedCount();
+  refreshDisplay();
+
+  FuelGaugeReading reading;
+  TEST_ASSERT_TRUE(d.gauge.begin());
+  TEST_ASSERT_TRUE(d.gauge.read(reading));
+  spend(FUEL_GAUGE_US);
+  markBoot(BOOT_FUEL_GAUGE);
+
+  spend(RESTORE_US);
+  struct tm timeinfo;
+  bool timeValid = d.clock.localTime(timeinfo);
+  if (timeValid) {
+    markBoot(BOOT_TIME);  // Survived in RTC memory
+  }
+  markBoot(BOOT_RESTORE);
+
+  if (d.wifi.network("home") == nullptr) {
+    d.wifi.addNetwork("home", true, 2500);
+    d.wifi.addNetwork("phone", true, 4000);
+  }
+  d.network.setNetworks(d.credentials, 2);
+  d.network.onEvent(onNetworkEvent);
+  unsigned long now = d.clock.millis();
+  d.scheduler.addTask("display", DISPLAY_TICK_MS, displayTask, now);
+  d.networkTask = d.scheduler.addTask("wifi", NetworkManager::ACTIVE_POLL_MS, networkTask, now);
+  if (!timeValid) {
+    d.network.sync(now);
+  }
+  spend(NETWORK_START_US);
+  markBoot(BOOT_SETUP);
+}
+
+// Run the loop until simulated time reaches untilMs since app start
+static void run(Device& d, uint64_t untilMs) {
+  while ((uint64_t)d.clock.monotonicUs() < untilMs * 1000) {
+    d.scheduler.runDue(d.clock.millis());
+    d.clock.advanceMs(d.scheduler.msUntilNext(d.clock.millis()));
+  }
+}
+
+// Milliseconds at which a phase was reached, from the JSON the way the
+// status API reports it; -1 if it wasn't
+static float phaseMs(const Device& d, BootPhase phase) {
+  char buffer[256];
+  JsonWriter json(buffer, sizeof(buffer));
+  json.beginObject();
+  d.timeline.writeJson(json);
+  json.endObject();
+  char key[24];
+  snprintf(key, sizeof(key), "\"%s\":", BootTimeline::phaseName(phase));
+  const char* at = strstr(buffer, key);
+  return at != nullptr ? strtof(at + strlen(key), nullptr) : -1.0f;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// Power loss: the clock is gone, so the count from before is shown as it
+// was with the last decimal point lit, until NTP replaces it with today's
+void test_power_on(void) {
+  Device d;
+  setup(d);
+  TEST_ASSERT_EQUAL(87, d.display.number());
+  TEST_ASSERT_TRUE(d.display.frame()[4] & SEG_DP);
+  TEST_ASSERT_TRUE(phaseMs(d, BOOT_CACHED) * 1000 < CACHED_BUDGET_US);
+  TEST_ASSERT_FALSE(d.timeline.reached(BOOT_TIME));
+
+  // Still up while WiFi connects; the spinner doesn't replace it
+  run(d, 2000);
+  TEST_ASSERT_EQUAL(87, d.display.number());
+  TEST_ASSERT_FALSE(d.timeline.reached(BOOT_COUNT));
+
+  run(d, 5000);
+  TEST_ASSERT_EQUAL(86, d.display.number());
+  TEST_ASSERT_FALSE(d.display.frame()[4] & SEG_DP);
+  TEST_ASSERT_TRUE(phaseMs(d, BOOT_WIFI) >= 2500);
+  TEST_ASSERT_TRUE(phaseMs(d, BOOT_TIME) > phaseMs(d, BOOT_WIFI));
+  TEST_ASSERT_TRUE(phaseMs(d, BOOT_COUNT) >= phaseMs(d, BOOT_TIME));
+  TEST_ASSERT_TRUE(phaseMs(d, BOOT_COUNT) - phaseMs(d, BOOT_TIME) <= DISPLAY_TICK_MS);
+}
+
+// Deep sleep wake or a software reset: the clock survived, so the cached
+// count is brought up to date and is the real count straight away
+void test_clock_survived(void) {
+  Device d;
+  d.clock.setEpoch(START_EPOCH);
+  d.cache.days = 90;  // Saved four days ago
+  setup(d);
+  TEST_ASSERT_EQUAL(86, d.display.number());
+  TEST_ASSERT_FALSE(d.display.frame()[4] & SEG_DP);
+  TEST_ASSERT_TRUE(d.timeline.reached(BOOT_TIME));
+  TEST_ASSERT_EQUAL_UINT32(0, d.wifi.begins);
+
+  run(d, 1000);
+  TEST_ASSERT_EQUAL(86, d.display.number());
+  TEST_ASSERT_TRUE(phaseMs(d, BOOT_COUNT) * 1000 < SETUP_BUDGET_US);
+}
+
+// Nothing cached, or the cached event has passed since: the display stays
+// dark rather than show something wrong
+void test_nothing_to_show(void) {
+  Device first;
+  first.cacheStored = false;
+  setup(first);
+  TEST_ASSERT_EQUAL(-1, first.display.number());
+  TEST_ASSERT_FALSE(first.timeline.reached(BOOT_CACHED));
+
+  Device passed;
+  passed.clock.setEpoch((int64_t)(EVENT_DAY + 1) * 86400);
+  setup(passed);
+  TEST_ASSERT_EQUAL(-1, passed.display.number());
+  TEST_ASSERT_FALSE(passed.timeline.reached(BOOT_CACHED));
+}
+
+// The self-test pattern costs its second and nothing else
+void test_self_test(void) {
+  Device plain;
+  setup(plain);
+  Device tested;
+  tested.selfTest = true;
+  setup(tested);
+  float extra = phaseMs(tested, BOOT_CACHED) - phaseMs(plain, BOOT_CACHED);
+  TEST_ASSERT_FLOAT_WITHIN(1.0f, 1000.0f + FRAME_WRITE_US / 1000.0f, extra);
+}
+
+// The regression benchmark: boot against networks that come up fast, slow
+// or not at all. The cached count and the end of setup() hold their
+// budgets in all of them; the count from a set clock follows the network.
+// The old boot (a second after Serial, a second of 8888, WiFi waited for
+// before anything) is worked out alongside for comparison.
+void test_boot_budget(void) {
+  struct Scenario {
+    const char* name;
+    bool homeUp;
+    unsigned long homeMs;
+    bool phoneUp;
+  };
+  static const Scenario scenarios[] = {
+      {"home 2.5 s", true, 2500, true},
+      {"home 9 s", true, 9000, true},
+      {"phone only", false, 0, true},
+      {"no WiFi", false, 0, false},
+  };
+
+  char report[512];
+  size_t used = snprintf(report, sizeof(report), "\n%-11s %7s %7s %7s %9s %9s", "ms", "cached", "setup",
+                         "wifi", "count", "old boot");
+  auto start = std::chrono::steady_clock::now();
+  for (const Scenario& s : scenarios) {
+    Device d;
+    device = &d;
+    d.wifi.addNetwork("home", s.homeUp, s.homeMs);
+    d.wifi.addNetwork("phone", s.phoneUp, 4000);
+    setup(d);
+    run(d, 60000);
+
+    TEST_ASSERT_TRUE(phaseMs(d, BOOT_CACHED) * 1000 < CACHED_BUDGET_US);
+    TEST_ASSERT_TRUE(phaseMs(d, BOOT_SETUP) * 1000 < SETUP_BUDGET_US);
+    TEST_ASSERT_EQUAL(s.homeUp || s.phoneUp, d.timeline.reached(BOOT_COUNT));
+
+    // The old boot showed nothing real until WiFi had connected (up to 30
+    // s of attempts) and NTP had answered
+    float wifiMs = phaseMs(d, BOOT_WIFI);
+    float oldMs = wifiMs < 0 ? 2000 + 30000 : 2000 + wifiMs + d.wifi.syncDelayMs;
+    used += snprintf(report + used, sizeof(report) - used, "\n%-11s %7.1f %7.1f %7.0f %9.0f %9.0f", s.name,
+                     phaseMs(d, BOOT_CACHED), phaseMs(d, BOOT_SETUP), wifiMs, phaseMs(d, BOOT_COUNT), oldMs);
+  }
+  double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  snprintf(report + used, sizeof(report) - used, "\n(4 boots and a simulated minute each in %.1f ms)", ms);
+  TEST_MESSAGE(report);
+}
+
+// Each phase keeps the first time it's reached; times that don't fit in
+// 32 bits of microseconds, or are negative, aren't recorded
+void test_timeline(void) {
+  BootTimeline timeline;
+  timeline.mark(BOOT_LOG, 1500);
+  timeline.mark(BOOT_LOG, 9000);
+  timeline.mark(BOOT_TIME, 1234567);
+  timeline.mark(BOOT_WIFI, 5000000000LL);
+  timeline.mark(BOOT_WEB, -1);
+  timeline.mark(BOOT_PHASE_COUNT, 10);
+  TEST_ASSERT_TRUE(timeline.reached(BOOT_LOG));
+  TEST_ASSERT_FALSE(timeline.reached(BOOT_WIFI));
+  TEST_ASSERT_FALSE(timeline.reached(BOOT_WEB));
+
+  char buffer[128];
+  JsonWriter json(buffer, sizeof(buffer));
+  json.beginObject();
+  timeline.writeJson(json);
+  json.endObject();
+  TEST_ASSERT_EQUAL_STRING("{\"boot\":{\"log\":1.5,\"time\":1234.6}}", buffer);
+  TEST_ASSERT_EQUAL_STRING("", BootTimeline::phaseName(BOOT_PHASE_COUNT));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_power_on);
+  RUN_TEST(test_clock_survived);
+  RUN_TEST(test_nothing_to_show);
+  RUN_TEST(test_self_test);
+  RUN_TEST(test_boot_budget);
+  RUN_TEST(test_timeline);
+  return UNITY_END();
+}
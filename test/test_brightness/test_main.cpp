@@ -0,0 +1,387 @@
+// Brightness schedule over a simulated week: quiet hours by local time
+// through a DST change, a light sensor following the daylight, a battery
+// running down to the dimming threshold and then charged, and the LED
+// current those levels add up to.
+//
+// The tasks follow main.cpp's: the display tick reads the light sensor,
+// asks the scheduler for a level and fades to it one level per animation
+// frame (blanking once the fade reaches 0), and the battery task feeds the
+// filtered fuel gauge state back in.
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <chrono>
+#include "sim_hal.h"
+#include "scheduler.h"
+#include "battery.h"
+#include "brightness.h"
+#include "animation.h"
+#include "countdown.h"
+
+static const char* TZ_RULE = "EST5EDT,M3.2.0,M11.1.0";
+static const int64_t START_EPOCH = (int64_t)daysFromCivil(2025, 11, 1) * 86400 + 4 * 3600;  // Saturday 00:00 EDT
+static const uint64_t WEEK_MS = 7ULL * 86400000;
+
+static const unsigned long DISPLAY_TICK_MS = 500;
+static const unsigned long FRAME_PARKED_MS = 3600000;  // Frame task idle between fades
+static const int16_t AMBIENT_SMOOTHING = 8;
+
+// The battery is down to the dimming threshold on Monday afternoon; the
+// charger goes in on Tuesday morning
+static const float START_PERCENT = 80.0f;
+static const float LOAD_MA = 16.0f;  // 0.8 %/hr of 2000 mAh
+static const uint64_t CHARGER_AT_MS = 84ULL * 3600000;  // Tuesday 11:00 EST
+
+struct Device {
+  SimClock clock;
+  SimDisplay display;
+  SimFuelGauge gauge;
+  Scheduler scheduler;
+  BatteryMonitor battery;
+  BrightnessScheduler brightness;
+  Animator animator;
+  LedPowerMeter ledPower;
+  BrightnessPolicy policy = {15, 22 * 60, 7 * 60, 1, 30, 4};
+
+  int8_t displayLevel = 15;
+  bool blankAfterFade = false;
+  bool lowBatteryAlert = false;
+  int16_t ambientLight = -1;
+  int frameTask = -1;
+  bool frameRunning = false;
+
+  // What the week showed
+  uint32_t ticks = 0;
+  uint32_t levelChanges = 0;   // Scheduler decisions, not fade steps
+  uint32_t settledWrong = 0;   // Display not at the scheduled level with no fade running
+  uint32_t quietTooBright = 0;
+  uint32_t dayTooDim = 0;
+  uint32_t batteryTooBright = 0;
+  int maxFadeStep = 0;
+  uint64_t dimmedAtMs = 0;     // First battery dimming
+  uint64_t undimmedAtMs = 0;   // Back up after the charger went in
+  uint32_t blanked = 0;
+  double integratedMaMs = 0;   // LED current summed by the test, tick by tick
+  uint64_t integratedMs = 0;
+
+  Device() : gauge(clock, 2000, START_PERCENT) { gauge.loadMa = LOAD_MA; }
+};
+
+static Device* device;
+
+// Daylight through a November window: dark before 07:00, a lamp in the
+// evening, and a few counts of noise on the ADC
+static int16_t lightAt(int hour, int minute) {
+  float h = hour + minute / 60.0f;
+  float level = 20;
+  if (h >= 7 && h < 17) {
+    level = 1000 * sinf(3.14159f * (h - 7) / 10);
+  } else if (h >= 17 && h < 22.5f) {
+    level = 300;
+  }
+  level += rand() % 61 - 30;
+  return level < 0 ? 0 : level > 1000 ? 1000 : (int16_t)level;
+}
+
+static struct tm referenceLocal() {
+  time_t t = (time_t)device->clock.epoch();
+  struct tm local;
+  localtime_r(&t, &local);
+  return local;
+}
+
+static void setDisplayLevel(int8_t level) {
+  Device& d = *device;
+  if (level == BRIGHTNESS_OFF) {
+    d.display.setPower(false);
+    if (d.displayLevel != BRIGHTNESS_OFF) {
+      d.blanked++;
+    }
+  } else {
+    if (d.displayLevel == BRIGHTNESS_OFF) {
+      d.display.setPower(true);
+    } else if (abs(level - d.displayLevel) > d.maxFadeStep) {
+      d.maxFadeStep = abs(level - d.displayLevel);
+    }
+    d.display.setBrightness(level);
+  }
+  d.displayLevel = level;
+  d.ledPower.update(d.clock.millis(), d.display.litSegments(), level);
+}
+
+static void startAnimation(unsigned long now) {
+  if (!device->frameRunning) {
+    device->scheduler.runAfter(device->frameTask, now, Animator::FRAME_MS);
+    device->frameRunning = true;
+  }
+}
+
+static void scheduleBrightness(unsigned long now) {
+  Device& d = *device;
+  BrightnessInputs inputs = {};
+  struct tm timeinfo;
+  inputs.timeValid = d.clock.localTime(timeinfo);
+  inputs.minuteOfDay = timeinfo.tm_hour * 60 + timeinfo.tm_min;
+  inputs.onBattery = d.battery.state() == BATTERY_ON_BATTERY || d.battery.state() == BATTERY_DISCHARGING;
+  inputs.batteryPercent = (uint8_t)(d.battery.percent() + 0.5f);
+  inputs.lowBattery = d.lowBatteryAlert;
+  inputs.ambient = d.ambientLight;
+  if (!d.brightness.update(d.policy, inputs)) {
+    return;
+  }
+  d.levelChanges++;
+  int8_t level = d.brightness.level();
+  if (d.displayLevel == BRIGHTNESS_OFF) {
+    setDisplayLevel(0);
+  }
+  d.blankAfterFade = level == BRIGHTNESS_OFF;
+  d.animator.fade(d.displayLevel, level == BRIGHTNESS_OFF ? 0 : level);
+  startAnimation(now);
+}
+
+static void frameTask(unsigned long now) {
+  Device& d = *device;
+  if (d.animator.fading()) {
+    d.animator.step();
+    setDisplayLevel(d.animator.brightness());
+  }
+  if (d.blankAfterFade && !d.animator.fading()) {
+    d.blankAfterFade = false;
+    setDisplayLevel(BRIGHTNESS_OFF);
+  }
+  if (!d.animator.fading()) {
+    d.frameRunning = false;
+    d.scheduler.runAfter(d.frameTask, now, FRAME_PARKED_MS);
+  }
+}
+
+// Everything the week is checked for, at each tick once any fade is done
+static void checkTick(const struct tm& local) {
+  Device& d = *device;
+  if (d.animator.fading() || d.blankAfterFade) {
+    return;
+  }
+  int8_t scheduled = d.brightness.level();
+  bool shownRight = scheduled == BRIGHTNESS_OFF ? !d.display.powered
+                                                : d.display.powered && d.display.brightness == scheduled;
+  if (!shownRight) {
+    d.settledWrong++;
+  }
+  int minute = local.tm_hour * 60 + local.tm_min;
+  if ((minute >= d.policy.quietStart || minute < d.policy.quietEnd) && d.displayLevel > d.policy.quietLevel) {
+    d.quietTooBright++;
+  }
+  bool onBattery = d.battery.state() == BATTERY_ON_BATTERY || d.battery.state() == BATTERY_DISCHARGING;
+  if (onBattery && d.battery.percent() < d.policy.dimBatteryPercent - 1 &&
+      d.displayLevel > (int8_t)d.policy.dimBatteryLevel) {
+    d.batteryTooBright++;
+  }
+  // Around midday the sensor reads over 800, so at least level 11
+  // unless the battery has it dimmed
+  if (local.tm_hour >= 10 && local.tm_hour < 14 && d.brightness.reason() != BRIGHTNESS_BATTERY &&
+      d.displayLevel < 11) {
+    d.dayTooDim++;
+  }
+}
+
+static void displayTask(unsigned long now) {
+  Device& d = *device;
+  d.ticks++;
+  struct tm local = referenceLocal();
+  int16_t scaled = lightAt(local.tm_hour, local.tm_min);
+  d.ambientLight = d.ambientLight < 0 ? scaled : d.ambientLight + (scaled - d.ambientLight) / AMBIENT_SMOOTHING;
+
+  scheduleBrightness(now);
+
+  Countdown c = countdownToAnnual(local.tm_year + 1900, local.tm_mon + 1, local.tm_mday, 12, 25);
+  d.display.showNumber(c.days);
+  d.display.refresh();
+  d.ledPower.update(now, d.display.litSegments(), d.displayLevel);
+
+  d.integratedMaMs += LedPowerMeter::currentMa(d.display.litSegments(), d.displayLevel) * DISPLAY_TICK_MS;
+  d.integratedMs += DISPLAY_TICK_MS;
+  if (d.brightness.reason() == BRIGHTNESS_BATTERY && d.dimmedAtMs == 0) {
+    d.dimmedAtMs = d.clock.monotonicUs() / 1000;
+  }
+  if (d.dimmedAtMs != 0 && d.undimmedAtMs == 0 && d.brightness.reason() != BRIGHTNESS_BATTERY &&
+      (uint64_t)d.clock.monotonicUs() / 1000 >= CHARGER_AT_MS) {
+    d.undimmedAtMs = d.clock.monotonicUs() / 1000;
+  }
+  checkTick(local);
+}
+
+static void batteryTask(unsigned long now) {
+  Device& d = *device;
+  if ((uint64_t)d.clock.monotonicUs() / 1000 >= CHARGER_AT_MS) {
+    d.gauge.chargingMa = 200.0f;
+  }
+  FuelGaugeReading reading;
+  if (!d.gauge.read(reading)) {
+    return;
+  }
+  d.battery.add(reading);
+  if (reading.alerts & (FUEL_ALERT_VOLTAGE_LOW | FUEL_ALERT_SOC_LOW)) {
+    d.lowBatteryAlert = true;
+    d.gauge.clearAlerts();
+  }
+  int id = 1;
+  d.scheduler.setInterval(id, d.battery.nextIntervalMs());
+}
+
+static void runWeek(Device& d) {
+  device = &d;
+  d.clock.setEpoch(START_EPOCH);
+  TzRule rule;
+  TEST_ASSERT_TRUE(parseTzRule(TZ_RULE, rule));
+  d.clock.setTimeZone(rule);
+  TEST_ASSERT_TRUE(d.display.begin(0x70));
+  d.gauge.setAlerts(3.0f, 5);
+
+  unsigned long now = d.clock.millis();
+  TEST_ASSERT_EQUAL(0, d.scheduler.addTask("display", DISPLAY_TICK_MS, displayTask, now));
+  TEST_ASSERT_EQUAL(1, d.scheduler.addTask("battery", BatteryMonitor::MIN_INTERVAL_MS, batteryTask, now));
+  d.frameTask = d.scheduler.addTask("frame", Animator::FRAME_MS, frameTask, now, FRAME_PARKED_MS);
+
+  while ((uint64_t)d.clock.monotonicUs() < WEEK_MS * 1000) {
+    d.scheduler.runDue(d.clock.millis());
+    d.clock.advanceMs(d.scheduler.msUntilNext(d.clock.millis()));
+  }
+}
+
+static void checkWeek(Device& d) {
+  TEST_ASSERT_EQUAL_UINT32(WEEK_MS / DISPLAY_TICK_MS, d.ticks);
+  TEST_ASSERT_EQUAL_UINT32(0, d.settledWrong);
+  TEST_ASSERT_EQUAL_UINT32(0, d.quietTooBright);
+  TEST_ASSERT_EQUAL_UINT32(0, d.dayTooDim);
+  TEST_ASSERT_EQUAL_UINT32(0, d.batteryTooBright);
+  TEST_ASSERT_EQUAL(1, d.maxFadeStep);
+  TEST_ASSERT_FALSE(d.lowBatteryAlert);
+
+  // 80% at 0.8 %/hr reaches 30% after about 62 hours; charging is seen
+  // within a few readings of the charger going in
+  TEST_ASSERT_TRUE(d.dimmedAtMs > 60ULL * 3600000 && d.dimmedAtMs < 65ULL * 3600000);
+  TEST_ASSERT_TRUE(d.undimmedAtMs > CHARGER_AT_MS && d.undimmedAtMs < CHARGER_AT_MS + 600000);
+
+  // Dawn, dusk and night a day with some ambient steps in between, not
+  // a flicker with the sensor noise
+  TEST_ASSERT_TRUE(d.levelChanges < 7 * 60);
+
+  // The meter agrees with the current summed tick by tick, and the
+  // schedule saves most of what full brightness would draw
+  float summedMa = d.integratedMaMs / d.integratedMs;
+  TEST_ASSERT_FLOAT_WITHIN(summedMa * 0.02f, summedMa, d.ledPower.averageMa());
+  TEST_ASSERT_TRUE(d.ledPower.mAhPerDay() < 0.6f * d.ledPower.fullBrightnessMAhPerDay());
+}
+
+static void report(const char* name, Device& d, double seconds) {
+  char message[200];
+  snprintf(message, sizeof(message),
+           "%s: %.1f mAh/day for the LEDs against %.1f at full brightness, %u level changes, "
+           "dimmed at %.1f h, back at %.1f h (%.2f s)",
+           name, d.ledPower.mAhPerDay(), d.ledPower.fullBrightnessMAhPerDay(), (unsigned)d.levelChanges,
+           d.dimmedAtMs / 3.6e6, d.undimmedAtMs / 3.6e6, seconds);
+  TEST_MESSAGE(message);
+}
+
+void setUp(void) {
+  setenv("TZ", TZ_RULE, 1);
+  tzset();
+  srand(25);
+}
+
+void tearDown(void) {}
+
+// Quiet hours at level 1, crossing the end of DST on Sunday morning
+void test_week_dimmed_nights(void) {
+  Device d;
+  auto start = std::chrono::steady_clock::now();
+  runWeek(d);
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  checkWeek(d);
+  TEST_ASSERT_EQUAL_UINT32(0, d.blanked);
+  report("dimmed nights", d, seconds);
+}
+
+// The same week with the display blanked overnight: off for the night
+// it starts in and the seven after, back on every morning
+void test_week_blank_nights(void) {
+  Device d;
+  d.policy.quietLevel = BRIGHTNESS_OFF;
+  auto start = std::chrono::steady_clock::now();
+  runWeek(d);
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  checkWeek(d);
+  TEST_ASSERT_EQUAL_UINT32(8, d.blanked);
+  report("blank nights", d, seconds);
+}
+
+// A latched fuel gauge alert takes the display to its dimmest readable
+// level, over the quiet hours' blanking too
+void test_low_battery_alert(void) {
+  BrightnessScheduler scheduler;
+  BrightnessPolicy policy = {15, 22 * 60, 7 * 60, BRIGHTNESS_OFF, 30, 4};
+  BrightnessInputs inputs = {true, 12 * 60, true, 50, true, -1};
+  TEST_ASSERT_TRUE(scheduler.update(policy, inputs));
+  TEST_ASSERT_EQUAL_INT8(0, scheduler.level());
+  TEST_ASSERT_EQUAL(BRIGHTNESS_LOW_BATTERY, scheduler.reason());
+
+  inputs.minuteOfDay = 23 * 60;
+  scheduler.update(policy, inputs);
+  TEST_ASSERT_EQUAL_INT8(BRIGHTNESS_OFF, scheduler.level());
+  TEST_ASSERT_EQUAL(BRIGHTNESS_QUIET_HOURS, scheduler.reason());
+
+  inputs.lowBattery = false;
+  inputs.minuteOfDay = 12 * 60;
+  TEST_ASSERT_TRUE(scheduler.update(policy, inputs));
+  TEST_ASSERT_EQUAL_INT8(15, scheduler.level());
+}
+
+// The battery cap holds until the charge is clearly back above the
+// threshold, or charging starts; without a clock quiet hours don't apply
+void test_battery_hysteresis(void) {
+  BrightnessScheduler scheduler;
+  BrightnessPolicy policy = {12, 22 * 60, 7 * 60, 1, 30, 4};
+  BrightnessInputs inputs = {false, 0, true, 31, false, -1};
+  scheduler.update(policy, inputs);
+  TEST_ASSERT_EQUAL_INT8(12, scheduler.level());
+  inputs.batteryPercent = 30;
+  scheduler.update(policy, inputs);
+  TEST_ASSERT_EQUAL_INT8(4, scheduler.level());
+  inputs.batteryPercent = 32;
+  scheduler.update(policy, inputs);
+  TEST_ASSERT_EQUAL_INT8(4, scheduler.level());
+  inputs.batteryPercent = 33;
+  scheduler.update(policy, inputs);
+  TEST_ASSERT_EQUAL_INT8(12, scheduler.level());
+
+  inputs.batteryPercent = 20;
+  scheduler.update(policy, inputs);
+  TEST_ASSERT_EQUAL_INT8(4, scheduler.level());
+  inputs.onBattery = false;
+  scheduler.update(policy, inputs);
+  TEST_ASSERT_EQUAL_INT8(12, scheduler.level());
+}
+
+void test_quiet_hours(void) {
+  TEST_ASSERT_TRUE(inQuietHours(22 * 60, 7 * 60, 22 * 60));
+  TEST_ASSERT_TRUE(inQuietHours(22 * 60, 7 * 60, 0));
+  TEST_ASSERT_TRUE(inQuietHours(22 * 60, 7 * 60, 7 * 60 - 1));
+  TEST_ASSERT_FALSE(inQuietHours(22 * 60, 7 * 60, 7 * 60));
+  TEST_ASSERT_FALSE(inQuietHours(22 * 60, 7 * 60, 22 * 60 - 1));
+  TEST_ASSERT_TRUE(inQuietHours(13 * 60, 14 * 60, 13 * 60 + 30));
+  TEST_ASSERT_FALSE(inQuietHours(13 * 60, 14 * 60, 14 * 60));
+  TEST_ASSERT_FALSE(inQuietHours(8 * 60, 8 * 60, 8 * 60));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_week_dimmed_nights);
+  RUN_TEST(test_week_blank_nights);
+  RUN_TEST(test_low_battery_alert);
+  RUN_TEST(test_battery_hysteresis);
+  RUN_TEST(test_quiet_hours);
+  return UNITY_END();
+}
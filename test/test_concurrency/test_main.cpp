@@ -0,0 +1,233 @@
+// The lock-free structures shared between tasks, hammered from threads:
+// Seqlock readers never see a torn value, and the LogRing keeps each
+// producer's lines in order and whole, losing only what it counts.
+
+#include <unity.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "seqlock.h"
+#include "log.h"
+
+// Every field derived from one counter, so a copy mixing two writes shows
+struct Sample {
+  uint32_t counter;
+  uint32_t squared;
+  float half;
+  char text[20];
+  uint64_t wide;
+  uint32_t check;
+};
+
+static Sample sampleFor(uint32_t n) {
+  Sample s;
+  memset(&s, 0, sizeof(s));
+  s.counter = n;
+  s.squared = n * n;
+  s.half = n / 2.0f;
+  snprintf(s.text, sizeof(s.text), "n=%u", n);
+  s.wide = ((uint64_t)n << 32) | (~n & 0xFFFFFFFF);
+  s.check = n ^ 0xA5A5A5A5;
+  return s;
+}
+
+static bool consistent(const Sample& s) {
+  Sample expected = sampleFor(s.counter);
+  return memcmp(&expected, &s, sizeof(s)) == 0;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// One writer as fast as it can go, several readers; each reader's copies
+// are whole and their versions never go backwards
+void test_seqlock_no_torn_reads(void) {
+  static const uint32_t WRITES = 2000000;
+  static const int READERS = 3;
+  static Seqlock<Sample> lock;
+  std::atomic<bool> done(false);
+  std::atomic<uint32_t> torn(0), backwards(0), reads(0);
+
+  std::vector<std::thread> readers;
+  for (int r = 0; r < READERS; r++) {
+    readers.emplace_back([&]() {
+      uint32_t lastVersion = 0, lastCounter = 0;
+      uint32_t n = 0;
+      while (!done.load(std::memory_order_relaxed)) {
+        Sample s;
+        uint32_t version = lock.read(s);
+        if (version == 0) {
+          continue;
+        }
+        if (!consistent(s)) torn++;
+        if (version < lastVersion || s.counter < lastCounter) backwards++;
+        // Version v is the v-th write, of counter v - 1
+        if (s.counter != version - 1) torn++;
+        lastVersion = version;
+        lastCounter = s.counter;
+        n++;
+      }
+      reads += n;
+    });
+  }
+  for (uint32_t n = 0; n < WRITES; n++) {
+    lock.write(sampleFor(n));
+  }
+  done = true;
+  for (std::thread& t : readers) {
+    t.join();
+  }
+
+  char message[96];
+  snprintf(message, sizeof(message), "%u writes, %u reads across %d readers", WRITES, reads.load(), READERS);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_TRUE(reads.load() > 1000);
+  TEST_ASSERT_EQUAL_UINT32(0, torn.load());
+  TEST_ASSERT_EQUAL_UINT32(0, backwards.load());
+  TEST_ASSERT_EQUAL_UINT32(WRITES, lock.version());
+}
+
+// What logWrite does, with the time given
+static bool pushLine(LogRing& ring, uint32_t timeMs, const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  bool ok = ring.push(LOG_LEVEL_INFO, timeMs, format, args);
+  va_end(args);
+  return ok;
+}
+
+// Padding tied to the line's numbers, so a line overwritten part way
+// through doesn't parse back
+static void padFor(uint32_t producer, uint32_t n, char* pad, size_t size) {
+  size_t length = 20 + (producer * 7 + n) % 60;
+  if (length >= size) length = size - 1;
+  for (size_t i = 0; i < length; i++) {
+    pad[i] = 'a' + (producer + n + i) % 26;
+  }
+  pad[length] = '\0';
+}
+
+struct RingResult {
+  uint32_t pushed;
+  uint32_t refused;
+  uint32_t received;
+  uint32_t dropped;
+  uint32_t torn;
+  uint32_t unordered;
+};
+
+// Producers push numbered lines (retrying refused ones if retry is set)
+// while one consumer drains; check every line is whole, each producer's
+// lines arrive in order, and the count of lost lines adds up
+static RingResult stressRing(int producers, uint32_t perProducer, bool retry) {
+  LogRing ring;
+  RingResult result = {};
+  std::atomic<int> running(producers);
+  std::atomic<uint32_t> pushed(0), refused(0);
+
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producers; p++) {
+    threads.emplace_back([&, p]() {
+      char pad[LogRing::LINE_BYTES];
+      uint32_t ok = 0, no = 0;
+      for (uint32_t n = 0; n < perProducer; n++) {
+        padFor(p, n, pad, sizeof(pad));
+        while (!pushLine(ring, n, "p%u n%u %s", p, n, pad)) {
+          no++;
+          if (!retry) break;
+          std::this_thread::yield();
+        }
+        ok++;
+        if (!retry && n % 16 == 0) {
+          std::this_thread::yield();  // Give the consumer a look in now and then
+        }
+      }
+      pushed += retry ? ok : ok - no;
+      refused += no;
+      running--;
+    });
+  }
+
+  std::vector<int64_t> last(producers, -1);
+  char line[LogRing::LINE_BYTES + 1];
+  for (;;) {
+    bool finished = running.load() == 0;
+    size_t length = ring.pop(line, LogRing::LINE_BYTES);
+    if (length == 0) {
+      if (finished && ring.empty()) break;
+      std::this_thread::yield();
+      continue;
+    }
+    line[length] = '\0';
+    result.received++;
+    unsigned seconds, millis, producer, n;
+    char level;
+    char text[LogRing::LINE_BYTES];
+    char pad[LogRing::LINE_BYTES];
+    if (line[length - 1] != '\n' ||
+        sscanf(line, "%u.%u %c p%u n%u %s", &seconds, &millis, &level, &producer, &n, text) != 6 ||
+        producer >= (unsigned)producers || seconds * 1000 + millis != n) {
+      result.torn++;
+      continue;
+    }
+    padFor(producer, n, pad, sizeof(pad));
+    if (strncmp(text, pad, strlen(text)) != 0) {
+      result.torn++;
+    }
+    if ((int64_t)n <= last[producer]) {
+      result.unordered++;
+    }
+    last[producer] = n;
+  }
+  for (std::thread& t : threads) {
+    t.join();
+  }
+  result.pushed = pushed.load();
+  result.refused = refused.load();
+  result.dropped = ring.takeDropped();
+  return result;
+}
+
+// Producers that retry lose nothing; every line arrives once, in order
+void test_log_ring_retrying_producers(void) {
+  static const int PRODUCERS = 4;
+  static const uint32_t LINES = 100000;
+  RingResult r = stressRing(PRODUCERS, LINES, true);
+  char message[128];
+  snprintf(message, sizeof(message), "%u lines from %d producers, %u refusals while full", r.received,
+           PRODUCERS, r.refused);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_EQUAL_UINT32(PRODUCERS * LINES, r.received);
+  TEST_ASSERT_EQUAL_UINT32(0, r.torn);
+  TEST_ASSERT_EQUAL_UINT32(0, r.unordered);
+  TEST_ASSERT_EQUAL_UINT32(r.refused, r.dropped);
+}
+
+// Producers that give up, as logWrite does: a line is either delivered or
+// counted as dropped, never both or neither
+void test_log_ring_dropping_producers(void) {
+  static const int PRODUCERS = 6;
+  static const uint32_t LINES = 100000;
+  RingResult r = stressRing(PRODUCERS, LINES, false);
+  char message[128];
+  snprintf(message, sizeof(message), "%u of %u lines delivered, %u dropped", r.received, PRODUCERS * LINES,
+           r.dropped);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_TRUE(r.dropped > 0);
+  TEST_ASSERT_TRUE(r.received > LogRing::SLOTS);
+  TEST_ASSERT_EQUAL_UINT32(PRODUCERS * LINES, r.received + r.dropped);
+  TEST_ASSERT_EQUAL_UINT32(r.refused, r.dropped);
+  TEST_ASSERT_EQUAL_UINT32(0, r.torn);
+  TEST_ASSERT_EQUAL_UINT32(0, r.unordered);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_seqlock_no_torn_reads);
+  RUN_TEST(test_log_ring_retrying_producers);
+  RUN_TEST(test_log_ring_dropping_producers);
+  return UNITY_END();
+}
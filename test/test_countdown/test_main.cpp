@@ -0,0 +1,153 @@
+// The civil-date math in countdown.h, checked for every day from 1900 to
+// 2199 against libc and against itself, and timed against the mktime and
+// difftime calculation it replaced.
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <chrono>
+#include "countdown.h"
+
+static const int FIRST_YEAR = 1900;
+static const int LAST_YEAR = 2199;
+
+// libc's idea of the UTC midnight starting a date
+static time_t utcMidnight(int year, int month, int day) {
+  struct tm t = {};
+  t.tm_year = year - 1900;
+  t.tm_mon = month - 1;
+  t.tm_mday = day;
+  return timegm(&t);
+}
+
+void setUp(void) {
+  setenv("TZ", "UTC0", 1);
+  tzset();
+}
+
+void tearDown(void) {}
+
+// Day numbers, the inverse, day of week and day of year agree with timegm
+// and gmtime, and consecutive days have consecutive numbers
+void test_every_day_against_libc(void) {
+  int32_t previous = daysFromCivil(FIRST_YEAR, 1, 1) - 1;
+  uint32_t checked = 0;
+  for (int year = FIRST_YEAR; year <= LAST_YEAR; year++) {
+    TEST_ASSERT_EQUAL_INT(year % 4 == 0 && (year % 100 != 0 || year % 400 == 0), isLeapYear(year));
+    for (int month = 1; month <= 12; month++) {
+      for (int day = 1; day <= daysInMonth(year, month); day++) {
+        int32_t days = daysFromCivil(year, month, day);
+        TEST_ASSERT_EQUAL_INT32(previous + 1, days);
+        previous = days;
+
+        time_t t = utcMidnight(year, month, day);
+        TEST_ASSERT_EQUAL_INT64(t / 86400, days);
+        struct tm g;
+        gmtime_r(&t, &g);
+        TEST_ASSERT_EQUAL_INT(g.tm_mday, day);  // libc didn't normalise it away
+        TEST_ASSERT_EQUAL_INT(g.tm_wday, dayOfWeek(days));
+        TEST_ASSERT_EQUAL_INT(g.tm_yday + 1, dayOfYear(year, month, day));
+
+        CivilDate back = civilFromDays(days);
+        TEST_ASSERT_EQUAL_INT(year, back.year);
+        TEST_ASSERT_EQUAL_INT(month, back.month);
+        TEST_ASSERT_EQUAL_INT(day, back.day);
+        checked++;
+      }
+    }
+    // Nothing past the end of the year's last month
+    TEST_ASSERT_EQUAL_INT32(daysFromCivil(year + 1, 1, 1), previous + 1);
+  }
+  TEST_ASSERT_EQUAL_UINT32(daysFromCivil(LAST_YEAR + 1, 1, 1) - daysFromCivil(FIRST_YEAR, 1, 1), checked);
+}
+
+// The countdown to a few anniversaries, for every day, matches the number
+// of days to the next occurrence found by libc
+void test_countdown_every_day(void) {
+  static const int targets[][2] = {{12, 25}, {1, 1}, {12, 31}, {3, 1}, {7, 4}};
+  for (const auto& target : targets) {
+    for (int32_t days = daysFromCivil(FIRST_YEAR, 1, 1); days < daysFromCivil(LAST_YEAR, 1, 1); days++) {
+      CivilDate date = civilFromDays(days);
+      Countdown c = countdownToAnnual(date.year, date.month, date.day, target[0], target[1]);
+
+      int year = date.year;
+      time_t today = utcMidnight(date.year, date.month, date.day);
+      time_t next = utcMidnight(year, target[0], target[1]);
+      if (next < today) {
+        next = utcMidnight(++year, target[0], target[1]);
+      }
+      TEST_ASSERT_EQUAL_INT((next - today) / 86400, c.days);
+      TEST_ASSERT_EQUAL_INT(year, c.targetYear);
+    }
+  }
+}
+
+// Dates before 1970 and across the 400-year era boundaries round-trip
+void test_era_boundaries(void) {
+  static const int32_t edges[] = {-719468, -719469, -146097, -146098, -1, 0, 1, 146096, 146097, 2932896};
+  for (int32_t days : edges) {
+    CivilDate d = civilFromDays(days);
+    TEST_ASSERT_EQUAL_INT32(days, daysFromCivil(d.year, d.month, d.day));
+    TEST_ASSERT_TRUE(dayOfWeek(days) >= 0 && dayOfWeek(days) <= 6);
+  }
+  TEST_ASSERT_EQUAL_INT(4, dayOfWeek(0));  // 1970-01-01 was a Thursday
+  TEST_ASSERT_EQUAL_INT(3, dayOfWeek(-1));
+}
+
+// The old calculation: mktime on both dates, difftime, divide by a day
+static int mktimeCountdown(int year, int month, int day) {
+  struct tm now = {};
+  now.tm_year = year - 1900;
+  now.tm_mon = month - 1;
+  now.tm_mday = day;
+  now.tm_hour = 12;
+  now.tm_isdst = -1;
+  struct tm target = now;
+  target.tm_mon = 11;
+  target.tm_mday = 25;
+  target.tm_hour = 0;
+  time_t t = mktime(&target);
+  time_t n = mktime(&now);
+  if (difftime(t, n) < -86400) {
+    target.tm_year++;
+    t = mktime(&target);
+  }
+  return (int)(difftime(t, n) / 86400.0);
+}
+
+void test_benchmark(void) {
+  static const int ROUNDS = 1000000;
+  setenv("TZ", "EST5EDT,M3.2.0,M11.1.0", 1);
+  tzset();
+  volatile int sink = 0;
+  int32_t first = daysFromCivil(2025, 1, 1);
+
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < ROUNDS; i++) {
+    CivilDate d = civilFromDays(first + i % 3650);
+    sink += mktimeCountdown(d.year, d.month, d.day);
+  }
+  double oldNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / ROUNDS;
+
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < ROUNDS; i++) {
+    CivilDate d = civilFromDays(first + i % 3650);
+    sink += countdownToAnnual(d.year, d.month, d.day, 12, 25).days;
+  }
+  double newNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / ROUNDS;
+
+  char message[128];
+  snprintf(message, sizeof(message), "countdown: mktime/difftime %.1f ns, day numbers %.1f ns", oldNs, newNs);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_TRUE(newNs < oldNs);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_every_day_against_libc);
+  RUN_TEST(test_countdown_every_day);
+  RUN_TEST(test_era_boundaries);
+  RUN_TEST(test_benchmark);
+  return UNITY_END();
+}
@@ -0,0 +1,198 @@
+// The shadowed HT16K33 driver's frame diffing on a recording bus: what
+// goes over I2C for an unchanged frame, one digit, the colon alone and a
+// failed write, and the counters /api/status reports from it.
+
+#include <unity.h>
+#include <vector>
+#include "displayshadow.h"
+
+// Row buffer as Adafruit_7segment lays it out: digits in rows 0, 1, 3 and
+// 4, the colon in row 2
+static const uint8_t DIGITS[10] = {0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07, 0x7F, 0x6F};
+static const uint8_t COLON_ROW = 2;
+static const uint16_t COLON = 0x02;
+static const uint32_t FULL_WRITE = DisplayShadow::RAM_BYTES + 1;
+
+class RecordingBus : public DisplayBus {
+public:
+  bool writeRam(const uint8_t* data, size_t length) override {
+    writes.push_back(std::vector<uint8_t>(data, data + length));
+    return !failNext;
+  }
+
+  std::vector<std::vector<uint8_t>> writes;
+  bool failNext = false;
+};
+
+static void showNumber(uint16_t* rows, int value, bool colon) {
+  static const uint8_t POSITION_ROWS[4] = {0, 1, 3, 4};
+  for (int i = 0; i < 8; i++) {
+    rows[i] = 0;
+  }
+  for (int i = 3; i >= 0; i--) {
+    rows[POSITION_ROWS[i]] = DIGITS[value % 10];
+    value /= 10;
+  }
+  rows[COLON_ROW] = colon ? COLON : 0;
+}
+
+static void assertWrite(const std::vector<uint8_t>& expected, const std::vector<uint8_t>& actual) {
+  TEST_ASSERT_EQUAL_UINT32(expected.size(), actual.size());
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected.data(), actual.data(), expected.size());
+}
+
+// Address 0, then two bytes per row, low byte first
+static void assertFullWrite(const uint16_t* rows, const std::vector<uint8_t>& actual) {
+  std::vector<uint8_t> expected = {0x00};
+  for (int i = 0; i < 8; i++) {
+    expected.push_back(rows[i] & 0xFF);
+    expected.push_back(rows[i] >> 8);
+  }
+  assertWrite(expected, actual);
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_first_frame_is_full(void) {
+  RecordingBus bus;
+  DisplayShadow shadow(bus);
+  uint16_t rows[8];
+  showNumber(rows, 1234, false);
+  TEST_ASSERT_EQUAL_UINT8(0, shadow.litSegments());
+  shadow.send(rows);
+
+  TEST_ASSERT_EQUAL_UINT32(1, bus.writes.size());
+  assertFullWrite(rows, bus.writes[0]);
+  TEST_ASSERT_EQUAL_UINT32(FULL_WRITE, shadow.bytesSent());
+  TEST_ASSERT_EQUAL_UINT32(1, shadow.transactions());
+  TEST_ASSERT_EQUAL_UINT32(0, shadow.skippedWrites());
+  TEST_ASSERT_EQUAL_UINT32(FULL_WRITE, shadow.fullFrameBytes());
+  TEST_ASSERT_EQUAL_UINT8(2 + 5 + 5 + 4, shadow.litSegments());
+}
+
+void test_unchanged_frame_sends_nothing(void) {
+  RecordingBus bus;
+  DisplayShadow shadow(bus);
+  uint16_t rows[8];
+  showNumber(rows, 86, false);
+  for (int i = 0; i < 10; i++) {
+    shadow.send(rows);
+  }
+
+  TEST_ASSERT_EQUAL_UINT32(1, bus.writes.size());
+  TEST_ASSERT_EQUAL_UINT32(FULL_WRITE, shadow.bytesSent());
+  TEST_ASSERT_EQUAL_UINT32(1, shadow.transactions());
+  TEST_ASSERT_EQUAL_UINT32(9, shadow.skippedWrites());
+  TEST_ASSERT_EQUAL_UINT32(10 * FULL_WRITE, shadow.fullFrameBytes());
+}
+
+// 0086 to 0085 touches row 4 only: its low byte at RAM address 8
+void test_one_digit(void) {
+  RecordingBus bus;
+  DisplayShadow shadow(bus);
+  uint16_t rows[8];
+  showNumber(rows, 86, false);
+  shadow.send(rows);
+  showNumber(rows, 85, false);
+  shadow.send(rows);
+
+  TEST_ASSERT_EQUAL_UINT32(2, bus.writes.size());
+  assertWrite({0x08, DIGITS[5]}, bus.writes[1]);
+  TEST_ASSERT_EQUAL_UINT32(FULL_WRITE + 2, shadow.bytesSent());
+  TEST_ASSERT_EQUAL_UINT32(2, shadow.transactions());
+  TEST_ASSERT_EQUAL_UINT32(0, shadow.skippedWrites());
+  TEST_ASSERT_EQUAL_UINT32(2 * FULL_WRITE, shadow.fullFrameBytes());
+}
+
+// Two digits apart go as one span, unchanged bytes between included
+void test_digits_apart(void) {
+  RecordingBus bus;
+  DisplayShadow shadow(bus);
+  uint16_t rows[8];
+  showNumber(rows, 1099, false);
+  shadow.send(rows);
+  showNumber(rows, 2098, false);
+  shadow.send(rows);
+
+  assertWrite({0x00, DIGITS[2], 0x00, DIGITS[0], 0x00, 0x00, 0x00, DIGITS[9], 0x00, DIGITS[8]}, bus.writes[1]);
+  TEST_ASSERT_EQUAL_UINT32(FULL_WRITE + 10, shadow.bytesSent());
+}
+
+void test_colon_only(void) {
+  RecordingBus bus;
+  DisplayShadow shadow(bus);
+  uint16_t rows[8];
+  showNumber(rows, 1200, false);
+  shadow.send(rows);
+  showNumber(rows, 1200, true);
+  shadow.send(rows);
+  showNumber(rows, 1200, false);
+  shadow.send(rows);
+
+  TEST_ASSERT_EQUAL_UINT32(3, bus.writes.size());
+  assertWrite({0x04, COLON}, bus.writes[1]);
+  assertWrite({0x04, 0x00}, bus.writes[2]);
+  TEST_ASSERT_EQUAL_UINT32(FULL_WRITE + 4, shadow.bytesSent());
+  TEST_ASSERT_EQUAL_UINT32(3, shadow.transactions());
+  TEST_ASSERT_EQUAL_UINT32(3 * FULL_WRITE, shadow.fullFrameBytes());
+}
+
+// A failed write counts as sent, and leaves the chip state unknown: the
+// next frame goes whole even if it's the same one, then diffing resumes
+void test_failed_write_then_full_resend(void) {
+  RecordingBus bus;
+  DisplayShadow shadow(bus);
+  uint16_t rows[8];
+  showNumber(rows, 86, false);
+  shadow.send(rows);
+
+  showNumber(rows, 85, false);
+  bus.failNext = true;
+  shadow.send(rows);
+  assertWrite({0x08, DIGITS[5]}, bus.writes[1]);
+  TEST_ASSERT_EQUAL_UINT8(0, shadow.litSegments());
+
+  bus.failNext = false;
+  shadow.send(rows);
+  TEST_ASSERT_EQUAL_UINT32(3, bus.writes.size());
+  assertFullWrite(rows, bus.writes[2]);
+  TEST_ASSERT_EQUAL_UINT8(6 + 6 + 7 + 5, shadow.litSegments());
+
+  shadow.send(rows);
+  showNumber(rows, 84, false);
+  shadow.send(rows);
+  TEST_ASSERT_EQUAL_UINT32(4, bus.writes.size());
+  assertWrite({0x08, DIGITS[4]}, bus.writes[3]);
+
+  TEST_ASSERT_EQUAL_UINT32(FULL_WRITE + 2 + FULL_WRITE + 2, shadow.bytesSent());
+  TEST_ASSERT_EQUAL_UINT32(4, shadow.transactions());
+  TEST_ASSERT_EQUAL_UINT32(1, shadow.skippedWrites());
+  TEST_ASSERT_EQUAL_UINT32(5 * FULL_WRITE, shadow.fullFrameBytes());
+}
+
+void test_invalidate(void) {
+  RecordingBus bus;
+  DisplayShadow shadow(bus);
+  uint16_t rows[8];
+  showNumber(rows, 86, false);
+  shadow.send(rows);
+  shadow.invalidate();
+  shadow.send(rows);
+
+  TEST_ASSERT_EQUAL_UINT32(2, bus.writes.size());
+  assertFullWrite(rows, bus.writes[1]);
+  TEST_ASSERT_EQUAL_UINT32(0, shadow.skippedWrites());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_first_frame_is_full);
+  RUN_TEST(test_unchanged_frame_sends_nothing);
+  RUN_TEST(test_one_digit);
+  RUN_TEST(test_digits_apart);
+  RUN_TEST(test_colon_only);
+  RUN_TEST(test_failed_write_then_full_resend);
+  RUN_TEST(test_invalidate);
+  return UNITY_END();
+}
@@ -0,0 +1,181 @@
+// The drift estimator against RTC drift traces: constant, a step, a daily
+// temperature swing and NTP jitter. Each trace runs main.cpp's loop (sync,
+// fold the sync into the estimate, wait the adaptive interval) over
+// simulated weeks and checks the estimate and the clock error it allows.
+
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "drift.h"
+
+// main.cpp's limits
+static const uint32_t MIN_SYNC_SEC = 3600;
+static const uint32_t MAX_SYNC_SEC = 86400;
+static const float MAX_CLOCK_ERROR = 1.0f;
+
+static const double PI = 3.14159265358979;
+static const int64_t STEP_US = 60000000;  // Trace resolution, one minute
+
+typedef double (*DriftTrace)(double trueSec);  // ppm at a moment, positive = fast
+
+struct TraceResult {
+  float finalPpm;
+  float maxErrorSec;        // Worst clock error seen just before a sync
+  float maxErrorSettledSec;  // The same, after the first day
+  uint32_t syncs;
+  uint32_t lastIntervalSec;
+};
+
+// Run the sync loop over a trace. The wall clock is set at each sync and
+// then runs on the local oscillator, like the monotonic clock it's
+// compared against; NTP answers off by up to jitterMs.
+static TraceResult runTrace(DriftTrace trace, uint32_t days, int jitterMs) {
+  DriftEstimator drift;
+  TraceResult result = {};
+  int64_t trueUs = 1000000;
+  double localUs = 1000000.0;
+  double wallAtSyncUs = 0, localAtSyncUs = 0;
+  int64_t endUs = (int64_t)days * 86400 * 1000000;
+  bool synced = false;
+  uint32_t interval = MIN_SYNC_SEC;
+
+  while (trueUs < endUs) {
+    if (synced) {
+      float error = (float)fabs((wallAtSyncUs + (localUs - localAtSyncUs) - trueUs) / 1e6);
+      if (error > result.maxErrorSec) result.maxErrorSec = error;
+      if (trueUs > 86400LL * 1000000 && error > result.maxErrorSettledSec) result.maxErrorSettledSec = error;
+    }
+    int jitterUs = jitterMs > 0 ? (rand() % (2 * jitterMs + 1) - jitterMs) * 1000 : 0;
+    wallAtSyncUs = (double)(trueUs + jitterUs);
+    localAtSyncUs = localUs;
+    drift.addSync(trueUs + jitterUs, (int64_t)localUs);
+    synced = true;
+    result.syncs++;
+
+    interval = drift.nextSyncDelay(MAX_CLOCK_ERROR, MIN_SYNC_SEC, MAX_SYNC_SEC);
+    for (int64_t left = (int64_t)interval * 1000000; left > 0; left -= STEP_US) {
+      int64_t step = left < STEP_US ? left : STEP_US;
+      localUs += step * (1.0 + trace(trueUs / 1e6) / 1e6);
+      trueUs += step;
+    }
+  }
+  result.finalPpm = drift.ppm();
+  result.lastIntervalSec = interval;
+  return result;
+}
+
+static void report(const char* name, const TraceResult& r) {
+  char message[160];
+  snprintf(message, sizeof(message), "%s: %.2f ppm, %u syncs, last interval %.1f h, worst error %.3f s (%.3f s settled)",
+           name, r.finalPpm, r.syncs, r.lastIntervalSec / 3600.0f, r.maxErrorSec, r.maxErrorSettledSec);
+  TEST_MESSAGE(message);
+}
+
+static double fast20(double t) { return 20.0; }
+static double slow35(double t) { return -35.0; }
+static double quartz(double t) { return 2.0; }
+static double step10to30(double t) { return t < 7 * 86400.0 ? 10.0 : 30.0; }
+static double dailySwing(double t) { return 15.0 + 8.0 * sin(2 * PI * t / 86400.0); }
+
+void setUp(void) { srand(9); }
+void tearDown(void) {}
+
+// A steady crystal: the estimate lands on it and the interval stretches to
+// what keeps the error under the limit
+void test_constant_drift(void) {
+  TraceResult fast = runTrace(fast20, 14, 0);
+  report("+20 ppm", fast);
+  TEST_ASSERT_FLOAT_WITHIN(0.1f, 20.0f, fast.finalPpm);
+  TEST_ASSERT_TRUE(fast.maxErrorSec < MAX_CLOCK_ERROR);
+  TEST_ASSERT_UINT32_WITHIN(60, (uint32_t)(MAX_CLOCK_ERROR / 25e-6f), fast.lastIntervalSec);
+
+  TraceResult slow = runTrace(slow35, 14, 0);
+  report("-35 ppm", slow);
+  TEST_ASSERT_FLOAT_WITHIN(0.1f, -35.0f, slow.finalPpm);
+  TEST_ASSERT_TRUE(slow.maxErrorSec < MAX_CLOCK_ERROR);
+  TEST_ASSERT_TRUE(slow.lastIntervalSec < fast.lastIntervalSec);
+
+  // A good crystal runs into the one-day cap
+  TraceResult good = runTrace(quartz, 14, 0);
+  TEST_ASSERT_EQUAL_UINT32(MAX_SYNC_SEC, good.lastIntervalSec);
+  TEST_ASSERT_TRUE(good.maxErrorSec < MAX_CLOCK_ERROR);
+}
+
+// Before the first measurement the estimator assumes the worst, so the
+// first intervals are short
+void test_first_syncs_are_cautious(void) {
+  DriftEstimator drift;
+  TEST_ASSERT_EQUAL_UINT32((uint32_t)(MAX_CLOCK_ERROR / (DriftEstimator::UNKNOWN_DRIFT_PPM * 1e-6f)),
+                           drift.nextSyncDelay(MAX_CLOCK_ERROR, MIN_SYNC_SEC, MAX_SYNC_SEC));
+  drift.addSync(1000000, 1000000);
+  TEST_ASSERT_FALSE(drift.hasEstimate());
+}
+
+// The drift jumps (the board moved somewhere warmer): the first interval
+// after it overshoots by the ratio of new to predicted drift, then the
+// estimate follows within a few syncs
+void test_step_change(void) {
+  TraceResult r = runTrace(step10to30, 21, 0);
+  report("10 -> 30 ppm step", r);
+  TEST_ASSERT_FLOAT_WITHIN(0.5f, 30.0f, r.finalPpm);
+  TEST_ASSERT_TRUE(r.maxErrorSettledSec > MAX_CLOCK_ERROR);
+  TEST_ASSERT_TRUE(r.maxErrorSettledSec < MAX_CLOCK_ERROR * 35.0f / 15.0f);
+}
+
+// Temperature swinging the drift over the day: the intervals average it
+// out and the margin keeps the error near the limit
+void test_daily_swing(void) {
+  TraceResult r = runTrace(dailySwing, 28, 0);
+  report("15 +/- 8 ppm daily", r);
+  TEST_ASSERT_FLOAT_WITHIN(8.0f, 15.0f, r.finalPpm);
+  TEST_ASSERT_TRUE(r.maxErrorSettledSec < MAX_CLOCK_ERROR * 1.5f);
+}
+
+// NTP answers off by up to 50 ms: the averaging keeps the estimate close
+// and the error bounded
+void test_ntp_jitter(void) {
+  TraceResult r = runTrace(fast20, 28, 50);
+  report("+20 ppm, 50 ms jitter", r);
+  TEST_ASSERT_FLOAT_WITHIN(2.0f, 20.0f, r.finalPpm);
+  TEST_ASSERT_TRUE(r.maxErrorSettledSec < MAX_CLOCK_ERROR * 1.2f);
+}
+
+// Syncs closer together than MIN_BASELINE_SEC don't move the estimate or
+// the baseline; the next long enough one measures from the old baseline
+void test_short_baseline_ignored(void) {
+  DriftEstimator drift;
+  drift.addSync(0, 0);
+  drift.addSync(600000000LL, 600000000LL + 30000);  // 50 ppm over 10 minutes, ignored
+  TEST_ASSERT_FALSE(drift.hasEstimate());
+  drift.addSync(3600000000LL, 3600000000LL + 36000);  // 10 ppm from the first
+  TEST_ASSERT_TRUE(drift.hasEstimate());
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 10.0f, drift.ppm());
+
+  drift.addSync(7200000000LL, 3600000000LL);  // Monotonic clock went backwards
+  TEST_ASSERT_EQUAL_UINT16(1, drift.sampleCount());
+}
+
+void test_seed(void) {
+  DriftEstimator drift;
+  drift.seed(NAN);
+  drift.seed(5000.0f);
+  TEST_ASSERT_FALSE(drift.hasEstimate());
+  drift.seed(-12.5f);
+  TEST_ASSERT_TRUE(drift.hasEstimate());
+  TEST_ASSERT_EQUAL_FLOAT(-12.5f, drift.ppm());
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 1.75f, drift.predictedError(100000));
+  TEST_ASSERT_EQUAL_UINT32(MIN_SYNC_SEC, drift.nextSyncDelay(0.01f, MIN_SYNC_SEC, MAX_SYNC_SEC));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_constant_drift);
+  RUN_TEST(test_first_syncs_are_cautious);
+  RUN_TEST(test_step_change);
+  RUN_TEST(test_daily_swing);
+  RUN_TEST(test_ntp_jitter);
+  RUN_TEST(test_short_baseline_ignored);
+  RUN_TEST(test_seed);
+  return UNITY_END();
+}
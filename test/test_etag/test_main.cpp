@@ -0,0 +1,56 @@
+// If-None-Match handling for the web page: which conditional requests get
+// the empty 304 and which get the page.
+
+#include <unity.h>
+#include "etag.h"
+
+// The form tools/build_webpage.py writes
+static const char* PAGE_ETAG = "\"3f9a1c0de2b47a65\"";
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_current_tag_matches(void) {
+  TEST_ASSERT_TRUE(etagMatches("\"3f9a1c0de2b47a65\"", PAGE_ETAG));
+  TEST_ASSERT_TRUE(etagMatches("  \"3f9a1c0de2b47a65\"  ", PAGE_ETAG));
+}
+
+// Proxies and some browsers weaken tags; If-None-Match compares weakly
+void test_weak_tags_match(void) {
+  TEST_ASSERT_TRUE(etagMatches("W/\"3f9a1c0de2b47a65\"", PAGE_ETAG));
+  TEST_ASSERT_TRUE(etagMatches("\"3f9a1c0de2b47a65\"", "W/\"3f9a1c0de2b47a65\""));
+}
+
+void test_lists_and_star(void) {
+  TEST_ASSERT_TRUE(etagMatches("\"0000000000000000\", W/\"3f9a1c0de2b47a65\"", PAGE_ETAG));
+  TEST_ASSERT_TRUE(etagMatches("\"a\",\"b\",\"3f9a1c0de2b47a65\"", PAGE_ETAG));
+  TEST_ASSERT_TRUE(etagMatches("*", PAGE_ETAG));
+}
+
+// The copy from an older firmware gets the new page, as do tags that only
+// contain or start with the current one
+void test_other_tags_dont_match(void) {
+  TEST_ASSERT_FALSE(etagMatches("\"0000000000000000\"", PAGE_ETAG));
+  TEST_ASSERT_FALSE(etagMatches("\"3f9a1c0de2b47a65ff\"", PAGE_ETAG));
+  TEST_ASSERT_FALSE(etagMatches("\"ff3f9a1c0de2b47a65\"", PAGE_ETAG));
+  TEST_ASSERT_FALSE(etagMatches("3f9a1c0de2b47a65", PAGE_ETAG));
+  TEST_ASSERT_FALSE(etagMatches("", PAGE_ETAG));
+}
+
+void test_malformed_headers(void) {
+  TEST_ASSERT_FALSE(etagMatches("\"3f9a1c0de2b47a65", PAGE_ETAG));
+  TEST_ASSERT_FALSE(etagMatches("W/", PAGE_ETAG));
+  TEST_ASSERT_FALSE(etagMatches(",,,", PAGE_ETAG));
+  TEST_ASSERT_TRUE(etagMatches("junk, \"3f9a1c0de2b47a65\"", PAGE_ETAG));
+  TEST_ASSERT_TRUE(etagMatches("\"x\"junk, \"3f9a1c0de2b47a65\"", PAGE_ETAG));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_current_tag_matches);
+  RUN_TEST(test_weak_tags_match);
+  RUN_TEST(test_lists_and_star);
+  RUN_TEST(test_other_tags_dont_match);
+  RUN_TEST(test_malformed_headers);
+  return UNITY_END();
+}
@@ -0,0 +1,286 @@
+// Load on the web server from the page's two ways of staying current: the
+// /events stream (full status on connect, then writeStatusDelta once a
+// second) and the fallback of polling /api/status every 5 s. Stand-in
+// clients count requests, messages and bytes over a simulated hour of a
+// running device, and check that what the stream leaves each client
+// knowing stays within the delta thresholds of the real status.
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "status.h"
+
+// main.cpp's settings
+static const unsigned long EVENTS_INTERVAL_MS = 1000;
+static const unsigned long POLL_INTERVAL_MS = 5000;  // web/index.html's fallback
+static const size_t STATUS_EVENT_SIZE = 384;
+static const size_t MAX_EVENT_BACKLOG = 4;
+static const size_t STATUS_JSON_SIZE = 1536;
+
+// What goes over the wire besides the JSON. A browser's GET with its usual
+// headers, the server's response headers, and TCP/IP's 40 bytes a packet:
+// a polled request takes about ten packets on a fresh connection (the
+// handshake, request, response, their acks and the close), an event one
+// data packet and an ack.
+static const size_t REQUEST_BYTES = 420;
+static const size_t PACKET_OVERHEAD = 40;
+static const uint32_t PACKETS_PER_POLL = 10;
+static const uint32_t PACKETS_PER_EVENT = 2;
+
+static const uint32_t SECONDS = 3600;
+
+// A device ticking along: the clock, a noisy RSSI, a battery slowly
+// running down
+struct Device {
+  StatusSnapshot status = {};
+  uint32_t tick = 0;
+  float charge = 82.0f;
+
+  Device() {
+    status.days = 87;
+    status.eventYear = 2025;
+    strcpy(status.event, "Christmas");
+    status.year = 2025;
+    status.month = 9;
+    status.day = 29;
+    status.hour = 14;
+    strcpy(status.ssid, "home");
+    strcpy(status.ip, "192.168.1.42");
+    status.rssi = -61;
+    status.batteryStatus = BATTERY_DISCHARGING;
+    update();
+  }
+
+  void advance() {
+    tick++;
+    if (++status.sec == 60) {
+      status.sec = 0;
+      if (++status.min == 60) {
+        status.min = 0;
+        status.hour++;
+      }
+    }
+    int step = rand() % 3 - 1;
+    if (status.rssi + step > -75 && status.rssi + step < -50) {
+      status.rssi += step;
+    }
+    charge -= 1.5f / 3600.0f;
+    update();
+  }
+
+  void update() {
+    status.batteryPercent = (uint8_t)charge;
+    // About 7 mV per percent, with a couple of mV of read noise
+    status.batteryVoltage = 3.4f + charge * 0.007f + (rand() % 5 - 2) * 0.001f;
+  }
+};
+
+// A subscribed page: what it's been told, kept up to date from each
+// message's fields
+struct StreamClient {
+  StatusSnapshot view = {};
+  uint32_t messages = 0;
+  uint32_t bytes = 0;
+  uint32_t packets = 0;
+  uint32_t queued = 0;
+  uint32_t drainEvery = 1;  // Seconds per message it can take off its queue
+
+  void receive(const char* json, uint32_t id) {
+    char frame[STATUS_EVENT_SIZE + 64];
+    int n = snprintf(frame, sizeof(frame), "id: %u\nevent: status\ndata: %s\n\n", (unsigned)id, json);
+    messages++;
+    bytes += n + PACKETS_PER_EVENT * PACKET_OVERHEAD;
+    packets += PACKETS_PER_EVENT;
+    queued++;
+    apply(json);
+  }
+
+  void apply(const char* json) {
+    int value;
+    float voltage;
+    if (field(json, "\"min\":", value)) view.min = value;
+    if (field(json, "\"hour\":", value)) view.hour = value;
+    if (field(json, "\"days\":", value)) view.days = value;
+    if (field(json, "\"rssi\":", value)) view.rssi = value;
+    if (field(json, "\"batteryPercent\":", value)) view.batteryPercent = value;
+    const char* p = strstr(json, "\"batteryVoltage\":");
+    if (p != nullptr && sscanf(p + 17, "%f", &voltage) == 1) view.batteryVoltage = voltage;
+  }
+
+  static bool field(const char* json, const char* key, int& value) {
+    const char* p = strstr(json, key);
+    return p != nullptr && sscanf(p + strlen(key), "%d", &value) == 1;
+  }
+};
+
+// The server side of the stream: main.cpp's onConnect and eventsTask
+struct EventServer {
+  StatusSnapshot lastSent = {};
+  uint32_t lastEventId = 0;
+
+  void connect(StreamClient& client, const StatusSnapshot& status) {
+    char buffer[STATUS_EVENT_SIZE];
+    JsonWriter json(buffer, sizeof(buffer));
+    json.beginObject();
+    writeStatusFields(json, status);
+    json.endObject();
+    TEST_ASSERT_FALSE(json.overflowed());
+    client.receive(json.c_str(), lastEventId);
+    lastSent = status;
+  }
+
+  void tick(StreamClient* clients, uint8_t count, const StatusSnapshot& status) {
+    uint32_t waiting = 0;
+    for (uint8_t i = 0; i < count; i++) {
+      waiting += clients[i].queued;
+    }
+    if (waiting / count >= MAX_EVENT_BACKLOG) {
+      return;
+    }
+    StatusSnapshot sent = lastSent;
+    char buffer[STATUS_EVENT_SIZE];
+    JsonWriter json(buffer, sizeof(buffer));
+    json.beginObject();
+    uint8_t changed = writeStatusDelta(json, status, sent);
+    json.endObject();
+    TEST_ASSERT_FALSE(json.overflowed());
+    if (changed == 0) {
+      return;
+    }
+    lastEventId++;
+    for (uint8_t i = 0; i < count; i++) {
+      clients[i].receive(json.c_str(), lastEventId);
+    }
+    lastSent = sent;
+  }
+};
+
+static uint32_t pollBytes(const StatusSnapshot& status) {
+  char body[STATUS_JSON_SIZE];
+  JsonWriter json(body, sizeof(body));
+  json.beginObject();
+  writeStatusFields(json, status);
+  json.endObject();
+  char headers[256];
+  int n = snprintf(headers, sizeof(headers),
+                   "HTTP/1.1 200 OK\r\nContent-Length: %u\r\nContent-Type: application/json\r\n"
+                   "Connection: close\r\nAccept-Ranges: none\r\n\r\n",
+                   (unsigned)json.length());
+  return REQUEST_BYTES + n + json.length() + PACKETS_PER_POLL * PACKET_OVERHEAD;
+}
+
+// The client's view is never further from the device than the delta
+// thresholds (plus the voltage's rounding to 10 mV in the JSON), checked
+// after every second
+static void assertCurrent(const StreamClient& client, const StatusSnapshot& status) {
+  TEST_ASSERT_EQUAL_INT8(status.min, client.view.min);
+  TEST_ASSERT_EQUAL_INT8(status.hour, client.view.hour);
+  TEST_ASSERT_EQUAL_INT16(status.days, client.view.days);
+  TEST_ASSERT_INT_WITHIN(2, status.rssi, client.view.rssi);
+  TEST_ASSERT_FLOAT_WITHIN(0.016f, status.batteryVoltage, client.view.batteryVoltage);
+  TEST_ASSERT_EQUAL_UINT8(status.batteryPercent, client.view.batteryPercent);
+}
+
+void setUp(void) { srand(11); }
+void tearDown(void) {}
+
+// An hour with four pages open, streamed and polled
+void test_stream_against_polling(void) {
+  static const uint8_t CLIENTS = 4;
+  Device device;
+  EventServer server;
+  StreamClient clients[CLIENTS];
+  for (uint8_t i = 0; i < CLIENTS; i++) {
+    server.connect(clients[i], device.status);
+  }
+
+  uint32_t polls = 0, polledBytes = 0;
+  for (uint32_t s = 1; s <= SECONDS; s++) {
+    device.advance();
+    if (s * 1000 % EVENTS_INTERVAL_MS == 0) {
+      server.tick(clients, CLIENTS, device.status);
+    }
+    for (uint8_t i = 0; i < CLIENTS; i++) {
+      clients[i].queued = 0;  // Keeping up
+      assertCurrent(clients[i], device.status);
+    }
+    if (s * 1000 % POLL_INTERVAL_MS == 0) {
+      polls += CLIENTS;
+      polledBytes += CLIENTS * pollBytes(device.status);
+    }
+  }
+
+  uint32_t streamed = 0, messages = 0;
+  for (uint8_t i = 0; i < CLIENTS; i++) {
+    streamed += clients[i].bytes;
+    messages += clients[i].messages;
+  }
+  float minutes = SECONDS / 60.0f;
+  char message[200];
+  snprintf(message, sizeof(message),
+           "%u clients: polling %.0f requests/min, %.0f bytes/min; stream 0 requests/min, "
+           "%.1f messages/min, %.0f bytes/min",
+           CLIENTS, polls / minutes, polledBytes / minutes, messages / minutes, streamed / minutes);
+  TEST_MESSAGE(message);
+
+  TEST_ASSERT_EQUAL_UINT32(CLIENTS * SECONDS * 1000 / POLL_INTERVAL_MS, polls);
+  TEST_ASSERT_TRUE(streamed * 10 < polledBytes);
+  // Well under a message a second: the seconds never go out, RSSI and
+  // voltage noise mostly stays under the thresholds
+  TEST_ASSERT_TRUE(messages / CLIENTS < SECONDS / 4);
+}
+
+// A client taking 30 s over each message backs up its queue: the server
+// holds off, and the changes accumulated meanwhile go out together once it
+// drains
+void test_slow_client_catches_up(void) {
+  Device device;
+  EventServer server;
+  StreamClient client;
+  client.drainEvery = 30;
+  server.connect(client, device.status);
+
+  uint32_t maxQueued = 0, heldBack = 0;
+  for (uint32_t s = 1; s <= SECONDS; s++) {
+    device.advance();
+    uint32_t before = client.messages;
+    server.tick(&client, 1, device.status);
+    if (client.messages == before && client.queued >= MAX_EVENT_BACKLOG) {
+      heldBack++;
+    }
+    if (client.queued > maxQueued) maxQueued = client.queued;
+    if (s % client.drainEvery == 0 && client.queued > 0) {
+      client.queued--;
+    }
+  }
+  // Let it drain, then one more tick brings it level
+  client.queued = 0;
+  device.advance();
+  server.tick(&client, 1, device.status);
+  assertCurrent(client, device.status);
+
+  TEST_ASSERT_TRUE(heldBack > 0);
+  TEST_ASSERT_EQUAL_UINT32(MAX_EVENT_BACKLOG, maxQueued);
+}
+
+// Every event fits the buffer main.cpp formats it in, the full status most
+// of all
+void test_event_sizes(void) {
+  Device device;
+  strcpy(device.status.ssid, "a-network-name-of-32-characters!");
+  strcpy(device.status.ip, "192.168.100.200");
+  strcpy(device.status.event, "Fifteen chars..");
+  EventServer server;
+  StreamClient client;
+  server.connect(client, device.status);
+  TEST_ASSERT_TRUE(client.bytes < STATUS_EVENT_SIZE + 64 + PACKETS_PER_EVENT * PACKET_OVERHEAD);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_stream_against_polling);
+  RUN_TEST(test_slow_client_catches_up);
+  RUN_TEST(test_event_sizes);
+  return UNITY_END();
+}
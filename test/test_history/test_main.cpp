@@ -0,0 +1,191 @@
+// Battery history: averaging into hours and days, restored hours weighted
+// by their readings, and streaming CSV from one thread while another
+// records.
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include "history.h"
+
+static const uint32_t DAY_START = 1735689600;  // 2025-01-01 00:00 UTC
+
+static uint32_t callbacks;
+static uint16_t lastReadings;
+static BatterySample lastSample;
+
+static void onSample(HistoryResolution res, const BatterySample& sample, uint32_t time, uint16_t readings) {
+  if (res == HISTORY_HOUR) {
+    callbacks++;
+    lastReadings = readings;
+    lastSample = sample;
+  }
+}
+
+static bool newest(BatteryHistory& history, HistoryResolution res, HistoryPoint& point) {
+  HistoryCursor cursor = history.begin(res);
+  bool any = false;
+  while (history.next(res, cursor, point)) {
+    any = true;
+  }
+  return any;
+}
+
+void setUp(void) {
+  callbacks = 0;
+  lastReadings = 0;
+}
+
+void tearDown(void) {}
+
+// A completed hour is the average of its readings, reported with how many
+// there were
+void test_hour_average(void) {
+  static BatteryHistory history;
+  history.onSample(onSample);
+  for (int i = 0; i < 30; i++) {
+    history.record(DAY_START + i * 60, 3.9f + (i % 2) * 0.1f, 80.0f, -1.5f);
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, callbacks);
+  history.record(DAY_START + 3600, 3.8f, 79.0f, -1.0f);
+
+  TEST_ASSERT_EQUAL_UINT32(1, callbacks);
+  TEST_ASSERT_EQUAL_UINT16(30, lastReadings);
+  TEST_ASSERT_EQUAL_UINT16(3950, lastSample.millivolts);
+  TEST_ASSERT_EQUAL_UINT8(80, lastSample.percent);
+  TEST_ASSERT_EQUAL_INT8(-3, lastSample.rate);
+
+  HistoryPoint point;
+  TEST_ASSERT_TRUE(newest(history, HISTORY_HOUR, point));
+  TEST_ASSERT_EQUAL_UINT32(DAY_START, point.time);
+  TEST_ASSERT_EQUAL_UINT16(31, history.count(HISTORY_MINUTE));
+}
+
+// Restored hours count toward the day by their readings: a ten-minute hour
+// before a reboot doesn't weigh as much as a full one
+void test_restored_hours_weighted_by_readings(void) {
+  static BatteryHistory history;
+  history.restoreHour(DAY_START, 3000, 10, -20, 10);
+  history.restoreHour(DAY_START + 3600, 4000, 80, -2, 60);
+  history.restoreHour(DAY_START + 7200, 4000, 80, -2, 0);  // Unknown, a full hour
+  history.record(DAY_START + 86400, 4.0f, 80.0f, 0.0f);    // Closes the day
+
+  HistoryPoint day;
+  TEST_ASSERT_TRUE(newest(history, HISTORY_DAY, day));
+  TEST_ASSERT_EQUAL_UINT32(DAY_START, day.time);
+  // (3000 * 10 + 4000 * 120) / 130, where one-per-hour weighting gives 3666
+  TEST_ASSERT_EQUAL_UINT32(3923, (uint32_t)(day.voltage * 1000.0f + 0.5f));
+  TEST_ASSERT_EQUAL_UINT8((10 * 10 + 80 * 120) / 130, day.percent);
+  TEST_ASSERT_EQUAL_UINT16(3, history.count(HISTORY_HOUR));
+}
+
+// Restoring doesn't write the restored hours back out
+void test_restore_is_silent(void) {
+  static BatteryHistory history;
+  history.onSample(onSample);
+  for (int h = 0; h < 5; h++) {
+    history.restoreHour(DAY_START + h * 3600, 3900, 70, 0, 60);
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, callbacks);
+}
+
+void test_csv_rows(void) {
+  static BatteryHistory history;
+  history.record(DAY_START, 4.123f, 91.0f, 2.5f);
+  history.record(DAY_START + 60, 3.05f, 12.0f, -0.5f);
+  HistoryCsvWriter writer(history, HISTORY_MINUTE);
+  char text[256];
+  size_t len = 0;
+  size_t n;
+  while ((n = writer.fill((uint8_t*)text + len, 7)) > 0) {  // Awkward chunk size on purpose
+    len += n;
+  }
+  text[len] = '\0';
+  TEST_ASSERT_EQUAL_STRING("time,voltage,percent,rate\n"
+                           "1735689600,4.123,91,2.5\n"
+                           "1735689660,3.050,12,-0.5\n",
+                           text);
+}
+
+// One thread records a reading per simulated minute while another streams
+// the minute ring as CSV over and over. Every reading is made so its
+// fields agree with each other, so a row mixing two writes shows up.
+static void fieldsFor(uint32_t n, uint16_t& millivolts, uint8_t& percent) {
+  millivolts = 3000 + (n * 7) % 1200;
+  percent = millivolts % 101;
+}
+
+void test_stream_while_recording(void) {
+  static BatteryHistory history;
+  std::atomic<bool> done(false);
+  std::atomic<uint32_t> written(0);
+
+  std::thread writer([&]() {
+    for (uint32_t n = 0; n < 300000; n++) {
+      uint16_t mv;
+      uint8_t pct;
+      fieldsFor(n, mv, pct);
+      history.record(DAY_START + n * 60, mv / 1000.0f, pct, 0.0f);
+      written.store(n + 1, std::memory_order_relaxed);
+    }
+    done = true;
+  });
+
+  uint32_t rows = 0, streams = 0, torn = 0, unordered = 0;
+  static char text[BatteryHistory::MINUTE_SAMPLES * 40 + 64];
+  while (!done || streams == 0) {
+    HistoryCsvWriter csv(history, HISTORY_MINUTE);
+    size_t len = 0;
+    size_t n;
+    while (len < sizeof(text) - 64 && (n = csv.fill((uint8_t*)text + len, 64)) > 0) {
+      len += n;
+    }
+    text[len] = '\0';
+    streams++;
+
+    char* line = strchr(text, '\n');
+    unsigned long lastTime = 0;
+    while (line != nullptr && line[1] != '\0') {
+      unsigned long time;
+      unsigned volts, milli, percent;
+      if (sscanf(line + 1, "%lu,%u.%u,%u,", &time, &volts, &milli, &percent) != 4) {
+        torn++;
+        break;
+      }
+      uint32_t index = (time - DAY_START) / 60;
+      uint16_t mv;
+      uint8_t pct;
+      fieldsFor(index, mv, pct);
+      if ((time - DAY_START) % 60 != 0 || volts * 1000 + milli != mv || percent != pct) {
+        torn++;
+      }
+      if (lastTime != 0 && time != lastTime + 60) {
+        unordered++;
+      }
+      lastTime = time;
+      rows++;
+      line = strchr(line + 1, '\n');
+    }
+  }
+  writer.join();
+
+  char message[96];
+  snprintf(message, sizeof(message), "%u streams, %u rows checked against %u writes", streams, rows,
+           written.load());
+  TEST_MESSAGE(message);
+  TEST_ASSERT_TRUE(streams > 1);
+  TEST_ASSERT_EQUAL_UINT32(0, torn);
+  TEST_ASSERT_EQUAL_UINT32(0, unordered);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_hour_average);
+  RUN_TEST(test_restored_hours_weighted_by_readings);
+  RUN_TEST(test_restore_is_silent);
+  RUN_TEST(test_csv_rows);
+  RUN_TEST(test_stream_while_recording);
+  return UNITY_END();
+}
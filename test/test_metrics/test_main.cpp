@@ -0,0 +1,98 @@
+// Prometheus output from the metrics, and scrapes from one thread while
+// another records: every histogram in a scrape is one consistent update.
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include "metrics.h"
+
+static size_t scrape(const Metrics& metrics, char* text, size_t size) {
+  MetricsGauges gauges = {};
+  gauges.uptimeSeconds = 42;
+  MetricsWriter writer(metrics, gauges);
+  size_t len = 0;
+  size_t n;
+  while ((n = writer.fill((uint8_t*)text + len, size - 1 - len < 100 ? size - 1 - len : 100)) > 0) {
+    len += n;
+  }
+  text[len] = '\0';
+  return len;
+}
+
+static unsigned long valueOf(const char* text, const char* series) {
+  const char* p = strstr(text, series);
+  unsigned long value = 0;
+  if (p != nullptr) {
+    sscanf(p + strlen(series), " %lu", &value);
+  }
+  return value;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_histogram_lines(void) {
+  static Metrics metrics;
+  metrics.recordRequest(ROUTE_STATUS, 30);
+  metrics.recordRequest(ROUTE_STATUS, 700);
+  metrics.recordRequest(ROUTE_STATUS, 2000000);
+  metrics.setCpuMhz(240);
+  metrics.recordPhase(PHASE_DISPLAY, 240 * 120);
+
+  static char text[16384];
+  scrape(metrics, text, sizeof(text));
+  TEST_ASSERT_NOT_NULL(strstr(text, "countdown_uptime_seconds 42\n"));
+  TEST_ASSERT_NOT_NULL(strstr(text, "http_request_duration_seconds_bucket{route=\"/api/status\",le=\"5e-05\"} 1\n"));
+  TEST_ASSERT_NOT_NULL(strstr(text, "http_request_duration_seconds_bucket{route=\"/api/status\",le=\"0.001\"} 2\n"));
+  TEST_ASSERT_NOT_NULL(strstr(text, "http_request_duration_seconds_bucket{route=\"/api/status\",le=\"+Inf\"} 3\n"));
+  TEST_ASSERT_NOT_NULL(strstr(text, "http_request_duration_seconds_sum{route=\"/api/status\"} 2.000730\n"));
+  TEST_ASSERT_NOT_NULL(strstr(text, "http_request_duration_seconds_count{route=\"/api/status\"} 3\n"));
+  TEST_ASSERT_NOT_NULL(strstr(text, "countdown_phase_duration_seconds_bucket{phase=\"display\",le=\"0.0005\"} 1\n"));
+}
+
+// Every request takes exactly 3 s, so the sum passes 2^32 us early on. A
+// scrape that mixed two updates would show a sum that isn't three seconds
+// per request, or a +Inf bucket that doesn't match the count.
+void test_scrape_while_recording(void) {
+  static Metrics metrics;
+  static const uint32_t US = 3000000;
+  std::atomic<bool> done(false);
+
+  std::thread writer([&]() {
+    for (uint32_t n = 0; n < 3000000; n++) {
+      metrics.recordRequest(ROUTE_HISTORY, US);
+    }
+    done = true;
+  });
+
+  static char text[16384];
+  uint32_t scrapes = 0, inconsistent = 0;
+  unsigned long lastCount = 0;
+  while (!done || scrapes == 0) {
+    scrape(metrics, text, sizeof(text));
+    unsigned long count = valueOf(text, "http_request_duration_seconds_count{route=\"/api/history\"}");
+    unsigned long inf = valueOf(text, "http_request_duration_seconds_bucket{route=\"/api/history\",le=\"+Inf\"}");
+    unsigned long seconds = valueOf(text, "http_request_duration_seconds_sum{route=\"/api/history\"}");
+    if (inf != count || seconds != count * 3 || count < lastCount) {
+      inconsistent++;
+    }
+    lastCount = count;
+    scrapes++;
+  }
+  writer.join();
+
+  char message[64];
+  snprintf(message, sizeof(message), "%u scrapes, last count %lu", scrapes, lastCount);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_TRUE(scrapes > 1);
+  TEST_ASSERT_EQUAL_UINT32(0, inconsistent);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_histogram_lines);
+  RUN_TEST(test_scrape_while_recording);
+  return UNITY_END();
+}
@@ -0,0 +1,242 @@
+// NetworkManager against the simulated network: fallback order, recovery
+// while offline, and how long it takes to get valid time compared with the
+// blocking connect loop it replaced.
+
+#include <unity.h>
+#include <stdio.h>
+#include <chrono>
+#include "sim_hal.h"
+#include "netconn.h"
+
+static const NetworkCredentials CREDENTIALS[2] = {{"home", "password1"}, {"phone", "password2"}};
+
+static int events[8];
+
+static void countEvent(NetworkEvent event, int index) {
+  events[event]++;
+}
+
+struct Rig {
+  SimClock clock;
+  SimNetwork wifi;
+  NetworkManager network;
+  unsigned long nextPoll = 0;
+
+  Rig() : wifi(clock), network(wifi) {
+    network.setNetworks(CREDENTIALS, 2);
+    network.onEvent(countEvent);
+  }
+
+  // Poll whenever the manager asks to be polled, for forMs
+  void run(unsigned long forMs) {
+    unsigned long end = clock.millis() + forMs;
+    while ((long)(end - clock.millis()) > 0) {
+      if ((long)(nextPoll - clock.millis()) <= 0) {
+        nextPoll = clock.millis() + network.poll(clock.millis());
+      }
+      unsigned long wait = (long)(nextPoll - end) < 0 ? nextPoll - clock.millis() : end - clock.millis();
+      clock.advanceMs(wait > 0 ? wait : 1);
+    }
+  }
+
+  void sync() {
+    network.sync(clock.millis());
+    nextPoll = clock.millis();
+  }
+};
+
+// The connect-then-sync loop from before NetworkManager, on the same
+// simulated network: poll every 500 ms for up to 10 s per network, then
+// the same for NTP, with nothing else running meanwhile. Returns how long
+// it blocked; validAtMs gets when time became valid (0 if it didn't).
+static unsigned long blockingConnect(SimClock& clock, SimNetwork& wifi, unsigned long& validAtMs) {
+  unsigned long start = clock.millis();
+  validAtMs = 0;
+  bool connected = false;
+  for (int i = 0; i < 2 && !connected; i++) {
+    wifi.begin(CREDENTIALS[i].ssid, CREDENTIALS[i].password);
+    int attempts = 0;
+    while (!wifi.isConnected() && attempts < 20) {
+      clock.advanceMs(500);
+      attempts++;
+    }
+    if (wifi.isConnected()) {
+      connected = true;
+    } else {
+      wifi.disconnect();
+    }
+  }
+  if (connected) {
+    wifi.startTimeSync();
+    int retries = 0;
+    while (!wifi.timeSynced() && retries < 20) {
+      clock.advanceMs(500);
+      retries++;
+    }
+    if (retries < 20) {
+      validAtMs = clock.millis() - start;
+    }
+  }
+  return clock.millis() - start;
+}
+
+void setUp(void) {
+  memset(events, 0, sizeof(events));
+}
+
+void tearDown(void) {}
+
+void test_connects_and_syncs(void) {
+  Rig rig;
+  rig.wifi.addNetwork("home", true, 3200);
+  rig.wifi.addNetwork("phone", true, 1000);
+  rig.sync();
+  rig.run(60000);
+
+  TEST_ASSERT_EQUAL(NetworkManager::ONLINE, rig.network.state());
+  TEST_ASSERT_EQUAL(0, rig.network.connectedNetwork());
+  TEST_ASSERT_EQUAL(1, events[NET_CONNECTED]);
+  TEST_ASSERT_EQUAL(1, events[NET_TIME_SYNCED]);
+  TEST_ASSERT_EQUAL_UINT32(3500, rig.network.firstSyncLatency());
+}
+
+// The last network that worked is tried first next time
+void test_fallback_prefers_last_good(void) {
+  Rig rig;
+  rig.wifi.addNetwork("home", false, 1000);
+  rig.wifi.addNetwork("phone", true, 1000);
+  rig.sync();
+  rig.run(30000);
+  TEST_ASSERT_EQUAL(1, rig.network.connectedNetwork());
+  TEST_ASSERT_EQUAL(1, events[NET_CONNECT_FAILED]);
+  TEST_ASSERT_EQUAL(1, rig.network.preferredNetwork());
+
+  rig.network.reconnect(rig.clock.millis());
+  rig.nextPoll = rig.clock.millis();
+  rig.run(30000);
+  TEST_ASSERT_EQUAL(1, rig.network.connectedNetwork());
+  TEST_ASSERT_EQUAL(1, events[NET_CONNECT_FAILED]);  // home wasn't tried
+  TEST_ASSERT_EQUAL_UINT32(3, rig.network.connectAttempts());
+}
+
+// The WiFi stack rejoins by itself after a drop: the manager notices and
+// syncs again instead of sitting offline until the next scheduled sync
+void test_rejoins_after_drop(void) {
+  Rig rig;
+  rig.wifi.addNetwork("home", true, 1000);
+  rig.sync();
+  rig.run(10000);
+  TEST_ASSERT_EQUAL(NetworkManager::ONLINE, rig.network.state());
+
+  rig.wifi.drop();
+  rig.run(NetworkManager::IDLE_POLL_MS);
+  TEST_ASSERT_EQUAL(NetworkManager::OFFLINE, rig.network.state());
+  TEST_ASSERT_EQUAL(1, events[NET_LOST]);
+
+  rig.run(NetworkManager::IDLE_POLL_MS + 1000);
+  TEST_ASSERT_EQUAL(NetworkManager::ONLINE, rig.network.state());
+  TEST_ASSERT_EQUAL(2, events[NET_CONNECTED]);
+  TEST_ASSERT_EQUAL_UINT32(2, rig.network.timeSyncs());
+  TEST_ASSERT_EQUAL_UINT32(1, rig.network.connectAttempts());  // No begin() needed
+}
+
+// With nothing to join, rounds of attempts back off to the cap, and a
+// successful connection resets the backoff
+void test_reconnect_backoff(void) {
+  Rig rig;
+  rig.wifi.addNetwork("home", false, 1000);
+  rig.wifi.addNetwork("phone", false, 1000);
+  rig.sync();
+  rig.run(30000);
+  TEST_ASSERT_EQUAL(NetworkManager::OFFLINE, rig.network.state());
+  TEST_ASSERT_EQUAL(1, events[NET_ALL_FAILED]);
+  TEST_ASSERT_EQUAL_UINT32(NetworkManager::RETRY_MIN_MS, rig.network.retryDelay());
+
+  // Rounds after 30 s, 1, 2, 4, 8, 16, 30, 30 min
+  rig.run(((30 + 60 + 120 + 240 + 480 + 960 + 1800 + 1800) + 20 * 8) * 1000UL);
+  TEST_ASSERT_EQUAL(9, events[NET_ALL_FAILED]);
+  TEST_ASSERT_EQUAL_UINT32(NetworkManager::RETRY_MAX_MS, rig.network.retryDelay());
+
+  rig.wifi.network("phone")->available = true;
+  rig.run(NetworkManager::RETRY_MAX_MS + 30000);
+  TEST_ASSERT_EQUAL(NetworkManager::ONLINE, rig.network.state());
+  TEST_ASSERT_EQUAL(1, rig.network.connectedNetwork());
+  TEST_ASSERT_EQUAL_UINT32(NetworkManager::RETRY_MIN_MS, rig.network.retryDelay());
+}
+
+// In low power mode the radio goes off after a failed round and stays off
+// until the next sync()
+void test_no_retry_without_stay_connected(void) {
+  Rig rig;
+  rig.network.setStayConnected(false);
+  rig.wifi.addNetwork("home", false, 1000);
+  rig.wifi.addNetwork("phone", false, 1000);
+  rig.sync();
+  rig.run(3600000);
+  TEST_ASSERT_EQUAL(NetworkManager::OFFLINE, rig.network.state());
+  TEST_ASSERT_FALSE(rig.wifi.radioOn());
+  TEST_ASSERT_EQUAL_UINT32(2, rig.network.connectAttempts());
+}
+
+// Time to first valid time and time the loop was blocked, for the
+// blocking loop and for NetworkManager, on the same networks
+void test_latency_against_blocking(void) {
+  struct Case {
+    const char* name;
+    bool homeUp;
+    unsigned long homeDelay;
+    bool phoneUp;
+    unsigned long phoneDelay;
+  };
+  static const Case cases[] = {
+      {"first network", true, 3200, true, 1000},
+      {"second network", false, 0, true, 6100},
+      {"no network", false, 0, false, 0},
+  };
+
+  for (const Case& c : cases) {
+    SimClock oldClock;
+    SimNetwork oldWifi(oldClock);
+    oldWifi.addNetwork("home", c.homeUp, c.homeDelay);
+    oldWifi.addNetwork("phone", c.phoneUp, c.phoneDelay);
+    unsigned long oldValidAt;
+    unsigned long oldBlocked = blockingConnect(oldClock, oldWifi, oldValidAt);
+
+    Rig rig;
+    rig.wifi.addNetwork("home", c.homeUp, c.homeDelay);
+    rig.wifi.addNetwork("phone", c.phoneUp, c.phoneDelay);
+    uint32_t polls = 0;
+    double pollSeconds = 0;
+    rig.sync();
+    while (rig.network.isBusy()) {
+      auto start = std::chrono::steady_clock::now();
+      unsigned long next = rig.network.poll(rig.clock.millis());
+      pollSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      polls++;
+      rig.clock.advanceMs(next);
+    }
+    unsigned long newValidAt = rig.network.firstSyncLatency();
+
+    // Never later than the blocking loop, which only looked every 500 ms
+    TEST_ASSERT_TRUE(newValidAt <= oldValidAt);
+    TEST_ASSERT_EQUAL(oldValidAt == 0, newValidAt == 0);
+
+    char message[200];
+    snprintf(message, sizeof(message),
+             "%s: valid time after %lu ms (blocking %lu ms, 0 = never); loop blocked %.3f ms "
+             "over %u polls (blocking %lu ms)",
+             c.name, newValidAt, oldValidAt, pollSeconds * 1000, polls, oldBlocked);
+    TEST_MESSAGE(message);
+  }
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_connects_and_syncs);
+  RUN_TEST(test_fallback_prefers_last_good);
+  RUN_TEST(test_rejoins_after_drop);
+  RUN_TEST(test_reconnect_backoff);
+  RUN_TEST(test_no_retry_without_stay_connected);
+  RUN_TEST(test_latency_against_blocking);
+  return UNITY_END();
+}
@@ -0,0 +1,347 @@
+// Firmware updates end to end on a simulated flash: an upload the way
+// /update's handlers feed it to OtaUpdate, a hash that doesn't match, an
+// image cut short, and the probation after reboot, confirmed by the
+// status report task's health check or rolled back.
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "sim_firmware.h"
+#include "ota.h"
+#include "sha256.h"
+
+static const unsigned long STATUS_REPORT_INTERVAL = 60000;  // main.cpp's statusReportTask
+static const unsigned long STATUS_REPORT_DELAY = 1000;
+static const size_t NO_DROP = (size_t)-1;
+
+// An ESP image: header, segments of the given sizes, padding and checksum
+static std::vector<uint8_t> makeImage(const std::vector<uint32_t>& segments, uint32_t seed) {
+  std::vector<uint8_t> image(24, 0);
+  image[0] = SimFirmwareSlot::IMAGE_MAGIC;
+  image[1] = segments.size();
+  image[12] = 9;  // ESP32-S3
+  uint8_t checksum = 0xEF;
+  srand(seed);
+  for (uint32_t size : segments) {
+    uint8_t header[8] = {0, 0, 0x38, 0x3C, (uint8_t)size, (uint8_t)(size >> 8), (uint8_t)(size >> 16), 0};
+    image.insert(image.end(), header, header + 8);
+    for (uint32_t i = 0; i < size; i++) {
+      uint8_t byte = rand();
+      checksum ^= byte;
+      image.push_back(byte);
+    }
+  }
+  image.resize((image.size() | 15) + 1, 0);
+  image.back() = checksum;
+  return image;
+}
+
+static std::string hexDigest(Sha256& hash) {
+  uint8_t digest[Sha256::DIGEST_BYTES];
+  hash.finish(digest);
+  char hex[2 * Sha256::DIGEST_BYTES + 1];
+  for (size_t i = 0; i < Sha256::DIGEST_BYTES; i++) {
+    snprintf(hex + 2 * i, 3, "%02x", digest[i]);
+  }
+  return hex;
+}
+
+static std::string sha256Hex(const uint8_t* data, size_t length) {
+  Sha256 hash;
+  hash.begin();
+  hash.update(data, length);
+  return hexDigest(hash);
+}
+
+static std::string sha256Hex(const std::vector<uint8_t>& data) {
+  return sha256Hex(data.data(), data.size());
+}
+
+struct Response {
+  int status;
+  std::string error;
+};
+
+// Stands in for the web server: the upload arrives in TCP-segment sized
+// chunks of uneven length, handed over as /update's upload handler gets
+// them (begin on the first, write each, finish on the last). A connection
+// dropped after dropAfter bytes aborts, as onDisconnect does, and the
+// request handler reports the outcome.
+static Response postUpdate(OtaUpdate& ota, const std::vector<uint8_t>& body, const std::string& sha,
+                           size_t dropAfter = NO_DROP) {
+  size_t index = 0;
+  uint32_t chunk = 0;
+  do {
+    size_t len = 536 + (chunk++ * 389) % 1100;
+    if (len > body.size() - index) len = body.size() - index;
+    if (index + len > dropAfter) {
+      ota.abort();
+      return {0, ota.error()};
+    }
+    if (index == 0) {
+      ota.begin(sha.c_str());
+    }
+    if (len > 0) {
+      ota.write(body.data() + index, len);
+    }
+    index += len;
+    if (index == body.size()) {
+      ota.finish();
+    }
+  } while (index < body.size());
+
+  ota.abort();  // Only does anything if the upload was cut short
+  return {ota.succeeded() ? 200 : 400, ota.error()};
+}
+
+// Boot and run statusReportTask's health check on its schedule until
+// untilMs. reachableAt is when the web server came up, -1 for never.
+static void runAfterBoot(FirmwareHealth& health, unsigned long untilMs, long reachableAt) {
+  health.begin();
+  for (unsigned long now = STATUS_REPORT_DELAY; now <= untilMs; now += STATUS_REPORT_INTERVAL) {
+    bool reachable = reachableAt >= 0 && now >= (unsigned long)reachableAt;
+    if (health.check(now, reachable) == FirmwareHealth::FAILED) {
+      health.rollback();
+      return;
+    }
+  }
+}
+
+static SimFirmwareSlot* flash;
+static std::vector<uint8_t> image;
+
+void setUp(void) {
+  flash = new SimFirmwareSlot();
+  image = makeImage({40000, 12345, 3000}, 1);
+}
+
+void tearDown(void) {
+  delete flash;
+}
+
+// Known answers, and any split of the input into pieces gives the same
+// digest
+void test_sha256(void) {
+  TEST_ASSERT_EQUAL_STRING("e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
+                           sha256Hex(nullptr, 0).c_str());
+  TEST_ASSERT_EQUAL_STRING("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+                           sha256Hex((const uint8_t*)"abc", 3).c_str());
+  const char* two = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+  TEST_ASSERT_EQUAL_STRING("248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1",
+                           sha256Hex((const uint8_t*)two, strlen(two)).c_str());
+  std::vector<uint8_t> million(1000000, 'a');
+  TEST_ASSERT_EQUAL_STRING("cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0",
+                           sha256Hex(million).c_str());
+
+  std::string whole = sha256Hex(image);
+  for (size_t piece : {1, 3, 55, 56, 63, 64, 65, 1436}) {
+    Sha256 hash;
+    hash.begin();
+    for (size_t i = 0; i < image.size(); i += piece) {
+      hash.update(image.data() + i, piece < image.size() - i ? piece : image.size() - i);
+    }
+    TEST_ASSERT_EQUAL_STRING(whole.c_str(), hexDigest(hash).c_str());
+  }
+
+  // Reusable after finish
+  Sha256 hash;
+  hash.begin();
+  hash.update((const uint8_t*)"x", 1);
+  hexDigest(hash);
+  hash.begin();
+  hash.update((const uint8_t*)"abc", 3);
+  TEST_ASSERT_EQUAL_STRING(sha256Hex((const uint8_t*)"abc", 3).c_str(), hexDigest(hash).c_str());
+}
+
+// A good image: written, made bootable, on probation after the reboot and
+// kept once the web server is up after a minute
+void test_update_and_confirm(void) {
+  OtaUpdate ota(*flash);
+  Response response = postUpdate(ota, image, sha256Hex(image));
+  TEST_ASSERT_EQUAL_INT(200, response.status);
+  TEST_ASSERT_EQUAL_UINT32(image.size(), ota.written());
+  TEST_ASSERT_EQUAL_MEMORY(image.data(), flash->partitions[1].data(), image.size());
+  TEST_ASSERT_EQUAL_UINT8(1, flash->boot);
+  TEST_ASSERT_EQUAL_UINT8(0, flash->running);  // Until the restart
+
+  flash->reboot();
+  FirmwareHealth health(*flash);
+  TEST_ASSERT_TRUE(flash->pendingVerify());
+  runAfterBoot(health, 10 * 60000, 20000);
+  TEST_ASSERT_FALSE(health.pending());
+  TEST_ASSERT_EQUAL(SimFirmwareSlot::VALID, flash->states[1]);
+
+  flash->reboot();  // Kept from now on
+  TEST_ASSERT_EQUAL_UINT8(1, flash->running);
+  TEST_ASSERT_FALSE(flash->pendingVerify());
+  TEST_ASSERT_EQUAL_UINT32(0, flash->rollbacks);
+}
+
+// Not confirmed before a minute has passed, even with the server up
+void test_confirmed_after_a_minute(void) {
+  OtaUpdate ota(*flash);
+  postUpdate(ota, image, sha256Hex(image));
+  flash->reboot();
+  FirmwareHealth health(*flash);
+  health.begin();
+  TEST_ASSERT_EQUAL(FirmwareHealth::WAITING, health.check(1000, true));
+  TEST_ASSERT_EQUAL(FirmwareHealth::WAITING, health.check(FirmwareHealth::HEALTHY_AFTER_MS - 1, true));
+  TEST_ASSERT_EQUAL(SimFirmwareSlot::PENDING_VERIFY, flash->states[1]);
+  TEST_ASSERT_EQUAL(FirmwareHealth::CONFIRMED, health.check(FirmwareHealth::HEALTHY_AFTER_MS, true));
+  TEST_ASSERT_EQUAL(FirmwareHealth::SETTLED, health.check(FirmwareHealth::DEADLINE_MS, false));
+}
+
+// A corrupted byte in transit, or the wrong hash: refused, and the next
+// boot is still the running image
+void test_sha256_mismatch(void) {
+  OtaUpdate ota(*flash);
+  std::string sha = sha256Hex(image);
+  std::vector<uint8_t> corrupted = image;
+  corrupted[corrupted.size() / 2] ^= 0x10;
+  Response response = postUpdate(ota, corrupted, sha);
+  TEST_ASSERT_EQUAL_INT(400, response.status);
+  TEST_ASSERT_EQUAL_STRING("sha256 mismatch", response.error.c_str());
+  TEST_ASSERT_EQUAL_UINT8(0, flash->boot);
+
+  sha[10] = sha[10] == '0' ? '1' : '0';
+  response = postUpdate(ota, image, sha);
+  TEST_ASSERT_EQUAL_STRING("sha256 mismatch", response.error.c_str());
+  TEST_ASSERT_EQUAL_UINT8(0, flash->boot);
+
+  response = postUpdate(ota, image, "not a hash");
+  TEST_ASSERT_EQUAL_INT(400, response.status);
+  TEST_ASSERT_EQUAL_STRING("sha256 must be 64 hex digits", response.error.c_str());
+
+  flash->reboot();
+  TEST_ASSERT_EQUAL_UINT8(0, flash->running);
+  TEST_ASSERT_FALSE(flash->pendingVerify());
+}
+
+// Cut short three ways: the connection drops part way (anywhere from the
+// first sector to the last), the body ends early against the full image's
+// hash, and a short image sent with its own hash, which the image check
+// turns away
+void test_truncated_image(void) {
+  OtaUpdate ota(*flash);
+  std::string sha = sha256Hex(image);
+  for (size_t drop = 1000; drop < image.size(); drop += 2711) {
+    Response response = postUpdate(ota, image, sha, drop);
+    TEST_ASSERT_EQUAL_STRING("aborted", response.error.c_str());
+    TEST_ASSERT_FALSE(ota.active());
+    TEST_ASSERT_EQUAL_UINT8(0, flash->boot);
+  }
+
+  std::vector<uint8_t> shortBody(image.begin(), image.begin() + image.size() - 1000);
+  Response response = postUpdate(ota, shortBody, sha);
+  TEST_ASSERT_EQUAL_STRING("sha256 mismatch", response.error.c_str());
+
+  for (size_t cut : {(size_t)1, (size_t)16, (size_t)1000, image.size() / 2, image.size() - 30}) {
+    std::vector<uint8_t> shortImage(image.begin(), image.end() - cut);
+    response = postUpdate(ota, shortImage, sha256Hex(shortImage));
+    TEST_ASSERT_EQUAL_INT(400, response.status);
+    TEST_ASSERT_EQUAL_STRING("image rejected", response.error.c_str());
+    TEST_ASSERT_EQUAL_UINT8(0, flash->boot);
+  }
+
+  // The same upload whole goes through afterwards
+  TEST_ASSERT_EQUAL_INT(200, postUpdate(ota, image, sha).status);
+}
+
+// Not an image at all, or bigger than the partition
+void test_bad_and_oversized_images(void) {
+  OtaUpdate ota(*flash);
+  std::vector<uint8_t> text(5000, 'x');
+  Response response = postUpdate(ota, text, sha256Hex(text));
+  TEST_ASSERT_EQUAL_STRING("write failed", response.error.c_str());
+
+  std::vector<uint8_t> huge = makeImage({SimFirmwareSlot::PARTITION_BYTES}, 2);
+  response = postUpdate(ota, huge, sha256Hex(huge));
+  TEST_ASSERT_EQUAL_STRING("write failed", response.error.c_str());
+  TEST_ASSERT_EQUAL_UINT8(0, flash->boot);
+}
+
+// Power lost mid-upload: the old image boots as if nothing happened
+void test_power_cut_while_writing(void) {
+  OtaUpdate ota(*flash);
+  ota.begin(sha256Hex(image).c_str());
+  ota.write(image.data(), 10000);
+  flash->reboot();
+  TEST_ASSERT_EQUAL_UINT8(0, flash->running);
+  TEST_ASSERT_EQUAL(SimFirmwareSlot::VALID, flash->states[0]);
+  TEST_ASSERT_FALSE(flash->pendingVerify());
+}
+
+// The new image never gets the web server up: at the 5 minute deadline
+// the status report task rolls back, and the old image runs again
+void test_rollback_when_unhealthy(void) {
+  OtaUpdate ota(*flash);
+  postUpdate(ota, image, sha256Hex(image));
+  flash->reboot();
+  FirmwareHealth health(*flash);
+  uint32_t boots = flash->boots;
+  runAfterBoot(health, 10 * 60000, -1);
+
+  TEST_ASSERT_EQUAL_UINT32(1, flash->rollbacks);
+  TEST_ASSERT_EQUAL_UINT32(boots + 1, flash->boots);
+  TEST_ASSERT_EQUAL_UINT8(0, flash->running);
+  TEST_ASSERT_EQUAL(SimFirmwareSlot::INVALID, flash->states[1]);
+  FirmwareHealth after(*flash);
+  after.begin();
+  TEST_ASSERT_FALSE(after.pending());
+
+  // Server up too late counts as unhealthy too
+  postUpdate(ota, image, sha256Hex(image));
+  flash->reboot();
+  runAfterBoot(health, 10 * 60000, FirmwareHealth::DEADLINE_MS + 30000);
+  TEST_ASSERT_EQUAL_UINT32(2, flash->rollbacks);
+  TEST_ASSERT_EQUAL_UINT8(0, flash->running);
+}
+
+// A crash or reset while on probation: the bootloader goes back by itself
+void test_reset_during_probation(void) {
+  OtaUpdate ota(*flash);
+  postUpdate(ota, image, sha256Hex(image));
+  flash->reboot();
+  FirmwareHealth health(*flash);
+  health.begin();
+  TEST_ASSERT_EQUAL(FirmwareHealth::WAITING, health.check(30000, true));
+  flash->reboot();
+  TEST_ASSERT_EQUAL_UINT8(0, flash->running);
+  TEST_ASSERT_EQUAL(SimFirmwareSlot::INVALID, flash->states[1]);
+  TEST_ASSERT_EQUAL_UINT32(0, flash->rollbacks);
+}
+
+// An update from the updated firmware goes to the other partition
+void test_second_update(void) {
+  OtaUpdate ota(*flash);
+  postUpdate(ota, image, sha256Hex(image));
+  flash->reboot();
+  FirmwareHealth health(*flash);
+  runAfterBoot(health, 2 * 60000, 0);
+  TEST_ASSERT_EQUAL_UINT8(1, flash->running);
+
+  std::vector<uint8_t> next = makeImage({30000, 500}, 3);
+  TEST_ASSERT_EQUAL_INT(200, postUpdate(ota, next, sha256Hex(next)).status);
+  TEST_ASSERT_EQUAL_MEMORY(next.data(), flash->partitions[0].data(), next.size());
+  flash->reboot();
+  TEST_ASSERT_EQUAL_UINT8(0, flash->running);
+  TEST_ASSERT_TRUE(flash->pendingVerify());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_sha256);
+  RUN_TEST(test_update_and_confirm);
+  RUN_TEST(test_confirmed_after_a_minute);
+  RUN_TEST(test_sha256_mismatch);
+  RUN_TEST(test_truncated_image);
+  RUN_TEST(test_bad_and_oversized_images);
+  RUN_TEST(test_power_cut_while_writing);
+  RUN_TEST(test_rollback_when_unhealthy);
+  RUN_TEST(test_reset_during_probation);
+  RUN_TEST(test_second_update);
+  return UNITY_END();
+}
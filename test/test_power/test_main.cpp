@@ -0,0 +1,188 @@
+// Power simulation: main.cpp's loop (run what's due, then light sleep or
+// wait until the next deadline) on simulated time, with a battery that
+// drains at what the board really draws in each state. Reports mAh/day
+// per mode and checks PowerModel's accounting and calibration against the
+// charge the battery actually lost.
+
+#include <unity.h>
+#include <stdio.h>
+#include "sim_hal.h"
+#include "scheduler.h"
+#include "netconn.h"
+#include "power.h"
+
+static const float BATTERY_MAH = 500.0f;     // The Feather's usual LiPo
+static const float BIG_BATTERY_MAH = 5000.0f;  // Enough not to run flat in a day always on
+static const unsigned long MIN_LIGHT_SLEEP_MS = 20;
+static const unsigned long TASK_MS = 2;  // CPU time per task run: I2C write, fuel gauge read
+
+struct Mode {
+  const char* name;
+  bool lowPower;
+  unsigned long displayTickMs;
+  unsigned long ntpIntervalMs;
+};
+
+struct PowerSim {
+  SimClock clock;
+  SimFuelGauge gauge;
+  SimNetwork wifi;
+  NetworkManager network;
+  Scheduler scheduler;
+  PowerModel model;
+  NetworkCredentials credentials[1] = {{"home", "password"}};
+  const Mode& mode;
+  float capacity;
+  float boardScale;  // How far this board's real draw is from the typical figures
+  int networkTask = -1;
+  unsigned long busyMs = 0;
+
+  PowerSim(const Mode& mode, float capacity, float boardScale)
+      : gauge(clock, capacity, 100.0f), wifi(clock), network(wifi), mode(mode), capacity(capacity),
+        boardScale(boardScale) {
+    wifi.addNetwork("home", true, 2500);
+    network.setNetworks(credentials, 1);
+    network.setStayConnected(!mode.lowPower);
+  }
+
+  // Spend ms in one state, draining the battery at the board's real draw
+  void spend(unsigned long ms, bool asleep, bool radio) {
+    FuelGaugeReading reading;
+    gauge.read(reading);  // Settle the charge up to now at the old load
+    float typical = asleep ? PowerModel::LIGHT_SLEEP_MA : radio ? PowerModel::RADIO_MA : PowerModel::AWAKE_MA;
+    gauge.loadMa = typical * boardScale;
+    clock.advanceMs(ms);
+  }
+
+  // Run for forMs, calibrating the model every hour from the charge lost
+  // that hour, as the fuel gauge's rate would
+  void run(uint64_t forMs, bool calibrate) {
+    uint64_t end = clock.monotonicUs() / 1000 + forMs;
+    uint64_t hourStart = clock.monotonicUs() / 1000;
+    float hourCharge = gauge.percent();
+    while ((uint64_t)clock.monotonicUs() / 1000 < end) {
+      busyMs = 0;
+      scheduler.runDue(clock.millis());
+      bool radio = network.radioActive();
+      spend(busyMs, false, radio);
+
+      unsigned long wait = scheduler.msUntilNext(clock.millis());
+      bool sleep = mode.lowPower && !radio && wait >= MIN_LIGHT_SLEEP_MS;
+      spend(wait, sleep, radio);
+      unsigned long elapsed = busyMs + wait;
+      model.account(elapsed, sleep ? wait : 0, radio ? elapsed : 0);
+
+      uint64_t nowMs = clock.monotonicUs() / 1000;
+      if (nowMs - hourStart >= 3600000) {
+        FuelGaugeReading reading;
+        gauge.read(reading);
+        float rate = (gauge.percent() - hourCharge) * 3600000.0f / (nowMs - hourStart);
+        if (calibrate) {
+          model.calibrate(rate, capacity);
+        }
+        hourStart = nowMs;
+        hourCharge = gauge.percent();
+      }
+    }
+  }
+
+  float usedMah() {
+    FuelGaugeReading reading;
+    gauge.read(reading);
+    return (100.0f - gauge.percent()) * capacity / 100.0f;
+  }
+};
+
+static PowerSim* sim;
+
+static void displayTask(unsigned long now) { sim->busyMs += TASK_MS; }
+static void batteryTask(unsigned long now) { sim->busyMs += TASK_MS; }
+static void networkTask(unsigned long now) {
+  sim->busyMs += 1;
+  sim->scheduler.runAfter(sim->networkTask, now, sim->network.poll(now));
+}
+static void ntpTask(unsigned long now) {
+  sim->network.sync(now);
+  sim->scheduler.runAfter(sim->networkTask, now, 0);
+}
+
+static void boot(PowerSim& s) {
+  sim = &s;
+  unsigned long now = s.clock.millis();
+  s.scheduler.addTask("display", s.mode.displayTickMs, displayTask, now);
+  s.scheduler.addTask("battery", 300000, batteryTask, now);
+  s.networkTask = s.scheduler.addTask("wifi", NetworkManager::ACTIVE_POLL_MS, networkTask, now);
+  s.scheduler.addTask("ntp", s.mode.ntpIntervalMs, ntpTask, now);
+}
+
+static const Mode ALWAYS_ON = {"always on", false, 500, 3600000};
+static const Mode LOW_POWER_HOURLY = {"low power, hourly sync", true, 1000, 3600000};
+static const Mode LOW_POWER_DAILY = {"low power, daily sync", true, 1000, 86400000};
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// Over a simulated day, the model's mAh/day for each mode matches what the
+// battery lost, and low power mode is what makes the battery last
+void test_mah_per_day_by_mode(void) {
+  static const Mode* modes[] = {&ALWAYS_ON, &LOW_POWER_HOURLY, &LOW_POWER_DAILY};
+  float perDay[3];
+  for (int i = 0; i < 3; i++) {
+    PowerSim s(*modes[i], BIG_BATTERY_MAH, 1.0f);
+    boot(s);
+    s.run(86400000ULL, false);
+    perDay[i] = s.model.measuredMAhPerDay();
+    float used = s.usedMah();
+    TEST_ASSERT_FLOAT_WITHIN(used * 0.02f + 0.5f, used, perDay[i]);
+
+    char message[160];
+    snprintf(message, sizeof(message), "%s: awake %.2f%%, radio %.3f%%, %.1f mAh/day, %.1f days on %.0f mAh",
+             modes[i]->name, s.model.awakeDuty() * 100.0f, s.model.radioDuty() * 100.0f, perDay[i],
+             BATTERY_MAH / perDay[i], BATTERY_MAH);
+    TEST_MESSAGE(message);
+  }
+
+  TEST_ASSERT_FLOAT_WITHIN(1.0f, PowerModel::RADIO_MA * 24.0f, perDay[0]);
+  TEST_ASSERT_TRUE(perDay[1] < perDay[0] / 20.0f);
+  TEST_ASSERT_TRUE(perDay[2] < perDay[1]);
+  // Light sleep floor plus the tasks' CPU time
+  TEST_ASSERT_TRUE(perDay[2] > PowerModel::LIGHT_SLEEP_MA * 24.0f);
+}
+
+// A board drawing 30% more than the typical figures: hourly calibration
+// from the battery's discharge pulls the projection onto the real draw
+void test_calibration_follows_the_battery(void) {
+  PowerSim s(LOW_POWER_HOURLY, BATTERY_MAH, 1.3f);
+  boot(s);
+  s.run(2 * 86400000ULL, true);
+
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, 1.3f, s.model.calibration());
+  float used = s.usedMah() / 2.0f;
+  TEST_ASSERT_FLOAT_WITHIN(used * 0.05f, used, s.model.measuredMAhPerDay());
+}
+
+// The low power projection /api/status shows while running always on
+// (nominal 1% awake plus the radio time per sync) is in the right range
+// for what low power mode then measures
+void test_projection_from_always_on(void) {
+  PowerSim on(ALWAYS_ON, BIG_BATTERY_MAH, 1.0f);
+  boot(on);
+  on.run(3600000ULL, false);
+  float radio = 10000.0f / 3600000.0f;  // nominalRadioOnPerSyncMs, hourly
+  float projected = on.model.mAhPerDay(0.01f + radio, radio);
+
+  PowerSim low(LOW_POWER_HOURLY, BATTERY_MAH, 1.0f);
+  boot(low);
+  low.run(86400000ULL, false);
+  float measured = low.model.measuredMAhPerDay();
+  TEST_ASSERT_TRUE(measured < projected);
+  TEST_ASSERT_TRUE(measured > projected / 4.0f);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_mah_per_day_by_mode);
+  RUN_TEST(test_calibration_follows_the_battery);
+  RUN_TEST(test_projection_from_always_on);
+  return UNITY_END();
+}
@@ -0,0 +1,247 @@
+// The response buffer pool: slicing a body out to the connection, claims
+// and releases, and what it saves over formatting on the stack and copying
+// into a heap buffer the way beginResponseStream does.
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <new>
+#include "responsebuf.h"
+#include "status.h"
+#include "jsonwriter.h"
+
+static const size_t SEGMENT = 1436;  // What lwIP offers per filler call, roughly one TCP segment
+static const size_t STATUS_JSON_SIZE = 1536;
+
+// Count heap allocations while counting is on
+static bool counting = false;
+static uint32_t allocations = 0;
+static size_t allocatedBytes = 0;
+
+static void* countedAlloc(size_t size) {
+  if (counting) {
+    allocations++;
+    allocatedBytes += size;
+  }
+  void* p = malloc(size > 0 ? size : 1);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void* operator new(size_t size) { return countedAlloc(size); }
+void* operator new[](size_t size) { return countedAlloc(size); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+static StatusSnapshot sampleStatus() {
+  StatusSnapshot status = {};
+  status.days = 87;
+  status.eventYear = 2025;
+  strcpy(status.event, "Christmas");
+  status.year = 2025;
+  status.month = 9;
+  status.day = 29;
+  status.hour = 14;
+  status.min = 3;
+  status.sec = 12;
+  strcpy(status.ssid, "home");
+  strcpy(status.ip, "192.168.1.42");
+  status.rssi = -61;
+  status.batteryVoltage = 3.98f;
+  status.batteryPercent = 81;
+  status.batteryStatus = BATTERY_DISCHARGING;
+  return status;
+}
+
+static size_t formatStatus(char* buffer, size_t size, const StatusSnapshot& status) {
+  JsonWriter json(buffer, size);
+  json.beginObject();
+  writeStatusFields(json, status);
+  for (int i = 0; i < 32; i++) {  // Diagnostics, about as many as /api/status carries
+    char key[24];
+    snprintf(key, sizeof(key), "diagnosticValue%d", i);
+    json.addFloat(key, i * 1.25f, 2);
+  }
+  json.endObject();
+  return json.length();
+}
+
+// What the web server does with the body of a response: pull it out in
+// segment-sized slices. Returns a checksum so the work isn't optimised away.
+static uint32_t drain(const ResponseBuffer& body) {
+  uint8_t segment[SEGMENT];
+  uint32_t sum = 0;
+  size_t index = 0;
+  size_t n;
+  while ((n = body.read(segment, sizeof(segment), index)) > 0) {
+    sum += segment[0] + segment[n - 1];
+    index += n;
+  }
+  return sum;
+}
+
+// The old path: format on the stack, copy into a heap buffer the size of
+// the body (beginResponseStream's cbuf), then drain that
+static uint32_t streamResponse(const StatusSnapshot& status) {
+  char json[STATUS_JSON_SIZE];
+  size_t len = formatStatus(json, sizeof(json), status);
+  char* cbuf = new char[len];
+  memcpy(cbuf, json, len);
+  uint8_t segment[SEGMENT];
+  uint32_t sum = 0;
+  for (size_t index = 0; index < len;) {
+    size_t n = len - index < SEGMENT ? len - index : SEGMENT;
+    memcpy(segment, cbuf + index, n);
+    sum += segment[0] + segment[n - 1];
+    index += n;
+  }
+  delete[] cbuf;
+  return sum;
+}
+
+static uint32_t pooledResponse(ResponseBufferPool& pool, const StatusSnapshot& status) {
+  ResponseBuffer* body = pool.claim();
+  body->setLength(formatStatus(body->data(), STATUS_JSON_SIZE, status));
+  uint32_t sum = drain(*body);
+  pool.release(body);
+  return sum;
+}
+
+static ResponseBufferPool pool;
+
+void setUp(void) {
+  counting = false;
+  allocations = 0;
+  allocatedBytes = 0;
+}
+
+void tearDown(void) {}
+
+// Any slice size reassembles the body exactly, and reading past the end
+// gives nothing
+void test_read_in_slices(void) {
+  ResponseBuffer* body = pool.claim();
+  TEST_ASSERT_NOT_NULL(body);
+  size_t len = formatStatus(body->data(), body->capacity(), sampleStatus());
+  body->setLength(len);
+  TEST_ASSERT_TRUE(len > 1024);
+
+  static const size_t sizes[] = {1, 7, 64, 512, SEGMENT, ResponseBuffer::SIZE};
+  for (size_t maxLen : sizes) {
+    char copy[ResponseBuffer::SIZE];
+    size_t index = 0;
+    size_t n;
+    while ((n = body->read((uint8_t*)copy + index, maxLen, index)) > 0) {
+      TEST_ASSERT_TRUE(n <= maxLen);
+      index += n;
+    }
+    TEST_ASSERT_EQUAL_UINT32(len, index);
+    TEST_ASSERT_EQUAL_MEMORY(body->data(), copy, len);
+  }
+  uint8_t byte;
+  TEST_ASSERT_EQUAL_UINT32(0, body->read(&byte, 1, len + 10));
+  pool.release(body);
+}
+
+void test_claim_and_release(void) {
+  ResponseBuffer* held[ResponseBufferPool::BUFFERS];
+  for (uint8_t i = 0; i < ResponseBufferPool::BUFFERS; i++) {
+    held[i] = pool.claim();
+    TEST_ASSERT_NOT_NULL(held[i]);
+    for (uint8_t j = 0; j < i; j++) {
+      TEST_ASSERT_TRUE(held[i] != held[j]);
+    }
+  }
+  TEST_ASSERT_EQUAL_UINT8(ResponseBufferPool::BUFFERS, pool.inUse());
+  TEST_ASSERT_NULL(pool.claim());
+  TEST_ASSERT_EQUAL_UINT32(1, pool.exhausted());
+
+  held[1]->setLength(5);
+  pool.release(held[1]);
+  ResponseBuffer* again = pool.claim();
+  TEST_ASSERT_EQUAL_PTR(held[1], again);
+  TEST_ASSERT_EQUAL_UINT32(0, again->length());  // Starts empty
+
+  for (uint8_t i = 0; i < ResponseBufferPool::BUFFERS; i++) {
+    pool.release(held[i]);
+  }
+  pool.release(nullptr);
+  TEST_ASSERT_EQUAL_UINT8(0, pool.inUse());
+}
+
+// A pooled response touches the heap not at all; the stream path makes a
+// body-sized allocation per request
+void test_allocations_per_response(void) {
+  StatusSnapshot status = sampleStatus();
+  counting = true;
+  uint32_t pooledSum = pooledResponse(pool, status);
+  counting = false;
+  TEST_ASSERT_EQUAL_UINT32(0, allocations);
+
+  counting = true;
+  uint32_t streamSum = streamResponse(status);
+  counting = false;
+  TEST_ASSERT_EQUAL_UINT32(1, allocations);
+  TEST_ASSERT_TRUE(allocatedBytes > 1024);
+  TEST_ASSERT_EQUAL_UINT32(streamSum, pooledSum);
+
+  char message[96];
+  snprintf(message, sizeof(message), "stream path: %u allocation of %u bytes per /api/status",
+           allocations, (unsigned)allocatedBytes);
+  TEST_MESSAGE(message);
+}
+
+void test_benchmark(void) {
+  static const int ROUNDS = 200000;
+  StatusSnapshot status = sampleStatus();
+  volatile uint32_t sink = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < ROUNDS; i++) {
+    status.sec = i % 60;
+    sink += streamResponse(status);
+  }
+  double streamNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / ROUNDS;
+
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < ROUNDS; i++) {
+    status.sec = i % 60;
+    sink += pooledResponse(pool, status);
+  }
+  double pooledNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / ROUNDS;
+
+  // The copy the pool saves, with the formatting (the same for both) taken out
+  char json[STATUS_JSON_SIZE];
+  size_t len = formatStatus(json, sizeof(json), status);
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < ROUNDS; i++) {
+    char* cbuf = new char[len];
+    memcpy(cbuf, json, len);
+    sink += cbuf[i % len];
+    delete[] cbuf;
+  }
+  double copyNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / ROUNDS;
+
+  char message[160];
+  snprintf(message, sizeof(message),
+           "/api/status: stack + heap copy %.0f ns, pooled buffer %.0f ns per response; "
+           "the heap copy alone %.0f ns",
+           streamNs, pooledNs, copyNs);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_EQUAL_UINT8(0, pool.inUse());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_read_in_slices);
+  RUN_TEST(test_claim_and_release);
+  RUN_TEST(test_allocations_per_response);
+  RUN_TEST(test_benchmark);
+  return UNITY_END();
+}
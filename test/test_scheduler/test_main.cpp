@@ -0,0 +1,168 @@
+// Scheduler timing on a fake clock: how late tasks run, how often the loop
+// wakes, and deadline order across the millis() rollover.
+
+#include <unity.h>
+#include <limits.h>
+#include <stdio.h>
+#include "sim_hal.h"
+#include "scheduler.h"
+
+static const int LOG_SIZE = 64;
+
+static SimClock* fakeClock;
+static char runLog[LOG_SIZE];
+static int logLength;
+
+static void logRun(char name) {
+  if (logLength < LOG_SIZE - 1) {
+    runLog[logLength++] = name;
+    runLog[logLength] = '\0';
+  }
+}
+
+static void taskA(unsigned long now) { logRun('a'); }
+static void taskB(unsigned long now) { logRun('b'); }
+static void taskC(unsigned long now) { logRun('c'); }
+
+// Sleep until the next deadline (plus oversleepMs, as a slow wakeup would)
+// and run what's due, until the clock has moved on by forMs
+static void runFor(Scheduler& scheduler, unsigned long forMs, unsigned long oversleepMs = 0) {
+  unsigned long start = fakeClock->millis();
+  while (fakeClock->millis() - start < forMs) {
+    scheduler.runDue(fakeClock->millis());
+    fakeClock->advanceMs(scheduler.msUntilNext(fakeClock->millis()) + oversleepMs);
+  }
+}
+
+void setUp(void) {
+  runLog[0] = '\0';
+  logLength = 0;
+}
+
+void tearDown(void) {
+  delete fakeClock;
+  fakeClock = nullptr;
+}
+
+// Waking exactly at each deadline, every task runs on time, as often as
+// its period says, and the loop wakes once per distinct deadline
+void test_on_time_wakeups(void) {
+  fakeClock = new SimClock();
+  Scheduler scheduler;
+  int a = scheduler.addTask("a", 100, taskA, fakeClock->millis());
+  int b = scheduler.addTask("b", 250, taskB, fakeClock->millis());
+  int c = scheduler.addTask("c", 1000, taskC, fakeClock->millis(), 50);
+
+  runFor(scheduler, 10000);
+
+  TEST_ASSERT_EQUAL_UINT32(100, scheduler.taskRuns(a));
+  TEST_ASSERT_EQUAL_UINT32(40, scheduler.taskRuns(b));
+  TEST_ASSERT_EQUAL_UINT32(10, scheduler.taskRuns(c));
+  TEST_ASSERT_EQUAL_UINT32(0, scheduler.taskMaxLateness(a));
+  TEST_ASSERT_EQUAL_UINT32(0, scheduler.taskMaxLateness(b));
+  TEST_ASSERT_EQUAL_UINT32(0, scheduler.taskMaxLateness(c));
+
+  // Multiples of 100 (b's 250s fall on them every other time) plus b's
+  // odd 250s plus c's x050s
+  TEST_ASSERT_EQUAL_UINT32(100 + 20 + 10, scheduler.wakeups());
+
+  char message[96];
+  snprintf(message, sizeof(message), "%u wakeups in 10 s, against 1000 for a 10 ms polling loop",
+           scheduler.wakeups());
+  TEST_MESSAGE(message);
+}
+
+// Oversleeping every time: lateness is bounded by the oversleep and the
+// tasks stay on their fixed rate instead of drifting by it each period
+void test_jitter_is_bounded(void) {
+  fakeClock = new SimClock();
+  Scheduler scheduler;
+  int a = scheduler.addTask("a", 100, taskA, fakeClock->millis());
+  int b = scheduler.addTask("b", 1000, taskB, fakeClock->millis());
+
+  runFor(scheduler, 60000, 7);
+
+  TEST_ASSERT_UINT32_WITHIN(7, 7, scheduler.taskMaxLateness(a));
+  TEST_ASSERT_UINT32_WITHIN(7 * 2, 7, scheduler.taskMaxLateness(b));
+  // A drifting 100 ms task would only get 60000 / 107 runs
+  TEST_ASSERT_UINT32_WITHIN(1, 600, scheduler.taskRuns(a));
+  TEST_ASSERT_UINT32_WITHIN(1, 60, scheduler.taskRuns(b));
+}
+
+// After a long stall each task runs once, not once per missed period
+void test_no_catch_up_after_stall(void) {
+  fakeClock = new SimClock();
+  Scheduler scheduler;
+  int a = scheduler.addTask("a", 100, taskA, fakeClock->millis());
+
+  scheduler.runDue(fakeClock->millis());
+  fakeClock->advanceMs(5050);
+  scheduler.runDue(fakeClock->millis());
+  TEST_ASSERT_EQUAL_UINT32(2, scheduler.taskRuns(a));
+  TEST_ASSERT_EQUAL_UINT32(4950, scheduler.taskMaxLateness(a));
+  TEST_ASSERT_EQUAL_UINT32(100, scheduler.msUntilNext(fakeClock->millis()));
+}
+
+// Deadlines on both sides of the millis() rollover still run in order,
+// and sleeps across it are the right length
+void test_order_across_rollover(void) {
+  fakeClock = new SimClock(ULONG_MAX - 149);  // Wraps 150 ms in
+  Scheduler scheduler;
+  unsigned long now = fakeClock->millis();
+  scheduler.addTask("a", 1000, taskA, now, 300);  // Due after the wrap
+  scheduler.addTask("b", 1000, taskB, now, 100);  // Due before it
+  scheduler.addTask("c", 1000, taskC, now, 200);  // Due after it
+
+  TEST_ASSERT_EQUAL_UINT32(100, scheduler.msUntilNext(now));
+  runFor(scheduler, 350);
+  TEST_ASSERT_EQUAL_STRING("bca", runLog);
+  TEST_ASSERT_TRUE(fakeClock->millis() < 1000);  // It did wrap
+
+  runFor(scheduler, 2000);
+  TEST_ASSERT_EQUAL_STRING("bcabcabca", runLog);
+}
+
+// A task rescheduled onto the far side of the rollover sorts after tasks
+// due before it, even though its raw deadline is the smallest number
+void test_reschedule_across_rollover(void) {
+  fakeClock = new SimClock(ULONG_MAX - 999);
+  Scheduler scheduler;
+  unsigned long now = fakeClock->millis();
+  int a = scheduler.addTask("a", 10000, taskA, now, 500);
+  int b = scheduler.addTask("b", 10000, taskB, now, 800);
+
+  scheduler.runAfter(a, now, 1500);  // Raw deadline 500
+  TEST_ASSERT_EQUAL_UINT32(800, scheduler.msUntilNext(now));
+  scheduler.runWithin(b, now, 2000);  // Later than it is, no change
+  TEST_ASSERT_EQUAL_UINT32(800, scheduler.msUntilNext(now));
+  scheduler.runWithin(a, now, 10);
+  TEST_ASSERT_EQUAL_UINT32(10, scheduler.msUntilNext(now));
+
+  runFor(scheduler, 2000);
+  TEST_ASSERT_EQUAL_STRING("ab", runLog);
+  TEST_ASSERT_EQUAL_UINT32(0, scheduler.taskMaxLateness(a));
+  TEST_ASSERT_EQUAL_UINT32(0, scheduler.taskMaxLateness(b));
+}
+
+void test_task_table_limits(void) {
+  fakeClock = new SimClock();
+  Scheduler scheduler;
+  TEST_ASSERT_EQUAL_UINT32(1000, scheduler.msUntilNext(0));
+  TEST_ASSERT_EQUAL(-1, scheduler.addTask("none", 100, nullptr, 0));
+  for (int i = 0; i < Scheduler::MAX_TASKS; i++) {
+    TEST_ASSERT_EQUAL(i, scheduler.addTask("a", 100, taskA, 0));
+  }
+  TEST_ASSERT_EQUAL(-1, scheduler.addTask("a", 100, taskA, 0));
+  TEST_ASSERT_EQUAL_STRING("", scheduler.taskName(Scheduler::MAX_TASKS));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_on_time_wakeups);
+  RUN_TEST(test_jitter_is_bounded);
+  RUN_TEST(test_no_catch_up_after_stall);
+  RUN_TEST(test_order_across_rollover);
+  RUN_TEST(test_reschedule_across_rollover);
+  RUN_TEST(test_task_table_limits);
+  return UNITY_END();
+}
@@ -0,0 +1,386 @@
+// The settings record: version 1 and 2 records as older firmware wrote
+// them, migrated into today's fields; version 3 round trips; the longest
+// record against SETTINGS_MAX_BYTES; and damaged records turned away.
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include "settings.h"
+#include "crc.h"
+#include "timezone.h"
+
+// Builds records byte by byte, the way the old firmware's encoder laid
+// them out, independently of encodeSettings
+struct RecordBuilder {
+  uint8_t bytes[1024];
+  size_t length = 10;  // Header filled in by finish()
+
+  void u8(uint8_t value) { bytes[length++] = value; }
+  void u16(uint16_t value) {
+    u8(value);
+    u8(value >> 8);
+  }
+  void i32(int32_t value) {
+    u16((uint32_t)value);
+    u16((uint32_t)value >> 16);
+  }
+  void str(const char* value) {
+    u8(strlen(value));
+    memcpy(bytes + length, value, strlen(value));
+    length += strlen(value);
+  }
+
+  size_t finish(uint8_t version) {
+    uint16_t payload = length - 10;
+    uint32_t crc = crc32(bytes + 10, payload);
+    uint8_t header[10] = {0x53, 0x43, version, 0, (uint8_t)payload, (uint8_t)(payload >> 8),
+                          (uint8_t)crc, (uint8_t)(crc >> 8), (uint8_t)(crc >> 16), (uint8_t)(crc >> 24)};
+    memcpy(bytes, header, sizeof(header));
+    return length;
+  }
+};
+
+static void networks(RecordBuilder& record) {
+  record.u8(2);
+  record.str("home");
+  record.str("password1");
+  record.str("cafe");
+  record.str("");
+}
+
+static RecordBuilder v1Record(int32_t gmtOffset, int32_t daylightOffset) {
+  RecordBuilder record;
+  networks(record);
+  record.str("pool.ntp.org");
+  record.i32(gmtOffset);
+  record.i32(daylightOffset);
+  record.u8(7);
+  record.u16(3300);
+  record.u8(5);
+  record.finish(1);
+  return record;
+}
+
+// What the caller fills in before decoding: config.h's first-boot values
+static Settings defaults() {
+  Settings settings = {};
+  settings.networkCount = 1;
+  strcpy(settings.networks[0].ssid, "default");
+  strcpy(settings.ntpServer, "time.example.com");
+  strcpy(settings.tzRule, "UTC0");
+  settings.displayBrightness = 15;
+  settings.quietStart = 22 * 60;
+  settings.quietEnd = 7 * 60;
+  settings.quietBrightness = 1;
+  settings.dimBatteryPercent = 20;
+  settings.dimBatteryBrightness = 3;
+  settings.lowBatteryVoltage = 3.4f;
+  settings.lowBatteryPercent = 10;
+  return settings;
+}
+
+static void assertDefaultsForV3Fields(const Settings& settings) {
+  TEST_ASSERT_EQUAL_UINT16(22 * 60, settings.quietStart);
+  TEST_ASSERT_EQUAL_UINT16(7 * 60, settings.quietEnd);
+  TEST_ASSERT_EQUAL_INT8(1, settings.quietBrightness);
+  TEST_ASSERT_EQUAL_UINT8(20, settings.dimBatteryPercent);
+  TEST_ASSERT_EQUAL_UINT8(3, settings.dimBatteryBrightness);
+}
+
+static void assertNetworks(const Settings& settings) {
+  TEST_ASSERT_EQUAL_UINT8(2, settings.networkCount);
+  TEST_ASSERT_EQUAL_STRING("home", settings.networks[0].ssid);
+  TEST_ASSERT_EQUAL_STRING("password1", settings.networks[0].password);
+  TEST_ASSERT_EQUAL_STRING("cafe", settings.networks[1].ssid);
+  TEST_ASSERT_EQUAL_STRING("", settings.networks[1].password);
+}
+
+static const int64_t JANUARY = 1736942400;  // 2025-01-15 12:00 UTC
+static const int64_t JULY = 1752580800;     // 2025-07-15 12:00 UTC
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// Version 1: the offsets become a TZ rule with the same offsets, US DST
+// rules when there was a daylight offset, and the brightness schedule
+// keeps the caller's values
+void test_v1_migrates(void) {
+  RecordBuilder record = v1Record(-5 * 3600, 3600);
+  Settings settings = defaults();
+  TEST_ASSERT_TRUE(decodeSettings(record.bytes, record.length, settings));
+
+  assertNetworks(settings);
+  TEST_ASSERT_EQUAL_STRING("pool.ntp.org", settings.ntpServer);
+  TEST_ASSERT_EQUAL_STRING("UTC+5:00DST+4:00", settings.tzRule);
+  TEST_ASSERT_EQUAL_UINT8(7, settings.displayBrightness);
+  TEST_ASSERT_FLOAT_WITHIN(0.0005f, 3.3f, settings.lowBatteryVoltage);
+  TEST_ASSERT_EQUAL_UINT8(5, settings.lowBatteryPercent);
+  assertDefaultsForV3Fields(settings);
+
+  const char* error = nullptr;
+  TEST_ASSERT_TRUE(validateSettings(settings, error));
+  TzRule rule;
+  TEST_ASSERT_TRUE(parseTzRule(settings.tzRule, rule));
+  TimeZone zone;
+  zone.setRule(rule);
+  TEST_ASSERT_EQUAL_INT32(-5 * 3600, zone.offsetAt(JANUARY));
+  TEST_ASSERT_EQUAL_INT32(-4 * 3600, zone.offsetAt(JULY));
+}
+
+// Offsets east of UTC, half hours, and no daylight offset
+void test_v1_offsets(void) {
+  static const struct {
+    int32_t gmt, daylight;
+    const char* rule;
+  } cases[] = {
+      {0, 0, "UTC+0:00"},
+      {3600, 3600, "UTC-1:00DST-2:00"},
+      {19800, 0, "UTC-5:30"},
+      {-12600, 3600, "UTC+3:30DST+2:30"},
+      {12 * 3600 + 2700, 0, "UTC-12:45"},
+      {-10 * 3600, 0, "UTC+10:00"},
+  };
+  for (const auto& c : cases) {
+    RecordBuilder record = v1Record(c.gmt, c.daylight);
+    Settings settings = defaults();
+    TEST_ASSERT_TRUE(decodeSettings(record.bytes, record.length, settings));
+    TEST_ASSERT_EQUAL_STRING(c.rule, settings.tzRule);
+
+    TzRule rule;
+    TEST_ASSERT_TRUE_MESSAGE(parseTzRule(settings.tzRule, rule), c.rule);
+    TimeZone zone;
+    zone.setRule(rule);
+    TEST_ASSERT_EQUAL_INT32(c.gmt, zone.offsetAt(JANUARY));
+    TEST_ASSERT_EQUAL_INT32(c.gmt + c.daylight, zone.offsetAt(JULY));
+  }
+}
+
+// Version 2: the TZ rule is taken as stored
+void test_v2_migrates(void) {
+  RecordBuilder record;
+  networks(record);
+  record.str("time.nist.gov");
+  record.str("AEST-10AEDT,M10.1.0,M4.1.0/3");
+  record.u8(12);
+  record.u16(3520);
+  record.u8(32);
+  record.finish(2);
+
+  Settings settings = defaults();
+  TEST_ASSERT_TRUE(decodeSettings(record.bytes, record.length, settings));
+  assertNetworks(settings);
+  TEST_ASSERT_EQUAL_STRING("time.nist.gov", settings.ntpServer);
+  TEST_ASSERT_EQUAL_STRING("AEST-10AEDT,M10.1.0,M4.1.0/3", settings.tzRule);
+  TEST_ASSERT_EQUAL_UINT8(12, settings.displayBrightness);
+  TEST_ASSERT_FLOAT_WITHIN(0.0005f, 3.52f, settings.lowBatteryVoltage);
+  TEST_ASSERT_EQUAL_UINT8(32, settings.lowBatteryPercent);
+  assertDefaultsForV3Fields(settings);
+  const char* error = nullptr;
+  TEST_ASSERT_TRUE(validateSettings(settings, error));
+}
+
+// A migrated record saved again comes back as version 3 with the same
+// fields
+void test_migrated_record_resaves(void) {
+  RecordBuilder record = v1Record(-8 * 3600, 3600);
+  Settings migrated = defaults();
+  TEST_ASSERT_TRUE(decodeSettings(record.bytes, record.length, migrated));
+
+  uint8_t saved[SETTINGS_MAX_BYTES];
+  size_t length = encodeSettings(migrated, saved, sizeof(saved));
+  TEST_ASSERT_TRUE(length > 0);
+  TEST_ASSERT_EQUAL_UINT8(SETTINGS_VERSION, saved[2]);
+
+  Settings again = {};
+  TEST_ASSERT_TRUE(decodeSettings(saved, length, again));
+  TEST_ASSERT_EQUAL_STRING(migrated.tzRule, again.tzRule);
+  assertNetworks(again);
+  assertDefaultsForV3Fields(again);
+}
+
+static Settings longest() {
+  Settings settings = defaults();
+  settings.networkCount = Settings::MAX_NETWORKS;
+  for (uint8_t i = 0; i < Settings::MAX_NETWORKS; i++) {
+    memset(settings.networks[i].ssid, 'a' + i, sizeof(settings.networks[i].ssid) - 1);
+    settings.networks[i].ssid[sizeof(settings.networks[i].ssid) - 1] = '\0';
+    memset(settings.networks[i].password, 'A' + i, sizeof(settings.networks[i].password) - 1);
+    settings.networks[i].password[sizeof(settings.networks[i].password) - 1] = '\0';
+  }
+  memset(settings.ntpServer, 'n', sizeof(settings.ntpServer) - 1);
+  settings.ntpServer[sizeof(settings.ntpServer) - 1] = '\0';
+  // The longest rule that still parses: padded quoted names
+  snprintf(settings.tzRule, sizeof(settings.tzRule), "<%s>5<%s>,M3.2.0/2:00:00,M11.1.0/2:00:00",
+           "ABCDEFGHIJKLMN", "ABCDEFGHIJKLM");
+  settings.quietBrightness = -1;
+  return settings;
+}
+
+// Every field at its longest: 640 bytes as settings.h says, within
+// SETTINGS_MAX_BYTES, and it round trips
+void test_longest_record(void) {
+  Settings settings = longest();
+  size_t ruleLength = strlen(settings.tzRule);
+  TEST_ASSERT_EQUAL_UINT32(sizeof(settings.tzRule) - 1, ruleLength);
+  const char* error = nullptr;
+  TEST_ASSERT_TRUE_MESSAGE(validateSettings(settings, error), error);
+
+  uint8_t record[SETTINGS_MAX_BYTES];
+  size_t length = encodeSettings(settings, record, sizeof(record));
+  TEST_ASSERT_EQUAL_UINT32(640, length);
+  TEST_ASSERT_TRUE(length <= SETTINGS_MAX_BYTES);
+  TEST_ASSERT_EQUAL_UINT32(0, encodeSettings(settings, record, length - 1));
+  TEST_ASSERT_EQUAL_UINT32(length, encodeSettings(settings, record, length));
+
+  Settings back = defaults();
+  TEST_ASSERT_TRUE(decodeSettings(record, length, back));
+  TEST_ASSERT_EQUAL_UINT8(Settings::MAX_NETWORKS, back.networkCount);
+  for (uint8_t i = 0; i < Settings::MAX_NETWORKS; i++) {
+    TEST_ASSERT_EQUAL_STRING(settings.networks[i].ssid, back.networks[i].ssid);
+    TEST_ASSERT_EQUAL_STRING(settings.networks[i].password, back.networks[i].password);
+  }
+  TEST_ASSERT_EQUAL_STRING(settings.ntpServer, back.ntpServer);
+  TEST_ASSERT_EQUAL_STRING(settings.tzRule, back.tzRule);
+  TEST_ASSERT_EQUAL_INT8(-1, back.quietBrightness);
+}
+
+// Every field survives a version 3 round trip
+void test_v3_round_trip(void) {
+  Settings settings = defaults();
+  settings.networkCount = 3;
+  strcpy(settings.networks[1].ssid, "office");
+  strcpy(settings.networks[1].password, "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef");
+  strcpy(settings.networks[2].ssid, "open");
+  strcpy(settings.tzRule, "<-03>3");
+  settings.displayBrightness = 0;
+  settings.quietStart = 0;
+  settings.quietEnd = 24 * 60 - 1;
+  settings.quietBrightness = 15;
+  settings.dimBatteryPercent = 100;
+  settings.dimBatteryBrightness = 15;
+  settings.lowBatteryVoltage = 2.5f;
+  settings.lowBatteryPercent = 1;
+
+  uint8_t record[SETTINGS_MAX_BYTES];
+  size_t length = encodeSettings(settings, record, sizeof(record));
+  Settings back = {};
+  TEST_ASSERT_TRUE(decodeSettings(record, length, back));
+  TEST_ASSERT_EQUAL_UINT8(3, back.networkCount);
+  TEST_ASSERT_EQUAL_STRING(settings.networks[1].password, back.networks[1].password);
+  TEST_ASSERT_EQUAL_STRING("open", back.networks[2].ssid);
+  TEST_ASSERT_EQUAL_STRING("<-03>3", back.tzRule);
+  TEST_ASSERT_EQUAL_UINT8(0, back.displayBrightness);
+  TEST_ASSERT_EQUAL_UINT16(0, back.quietStart);
+  TEST_ASSERT_EQUAL_UINT16(24 * 60 - 1, back.quietEnd);
+  TEST_ASSERT_EQUAL_INT8(15, back.quietBrightness);
+  TEST_ASSERT_EQUAL_UINT8(100, back.dimBatteryPercent);
+  TEST_ASSERT_EQUAL_UINT8(15, back.dimBatteryBrightness);
+  TEST_ASSERT_FLOAT_WITHIN(0.0005f, 2.5f, back.lowBatteryVoltage);
+  TEST_ASSERT_EQUAL_UINT8(1, back.lowBatteryPercent);
+  const char* error = nullptr;
+  TEST_ASSERT_TRUE(validateSettings(back, error));
+}
+
+// Any flipped bit, any truncation, trailing bytes, a bad magic number or
+// a version from newer firmware: rejected
+void test_damaged_records_rejected(void) {
+  uint8_t record[SETTINGS_MAX_BYTES];
+  Settings settings = defaults();
+  size_t length = encodeSettings(settings, record, sizeof(record));
+
+  for (size_t i = 0; i < length; i++) {
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      if (i == 2 || i == 3) {
+        continue;  // The version byte, below, and the reserved one
+      }
+      record[i] ^= 1 << bit;
+      Settings decoded = defaults();
+      TEST_ASSERT_FALSE(decodeSettings(record, length, decoded));
+      record[i] ^= 1 << bit;
+    }
+  }
+  for (size_t cut = 0; cut < length; cut++) {
+    Settings decoded = defaults();
+    TEST_ASSERT_FALSE(decodeSettings(record, cut, decoded));
+  }
+  record[length] = 0;
+  Settings decoded = defaults();
+  TEST_ASSERT_FALSE(decodeSettings(record, length + 1, decoded));
+
+  record[2] = SETTINGS_VERSION + 1;
+  TEST_ASSERT_FALSE(decodeSettings(record, length, decoded));
+  record[2] = 0;
+  TEST_ASSERT_FALSE(decodeSettings(record, length, decoded));
+  record[2] = SETTINGS_VERSION;
+  TEST_ASSERT_TRUE(decodeSettings(record, length, decoded));
+}
+
+// A well-formed record whose payload is wrong for its version: the v1
+// layout labelled as version 2, and more networks than fit
+void test_wrong_layout_rejected(void) {
+  RecordBuilder record = v1Record(0, 0);
+  record.finish(2);
+  Settings settings = defaults();
+  TEST_ASSERT_FALSE(decodeSettings(record.bytes, record.length, settings));
+
+  RecordBuilder tooMany;
+  tooMany.u8(Settings::MAX_NETWORKS + 1);
+  for (uint8_t i = 0; i <= Settings::MAX_NETWORKS; i++) {
+    tooMany.str("net");
+    tooMany.str("");
+  }
+  tooMany.str("pool.ntp.org");
+  tooMany.str("UTC0");
+  tooMany.u8(7);
+  tooMany.u16(3300);
+  tooMany.u8(5);
+  tooMany.finish(2);
+  settings = defaults();
+  TEST_ASSERT_FALSE(decodeSettings(tooMany.bytes, tooMany.length, settings));
+}
+
+// validateSettings names the first field out of range
+void test_validation_errors(void) {
+  static const struct {
+    void (*spoil)(Settings&);
+    const char* error;
+  } cases[] = {
+      {[](Settings& s) { s.networkCount = Settings::MAX_NETWORKS + 1; }, "too many networks"},
+      {[](Settings& s) { s.networks[0].ssid[0] = '\0'; }, "ssid"},
+      {[](Settings& s) { strcpy(s.networks[0].password, "short"); }, "password"},
+      {[](Settings& s) { s.ntpServer[0] = '\0'; }, "ntpServer"},
+      {[](Settings& s) { strcpy(s.tzRule, "not a rule"); }, "tzRule"},
+      {[](Settings& s) { s.displayBrightness = 16; }, "brightness"},
+      {[](Settings& s) { s.quietStart = 24 * 60; }, "quietStart"},
+      {[](Settings& s) { s.quietEnd = 24 * 60; }, "quietEnd"},
+      {[](Settings& s) { s.quietBrightness = -2; }, "quietBrightness"},
+      {[](Settings& s) { s.dimBatteryPercent = 101; }, "dimBatteryPercent"},
+      {[](Settings& s) { s.dimBatteryBrightness = 16; }, "dimBatteryBrightness"},
+      {[](Settings& s) { s.lowBatteryVoltage = 3.9f; }, "lowBatteryVoltage"},
+      {[](Settings& s) { s.lowBatteryPercent = 33; }, "lowBatteryPercent"},
+  };
+  const char* error = nullptr;
+  Settings settings = defaults();
+  TEST_ASSERT_TRUE(validateSettings(settings, error));
+  for (const auto& c : cases) {
+    settings = defaults();
+    c.spoil(settings);
+    error = nullptr;
+    TEST_ASSERT_FALSE(validateSettings(settings, error));
+    TEST_ASSERT_EQUAL_STRING(c.error, error);
+  }
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_v1_migrates);
+  RUN_TEST(test_v1_offsets);
+  RUN_TEST(test_v2_migrates);
+  RUN_TEST(test_migrated_record_resaves);
+  RUN_TEST(test_longest_record);
+  RUN_TEST(test_v3_round_trip);
+  RUN_TEST(test_damaged_records_rejected);
+  RUN_TEST(test_wrong_layout_rejected);
+  RUN_TEST(test_validation_errors);
+  return UNITY_END();
+}
@@ -0,0 +1,277 @@
+// The countdown, battery cutoff and reconnect logic running together on
+// simulated hardware, at the firmware's cadences but faster than real time.
+//
+// The tasks below follow main.cpp's: a display tick that turns the local
+// date into a count, a fuel gauge poll that latches the low battery alert
+// and cuts off once the filtered readings agree, and a daily NTP sync
+// through NetworkManager. The clock jumps straight to each next deadline.
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <chrono>
+#include "sim_hal.h"
+#include "scheduler.h"
+#include "netconn.h"
+#include "battery.h"
+#include "targets.h"
+#include "countdown.h"
+
+static const char* TZ_RULE = "EST5EDT,M3.2.0,M11.1.0";
+static const int64_t START_EPOCH = 1735707600;  // 2025-01-01 00:00 EST
+
+static const unsigned long DISPLAY_TICK_MS = 1000;  // Low-power cadence
+static const unsigned long NTP_INTERVAL_MS = 86400000;
+static const float CUTOFF_VOLTAGE = 3.0f;
+static const uint8_t CUTOFF_PERCENT = 5;
+
+struct Device {
+  SimClock clock;
+  SimDisplay display;
+  SimFuelGauge gauge;
+  SimNetwork wifi;
+  NetworkManager network;
+  Scheduler scheduler;
+  BatteryMonitor battery;
+  TargetTable targets;
+  NetworkCredentials credentials[2] = {{"home", "password1"}, {"phone", "password2"}};
+
+  int networkTask = -1;
+  int32_t tableDate = INT32_MIN;
+  bool lowBatteryAlert = false;
+  bool cutOff = false;
+  unsigned long cutOffAt = 0;
+  uint32_t displayTicks = 0;
+  uint32_t countChanges = 0;
+  uint32_t countErrors = 0;
+  uint32_t changesAwayFromMidnight = 0;
+  long lastCount = -1;
+
+  Device(float percent) : gauge(clock, 500, percent), wifi(clock), network(wifi) {}
+};
+
+static Device* device;
+
+// What the clock should say, for setting it on a sync
+static int64_t trueEpoch() {
+  return START_EPOCH + device->clock.monotonicUs() / 1000000;
+}
+
+// Days until the next Christmas for a UTC time, worked out by libc
+static long referenceCount(int64_t epoch, int* hour, int* minute) {
+  time_t t = (time_t)epoch;
+  struct tm local;
+  localtime_r(&t, &local);
+  *hour = local.tm_hour;
+  *minute = local.tm_min;
+  Countdown c = countdownToAnnual(local.tm_year + 1900, local.tm_mon + 1, local.tm_mday, 12, 25);
+  return c.days;
+}
+
+static void onNetworkEvent(NetworkEvent event, int index) {
+  if (event == NET_TIME_SYNCED) {
+    device->clock.setEpoch(trueEpoch());
+  }
+}
+
+static void displayTask(unsigned long now) {
+  Device& d = *device;
+  d.displayTicks++;
+  struct tm timeinfo;
+  if (!d.clock.localTime(timeinfo)) {
+    d.display.showNumber(0);
+    d.display.refresh();
+    return;
+  }
+  int32_t today = daysFromCivil(timeinfo.tm_year + 1900, timeinfo.tm_mon + 1, timeinfo.tm_mday);
+  if (today != d.tableDate) {
+    d.targets.advance(today);
+    d.tableDate = today;
+  }
+  long days = d.targets.count() > 0 ? d.targets.day(0) - today : -1;
+  if (days < 0) {
+    d.display.showDashes();
+  } else {
+    d.display.showNumber(days);
+    d.display.showColon(days == 0 && (d.displayTicks & 1));
+  }
+  d.display.refresh();
+
+  long shown = d.display.number();
+  if (shown != d.lastCount) {
+    int hour, minute;
+    long expected = referenceCount(d.clock.epoch(), &hour, &minute);
+    d.countChanges++;
+    if (shown != expected) {
+      d.countErrors++;
+    }
+    // After the first count, it should only move on at local midnight
+    if (d.lastCount >= 0 && (hour != 0 || minute != 0)) {
+      d.changesAwayFromMidnight++;
+    }
+    d.lastCount = shown;
+  }
+}
+
+static void batteryTask(unsigned long now) {
+  Device& d = *device;
+  FuelGaugeReading reading;
+  if (!d.gauge.read(reading)) {
+    return;
+  }
+  d.battery.add(reading);
+  if (reading.alerts & (FUEL_ALERT_VOLTAGE_LOW | FUEL_ALERT_SOC_LOW)) {
+    d.lowBatteryAlert = true;
+    d.gauge.clearAlerts();
+  }
+  if (d.lowBatteryAlert && d.battery.critical(CUTOFF_VOLTAGE, CUTOFF_PERCENT)) {
+    d.cutOff = true;
+    d.cutOffAt = now;
+  }
+  int id = 1;
+  d.scheduler.setInterval(id, d.lowBatteryAlert ? BatteryMonitor::MIN_INTERVAL_MS : d.battery.nextIntervalMs());
+}
+
+static void networkTask(unsigned long now) {
+  device->scheduler.runAfter(device->networkTask, now, device->network.poll(now));
+}
+
+static void ntpTask(unsigned long now) {
+  device->network.sync(now);
+  device->scheduler.runAfter(device->networkTask, now, 0);
+}
+
+static void boot(Device& d) {
+  device = &d;
+  TzRule rule;
+  TEST_ASSERT_TRUE(parseTzRule(TZ_RULE, rule));
+  d.clock.setTimeZone(rule);
+  TEST_ASSERT_TRUE(d.display.begin(0x70));
+  TEST_ASSERT_TRUE(d.gauge.begin());
+  d.gauge.setAlerts(CUTOFF_VOLTAGE, CUTOFF_PERCENT);
+
+  TargetList list;
+  int errorLine;
+  const char* text = "Christmas,12-25\n";
+  TEST_ASSERT_TRUE(parseTargets(text, strlen(text), list, errorLine));
+  d.targets.load(list, daysFromCivil(2025, 1, 1));
+
+  d.wifi.addNetwork("home", true, 3000);
+  d.wifi.addNetwork("phone", true, 6000);
+  d.network.setNetworks(d.credentials, 2);
+  d.network.onEvent(onNetworkEvent);
+
+  unsigned long now = d.clock.millis();
+  TEST_ASSERT_EQUAL(0, d.scheduler.addTask("display", DISPLAY_TICK_MS, displayTask, now));
+  TEST_ASSERT_EQUAL(1, d.scheduler.addTask("battery", BatteryMonitor::MIN_INTERVAL_MS, batteryTask, now));
+  d.networkTask = d.scheduler.addTask("wifi", NetworkManager::ACTIVE_POLL_MS, networkTask, now);
+  d.scheduler.addTask("ntp", NTP_INTERVAL_MS, ntpTask, now);
+}
+
+// Run until simulated time reaches untilMs or the battery cuts off
+static void run(Device& d, uint64_t untilMs) {
+  uint64_t startUs = d.clock.monotonicUs();
+  while (!d.cutOff && (uint64_t)d.clock.monotonicUs() - startUs < untilMs * 1000) {
+    d.scheduler.runDue(d.clock.millis());
+    d.clock.advanceMs(d.scheduler.msUntilNext(d.clock.millis()));
+  }
+}
+
+void setUp(void) {
+  setenv("TZ", TZ_RULE, 1);
+  tzset();
+}
+
+void tearDown(void) {}
+
+// A year on a charger: the count matches libc for every day, moves on at
+// local midnight only (both DST changes included) and reaches 0 on
+// Christmas Day
+void test_year_of_countdown(void) {
+  Device d(100.0f);
+  d.gauge.loadMa = 0;
+  d.gauge.chargingMa = 1.0f;
+  boot(d);
+
+  auto start = std::chrono::steady_clock::now();
+  run(d, 366ULL * 86400000);
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  TEST_ASSERT_FALSE(d.cutOff);
+  TEST_ASSERT_EQUAL(0, d.countErrors);
+  TEST_ASSERT_EQUAL(0, d.changesAwayFromMidnight);
+  TEST_ASSERT_EQUAL(366, d.countChanges);  // First count, then once a day
+  TEST_ASSERT_EQUAL(366, d.network.timeSyncs());
+
+  char message[128];
+  snprintf(message, sizeof(message), "simulated year: %u display ticks in %.2f s, %.0f ns per tick",
+           d.displayTicks, seconds, seconds * 1e9 / d.displayTicks);
+  TEST_MESSAGE(message);
+}
+
+// Draining from 40%: one wild reading mustn't cut off, the real crossing
+// of 5% must, and promptly
+void test_battery_cutoff(void) {
+  Device d(40.0f);
+  d.gauge.loadMa = 60.0f;
+  boot(d);
+
+  run(d, 3600000);
+  TEST_ASSERT_FALSE(d.cutOff);
+  d.gauge.glitchNext = true;
+  run(d, 600000);
+  TEST_ASSERT_FALSE(d.cutOff);
+
+  run(d, 24ULL * 3600000);
+  TEST_ASSERT_TRUE(d.cutOff);
+  // The filter lags the gauge by a few readings, no more
+  TEST_ASSERT_TRUE(d.gauge.percent() <= CUTOFF_PERCENT);
+  TEST_ASSERT_TRUE(d.gauge.percent() > CUTOFF_PERCENT - 1.0f);
+  // 35% of 500 mAh at 60 mA
+  TEST_ASSERT_UINT32_WITHIN(10 * 60000, 35 * 500 * 36000UL / 60, d.cutOffAt);
+}
+
+// The first network is down: the second one is used, the clock keeps the
+// count going through an outage, and the device gets back online on its
+// own once a network returns, without waiting for the next daily sync
+void test_fallback_and_reconnect(void) {
+  Device d(100.0f);
+  d.gauge.loadMa = 0;
+  d.gauge.chargingMa = 1.0f;
+  d.wifi.autoReconnect = false;
+  boot(d);
+  d.wifi.network("home")->available = false;
+
+  run(d, 60000);
+  TEST_ASSERT_EQUAL(1, d.network.connectedNetwork());
+  TEST_ASSERT_EQUAL(1, d.network.timeSyncs());
+  TEST_ASSERT_EQUAL_STRING("phone", d.wifi.lastSsid);
+  long before = d.display.number();
+  TEST_ASSERT_EQUAL(358, before);
+
+  d.wifi.network("phone")->available = false;
+  d.wifi.drop();
+  run(d, 3600000);
+  TEST_ASSERT_EQUAL(-1, d.network.connectedNetwork());
+  TEST_ASSERT_EQUAL(before, d.display.number());
+  // Backing off: 30 s, 1, 2, 4, 8, 16 and 30 min rounds in the hour
+  TEST_ASSERT_UINT32_WITHIN(1, 1 + 2 * 6, d.network.connectAttempts());
+
+  d.wifi.network("home")->available = true;
+  run(d, NetworkManager::RETRY_MAX_MS + 60000);
+  TEST_ASSERT_EQUAL(0, d.network.connectedNetwork());
+  TEST_ASSERT_EQUAL(2, d.network.timeSyncs());
+
+  run(d, 2 * 86400000ULL);
+  TEST_ASSERT_EQUAL(before - 2, d.display.number());
+  TEST_ASSERT_EQUAL(0, d.countErrors);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_year_of_countdown);
+  RUN_TEST(test_battery_cutoff);
+  RUN_TEST(test_fallback_and_reconnect);
+  return UNITY_END();
+}
@@ -0,0 +1,247 @@
+// Countdown targets: the text format, and the table walked a day at a time
+// over two centuries with a full set of targets, checked against working
+// every occurrence out from scratch.
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "targets.h"
+#include "countdown.h"
+
+// A full list: fixed dates including February 29, every 5th and last
+// weekday rule that can go missing for years, and one-offs spread out
+static const char* const FULL_LIST =
+    "Christmas,12-25\n"
+    "New Year,01-01\n"
+    "Leap Day,02-29\n"
+    "Halloween,10-31\n"
+    "Year End,12-31\n"
+    "Thanksgiving,11/4/Thu\n"
+    "Memorial Day,5/L/Mon\n"
+    "Labor Day,9/1/Mon\n"
+    "Feb 5th Sun,2/5/Sun\n"
+    "Feb 5th Mon,2/5/Mon\n"
+    "Feb Last Sat,2/L/Sat\n"
+    "Apr 5th Fri,4/5/Fri\n"
+    "Jun 5th Wed,6/5/Wed\n"
+    "Sep 5th Tue,9/5/Tue\n"
+    "Nov 5th Sat,11/5/Sat\n"
+    "Jan 5th Thu,1/5/Thu\n"
+    "Mar Last Sun,3/L/Sun\n"
+    "Oct 2nd Mon,10/2/Mon\n"
+    "Launch,2026-03-14\n"
+    "Y2K38,2038-01-19\n"
+    "Expo,2050-06-30\n"
+    "Centenary,2100-02-28\n"
+    "Far Off,2199-12-31\n"
+    "Past,2001-09-09\n"
+    "Same Day A,07-04\n"
+    "Same Day B,07-04\n"
+    "Birthday,03-17\n"
+    "Anniversary,08-21\n"
+    "Solstice,06-21\n"
+    "Equinox,09-22\n"
+    "Tax Day,04-15\n"
+    "Pi Day,03-14\n";
+
+static TargetList fullList() {
+  TargetList list;
+  int errorLine;
+  TEST_ASSERT_TRUE(parseTargets(FULL_LIST, strlen(FULL_LIST), list, errorLine));
+  TEST_ASSERT_EQUAL_UINT8(TargetList::MAX_TARGETS, list.count);
+  return list;
+}
+
+// Every target's next occurrence worked out from scratch, sorted, by brute
+// force over the calendar rather than through nextOccurrence
+static int32_t bruteForce(const CountdownTarget& t, int32_t today) {
+  if (t.rule == RULE_ONCE) {
+    int32_t day = daysFromCivil(t.year, t.month, t.day);
+    return day >= today ? day : NO_OCCURRENCE;
+  }
+  for (int32_t day = today; day < today + 366 * 40; day++) {
+    CivilDate d = civilFromDays(day);
+    if (d.month != t.month) continue;
+    if (t.rule == RULE_ANNUAL) {
+      int want = t.day <= daysInMonth(d.year, d.month) ? t.day : daysInMonth(d.year, d.month);
+      if (d.day == want) return day;
+    } else if (dayOfWeek(day) == t.weekday) {
+      int nth = (d.day - 1) / 7 + 1;
+      bool last = d.day + 7 > daysInMonth(d.year, d.month);
+      if (t.nth == nth || (t.nth < 0 && last)) return day;
+    }
+  }
+  return NO_OCCURRENCE;
+}
+
+static std::vector<std::pair<int32_t, int>> expected(const TargetList& list, int32_t today) {
+  std::vector<std::pair<int32_t, int>> occurrences;
+  for (int i = 0; i < list.count; i++) {
+    int32_t day = bruteForce(list.targets[i], today);
+    if (day != NO_OCCURRENCE) occurrences.push_back({day, i});
+  }
+  std::stable_sort(occurrences.begin(), occurrences.end(),
+                   [](const std::pair<int32_t, int>& a, const std::pair<int32_t, int>& b) { return a.first < b.first; });
+  return occurrences;
+}
+
+static void assertTable(const TargetTable& table, const TargetList& list, int32_t today) {
+  std::vector<std::pair<int32_t, int>> want = expected(list, today);
+  TEST_ASSERT_EQUAL_UINT32(want.size(), table.count());
+  for (uint8_t i = 0; i < table.count(); i++) {
+    TEST_ASSERT_EQUAL_INT32(want[i].first, table.day(i));
+    TEST_ASSERT_EQUAL_STRING(list.targets[want[i].second].name, table.target(i).name);
+  }
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_parse_and_format(void) {
+  TargetList list = fullList();
+  char text[2048];
+  size_t length = formatTargets(list, text, sizeof(text));
+  TargetList again;
+  int errorLine;
+  TEST_ASSERT_TRUE(parseTargets(text, length, again, errorLine));
+  TEST_ASSERT_EQUAL_UINT8(list.count, again.count);
+  TEST_ASSERT_EQUAL_MEMORY(list.targets, again.targets, sizeof(CountdownTarget) * list.count);
+
+  static const char* const bad[] = {"NoComma\n", "Bad,13-01\n", "Bad,02-30\n", "Bad,2/6/Mon\n", "Bad,2/1/Xyz\n",
+                                    "Bad,2025-02-29\n", "A name far too long,12-25\n"};
+  for (const char* line : bad) {
+    char text2[64];
+    snprintf(text2, sizeof(text2), "# comment\n\nOK,12-25\n%s", line);
+    TEST_ASSERT_FALSE(parseTargets(text2, strlen(text2), again, errorLine));
+    TEST_ASSERT_EQUAL_INT(4, errorLine);
+  }
+}
+
+// One more than fits is refused with the line it was on
+void test_list_limit(void) {
+  char text[2048];
+  size_t length = 0;
+  for (int i = 0; i <= TargetList::MAX_TARGETS; i++) {
+    length += snprintf(text + length, sizeof(text) - length, "Event %d,%02d-%02d\n", i, i % 12 + 1, i % 28 + 1);
+  }
+  TargetList list;
+  int errorLine;
+  TEST_ASSERT_FALSE(parseTargets(text, length, list, errorLine));
+  TEST_ASSERT_EQUAL_INT(TargetList::MAX_TARGETS + 1, errorLine);
+}
+
+// A full table advanced every day from 2000 to 2199: after each midnight
+// it holds exactly the next occurrence of every target, soonest first,
+// and find() agrees with a linear scan
+void test_every_day_for_two_centuries(void) {
+  TargetList list = fullList();
+  static TargetTable table;
+  int32_t first = daysFromCivil(2000, 1, 1);
+  int32_t last = daysFromCivil(2199, 12, 31);
+  table.load(list, first);
+  assertTable(table, list, first);
+
+  uint32_t rollovers = 0;
+  int32_t previousNext = table.day(0);
+  for (int32_t today = first + 1; today <= last; today++) {
+    table.advance(today);
+    if (table.day(0) != previousNext) rollovers++;
+    previousNext = table.day(0);
+    if (today % 7 == 0 || table.day(0) == today) {
+      assertTable(table, list, today);
+    }
+    int32_t probe = today + (today * 37) % 400;
+    uint8_t linear = 0;
+    while (linear < table.count() && table.day(linear) < probe) linear++;
+    TEST_ASSERT_EQUAL_UINT8(linear, table.find(probe));
+  }
+  char message[96];
+  snprintf(message, sizeof(message), "%u next-target rollovers over %d days", rollovers, last - first);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_TRUE(rollovers > 3000);
+  // The one-offs have all gone by the end but the last
+  uint8_t once = 0;
+  for (uint8_t i = 0; i < table.count(); i++) {
+    if (table.target(i).rule == RULE_ONCE) {
+      once++;
+      TEST_ASSERT_EQUAL_STRING("Far Off", table.target(i).name);
+    }
+  }
+  TEST_ASSERT_EQUAL_UINT8(1, once);
+}
+
+// Asleep for months, or the clock jumping a year ahead: one advance()
+// catches up
+void test_long_jumps(void) {
+  TargetList list = fullList();
+  static TargetTable table;
+  int32_t today = daysFromCivil(2024, 2, 28);
+  table.load(list, today);
+  static const int32_t jumps[] = {1, 2, 100, 365, 366, 3000, 1, 29};
+  for (int32_t jump : jumps) {
+    today += jump;
+    table.advance(today);
+    assertTable(table, list, today);
+  }
+}
+
+// Rules that go missing for years at a time, like a 5th Monday in
+// February, still find their next occurrence from any day
+void test_rare_rules(void) {
+  TargetList list = fullList();
+  for (int i = 0; i < list.count; i++) {
+    const CountdownTarget& t = list.targets[i];
+    if (t.rule != RULE_NTH_WEEKDAY) continue;
+    for (int32_t today = daysFromCivil(1990, 1, 1); today < daysFromCivil(2150, 1, 1); today += 13) {
+      TEST_ASSERT_EQUAL_INT32(bruteForce(t, today), nextOccurrence(t, today));
+    }
+  }
+}
+
+void test_benchmark(void) {
+  TargetList list = fullList();
+  static TargetTable table;
+  int32_t first = daysFromCivil(2025, 1, 1);
+  static const int DAYS = 36500;
+
+  table.load(list, first);
+  auto start = std::chrono::steady_clock::now();
+  for (int32_t today = first; today < first + DAYS; today++) {
+    table.advance(today);
+  }
+  double advanceNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / DAYS;
+
+  start = std::chrono::steady_clock::now();
+  for (int32_t today = first; today < first + DAYS; today++) {
+    table.load(list, today);
+  }
+  double loadNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / DAYS;
+
+  volatile uint8_t sink = 0;
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < 1000000; i++) {
+    sink += table.find(first + i % 800);
+  }
+  double findNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / 1000000;
+
+  char message[128];
+  snprintf(message, sizeof(message), "%d targets: midnight advance %.0f ns, full reload %.0f ns, find %.1f ns",
+           list.count, advanceNs, loadNs, findNs);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_TRUE(advanceNs < loadNs);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_parse_and_format);
+  RUN_TEST(test_list_limit);
+  RUN_TEST(test_every_day_for_two_centuries);
+  RUN_TEST(test_long_jumps);
+  RUN_TEST(test_rare_rules);
+  RUN_TEST(test_benchmark);
+  return UNITY_END();
+}
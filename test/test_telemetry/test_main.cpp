@@ -0,0 +1,176 @@
+// COBS framing for serial telemetry: round trips through runs of zeros
+// and across the 254-byte block edge, malformed input, and whole frames
+// as tools/telemetry_decode.py splits and checks them.
+
+#include <unity.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "telemetry.h"
+#include "crc.h"
+
+// Encode into exactly the worst case, check there are no zeros and that
+// one byte less isn't enough, then decode back to the input
+static void roundTrip(const std::vector<uint8_t>& data) {
+  size_t bound = data.size() + data.size() / 254 + 1;
+  std::vector<uint8_t> encoded(bound);
+  size_t length = cobsEncode(data.data(), data.size(), encoded.data(), encoded.size());
+  TEST_ASSERT_TRUE(length > 0);
+  TEST_ASSERT_TRUE(length <= bound);
+  for (size_t i = 0; i < length; i++) {
+    TEST_ASSERT_NOT_EQUAL(0, encoded[i]);
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, cobsEncode(data.data(), data.size(), encoded.data(), length - 1));
+
+  std::vector<uint8_t> decoded(data.size() + 1);
+  TEST_ASSERT_EQUAL_UINT32(data.size(), cobsDecode(encoded.data(), length, decoded.data(), decoded.size()));
+  if (!data.empty()) {
+    TEST_ASSERT_EQUAL_MEMORY(data.data(), decoded.data(), data.size());
+    TEST_ASSERT_EQUAL_UINT32(0, cobsDecode(encoded.data(), length, decoded.data(), data.size() - 1));
+  }
+}
+
+static std::vector<uint8_t> nonZero(size_t count) {
+  std::vector<uint8_t> data(count);
+  for (size_t i = 0; i < count; i++) {
+    data[i] = 1 + i % 255;
+  }
+  return data;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_cobs_known_encodings(void) {
+  const uint8_t data[] = {0x11, 0x22, 0x00, 0x33};
+  uint8_t out[8];
+  TEST_ASSERT_EQUAL_UINT32(5, cobsEncode(data, sizeof(data), out, sizeof(out)));
+  const uint8_t expected[] = {0x03, 0x11, 0x22, 0x02, 0x33};
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, out, sizeof(expected));
+
+  const uint8_t zeros[] = {0x00, 0x00};
+  TEST_ASSERT_EQUAL_UINT32(3, cobsEncode(zeros, sizeof(zeros), out, sizeof(out)));
+  TEST_ASSERT_EQUAL_HEX8(0x01, out[0]);
+  TEST_ASSERT_EQUAL_HEX8(0x01, out[1]);
+  TEST_ASSERT_EQUAL_HEX8(0x01, out[2]);
+
+  TEST_ASSERT_EQUAL_UINT32(1, cobsEncode(data, 0, out, sizeof(out)));
+  TEST_ASSERT_EQUAL_HEX8(0x01, out[0]);
+  TEST_ASSERT_EQUAL_UINT32(0, cobsEncode(data, 0, out, 0));
+}
+
+// Zeros alone, leading, trailing and in a run between data
+void test_cobs_zero_runs(void) {
+  roundTrip({});
+  roundTrip({0});
+  roundTrip(std::vector<uint8_t>(40, 0));
+  roundTrip({0, 0, 0, 7});
+  roundTrip({7, 0, 0, 0});
+  std::vector<uint8_t> run = {1, 2, 3};
+  run.insert(run.end(), 300, 0);
+  run.insert(run.end(), {4, 5});
+  roundTrip(run);
+}
+
+// A block holds at most 254 non-zero bytes: runs just under, at and over
+// the edge, with and without a zero after, and two full blocks
+void test_cobs_block_edge(void) {
+  for (size_t count : {253, 254, 255, 508, 509}) {
+    roundTrip(nonZero(count));
+    std::vector<uint8_t> thenZero = nonZero(count);
+    thenZero.push_back(0);
+    roundTrip(thenZero);
+    std::vector<uint8_t> zeroFirst = nonZero(count);
+    zeroFirst.insert(zeroFirst.begin(), 0);
+    roundTrip(zeroFirst);
+  }
+
+  // Exactly one full block: the code byte says so, and no zero follows
+  uint8_t out[260];
+  std::vector<uint8_t> block = nonZero(254);
+  TEST_ASSERT_EQUAL_UINT32(256, cobsEncode(block.data(), block.size(), out, sizeof(out)));
+  TEST_ASSERT_EQUAL_HEX8(0xFF, out[0]);
+  TEST_ASSERT_EQUAL_HEX8(0x01, out[255]);
+}
+
+void test_cobs_random(void) {
+  srand(24);
+  for (int round = 0; round < 2000; round++) {
+    std::vector<uint8_t> data(rand() % 700);
+    int zeroChance = 1 + rand() % 64;  // From mostly zeros to hardly any
+    for (auto& b : data) {
+      b = rand() % zeroChance == 0 ? 0 : 1 + rand() % 255;
+    }
+    roundTrip(data);
+  }
+}
+
+void test_cobs_malformed(void) {
+  uint8_t out[16];
+  const uint8_t zeroCode[] = {0x02, 0x11, 0x00, 0x22};
+  TEST_ASSERT_EQUAL_UINT32(0, cobsDecode(zeroCode, sizeof(zeroCode), out, sizeof(out)));
+  const uint8_t zeroInBlock[] = {0x03, 0x11, 0x00};
+  TEST_ASSERT_EQUAL_UINT32(0, cobsDecode(zeroInBlock, sizeof(zeroInBlock), out, sizeof(out)));
+  const uint8_t cutShort[] = {0x05, 0x11, 0x22};
+  TEST_ASSERT_EQUAL_UINT32(0, cobsDecode(cutShort, sizeof(cutShort), out, sizeof(out)));
+}
+
+// A frame is zero, COBS of record and CRC, zero; decoding the inside
+// gives the record back with the low 16 bits of its CRC32
+void test_frame(void) {
+  TelemetryFrame frame(TELEMETRY_NETWORK, 0x00010000);  // Time with zero bytes in it
+  frame.u8(1);
+  frame.i8(0);
+  frame.i8(-61);
+  uint8_t out[TELEMETRY_MAX_FRAME];
+  size_t length = frame.finish(out, sizeof(out));
+  TEST_ASSERT_TRUE(length > 2);
+  TEST_ASSERT_EQUAL_HEX8(0, out[0]);
+  TEST_ASSERT_EQUAL_HEX8(0, out[length - 1]);
+  for (size_t i = 1; i < length - 1; i++) {
+    TEST_ASSERT_NOT_EQUAL(0, out[i]);
+  }
+
+  uint8_t record[16];
+  TEST_ASSERT_EQUAL_UINT32(10, cobsDecode(out + 1, length - 2, record, sizeof(record)));
+  const uint8_t expected[] = {TELEMETRY_NETWORK, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0xC3};
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, record, sizeof(expected));
+  uint32_t crc = crc32(record, 8);
+  TEST_ASSERT_EQUAL_HEX8(crc & 0xFF, record[8]);
+  TEST_ASSERT_EQUAL_HEX8((crc >> 8) & 0xFF, record[9]);
+
+  TEST_ASSERT_EQUAL_UINT32(0, frame.finish(out, length - 1));
+}
+
+// The biggest record fits TELEMETRY_MAX_FRAME; one byte more isn't taken
+void test_frame_capacity(void) {
+  TelemetryFrame netstatus(TELEMETRY_NETSTATUS, 0);
+  netstatus.u8(0);
+  netstatus.i8(0);
+  netstatus.u32(0);
+  for (int i = 0; i < 5; i++) {
+    netstatus.u16(0);
+  }
+  uint8_t out[TELEMETRY_MAX_FRAME];
+  TEST_ASSERT_TRUE(netstatus.finish(out, sizeof(out)) > 0);
+
+  TelemetryFrame full(TELEMETRY_TICK, 1);
+  for (int i = 0; i < 27; i++) {
+    full.u8(0);
+  }
+  TEST_ASSERT_TRUE(full.finish(out, sizeof(out)) > 0);
+  full.u8(0);
+  TEST_ASSERT_EQUAL_UINT32(0, full.finish(out, sizeof(out)));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_cobs_known_encodings);
+  RUN_TEST(test_cobs_zero_runs);
+  RUN_TEST(test_cobs_block_edge);
+  RUN_TEST(test_cobs_random);
+  RUN_TEST(test_cobs_malformed);
+  RUN_TEST(test_frame);
+  RUN_TEST(test_frame_capacity);
+  return UNITY_END();
+}
@@ -0,0 +1,234 @@
+// TimeZone against glibc: every hour from 1970 to 2100 and every
+// transition to the second, for northern and southern hemisphere zones
+// and the corners of the rule syntax (week 5, weekday rules late in the
+// month, transition times past midnight or before it, Jn and n days,
+// half-hour and negative DST). Plus the rules parseTzRule must turn away.
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "timezone.h"
+
+static const int64_t FROM = 0;            // 1970-01-01
+static const int64_t UNTIL = 4102444800;  // 2100-01-01
+
+static const char* RULES[] = {
+    "EST5EDT,M3.2.0,M11.1.0",
+    "XST5XDT",                            // US rules by default
+    "CET-1CEST,M3.5.0,M10.5.0/3",         // Last Sunday, week 5
+    "GMT0BST,M3.5.0/1,M10.5.0",
+    "AEST-10AEDT,M10.1.0,M4.1.0/3",       // Southern: DST across New Year
+    "NZST-12NZDT,M9.5.0,M4.1.0/3",
+    "<+1030>-10:30<+11>-11,M10.1.0,M4.1.0",  // Half-hour DST
+    "<-04>4<-03>,M9.1.6/24,M4.1.6/24",    // Midnight at the end of Saturday
+    "<-02>2<-01>,M3.5.0/-1,M10.5.0/0",    // Greenland: before midnight
+    "IST-2IDT,M3.4.4/26,M10.5.0",         // Friday before the last Sunday
+    "IST-1GMT0,M10.5.0,M3.5.0/1",         // Dublin: "DST" is winter
+    "EST5EDT,M3.5.2/1:30:15,M11.5.3/23:59:59",
+    "EST5EDT,J60/2,J300/2",               // Julian: March 1 every year
+    "EST5EDT,59,300",                     // Zero-based: February 29 in leap years
+    "<+0545>-5:45",
+    "UTC0",
+};
+
+// glibc fills in a rule without dates from the tz database's posixrules,
+// which has the US rules' history before 2007, so it's given them
+// explicitly
+static void useLibcZone(const char* rule) {
+  char text[80];
+  if (strcmp(rule, "XST5XDT") == 0) {
+    snprintf(text, sizeof(text), "%s,M3.2.0,M11.1.0", rule);
+    rule = text;
+  }
+  setenv("TZ", rule, 1);
+  tzset();
+}
+
+static int32_t libcOffset(int64_t utc, int& isdst) {
+  time_t t = utc;
+  struct tm local;
+  localtime_r(&t, &local);
+  isdst = local.tm_isdst;
+  return local.tm_gmtoff;
+}
+
+static void check(TimeZone& zone, int64_t utc, const char* rule) {
+  int isdst;
+  int32_t expected = libcOffset(utc, isdst);
+  if (zone.offsetAt(utc) != expected) {
+    char message[160];
+    snprintf(message, sizeof(message), "%s at %lld: offset %d, libc %d", rule, (long long)utc,
+             (int)zone.offsetAt(utc), (int)expected);
+    TEST_FAIL_MESSAGE(message);
+  }
+
+  time_t t = utc;
+  struct tm want, got;
+  localtime_r(&t, &want);
+  zone.toLocal(utc, got);
+  if (got.tm_year != want.tm_year || got.tm_mon != want.tm_mon || got.tm_mday != want.tm_mday ||
+      got.tm_hour != want.tm_hour || got.tm_min != want.tm_min || got.tm_sec != want.tm_sec ||
+      got.tm_wday != want.tm_wday || got.tm_yday != want.tm_yday || got.tm_isdst != want.tm_isdst) {
+    char message[160];
+    snprintf(message, sizeof(message), "%s at %lld: %04d-%02d-%02d %02d:%02d:%02d dst %d, libc %02d:%02d dst %d",
+             rule, (long long)utc, got.tm_year + 1900, got.tm_mon + 1, got.tm_mday, got.tm_hour, got.tm_min,
+             got.tm_sec, got.tm_isdst, want.tm_hour, want.tm_min, want.tm_isdst);
+    TEST_FAIL_MESSAGE(message);
+  }
+}
+
+void setUp(void) {}
+
+void tearDown(void) {
+  useLibcZone("UTC0");
+}
+
+// Every hour, and where libc's offset changes within the hour, the exact
+// second either side of the change. Time only moves forward here, as it
+// does on the device.
+void test_every_hour_against_libc(void) {
+  uint32_t transitions = 0;
+  for (const char* text : RULES) {
+    TzRule rule;
+    TEST_ASSERT_TRUE_MESSAGE(parseTzRule(text, rule), text);
+    TimeZone zone;
+    zone.setRule(rule);
+    useLibcZone(text);
+
+    int isdst;
+    int32_t previous = libcOffset(FROM, isdst);
+    for (int64_t utc = FROM; utc < UNTIL; utc += 3600) {
+      int32_t offset = libcOffset(utc, isdst);
+      if (offset != previous) {
+        // Find the first second of the new offset
+        int64_t lo = utc - 3600, hi = utc;
+        while (hi - lo > 1) {
+          int64_t mid = lo + (hi - lo) / 2;
+          (libcOffset(mid, isdst) == previous ? lo : hi) = mid;
+        }
+        check(zone, hi - 1, text);
+        check(zone, hi, text);
+        transitions++;
+        previous = offset;
+      }
+      check(zone, utc, text);
+    }
+  }
+  char message[64];
+  snprintf(message, sizeof(message), "%u transitions checked", transitions);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_TRUE(transitions > 2 * 130 * 10);
+}
+
+// Jumping about in time, backwards included, rebuilds the table as needed
+void test_random_times_against_libc(void) {
+  srand(19);
+  for (const char* text : RULES) {
+    TzRule rule;
+    parseTzRule(text, rule);
+    TimeZone zone;
+    zone.setRule(rule);
+    useLibcZone(text);
+    for (int i = 0; i < 20000; i++) {
+      int64_t utc = FROM + (int64_t)(((uint64_t)rand() << 31 | rand()) % (uint64_t)(UNTIL - FROM));
+      check(zone, utc, text);
+    }
+  }
+}
+
+// A few transitions worked out by hand, so the tests don't only trust libc
+void test_known_transitions(void) {
+  static const struct {
+    const char* rule;
+    int64_t utc;  // First second of the new offset
+    int32_t before, after;
+  } cases[] = {
+      {"EST5EDT,M3.2.0,M11.1.0", 1741503600, -5 * 3600, -4 * 3600},        // 2025-03-09 07:00 UTC
+      {"EST5EDT,M3.2.0,M11.1.0", 1762063200, -4 * 3600, -5 * 3600},        // 2025-11-02 06:00 UTC
+      {"AEST-10AEDT,M10.1.0,M4.1.0/3", 1743868800, 11 * 3600, 10 * 3600},  // 2025-04-05 16:00 UTC
+      {"AEST-10AEDT,M10.1.0,M4.1.0/3", 1759593600, 10 * 3600, 11 * 3600},  // 2025-10-04 16:00 UTC
+      {"CET-1CEST,M3.5.0,M10.5.0/3", 1743296400, 3600, 7200},              // 2025-03-30 01:00 UTC
+      {"<-04>4<-03>,M9.1.6/24,M4.1.6/24", 1757217600, -4 * 3600, -3 * 3600},  // 2025-09-07 04:00 UTC
+      {"EST5EDT,59,300", 1709190000, -5 * 3600, -4 * 3600},                // 2024-02-29 07:00 UTC
+      {"EST5EDT,J60/2,J300/2", 1709276400, -5 * 3600, -4 * 3600},          // 2024-03-01 07:00 UTC
+  };
+  for (const auto& c : cases) {
+    TzRule rule;
+    TEST_ASSERT_TRUE(parseTzRule(c.rule, rule));
+    TimeZone zone;
+    zone.setRule(rule);
+    TEST_ASSERT_EQUAL_INT32(c.before, zone.offsetAt(c.utc - 1));
+    TEST_ASSERT_EQUAL_INT32(c.after, zone.offsetAt(c.utc));
+  }
+}
+
+void test_parse_fields(void) {
+  TzRule rule;
+  TEST_ASSERT_TRUE(parseTzRule("<-03>3<-02>,M3.5.0/-2,M10.5.0/167", rule));
+  TEST_ASSERT_EQUAL_INT32(-3 * 3600, rule.stdOffset);
+  TEST_ASSERT_EQUAL_INT32(-2 * 3600, rule.dstOffset);
+  TEST_ASSERT_TRUE(rule.hasDst);
+  TEST_ASSERT_EQUAL_UINT8(TzTransitionRule::MONTH_WEEK, rule.start.kind);
+  TEST_ASSERT_EQUAL_UINT8(3, rule.start.month);
+  TEST_ASSERT_EQUAL_UINT8(5, rule.start.week);
+  TEST_ASSERT_EQUAL_UINT8(0, rule.start.weekday);
+  TEST_ASSERT_EQUAL_INT32(-2 * 3600, rule.start.time);
+  TEST_ASSERT_EQUAL_INT32(167 * 3600, rule.end.time);
+
+  TEST_ASSERT_TRUE(parseTzRule("EST5EDT", rule));
+  TEST_ASSERT_EQUAL_INT32(-4 * 3600, rule.dstOffset);
+  TEST_ASSERT_EQUAL_UINT8(3, rule.start.month);
+  TEST_ASSERT_EQUAL_UINT8(2, rule.start.week);
+  TEST_ASSERT_EQUAL_UINT8(11, rule.end.month);
+  TEST_ASSERT_EQUAL_INT32(2 * 3600, rule.end.time);
+
+  TEST_ASSERT_TRUE(parseTzRule("<+0545>-5:45", rule));
+  TEST_ASSERT_EQUAL_INT32(5 * 3600 + 45 * 60, rule.stdOffset);
+  TEST_ASSERT_FALSE(rule.hasDst);
+
+  TEST_ASSERT_TRUE(parseTzRule("ABC-1:02:03", rule));
+  TEST_ASSERT_EQUAL_INT32(3723, rule.stdOffset);
+}
+
+void test_rejected_rules(void) {
+  static const char* bad[] = {
+      "",
+      "EST",                           // No offset
+      "ES5",                           // Name too short
+      "<AB>5",
+      "<ABC5",
+      "EST25",                         // Offset out of range
+      "EST5:60",
+      "EST5EDT,M3.2.0",                // Start without end
+      "EST5EDT,M3.2.0,",
+      "EST5EDT,M13.1.0,M11.1.0",       // No month 13
+      "EST5EDT,M0.1.0,M11.1.0",
+      "EST5EDT,M3.0.0,M11.1.0",        // Weeks are 1-5
+      "EST5EDT,M3.6.0,M11.1.0",
+      "EST5EDT,M3.2.7,M11.1.0",        // Weekdays are 0-6
+      "EST5EDT,M3.2,M11.1.0",
+      "EST5EDT,J0,J300",               // Julian days are 1-365
+      "EST5EDT,J366,J300",
+      "EST5EDT,366,300",               // Zero-based days are 0-365
+      "EST5EDT,M3.2.0/168,M11.1.0",    // Transition times within 167 hours
+      "EST5EDT,M3.2.0/-168,M11.1.0",
+      "EST5EDT,M3.2.0,M11.1.0x",       // Trailing junk
+      "EST5EDT4x",
+  };
+  for (const char* text : bad) {
+    TzRule rule;
+    TEST_ASSERT_FALSE_MESSAGE(parseTzRule(text, rule), text);
+  }
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_every_hour_against_libc);
+  RUN_TEST(test_random_times_against_libc);
+  RUN_TEST(test_known_transitions);
+  RUN_TEST(test_parse_fields);
+  RUN_TEST(test_rejected_rules);
+  return UNITY_END();
+}
@@ -0,0 +1,162 @@
+"""tools/beacon_collector.py: decodes the firmware's packets, keeps count
+of lost and repeated ones, and works over a real UDP socket.
+
+The golden packets are the ones test/test_beacon checks encodeBeacon()
+against, so the two sides agree on the layout. The loopback tests run the
+collector and the simulator as they're run from the command line, on
+127.0.0.1.
+
+    python3 -m unittest discover test/tools
+"""
+
+import json
+import os
+import select
+import socket
+import subprocess
+import sys
+import time
+import unittest
+
+ROOT = os.path.dirname(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+SCRIPT = os.path.join(ROOT, "tools", "beacon_collector.py")
+sys.path.insert(0, os.path.join(ROOT, "tools"))
+
+import beacon_collector  # noqa: E402
+
+GOLDEN_CHARGING = bytes.fromhex("42430103246f28aabbcc34125700930f51c3a0cc020080510100")
+GOLDEN_NO_GAUGE = bytes.fromhex("42430118246f28aabbcc0700ffff000000a6a086010005000000")
+MAC = [0x24, 0x6f, 0x28, 0xaa, 0xbb, 0xcc]
+
+
+def free_port():
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("127.0.0.1", 0))
+    port = sock.getsockname()[1]
+    sock.close()
+    return port
+
+
+class LayoutTest(unittest.TestCase):
+    def test_golden_packets(self):
+        beacon = beacon_collector.decode(GOLDEN_CHARGING)
+        self.assertEqual(beacon["mac"], "24:6f:28:aa:bb:cc")
+        self.assertEqual(beacon["flags"], ["time", "charging"])
+        self.assertEqual(beacon["sequence"], 0x1234)
+        self.assertEqual(beacon["days"], 87)
+        self.assertAlmostEqual(beacon["batteryVoltage"], 3.987)
+        self.assertEqual(beacon["batteryPercent"], 81)
+        self.assertEqual(beacon["rssi"], -61)
+        self.assertEqual(beacon["freeHeap"], 183456)
+        self.assertEqual(beacon["uptime"], 86400)
+
+        beacon = beacon_collector.decode(GOLDEN_NO_GAUGE)
+        self.assertEqual(beacon["flags"], ["low-power", "no-gauge"])
+        self.assertEqual(beacon["days"], -1)
+        self.assertEqual(beacon["rssi"], -90)
+
+    def test_encode_matches_firmware(self):
+        self.assertEqual(beacon_collector.encode(MAC, 0x1234, 87, 3987, 81, -61, 183456, 86400, flags=0x03),
+                         GOLDEN_CHARGING)
+        self.assertEqual(beacon_collector.encode(MAC, 7, -1, 0, 0, -90, 100000, 5, flags=0x18),
+                         GOLDEN_NO_GAUGE)
+
+    def test_foreign_packets(self):
+        newer = bytearray(GOLDEN_CHARGING) + b"\xab" * 6
+        newer[2] = 2
+        self.assertEqual(beacon_collector.decode(bytes(newer))["version"], 2)
+        self.assertIsNone(beacon_collector.decode(GOLDEN_CHARGING[:-1]))
+        self.assertIsNone(beacon_collector.decode(b"GET / HTTP/1.1\r\n\r\n" + b" " * 16))
+        version_zero = bytearray(GOLDEN_CHARGING)
+        version_zero[2] = 0
+        self.assertIsNone(beacon_collector.decode(bytes(version_zero)))
+
+
+class CollectorTest(unittest.TestCase):
+    def packet(self, sequence, uptime, mac=MAC):
+        return beacon_collector.encode(mac, sequence, 10, 3900, 70, -60, 150000, uptime)
+
+    def test_loss_duplicates_and_restarts(self):
+        collector = beacon_collector.Collector()
+        address = ("192.168.1.50", 47474)
+        for sequence in (1, 2, 5, 5, 6):  # 3 and 4 lost, 5 repeated
+            collector.ingest(self.packet(sequence, 100 + sequence), address, 0)
+        collector.ingest(self.packet(1, 3), address, 0)  # Rebooted
+        other = [0x02, 0, 0, 0, 0, 1]
+        collector.ingest(self.packet(3, 50, other), ("192.168.1.51", 47474), 0)
+        collector.ingest(self.packet(4, 60, other), ("192.168.1.51", 47474), 0)  # Another unit, counted apart
+        collector.ingest(b"junk", address, 0)
+
+        row = next(r for r in collector.rows(0) if r["address"] == "192.168.1.50")
+        self.assertEqual(row["received"], 5)
+        self.assertEqual(row["lost"], 2)
+        self.assertEqual(row["restarts"], 1)
+        self.assertEqual(collector.rejected, 1)
+        self.assertEqual(collector.packets, 9)
+
+    def test_sequence_wraps(self):
+        collector = beacon_collector.Collector()
+        other = [0x02, 0, 0, 0, 0, 1]
+        collector.ingest(self.packet(0xFFFE, 10, other), ("10.0.0.2", 1), 0)
+        collector.ingest(self.packet(0x0001, 11, other), ("10.0.0.2", 1), 0)
+        row = next(collector.rows(0))
+        self.assertEqual(row["lost"], 2)  # 0xFFFF and 0x0000
+        self.assertEqual(row["restarts"], 0)
+
+    def test_stale(self):
+        collector = beacon_collector.Collector()
+        collector.ingest(self.packet(1, 1), ("10.0.0.2", 1), 0)
+        self.assertFalse(next(collector.rows(beacon_collector.STALE_AFTER))["stale"])
+        self.assertTrue(next(collector.rows(beacon_collector.STALE_AFTER + 1))["stale"])
+
+
+class LoopbackTest(unittest.TestCase):
+    def test_collector_receives(self):
+        port = free_port()
+        collector = subprocess.Popen(
+            [sys.executable, SCRIPT, "--bind", "127.0.0.1", "--port", str(port), "--json", "--interval", "0.2"],
+            stdout=subprocess.PIPE, text=True)
+        try:
+            sender = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+            deadline = time.monotonic() + 10
+            row = None
+            while row is None and time.monotonic() < deadline:
+                # Resent until the collector is listening; it counts repeats as duplicates
+                sender.sendto(GOLDEN_CHARGING, ("127.0.0.1", port))
+                if select.select([collector.stdout], [], [], 0.5)[0]:
+                    row = json.loads(collector.stdout.readline())
+            sender.close()
+        finally:
+            collector.kill()
+            collector.communicate()
+        self.assertIsNotNone(row, "collector printed nothing")
+        self.assertEqual(row["mac"], "24:6f:28:aa:bb:cc")
+        self.assertEqual(row["address"], "127.0.0.1")
+        self.assertEqual(row["days"], 87)
+        self.assertEqual(row["flags"], ["time", "charging"])
+        self.assertEqual(row["lost"], 0)
+
+    def test_simulator_sends(self):
+        receiver = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        receiver.bind(("127.0.0.1", 0))
+        receiver.settimeout(5)
+        port = receiver.getsockname()[1]
+        simulator = subprocess.Popen(
+            [sys.executable, SCRIPT, "--simulate", "50", "--host", "127.0.0.1", "--port", str(port)])
+        try:
+            units = set()
+            for _ in range(20):
+                packet, _ = receiver.recvfrom(512)
+                beacon = beacon_collector.decode(packet)
+                self.assertIsNotNone(beacon)
+                self.assertEqual(len(packet), beacon_collector.LAYOUT.size)
+                units.add(beacon["mac"])
+        finally:
+            simulator.kill()
+            simulator.wait()
+            receiver.close()
+        self.assertGreater(len(units), 1)
+
+
+if __name__ == "__main__":
+    unittest.main()
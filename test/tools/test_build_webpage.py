@@ -0,0 +1,83 @@
+"""tools/build_webpage.py: the embedded page gunzips back to web/index.html
+and its ETag follows the page.
+
+Each test runs the script on a copy of the project layout in a temporary
+directory, so src/webpage.h in the tree is left alone.
+
+    python3 -m unittest discover test/tools
+"""
+
+import gzip
+import hashlib
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+import unittest
+
+ROOT = os.path.dirname(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+SCRIPT = os.path.join(ROOT, "tools", "build_webpage.py")
+
+
+class BuildWebpageTest(unittest.TestCase):
+    def setUp(self):
+        self.project = tempfile.mkdtemp()
+        os.makedirs(os.path.join(self.project, "tools"))
+        os.makedirs(os.path.join(self.project, "web"))
+        os.makedirs(os.path.join(self.project, "src"))
+        shutil.copy(SCRIPT, os.path.join(self.project, "tools"))
+        shutil.copy(os.path.join(ROOT, "web", "index.html"), os.path.join(self.project, "web"))
+
+    def tearDown(self):
+        shutil.rmtree(self.project)
+
+    def build(self):
+        subprocess.run([sys.executable, os.path.join(self.project, "tools", "build_webpage.py")],
+                       check=True, capture_output=True)
+        with open(os.path.join(self.project, "src", "webpage.h")) as f:
+            return f.read()
+
+    def page(self):
+        with open(os.path.join(self.project, "web", "index.html"), "rb") as f:
+            return f.read()
+
+    @staticmethod
+    def embedded(header):
+        body = re.search(r"index_html_gz\[\] PROGMEM = \{(.*?)\};", header, re.S).group(1)
+        data = bytes(int(b, 16) for b in re.findall(r"0x([0-9a-f]{2})", body))
+        etag = re.search(r'index_html_etag\[\] = "(.*)";', header).group(1).replace('\\"', '"')
+        return data, etag
+
+    def test_round_trip(self):
+        data, etag = self.embedded(self.build())
+        self.assertEqual(gzip.decompress(data), self.page())
+        self.assertLess(len(data), len(self.page()) / 2)
+        self.assertEqual(etag, '"' + hashlib.sha256(self.page()).hexdigest()[:16] + '"')
+
+    def test_reproducible(self):
+        first = self.build()
+        os.remove(os.path.join(self.project, "src", "webpage.h"))
+        self.assertEqual(self.build(), first)
+
+    def test_unchanged_page_leaves_header_alone(self):
+        self.build()
+        path = os.path.join(self.project, "src", "webpage.h")
+        os.utime(path, (1000000000, 1000000000))
+        self.build()
+        self.assertEqual(os.path.getmtime(path), 1000000000)
+
+    # Any change to the page changes the tag, so browsers holding the old
+    # one get the new page instead of a 304
+    def test_etag_follows_page(self):
+        _, before = self.embedded(self.build())
+        with open(os.path.join(self.project, "web", "index.html"), "ab") as f:
+            f.write(b"\n")
+        data, after = self.embedded(self.build())
+        self.assertNotEqual(before, after)
+        self.assertEqual(gzip.decompress(data), self.page())
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,204 @@
+"""Collect status beacons from a fleet of countdown units.
+
+Each unit with beaconHost set in config.h sends a 26-byte UDP packet
+whenever its status changes and at least every 5 minutes (see
+src/beacon.h for the layout). This listens for them and keeps the latest
+status of every unit, keyed by MAC address, printing a summary table
+every few seconds:
+
+    python tools/beacon_collector.py --port 47474
+
+Units that haven't been heard from for three heartbeats are marked
+stale. --json prints the table as JSON lines instead, for feeding into
+something else.
+
+To try it without hardware, --simulate sends beacons from made-up units,
+e.g. to a collector running on the same machine:
+
+    python tools/beacon_collector.py --simulate 200 --host 127.0.0.1
+"""
+
+import argparse
+import json
+import random
+import socket
+import struct
+import sys
+import time
+
+MAGIC = 0x4342
+VERSION = 1
+# magic, version, flags, mac, sequence, days, mV, %, RSSI, heap, uptime
+LAYOUT = struct.Struct("<HBB6sHhHBbII")
+
+FLAGS = {
+    0x01: "time",
+    0x02: "charging",
+    0x04: "low-battery",
+    0x08: "low-power",
+    0x10: "no-gauge",
+}
+
+HEARTBEAT = 300  # Seconds, beaconHeartbeatInterval in main.cpp
+STALE_AFTER = 3 * HEARTBEAT
+
+
+def decode(packet):
+    """Return the beacon's fields as a dict, or None if it isn't one.
+
+    Newer versions only append fields, so longer packets decode too.
+    """
+    if len(packet) < LAYOUT.size:
+        return None
+    (magic, version, flags, mac, sequence, days, millivolts, percent, rssi, heap,
+     uptime) = LAYOUT.unpack_from(packet)
+    if magic != MAGIC or version < 1:
+        return None
+    return {
+        "mac": ":".join("%02x" % b for b in mac),
+        "version": version,
+        "flags": [name for bit, name in FLAGS.items() if flags & bit],
+        "sequence": sequence,
+        "days": days,
+        "batteryVoltage": millivolts / 1000.0,
+        "batteryPercent": percent,
+        "rssi": rssi,
+        "freeHeap": heap,
+        "uptime": uptime,
+    }
+
+
+def encode(mac, sequence, days, millivolts, percent, rssi, heap, uptime, flags=0x01):
+    """Build a version 1 packet, as the firmware's encodeBeacon() does."""
+    return LAYOUT.pack(MAGIC, VERSION, flags, bytes(mac), sequence & 0xFFFF, days, millivolts,
+                       percent, rssi, heap, uptime)
+
+
+class Collector:
+    """Latest beacon per unit, plus loss and restart counts."""
+
+    def __init__(self):
+        self.units = {}
+        self.packets = 0
+        self.bytes = 0
+        self.rejected = 0
+
+    def ingest(self, packet, address, now):
+        self.packets += 1
+        self.bytes += len(packet)
+        beacon = decode(packet)
+        if beacon is None:
+            self.rejected += 1
+            return None
+
+        unit = self.units.get(beacon["mac"])
+        if unit is None:
+            unit = self.units[beacon["mac"]] = {"received": 0, "lost": 0, "restarts": 0}
+        else:
+            previous = unit["beacon"]
+            if beacon["uptime"] < previous["uptime"]:
+                unit["restarts"] += 1  # Sequence numbers start over too
+            else:
+                gap = (beacon["sequence"] - previous["sequence"]) & 0xFFFF
+                if gap == 0:
+                    return beacon  # Duplicate
+                unit["lost"] += gap - 1
+        unit["received"] += 1
+        unit["beacon"] = beacon
+        unit["address"] = address[0]
+        unit["seen"] = now
+        return beacon
+
+    def rows(self, now):
+        for mac in sorted(self.units):
+            unit = self.units[mac]
+            yield dict(unit["beacon"], address=unit["address"], age=round(now - unit["seen"]),
+                       stale=now - unit["seen"] > STALE_AFTER, received=unit["received"],
+                       lost=unit["lost"], restarts=unit["restarts"])
+
+
+def print_table(collector, now, out):
+    rows = list(collector.rows(now))
+    stale = sum(1 for row in rows if row["stale"])
+    out.write("\n%d units (%d stale), %d packets, %d bytes, %d rejected\n" %
+              (len(rows), stale, collector.packets, collector.bytes, collector.rejected))
+    out.write("%-17s %-15s %5s %6s %4s %5s %7s %8s %5s  %s\n" %
+              ("mac", "address", "days", "volts", "%", "rssi", "heap", "uptime", "age", "flags"))
+    for row in rows:
+        out.write("%-17s %-15s %5d %6.2f %4d %5d %7d %8d %5d  %s%s\n" %
+                  (row["mac"], row["address"], row["days"], row["batteryVoltage"],
+                   row["batteryPercent"], row["rssi"], row["freeHeap"], row["uptime"], row["age"],
+                   ",".join(row["flags"]), " STALE" if row["stale"] else ""))
+    out.flush()
+
+
+def collect(args):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind((args.bind, args.port))
+    sock.settimeout(0.5)
+    collector = Collector()
+    next_report = time.monotonic() + args.interval
+    while True:
+        try:
+            packet, address = sock.recvfrom(512)
+        except socket.timeout:
+            packet = None
+        now = time.monotonic()
+        if packet is not None:
+            collector.ingest(packet, address, now)
+        if now >= next_report:
+            next_report = now + args.interval
+            if args.json:
+                for row in collector.rows(now):
+                    print(json.dumps(row), flush=True)
+            else:
+                print_table(collector, now, sys.stdout)
+
+
+def simulate(args):
+    """Send beacons from args.simulate made-up units, each one changing
+    now and then like a real one would."""
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_BROADCAST, 1)
+    start = time.monotonic()
+    units = []
+    for i in range(args.simulate):
+        units.append({"mac": [0x02, 0, 0, 0, i >> 8, i & 0xFF], "sequence": 0,
+                      "days": random.randint(0, 365), "percent": random.randint(20, 100),
+                      "rssi": random.randint(-85, -40)})
+    while True:
+        for unit in units:
+            if random.random() < 0.2:
+                unit["percent"] = max(0, unit["percent"] - 1)
+                unit["rssi"] = random.randint(-85, -40)
+                unit["sequence"] += 1
+                millivolts = 3300 + unit["percent"] * 9
+                packet = encode(unit["mac"], unit["sequence"], unit["days"], millivolts,
+                                unit["percent"], unit["rssi"], random.randint(150000, 200000),
+                                int(time.monotonic() - start))
+                sock.sendto(packet, (args.host, args.port))
+        time.sleep(1)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--port", type=int, default=47474, help="UDP port (beaconPort)")
+    parser.add_argument("--bind", default="0.0.0.0", help="address to listen on")
+    parser.add_argument("--interval", type=float, default=10, help="seconds between reports")
+    parser.add_argument("--json", action="store_true", help="print JSON lines, one per unit")
+    parser.add_argument("--simulate", type=int, metavar="N",
+                        help="send beacons from N made-up units instead of listening")
+    parser.add_argument("--host", default="127.0.0.1", help="where --simulate sends to")
+    args = parser.parse_args()
+    try:
+        if args.simulate:
+            simulate(args)
+        else:
+            collect(args)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,74 @@
+"""Generate src/webpage.h from web/index.html.
+
+The page is gzip-compressed and embedded as a byte array together with a
+strong ETag derived from its contents, so the firmware can serve it with
+Content-Encoding: gzip and answer conditional requests with 304.
+
+Runs automatically before every PlatformIO build (see extra_scripts in
+platformio.ini) and can also be run by hand:
+
+    python tools/build_webpage.py
+"""
+
+import gzip
+import hashlib
+import os
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO's SCons environment
+    PROJECT_DIR = env["PROJECT_DIR"]  # noqa: F821
+except NameError:
+    PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+SOURCE = os.path.join(PROJECT_DIR, "web", "index.html")
+OUTPUT = os.path.join(PROJECT_DIR, "src", "webpage.h")
+
+
+def render_header(html):
+    # mtime=0 keeps the output byte-for-byte reproducible
+    compressed = gzip.compress(html, compresslevel=9, mtime=0)
+    etag = '"' + hashlib.sha256(html).hexdigest()[:16] + '"'
+
+    lines = [
+        "// Generated by tools/build_webpage.py from web/index.html - do not edit",
+        "#ifndef WEBPAGE_H",
+        "#define WEBPAGE_H",
+        "",
+        "#include <Arduino.h>",
+        "",
+        "// %d bytes of HTML, %d bytes gzipped" % (len(html), len(compressed)),
+        "const uint8_t index_html_gz[] PROGMEM = {",
+    ]
+    for i in range(0, len(compressed), 16):
+        chunk = compressed[i:i + 16]
+        lines.append("  " + ", ".join("0x%02x" % b for b in chunk) + ",")
+    lines += [
+        "};",
+        "const size_t index_html_gz_len = sizeof(index_html_gz);",
+        "const char index_html_etag[] = %s;" % ('"' + etag.replace('"', '\\"') + '"'),
+        "",
+        "#endif",
+        "",
+    ]
+    return "\n".join(lines)
+
+
+def main():
+    with open(SOURCE, "rb") as f:
+        html = f.read()
+    header = render_header(html)
+
+    # Only touch the file when it changes, so unchanged pages don't
+    # trigger a rebuild
+    if os.path.exists(OUTPUT):
+        with open(OUTPUT, "r") as f:
+            if f.read() == header:
+                return
+    with open(OUTPUT, "w") as f:
+        f.write(header)
+    print("Generated %s" % os.path.relpath(OUTPUT, PROJECT_DIR))
+
+
+# PlatformIO executes extra scripts rather than importing them, so run
+# unconditionally
+main()
@@ -0,0 +1,218 @@
+"""Split the serial stream into log text and telemetry CSV files.
+
+With serialTelemetry set in config.h the firmware sends binary records
+(status ticks, battery readings, network events and status) on the
+serial port next to the usual log lines; see src/telemetry.h for the
+framing and layouts. This reads a capture file, stdin or the serial port
+itself and writes one CSV per record type, plus the log text:
+
+    python tools/telemetry_decode.py capture.bin --out run1/
+    python tools/telemetry_decode.py --serial /dev/ttyACM0 --out run1/
+
+which produces run1/tick.csv, battery.csv, network.csv, netstatus.csv
+and log.txt. Files are appended to as records arrive, so the output can
+be followed while recording. --serial needs pyserial.
+"""
+
+import argparse
+import csv
+import os
+import struct
+import sys
+import zlib
+
+BATTERY_STATES = ["Unknown", "On Battery", "Discharging", "Charging", "Charged"]
+NETWORK_EVENTS = ["attempt", "connected", "connect_failed", "all_failed", "time_synced",
+                  "sync_failed", "lost"]
+TICK_FLAGS = {0x01: "time", 0x02: "wifi", 0x04: "low-power", 0x08: "low-battery"}
+
+MAX_FRAME = 64  # Anything longer between zeros is text that lost a frame
+
+
+def flag_names(value, names):
+    return "|".join(name for bit, name in names.items() if value & bit)
+
+
+def lookup(table, index):
+    return table[index] if 0 <= index < len(table) else str(index)
+
+
+# Record type: (file name, header fields, struct layout after type and time, row builder)
+RECORDS = {
+    1: ("tick", ["time_ms", "epoch", "days", "battery_v", "battery_percent", "battery_state",
+                 "rssi", "flags"], struct.Struct("<IhHBBbB"),
+        lambda f: [f[0] or "", f[1], f[2] / 1000.0, f[3], lookup(BATTERY_STATES, f[4]),
+                   f[5], flag_names(f[6], TICK_FLAGS)]),
+    2: ("battery", ["time_ms", "voltage", "percent", "rate_percent_per_hr", "state", "alerts"],
+        struct.Struct("<HHhBB"),
+        lambda f: [f[0] / 1000.0, f[1] / 100.0, f[2] / 100.0, lookup(BATTERY_STATES, f[3]),
+                   "0x%02x" % f[4]]),
+    3: ("network", ["time_ms", "event", "network", "rssi"], struct.Struct("<Bbb"),
+        lambda f: [lookup(NETWORK_EVENTS, f[0]), f[1], f[2]]),
+    4: ("netstatus", ["time_ms", "connected", "rssi", "since_sync_s", "drift_ppm",
+                      "sync_interval_min", "awake_duty", "radio_duty", "mah_per_day"],
+        struct.Struct("<BbIhHHHH"),
+        lambda f: [f[0], f[1], "" if f[2] == 0xFFFFFFFF else f[2], f[3] / 10.0, f[4],
+                   f[5] / 10000.0, f[6] / 10000.0, f[7] / 10.0]),
+}
+
+HEADER = struct.Struct("<BI")
+
+
+def cobs_decode(data):
+    """Reverse COBS, or None if data isn't valid COBS."""
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        i += 1
+        if code == 0 or i + code - 1 > len(data):
+            return None
+        block = data[i:i + code - 1]
+        if 0 in block:
+            return None
+        out += block
+        i += code - 1
+        if code != 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def decode_frame(frame):
+    """Return (type, time_ms, fields) for a frame's contents between the
+    zero delimiters, or None if it's damaged or of an unknown type."""
+    record = cobs_decode(frame)
+    if record is None or len(record) < HEADER.size + 2:
+        return None
+    body, crc = record[:-2], struct.unpack("<H", record[-2:])[0]
+    if zlib.crc32(body) & 0xFFFF != crc:
+        return None
+    kind, time_ms = HEADER.unpack_from(body)
+    if kind not in RECORDS:
+        return None
+    layout = RECORDS[kind][2]
+    if len(body) < HEADER.size + layout.size:
+        return None
+    # Newer firmware may append fields; take the ones known here
+    return kind, time_ms, layout.unpack_from(body, HEADER.size)
+
+
+class StreamSplitter:
+    """Feed bytes in, get text and frames out.
+
+    A zero byte opens a frame and the next one closes it. Two zeros in a
+    row (one frame's end, the next one's start) leave it open, and a run
+    too long to be a frame is given back as text, so a frame damaged in
+    transit costs only itself.
+    """
+
+    def __init__(self, on_text, on_frame):
+        self.on_text = on_text
+        self.on_frame = on_frame
+        self.in_frame = False
+        self.buffer = bytearray()
+
+    def feed(self, data):
+        for byte in data:
+            if byte == 0:
+                if self.in_frame and self.buffer:
+                    self.on_frame(bytes(self.buffer))
+                    self.buffer.clear()
+                    self.in_frame = False
+                else:
+                    if self.buffer:
+                        self.on_text(bytes(self.buffer))
+                        self.buffer.clear()
+                    self.in_frame = True
+            else:
+                self.buffer.append(byte)
+                if self.in_frame and len(self.buffer) > MAX_FRAME:
+                    self.in_frame = False
+                elif not self.in_frame and byte == 0x0A:
+                    self.on_text(bytes(self.buffer))
+                    self.buffer.clear()
+
+
+class Recorder:
+    def __init__(self, out_dir):
+        os.makedirs(out_dir, exist_ok=True)
+        self.out_dir = out_dir
+        self.writers = {}
+        self.files = []
+        self.log = open(os.path.join(out_dir, "log.txt"), "ab")
+        self.files.append(self.log)
+        self.counts = {name: 0 for name, _, _, _ in RECORDS.values()}
+        self.damaged = 0
+
+    def writer(self, kind):
+        if kind not in self.writers:
+            name, header = RECORDS[kind][0], RECORDS[kind][1]
+            path = os.path.join(self.out_dir, name + ".csv")
+            new = not os.path.exists(path) or os.path.getsize(path) == 0
+            f = open(path, "a", newline="")
+            self.files.append(f)
+            w = csv.writer(f)
+            if new:
+                w.writerow(header)
+            self.writers[kind] = (w, f)
+        return self.writers[kind]
+
+    def text(self, data):
+        self.log.write(data)
+        self.log.flush()
+
+    def frame(self, data):
+        decoded = decode_frame(data)
+        if decoded is None:
+            self.damaged += 1
+            return
+        kind, time_ms, fields = decoded
+        w, f = self.writer(kind)
+        w.writerow([time_ms] + RECORDS[kind][3](fields))
+        f.flush()
+        self.counts[RECORDS[kind][0]] += 1
+
+    def close(self):
+        for f in self.files:
+            f.close()
+
+    def summary(self):
+        parts = ["%s %d" % (name, count) for name, count in self.counts.items()]
+        return ", ".join(parts) + ", damaged %d" % self.damaged
+
+
+def open_input(args):
+    if args.serial:
+        import serial  # pyserial
+        port = serial.Serial(args.serial, args.baud, timeout=1)
+        return lambda: port.read(4096) or b""
+    stream = sys.stdin.buffer if args.input in (None, "-") else open(args.input, "rb")
+    return lambda: stream.read(4096) or None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("input", nargs="?", help="capture file, - or nothing for stdin")
+    parser.add_argument("--serial", metavar="PORT", help="read from a serial port instead")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--out", default="telemetry", help="directory for the CSV files")
+    args = parser.parse_args()
+
+    recorder = Recorder(args.out)
+    splitter = StreamSplitter(recorder.text, recorder.frame)
+    read = open_input(args)
+    try:
+        while True:
+            data = read()
+            if data is None:
+                break
+            splitter.feed(data)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        recorder.close()
+    print(recorder.summary(), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()